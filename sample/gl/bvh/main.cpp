@@ -109,13 +109,13 @@ private:
 
             glRenderSurface(m_model);
 
-            const Mem1<const BVH::Node*> nodes = m_bvh.getNodes(0, m_level);
+            const Mem1<Box3> boxes = m_bvh.getNodes(0, m_level);
 
             glLineWidth(2.0);
-            for (int i = 0; i < nodes.size(); i++) {
-                glColor(getCol3(i + nodes.size()));
-                const Vec3 A = nodes[i]->box.pos[0];
-                const Vec3 B = nodes[i]->box.pos[1];
+            for (int i = 0; i < boxes.size(); i++) {
+                glColor(getCol3(i + boxes.size()));
+                const Vec3 A = boxes[i].pos[0];
+                const Vec3 B = boxes[i].pos[1];
 
                 glBegin(GL_LINE_LOOP);
                 glVertex(getVec3(A.x, A.y, A.z)); glVertex(getVec3(B.x, A.y, A.z)); glVertex(getVec3(B.x, B.y, A.z)); glVertex(getVec3(A.x, B.y, A.z));
@@ -117,7 +117,8 @@ private:
             m_thread.run([&]() {
                 Timer timer;
                 timer.start();
-                m_pt.update();
+                // time budget per call (partial result is shown)
+                m_pt.update(30.0);
                 timer.stop();
                 static double mean = 0.0;
                 static int cnt = 0;
@@ -0,0 +1,132 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+template <typename TYPE, typename ELEM>
+void test(const Mem2<TYPE> &src, const char *name) {
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("%s (%d x %d)\n", name, src.dsize[0], src.dsize[1]);
+    printf("--------------------------------------------------------------------------------\n");
+
+    const int ch = sizeof(TYPE) / sizeof(ELEM);
+
+    for (int half = 1; half <= 15; half += 2) {
+        const double sigma = 0.3 * (half - 1) + 0.8;
+
+        Mem1<SP_REAL> kernel(2 * half + 1);
+        for (int k = -half; k <= half; k++) {
+            kernel(k + half) = sp::exp(-(k * k) / (2.0 * sq(sigma)));
+        }
+
+        Mem2<TYPE> dst0, dst1, tmp;
+
+        Timer timer0;
+        filterX<TYPE, ELEM>(tmp, src, kernel);
+        filterY<TYPE, ELEM>(dst0, tmp, kernel);
+        timer0.stop();
+
+        Timer timer1;
+        sepFilter<TYPE, ELEM>(dst1, src, kernel, kernel);
+        timer1.stop();
+
+        double maxd = 0.0;
+        int dcnt = 0;
+        for (int i = 0; i < dst0.size() * ch; i++) {
+            const double d = sp::fabs(static_cast<double>(reinterpret_cast<ELEM*>(dst0.ptr)[i]) - reinterpret_cast<ELEM*>(dst1.ptr)[i]);
+            maxd = max(maxd, d);
+            dcnt += (d > 0.0) ? 1 : 0;
+        }
+
+        printf("kernel %2d : filterX/Y %8.3lf [ms], sepFilter %8.3lf [ms], max diff %.3lf (%d / %d)\n",
+            2 * half + 1, timer0.getms(), timer1.getms(), maxd, dcnt, dst0.size() * ch);
+    }
+    printf("\n");
+}
+
+template <typename TYPE, typename ELEM>
+void testBox(const Mem2<TYPE> &src, const char *name) {
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("box %s (%d x %d)\n", name, src.dsize[0], src.dsize[1]);
+    printf("--------------------------------------------------------------------------------\n");
+
+    const int ch = sizeof(TYPE) / sizeof(ELEM);
+
+    for (int winSize = 3; winSize <= 65; winSize = winSize * 2 + 1) {
+        Mem1<SP_REAL> kernel(winSize);
+        for (int k = 0; k < winSize; k++) {
+            kernel(k) = 1.0;
+        }
+
+        Mem2<TYPE> dst0, dst1;
+
+        Timer timer0;
+        sepFilter<TYPE, ELEM>(dst0, src, kernel, kernel);
+        timer0.stop();
+
+        Timer timer1;
+        boxFilter<TYPE, ELEM>(dst1, src, winSize);
+        timer1.stop();
+
+        double maxd = 0.0;
+        for (int i = 0; i < dst0.size() * ch; i++) {
+            const double d = sp::fabs(static_cast<double>(reinterpret_cast<ELEM*>(dst0.ptr)[i]) - reinterpret_cast<ELEM*>(dst1.ptr)[i]);
+            maxd = max(maxd, d);
+        }
+
+        printf("window %2d : sepFilter %8.3lf [ms], boxFilter %8.3lf [ms], max diff %.3lf\n",
+            winSize, timer0.getms(), timer1.getms(), maxd);
+    }
+    printf("\n");
+}
+
+int main() {
+
+    const int dsize[2] = { 1920, 1080 };
+
+    Mem2<Byte> gry(dsize);
+    Mem2<Col3> col(dsize);
+    Mem2<float> flt(dsize);
+
+    srand(0);
+    for (int v = 0; v < dsize[1]; v++) {
+        for (int u = 0; u < dsize[0]; u++) {
+            const double a = 127.5 + 60.0 * sp::sin(u * 0.05) * sp::cos(v * 0.03) + 60.0 * randu();
+            gry(u, v) = cast<Byte>(a);
+            col(u, v) = getCol3(cast<Byte>(a), cast<Byte>(255 - a), cast<Byte>(a * 0.5));
+            flt(u, v) = static_cast<float>(a / 255.0);
+        }
+    }
+
+    test<Byte, Byte>(gry, "Byte");
+    test<Col3, Byte>(col, "Col3");
+    test<float, float>(flt, "float");
+
+    testBox<Byte, Byte>(gry, "Byte");
+    testBox<Col3, Byte>(col, "Col3");
+    testBox<float, float>(flt, "float");
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("guided filter (%d x %d)\n", dsize[0], dsize[1]);
+    printf("--------------------------------------------------------------------------------\n");
+
+    for (int winSize = 9; winSize <= 65; winSize = winSize * 2 - 1) {
+        Mem2<Byte> gdst;
+        Mem2<Col3> cdst;
+
+        Timer timer0;
+        guidedFilter(gdst, gry, winSize, 100.0);
+        timer0.stop();
+
+        Timer timer1;
+        guidedFilter(cdst, col, winSize, 100.0);
+        timer1.stop();
+
+        printf("window %2d : Byte %8.3lf [ms], Col3 %8.3lf [ms]\n", winSize, timer0.getms(), timer1.getms());
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main() {
+
+    const int num = 100000;
+
+    // synthetic scan (wavy surface with normals)
+    Mem1<VecPD3> pnts0;
+    Mem1<VecPD3> pnts1;
+
+    const Pose truth = getPose(getRotAngle(getVec3(0.02, -0.03, 0.01)), getVec3(2.0, -1.0, 1.0));
+    {
+        srand(0);
+        for (int i = 0; i < num; i++) {
+            const double x = sp::randu() * 300.0;
+            const double y = sp::randu() * 300.0;
+            const double z = 500.0 + 10.0 * ::sin(x * 0.1) * ::cos(y * 0.07);
+
+            const double dx = +1.0 * ::cos(x * 0.1) * ::cos(y * 0.07);
+            const double dy = -0.7 * ::sin(x * 0.1) * ::sin(y * 0.07);
+
+            VecPD3 pnt;
+            pnt.pos = getVec3(x, y, z);
+            pnt.drc = unitVec(getVec3(-dx, -dy, 1.0));
+            pnts0.push(pnt);
+        }
+
+        const Pose ipose = invPose(truth);
+        for (int i = 0; i < num; i++) {
+            pnts1.push(ipose * pnts0[(i * 7) % num]);
+        }
+    }
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("icp (%d points vs %d points)\n", num, num);
+    printf("--------------------------------------------------------------------------------\n");
+
+    ICP<VecPD3> icp;
+    {
+        Timer timer;
+        icp.setModel(pnts0);
+        timer.stop();
+        printf("model index : %8.3lf [ms]\n", timer.getms());
+    }
+
+    Mem1<int> steps;
+    steps.push(16);
+    steps.push(4);
+    steps.push(1);
+
+    icp.setSchedule(steps);
+    icp.setMaxIt(5);
+
+    Pose pose = zeroPose();
+    {
+        Timer timer;
+        const bool ret = icp.execute(pose, pnts1);
+        timer.stop();
+        printf("execute     : %8.3lf [ms], %s\n", timer.getms(), ret ? "success" : "failure");
+    }
+
+    const Mem1<ICP<VecPD3>::Log> &logs = icp.getLogs();
+    for (int i = 0; i < logs.size(); i++) {
+        const ICP<VecPD3>::Log &log = logs[i];
+        printf("level %d (step %2d) : crsp %6d, err %.6lf, crsp %8.3lf [ms], solve %8.3lf [ms]\n",
+            log.level, log.step, log.crsp, log.err, log.crspTime, log.solveTime);
+    }
+
+    print(truth);
+    print(pose);
+
+    return 0;
+}
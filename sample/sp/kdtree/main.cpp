@@ -58,6 +58,34 @@ int main(){
         printf("\n");
     }
 
+    // kd tree (batch, k nearest neighbors)
+    {
+        const int k = 4;
+
+        Mem1<int> result;
+        {
+            SP_LOGGER_SET("kd tree (knn batch)");
+
+            KdTree<double> kdtree(2);
+
+            for (int i = 0; i < targ.size(); i++) {
+                kdtree.addData(&targ[i]);
+            }
+            kdtree.makeTree();
+
+            result = kdtree.knnBatch(test.ptr, test.size(), k);
+        }
+
+        SP_LOGGER_PRINT("kd tree (knn batch)");
+        {
+            int step = (test.size() / 10);
+            for (int i = 0; i < test.size(); i += step) {
+                print(targ[result[i * k]]);
+            }
+        }
+        printf("\n");
+    }
+
     // brute force search
     {
         Mem1<Vec2> result;
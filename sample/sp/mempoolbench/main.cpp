@@ -0,0 +1,76 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main() {
+
+    const int num = 1000000;
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("mem pool (%d elements)\n", num);
+    printf("--------------------------------------------------------------------------------\n");
+
+    MemP<Vec3> pool;
+
+    // malloc
+    {
+        Timer timer;
+        for (int i = 0; i < num; i++) {
+            *pool.malloc() = getVec3(i, 0.0, 0.0);
+        }
+        timer.stop();
+        printf("malloc   : %8.3lf [ms]\n", timer.getms());
+    }
+
+    // indexed access
+    {
+        Timer timer;
+        SP_REAL sum = 0.0;
+        for (int i = 0; i < pool.size(); i++) {
+            sum += pool[i].x;
+        }
+        timer.stop();
+        printf("index    : %8.3lf [ms] (sum %.0lf)\n", timer.getms(), static_cast<double>(sum));
+    }
+
+    // range iteration
+    {
+        Timer timer;
+        SP_REAL sum = 0.0;
+        for (const Vec3 &v : pool) {
+            sum += v.x;
+        }
+        timer.stop();
+        printf("range    : %8.3lf [ms] (sum %.0lf)\n", timer.getms(), static_cast<double>(sum));
+    }
+
+    // free (random half)
+    {
+        Mem1<Vec3*> ptrs(num);
+        for (int i = 0; i < num; i++) {
+            ptrs[i] = &pool[i];
+        }
+        const Mem1<int> index = shuffle(num, 0);
+
+        Timer timer;
+        for (int i = 0; i < num / 2; i++) {
+            pool.free(ptrs[index[i]]);
+        }
+        timer.stop();
+        printf("free     : %8.3lf [ms] (size %d)\n", timer.getms(), pool.size());
+    }
+
+    // reuse
+    {
+        Timer timer;
+        for (int i = 0; i < num / 2; i++) {
+            *pool.malloc() = getVec3(i, 0.0, 0.0);
+        }
+        timer.stop();
+        printf("re-malloc: %8.3lf [ms] (size %d)\n", timer.getms(), pool.size());
+    }
+
+    return 0;
+}
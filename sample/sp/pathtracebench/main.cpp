@@ -0,0 +1,84 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main() {
+
+    Mem1<Mesh3> model = loadBunny(SP_DATA_DIR "/stanford/bun_zipper.ply");
+    if (model.size() == 0) {
+        // if could not find stanford bunny, load dummy model
+        model = loadGeodesicDorm(100.0, 4);
+    }
+
+    const CamParam cam = getCamParam(640, 480);
+    const Pose pose = getPose(getVec3(0.0, 0.0, getModelDistance(model, cam)));
+
+    Material mat;
+    memset(&mat, 0, sizeof(Material));
+    mat.col = getCol4f(0.9, 0.2, 0.2, 1.0);
+
+    Mem1<Material> mats(model.size());
+    for (int i = 0; i < mats.size(); i++) {
+        mats[i] = mat;
+    }
+
+    Mem1<Mat> poses;
+    poses.push(eyeMat(4, 4));
+    poses.push(getMat(getPose(getVec3(100, 0, 0)), 4, 4));
+
+    const int updates = 10;
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("path trace (%d meshes x %d, %d x %d, %d updates)\n", model.size(), poses.size(), cam.dsize[0], cam.dsize[1], updates);
+    printf("--------------------------------------------------------------------------------\n");
+
+    const char *names[] = { "none", "sse4", "avx2" };
+    const SimdLevel maxLevel = setSimdLevel(SimdLevel_AVX2);
+
+    for (int l = SimdLevel_None; l <= maxLevel; l++) {
+        setSimdLevel(static_cast<SimdLevel>(l));
+
+        PathTrace pt;
+
+        PathTrace::Light amb;
+        amb.val = 0.8f;
+        amb.sdw = 0.8f;
+        pt.setAmbient(amb);
+        pt.setCam(cam, pose);
+        pt.addModel(model, mats, poses);
+
+        double buildTime = 0.0;
+        {
+            Timer timer;
+            pt.build();
+            timer.stop();
+            buildTime = timer.getms();
+        }
+
+        double updateTime = 0.0;
+        {
+            Timer timer;
+            for (int i = 0; i < updates; i++) {
+                pt.update();
+            }
+            timer.stop();
+            updateTime = timer.getms() / updates;
+        }
+
+        const double rays = static_cast<double>(cam.dsize[0] * cam.dsize[1]) / (updateTime * 1000.0);
+        printf("simd %s : build %8.3lf [ms], update %8.3lf [ms], %6.2lf [Mpixel/s]\n", names[l], buildTime, updateTime, rays);
+
+        if (l == maxLevel) {
+            Mem2<Col4> img;
+            pt.render(img);
+
+            Mem2<Col3> dst;
+            cnvImg(dst, img);
+            saveBMP("pathtrace.bmp", dst);
+        }
+    }
+
+    return 0;
+}
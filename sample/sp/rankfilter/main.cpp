@@ -0,0 +1,60 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+template <typename TYPE, typename FUNC0, typename FUNC1>
+void test(const Mem2<TYPE> &src, const char *name, const FUNC0 &func0, const FUNC1 &func1) {
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("%s (%d x %d)\n", name, src.dsize[0], src.dsize[1]);
+    printf("--------------------------------------------------------------------------------\n");
+
+    for (int winSize = 3; winSize <= 31; winSize += 2) {
+        Mem2<TYPE> dst0, dst1;
+
+        Timer timer0;
+        func0(dst0, src, winSize);
+        timer0.stop();
+
+        Timer timer1;
+        func1(dst1, src, winSize);
+        timer1.stop();
+
+        const bool same = (memcmp(dst0.ptr, dst1.ptr, dst0.size() * sizeof(TYPE)) == 0);
+
+        printf("window %2d : naive %10.3lf [ms], fast %8.3lf [ms], %s\n",
+            winSize, timer0.getms(), timer1.getms(), (same == true) ? "same" : "diff");
+    }
+    printf("\n");
+}
+
+int main() {
+
+    const int dsize[2] = { 320, 240 };
+
+    Mem2<Byte> gry(dsize);
+
+    srand(0);
+    for (int v = 0; v < dsize[1]; v++) {
+        for (int u = 0; u < dsize[0]; u++) {
+            const double a = 127.5 + 60.0 * sp::sin(u * 0.05) * sp::cos(v * 0.03) + 60.0 * randu();
+            gry(u, v) = cast<Byte>(a);
+        }
+    }
+
+    test(gry, "max filter (van Herk / Gil-Werman)",
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _maxmin::filterNaive(dst, src, winSize, _maxmin::MaxOp()); },
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _maxmin::filterVHGW(dst, src, winSize, _maxmin::MaxOp()); });
+
+    test(gry, "min filter (van Herk / Gil-Werman)",
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _maxmin::filterNaive(dst, src, winSize, _maxmin::MinOp()); },
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _maxmin::filterVHGW(dst, src, winSize, _maxmin::MinOp()); });
+
+    test(gry, "median filter (histogram)",
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _median::filterNaive<Byte, Byte>(dst, src, winSize); },
+        [](Mem2<Byte> &dst, const Mem2<Byte> &src, const int winSize) { _median::filterHist(dst, src, winSize); });
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main() {
+
+    const Mem1<Mesh3> model = loadBunny(SP_DATA_DIR "/stanford/bun_zipper.ply");
+    if (model.size() == 0) return -1;
+
+    // sphere (large triangles)
+    Mem1<Mesh3> sphere;
+    {
+        const int level = 2;
+        for (int i = 0; i < getGeodesicMeshNum(level); i++) {
+            sphere.push(getGeodesicMesh(level, i) * getModelRadius(model));
+        }
+    }
+
+    // views from geodesic directions (same as getPoseModel)
+    Mem1<Pose> poses;
+    {
+        const int level = 2;
+        const CamParam cam = getCamParam(640, 480);
+        const SP_REAL distance = getModelDistance(model, cam);
+        for (int i = 0; i < getGeodesicMeshNum(level); i++) {
+            const Vec3 v = getMeshCent(getGeodesicMesh(level, i)) * (-1.0);
+            poses.push(getPose(getRotDirection(v), getVec3(0.0, 0.0, distance)));
+        }
+    }
+
+    for (int d = 0; d < 2; d++) {
+        CamParam cam = getCamParam(640, 480);
+        if (d == 1) {
+            cam.k1 = 0.1;
+            cam.k2 = -0.05;
+            cam.p1 = 0.001;
+        }
+
+        printf("--------------------------------------------------------------------------------\n");
+        printf("render %d views (640 x 480, %s)\n", poses.size(), (d == 0) ? "no distortion" : "distortion");
+        printf("--------------------------------------------------------------------------------\n");
+
+        for (int m = 0; m < 2; m++) {
+            const Mem1<Mesh3> &meshes = (m == 0) ? model : sphere;
+
+            Mem2<VecPD3> map(cam.dsize);
+
+            Timer timer;
+            int cnt = 0;
+            for (int i = 0; i < poses.size(); i++) {
+                map.zero();
+                renderVecPD(map, cam, poses[i], meshes);
+
+                for (int j = 0; j < map.size(); j++) {
+                    if (map[j].pos.z > 0.0) cnt++;
+                }
+            }
+            timer.stop();
+
+            printf("%-6s (%6d meshes) : %8.3lf [ms/view], %d pixels/view\n", (m == 0) ? "bunny" : "sphere", meshes.size(), timer.getms() / poses.size(), cnt / poses.size());
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main() {
+
+    const int dsize[2] = { 640, 480 };
+
+    const int maxDisp = 63;
+    const int minDisp = 0;
+
+    // synthetic stereo pair (slanted plane with a box in front)
+    Mem2<Byte> imgs[2];
+    Mem2<int> truth(dsize);
+    {
+        imgs[0].resize(dsize);
+        imgs[1].resize(dsize);
+
+        srand(0);
+        Mem2<Byte> tex(dsize[0] + maxDisp, dsize[1]);
+        for (int i = 0; i < tex.size(); i++) {
+            tex[i] = static_cast<Byte>(sp::rand() % 256);
+        }
+        for (int v = 0; v < dsize[1]; v++) {
+            for (int u = 0; u < dsize[0]; u++) {
+                const bool box = (u > 200 && u < 440 && v > 140 && v < 340);
+                truth(u, v) = box ? 40 : 10 + u / 40;
+            }
+        }
+        for (int v = 0; v < dsize[1]; v++) {
+            for (int u = 0; u < dsize[0]; u++) {
+                imgs[0](u, v) = tex(u + maxDisp, v);
+                imgs[1](u, v) = tex(u + maxDisp, v);
+            }
+            for (int u = 0; u < dsize[0]; u++) {
+                const int x = u - truth(u, v);
+                if (x >= 0) imgs[1](x, v) = imgs[0](u, v);
+            }
+        }
+    }
+
+    printf("--------------------------------------------------------------------------------\n");
+    printf("stereo matching (%d x %d, disparity %d - %d)\n", dsize[0], dsize[1], minDisp, maxDisp);
+    printf("--------------------------------------------------------------------------------\n");
+
+    const SimdLevel maxLevel = getSimdLevel();
+    const char *names[] = { "none", "sse4.1", "avx2" };
+
+    for (int method = StereoBase::BM; method <= StereoBase::SGM; method++) {
+        for (int level = SimdLevel_None; level <= maxLevel; level++) {
+            setSimdLevel(static_cast<SimdLevel>(level));
+
+            StereoBase stereo;
+            stereo.setRange(maxDisp, minDisp);
+            stereo.setWinSize((method == StereoBase::BM) ? 9 : 5);
+            stereo.setMethod(static_cast<StereoBase::Method>(method));
+
+            Timer timer;
+            stereo.execute(imgs[0], imgs[1]);
+            timer.stop();
+
+            const Mem2<float> &disp = stereo.getDispMap(StereoBase::StereoL);
+
+            int cnt = 0;
+            int err = 0;
+            for (int v = 0; v < dsize[1]; v++) {
+                for (int u = maxDisp; u < dsize[0] - 16; u++) {
+                    cnt++;
+                    err += (fabs(disp(u, v) - truth(u, v)) > 1.0f) ? 1 : 0;
+                }
+            }
+
+            printf("%s %-6s : %8.3lf [ms], bad pixel %5.2lf [%%]\n",
+                (method == StereoBase::BM) ? "BM " : "SGM", names[level], timer.getms(), 100.0 * err / cnt);
+        }
+        setSimdLevel(maxLevel);
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+﻿#define SP_USE_DEBUG 1
+
+#include "simplesp.h"
+
+using namespace sp;
+
+int main(){
+
+    const int taskNum = 1000;
+
+    //--------------------------------------------------------------------------------
+    // task spawn latency
+    //--------------------------------------------------------------------------------
+
+    // detached std::thread per task (previous Thread::run)
+    {
+        std::atomic<int> cnt(0);
+        {
+            SP_LOGGER_SET("std::thread (detach)");
+
+            for (int i = 0; i < taskNum; i++) {
+                std::thread th([&cnt] { cnt++; });
+                th.detach();
+            }
+            while (cnt < taskNum) {
+                std::this_thread::yield();
+            }
+        }
+        SP_LOGGER_PRINT("std::thread (detach)");
+    }
+
+    // persistent serial thread
+    {
+        std::atomic<int> cnt(0);
+        Thread thread;
+        {
+            SP_LOGGER_SET("Thread::run");
+
+            for (int i = 0; i < taskNum; i++) {
+                thread.run([&cnt] { cnt++; });
+            }
+            while (cnt < taskNum) {
+                std::this_thread::yield();
+            }
+        }
+        SP_LOGGER_PRINT("Thread::run");
+    }
+
+    // thread pool
+    {
+        std::atomic<int> cnt(0);
+        ThreadPool::instance();
+        {
+            SP_LOGGER_SET("TaskGroup::run");
+
+            TaskGroup group;
+            for (int i = 0; i < taskNum; i++) {
+                group.run([&cnt] { cnt++; });
+            }
+            group.wait();
+        }
+        SP_LOGGER_PRINT("TaskGroup::run");
+        printf("workers %d, tasks %d\n\n", ThreadPool::instance()->size(), static_cast<int>(cnt));
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // parallel for / reduce
+    //--------------------------------------------------------------------------------
+
+    const int dataNum = 10000000;
+
+    Mem1<double> data(dataNum);
+    for (int i = 0; i < dataNum; i++) {
+        data[i] = randu();
+    }
+
+    {
+        double sum = 0.0;
+        {
+            SP_LOGGER_SET("serial sum");
+
+            for (int i = 0; i < dataNum; i++) {
+                sum += sq(data[i]);
+            }
+        }
+        SP_LOGGER_PRINT("serial sum");
+        printf("sum %lf\n\n", sum);
+    }
+
+    {
+        double sum = 0.0;
+        {
+            SP_LOGGER_SET("parallel_reduce sum");
+
+            sum = parallel_reduce(0, dataNum, 0.0, [&](const int b, const int e, double v) {
+                for (int i = b; i < e; i++) {
+                    v += sq(data[i]);
+                }
+                return v;
+            }, [](const double a, const double b) { return a + b; });
+        }
+        SP_LOGGER_PRINT("parallel_reduce sum");
+        printf("sum %lf\n\n", sum);
+    }
+
+    {
+        Mem1<double> dst(dataNum);
+        {
+            SP_LOGGER_SET("parallel_for");
+
+            parallel_for(0, dataNum, [&](const int i) {
+                dst[i] = sq(data[i]) * 0.5;
+            });
+        }
+        SP_LOGGER_PRINT("parallel_for");
+    }
+
+    return 0;
+}
@@ -13,44 +13,48 @@ namespace sp{
     //--------------------------------------------------------------------------------
     // kd tree
     //--------------------------------------------------------------------------------
+    //
+    // bulk built on makeTree (median split on the widest dimension), nodes are stored
+    // in a flat array and points are stored contiguously in leaf buckets
+    //
 
     template<typename TYPE> class KdTree{
 
     private:
 
+        // max point num in leaf
+        static const int LEAF_SIZE = 8;
+
         // data dimension
         int m_dim;
 
         struct Node {
-            // point data
-            TYPE *data;
-
-            // point index
-            int index;
-
-            // div dimension
+            // div dimension (-1 : leaf)
             int div;
 
-            // 0 : left node, 1 : right node
-            Node *sub[2];
+            // div value
+            TYPE val;
+
+            // 0 : left node, 1 : right node (leaf : [begin, end) of m_pnts)
+            int sub[2];
         };
 
         // point num;
         int m_size;
 
-        // root node
-        Node *m_root;
+        // point data (index order)
+        Mem1<TYPE> m_data;
 
-        // space rect 
-        Mem2<TYPE> m_rect;
+        // point data (leaf order) and index
+        Mem1<TYPE> m_pnts;
+        Mem1<int> m_ids;
+
+        // nodes (m_nodes[0] : root)
+        Mem1<Node> m_nodes;
 
         // data ptr;
         Mem1<const TYPE*> m_stack;
 
-        // memory pool
-        MemP<Node> nodePool;
-        MemP<TYPE> dataPool;
-
     public:
 
         KdTree(const int dim = 0){
@@ -65,12 +69,13 @@ namespace sp{
         //--------------------------------------------------------------------------------
 
         void init(const int dim){
-            dataPool.init(dim);
-
             m_dim = dim;
             m_size = 0;
-            m_root = NULL;
-            m_rect.resize(dim, 2);
+
+            m_data.clear();
+            m_pnts.clear();
+            m_ids.clear();
+            m_nodes.clear();
 
             m_stack.clear();
         }
@@ -88,7 +93,7 @@ namespace sp{
         }
 
         const TYPE* getData(const int i) const {
-            return &dataPool[i];
+            return &m_data[i * m_dim];
         }
 
 
@@ -103,179 +108,329 @@ namespace sp{
         void makeTree() {
             if (m_stack.size() == 0) return;
 
-            const int offset = m_size;
-
-            const Mem1<int> index = shuffle(m_stack.size());
-            m_stack = shuffle(m_stack, index);
+            if (m_size > 0) {
+                const Mem1<TYPE> tmp = m_data;
+                m_data.resize((m_size + m_stack.size()) * m_dim);
+                memcpy(m_data.ptr, tmp.ptr, m_size * m_dim * sizeof(TYPE));
+            }
+            else {
+                m_data.resize(m_stack.size() * m_dim);
+            }
 
             for (int i = 0; i < m_stack.size(); i++) {
-                const TYPE *data = m_stack[i];
-                addNode(&m_root, data, 0, index[i] + offset);
-
-                for (int i = 0; i < m_dim; i++) {
-                    if (m_size == 0) {
-                        m_rect(i, 0) = data[i];
-                        m_rect(i, 1) = data[i];
-                    }
-                    else {
-                        m_rect(i, 0) = (TYPE)min(data[i], m_rect(i, 0));
-                        m_rect(i, 1) = (TYPE)max(data[i], m_rect(i, 1));
-                    }
-                }
-
-                m_size++;
+                memcpy(&m_data[(m_size + i) * m_dim], m_stack[i], m_dim * sizeof(TYPE));
             }
-
+            m_size += m_stack.size();
             m_stack.clear();
+
+            buildTree();
         }
 
         //--------------------------------------------------------------------------------
         // search data
         //--------------------------------------------------------------------------------
 
+        // nearest neighbor (-1 : empty)
         int search(const void *ptr) const {
             SP_ASSERT(m_stack.size() == 0);
-            if (m_root == NULL) return -1;
 
-            const TYPE *data = (TYPE*)ptr;
+            int index = -1;
+            SP_REAL dist = SP_INFINITY;
+            searchKnn(&index, &dist, 1, (const TYPE*)ptr);
 
-            Mem2<TYPE> rect = m_rect;
+            return index;
+        }
 
-            Node *result = m_root;
-            SP_REAL dist = normData(result->data, data);
+        // points within range
+        Mem1<int> search(const void *ptr, double range) const {
+            SP_ASSERT(m_stack.size() == 0);
+            Mem1<int> index;
 
-            searchOne(dist, result, m_root, data, rect);
+            searchRange(index, (const TYPE*)ptr, range);
 
-            return result->index;
+            return index;
         }
 
-        Mem1<int> search(const void *ptr, double range) const {
+        // k nearest neighbors (sorted by distance)
+        Mem1<int> knn(const void *ptr, const int k) const {
             SP_ASSERT(m_stack.size() == 0);
-            Mem1<int> index;
 
-            const TYPE *data = (TYPE*)ptr;
+            Mem1<int> index(k);
+            Mem1<SP_REAL> dists(k);
+            const int num = searchKnn(index.ptr, dists.ptr, k, (const TYPE*)ptr);
 
-            searchRange(index, m_root, data, range);
-            
+            index.resize(num);
             return index;
         }
 
-    private:
+        // nearest neighbor of num points (ptrs : num * dim)
+        Mem1<int> batch(const void *ptrs, const int num) const {
+            SP_ASSERT(m_stack.size() == 0);
 
-        SP_REAL normData(const TYPE *data, const TYPE *base) const {
-            SP_REAL norm = 0.0;
-            for (int i = 0; i < m_dim; i++) {
-                norm += sq(data[i] - base[i]);
-            }
-            return sqrt(norm);
+            Mem1<int> index(num);
+
+            parallel_for(0, num, [&](const int i) {
+                SP_REAL dist = SP_INFINITY;
+                index[i] = -1;
+                searchKnn(&index[i], &dist, 1, (const TYPE*)ptrs + i * m_dim);
+            }, 64);
+
+            return index;
         }
 
-        SP_REAL normRect(Mem2<TYPE> &rect, const TYPE *base) const {
-            SP_REAL norm = 0.0;
+        // k nearest neighbors of num points (ptrs : num * dim, result : num * k, -1 : empty)
+        Mem1<int> knnBatch(const void *ptrs, const int num, const int k) const {
+            SP_ASSERT(m_stack.size() == 0);
 
-            for (int i = 0; i < m_dim; i++) {
-                if (base[i] >= rect(i, 0) && base[i] <= rect(i, 1)) continue;
+            Mem1<int> index(num * k);
 
-                const int t = (base[i] < rect(i, 0)) ? 0 : 1;
-                norm += sq(rect(i, t) - base[i]);
-            }
+            parallel_for(0, num, [&](const int i) {
+                SP_REAL dists[16];
+                Mem1<SP_REAL> tmp;
+                SP_REAL *pd = (k <= 16) ? dists : (tmp.resize(k), tmp.ptr);
+
+                const int n = searchKnn(&index[i * k], pd, k, (const TYPE*)ptrs + i * m_dim);
+                for (int j = n; j < k; j++) {
+                    index[i * k + j] = -1;
+                }
+            }, 16);
 
-            return sqrt(norm);
+            return index;
         }
 
-        SP_REAL cmpData(const TYPE *data0, const TYPE *data1, const int div) const {
-            return data0[div] - data1[div];
+        // points within range of num points
+        Mem1<Mem1<int> > rangeBatch(const void *ptrs, const int num, const double range) const {
+            SP_ASSERT(m_stack.size() == 0);
+
+            Mem1<Mem1<int> > index(num);
+
+            parallel_for(0, num, [&](const int i) {
+                searchRange(index[i], (const TYPE*)ptrs + i * m_dim, range);
+            }, 16);
+
+            return index;
         }
 
-        void addNode(Node **parent, const TYPE *data, int div, const int index){
+    private:
 
-            for (int i = 0; ; i++) {
-                if (!*parent) {
-                    Node *node = nodePool.malloc();
-                    node->data = dataPool.malloc();
+        //--------------------------------------------------------------------------------
+        // build
+        //--------------------------------------------------------------------------------
 
-                    memcpy(node->data, data, m_dim * sizeof(TYPE));
+        void buildTree() {
+            m_nodes.clear();
+            m_nodes.reserve(2 * (m_size / (LEAF_SIZE / 2) + 1));
 
-                    node->div = div % m_dim;
-                    node->sub[0] = NULL;
-                    node->sub[1] = NULL;
-                    node->index = index;
+            // points are partitioned in place (leaf order)
+            m_pnts = m_data;
+            m_ids.resize(m_size);
+            for (int i = 0; i < m_size; i++) {
+                m_ids[i] = i;
+            }
 
-                    *parent = node;
-                    break;
+            // bounding box (the cell is cut at each split)
+            Mem1<SP_REAL> rect(2 * m_dim);
+            for (int d = 0; d < m_dim; d++) {
+                SP_REAL minv = m_data[d];
+                SP_REAL maxv = m_data[d];
+                for (int i = 1; i < m_size; i++) {
+                    const SP_REAL v = m_data[i * m_dim + d];
+                    minv = min(minv, v);
+                    maxv = max(maxv, v);
                 }
-                else {
-                    Node *node = *parent;
-                    const SP_REAL d = cmpData(data, node->data, node->div);
-                    const int t = (d < 0.0) ? 0 : 1;
+                rect[d * 2 + 0] = minv;
+                rect[d * 2 + 1] = maxv;
+            }
+
+            buildNode(0, m_size, rect.ptr);
+        }
 
-                    parent = &node->sub[t];
-                    div = node->div + 1;
-                    //addNode(&node->sub[t], data, node->div + 1, index);
+        int buildNode(const int base, const int num, SP_REAL *rect) {
+            const int n = m_nodes.size();
+            m_nodes.push(Node());
+
+            // widest dimension of the cell
+            int div = -1;
+            SP_REAL maxw = 0.0;
+            if (num > LEAF_SIZE) {
+                for (int d = 0; d < m_dim; d++) {
+                    const SP_REAL w = rect[d * 2 + 1] - rect[d * 2 + 0];
+                    if (w > maxw) {
+                        maxw = w;
+                        div = d;
+                    }
                 }
             }
+
+            if (div < 0) {
+                Node &node = m_nodes[n];
+                node.div = -1;
+                node.val = 0;
+                node.sub[0] = base;
+                node.sub[1] = base + num;
+                return n;
+            }
+
+            // median split ([base, mid) <= val <= [mid, base + num))
+            const int mid = base + num / 2;
+            select(base, base + num - 1, mid, div);
+            const TYPE val = m_pnts[mid * m_dim + div];
+
+            const SP_REAL tmp[2] = { rect[div * 2 + 0], rect[div * 2 + 1] };
+
+            rect[div * 2 + 1] = val;
+            const int sub0 = buildNode(base, mid - base, rect);
+            rect[div * 2 + 1] = tmp[1];
+
+            rect[div * 2 + 0] = val;
+            const int sub1 = buildNode(mid, base + num - mid, rect);
+            rect[div * 2 + 0] = tmp[0];
+
+            Node &node = m_nodes[n];
+            node.div = div;
+            node.val = val;
+            node.sub[0] = sub0;
+            node.sub[1] = sub1;
+            return n;
         }
 
-        void searchOne(SP_REAL &mindist, Node *&result, Node *node, const TYPE *data, Mem2<TYPE> &rect) const {
+        void swapPnt(const int i, const int j) {
+            TYPE *a = &m_pnts[i * m_dim];
+            TYPE *b = &m_pnts[j * m_dim];
+            for (int d = 0; d < m_dim; d++) {
+                swap(a[d], b[d]);
+            }
+            swap(m_ids[i], m_ids[j]);
+        }
 
-            const SP_REAL d = cmpData(data, node->data, node->div);
-            const int t = (d < 0.0) ? 0 : 1;
+        // quick select (m_pnts[k] is the k-th point along div)
+        void select(int l, int r, const int k, const int div) {
+            const TYPE *pnts = m_pnts.ptr + div;
+            const int dim = m_dim;
+
+            while (l < r) {
+                const TYPE pv = pnts[((l + r) / 2) * dim];
+                int i = l;
+                int j = r;
+                while (i <= j) {
+                    while (pnts[i * dim] < pv) i++;
+                    while (pnts[j * dim] > pv) j--;
+                    if (i <= j) {
+                        swapPnt(i, j);
+                        i++;
+                        j--;
+                    }
+                }
+                if (k <= j) {
+                    r = j;
+                }
+                else if (k >= i) {
+                    l = i;
+                }
+                else {
+                    break;
+                }
+            }
+        }
 
-            // check near node
-            if (node->sub[t] != NULL) {
-                TYPE &side = rect(node->div, 1 - t);
+        //--------------------------------------------------------------------------------
+        // search
+        //--------------------------------------------------------------------------------
+
+        SP_REAL sqDist(const TYPE *data, const TYPE *base) const {
+            SP_REAL norm = 0.0;
+            for (int i = 0; i < m_dim; i++) {
+                norm += sq(static_cast<SP_REAL>(data[i]) - static_cast<SP_REAL>(base[i]));
+            }
+            return norm;
+        }
 
-                // cut rect
-                const TYPE tmp = side;
-                side = node->data[node->div];
+        // bounded priority queue (sorted, size <= k)
+        static void pushQueue(int *index, SP_REAL *dists, int &num, const int k, const int id, const SP_REAL dist) {
+            if (num == k && dist >= dists[k - 1]) return;
 
-                searchOne(mindist, result, node->sub[t], data, rect);
-                
-                // reset
-                side = tmp;
+            int p = (num < k) ? num++ : k - 1;
+            while (p > 0 && dists[p - 1] > dist) {
+                index[p] = index[p - 1];
+                dists[p] = dists[p - 1];
+                p--;
             }
+            index[p] = id;
+            dists[p] = dist;
+        }
+
+        // return found num (dists : squared distance)
+        int searchKnn(int *index, SP_REAL *dists, const int k, const TYPE *data) const {
+            if (m_nodes.size() == 0 || k <= 0) return 0;
 
-            const SP_REAL dist = normData(node->data, data);
-            if (dist < mindist) {
-                result = node;
-                mindist = dist;
+            // per axis offset from the query to the current cell
+            SP_REAL buf[8];
+            Mem1<SP_REAL> tmp;
+            SP_REAL *off = (m_dim <= 8) ? buf : (tmp.resize(m_dim), tmp.ptr);
+            for (int d = 0; d < m_dim; d++) {
+                off[d] = 0.0;
             }
 
-            // check far node
-            if (node->sub[1 - t] != NULL) {
-                TYPE *side = &rect(node->div, t);
+            int num = 0;
+            searchKnn(index, dists, num, k, data, 0, 0.0, off);
+            return num;
+        }
 
-                // cut rect
-                const TYPE tmp = *side;
-                *side = node->data[node->div];
+        void searchKnn(int *index, SP_REAL *dists, int &num, const int k, const TYPE *data, const int n, const SP_REAL rd, SP_REAL *off) const {
+            const Node &node = m_nodes[n];
 
-                if (normRect(rect, data) < mindist) {
-                    searchOne(mindist, result, node->sub[1 - t], data, rect);
+            if (node.div < 0) {
+                for (int i = node.sub[0]; i < node.sub[1]; i++) {
+                    const SP_REAL dist = sqDist(&m_pnts[i * m_dim], data);
+                    pushQueue(index, dists, num, k, m_ids[i], dist);
                 }
+                return;
+            }
+
+            const SP_REAL d = static_cast<SP_REAL>(data[node.div]) - static_cast<SP_REAL>(node.val);
+            const int t = (d < 0.0) ? 0 : 1;
+
+            // check near node
+            searchKnn(index, dists, num, k, data, node.sub[t], rd, off);
 
-                // reset
-                *side = tmp;
+            // check far node
+            const SP_REAL pre = off[node.div];
+            const SP_REAL frd = rd - pre * pre + d * d;
+            if (num < k || frd < dists[k - 1]) {
+                off[node.div] = d;
+                searchKnn(index, dists, num, k, data, node.sub[1 - t], frd, off);
+                off[node.div] = pre;
             }
         }
 
-        void searchRange(Mem1<int> &index, Node *node, const TYPE *data, TYPE rect) const {
-            if (node == NULL) return;
+        void searchRange(Mem1<int> &index, const TYPE *data, const double range) const {
+            if (m_nodes.size() == 0) return;
+            searchRange(index, data, 0, range);
+        }
+
+        void searchRange(Mem1<int> &index, const TYPE *data, const int n, const double range) const {
+            const Node &node = m_nodes[n];
 
-            const SP_REAL dist = normData(node->data, data);
-            if (dist <= rect) {
-                index.push(node->index);
+            if (node.div < 0) {
+                const SP_REAL sqr = range * range;
+                for (int i = node.sub[0]; i < node.sub[1]; i++) {
+                    if (sqDist(&m_pnts[i * m_dim], data) <= sqr) {
+                        index.push(m_ids[i]);
+                    }
+                }
+                return;
             }
 
-            const SP_REAL d = cmpData(data, node->data, node->div);
+            const SP_REAL d = static_cast<SP_REAL>(data[node.div]) - static_cast<SP_REAL>(node.val);
             const int t = (d < 0.0) ? 0 : 1;
 
-            searchRange(index, node->sub[t], data, rect);
-            if (fabs(d) < rect) {
-                searchRange(index, node->sub[1 - t], data, rect);
+            searchRange(index, data, node.sub[t], range);
+            if (fabs(d) <= range) {
+                searchRange(index, data, node.sub[1 - t], range);
             }
         }
 
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -32,6 +32,7 @@
 #include "spapp/spimg/sprender.h"
 
 #include "spapp/spimgex/spfeature.h"
+#include "spapp/spimgex/spdscindex.h"
 #include "spapp/spimgex/spcfblob.h"
 #include "spapp/spimgex/spgfilter.h"
 #include "spapp/spimgex/spcontour.h"
@@ -45,6 +46,8 @@
 #include "spapp/spimgex/spstereo.h"
 
 // geometry
+#include "spapp/spgeom/spransac.h"
+#include "spapp/spgeom/spbundle.h"
 #include "spapp/spgeom/spxmat.h"
 #include "spapp/spgeom/spgeom.h"
 #include "spapp/spgeom/spdepth.h"
@@ -63,6 +66,7 @@
 #include "spapp/spgeomex/spdotpattern.h"
 #include "spapp/spgeomex/spprojector.h"
 #include "spapp/spgeomex/spvoxel.h"
+#include "spapp/spgeomex/spvoxelhash.h"
 
 #include "spapp/spgeomex/spkfusion.h"
 
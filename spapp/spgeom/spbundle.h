@@ -0,0 +1,761 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_BUNDLE_H__
+#define __SP_BUNDLE_H__
+
+#include "spcore/spcore.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // bundle adjustment
+    //--------------------------------------------------------------------------------
+    //
+    // observation: pix = cam(prj(rig * pose * pnt)), (rig is optional)
+    //
+    // the normal equation is built from 2 x n jacobian blocks (one per observation and parameter)
+    // and the eliminated blocks are removed by the schur complement.
+    // - points are eliminated when some of them are variable (sfm)
+    // - poses are eliminated when all points are fixed (calibration)
+    // the reduced system (cams, rigs, [poses]) is solved densely by cholesky decomposition.
+    //
+
+    namespace _bundle {
+
+        // solve symmetric positive definite system (mat is overwritten)
+        SP_CPUFUNC bool solveChol(SP_REAL *x, SP_REAL *mat, const SP_REAL *b, const int size) {
+
+            // mat = L * L^T
+            for (int c = 0; c < size; c++) {
+                SP_REAL *pc = &mat[c * size];
+
+                double d = pc[c];
+                for (int k = 0; k < c; k++) {
+                    d -= pc[k] * pc[k];
+                }
+                if (d <= SP_SMALL) return false;
+
+                const double l = sqrt(d);
+                pc[c] = static_cast<SP_REAL>(l);
+
+                for (int r = c + 1; r < size; r++) {
+                    SP_REAL *pr = &mat[r * size];
+
+                    double s = pr[c];
+                    for (int k = 0; k < c; k++) {
+                        s -= pr[k] * pc[k];
+                    }
+                    pr[c] = static_cast<SP_REAL>(s / l);
+                }
+            }
+
+            // L * y = b
+            for (int r = 0; r < size; r++) {
+                const SP_REAL *pr = &mat[r * size];
+
+                double s = b[r];
+                for (int k = 0; k < r; k++) {
+                    s -= pr[k] * x[k];
+                }
+                x[r] = static_cast<SP_REAL>(s / pr[r]);
+            }
+
+            // L^T * x = y
+            for (int r = size - 1; r >= 0; r--) {
+                double s = x[r];
+                for (int k = r + 1; k < size; k++) {
+                    s -= mat[k * size + r] * x[k];
+                }
+                x[r] = static_cast<SP_REAL>(s / mat[r * size + r]);
+            }
+            return true;
+        }
+
+        // dst(rows x cols) += w * A^T * B (A: 2 x rows, B: 2 x cols)
+        SP_GENFUNC void addJtJ(SP_REAL *dst, const int step, const SP_REAL *A, const int rows, const SP_REAL *B, const int cols, const double w) {
+            for (int r = 0; r < rows; r++) {
+                const double a0 = A[0 * rows + r] * w;
+                const double a1 = A[1 * rows + r] * w;
+                SP_REAL *pd = &dst[r * step];
+                for (int c = 0; c < cols; c++) {
+                    pd[c] += static_cast<SP_REAL>(a0 * B[0 * cols + c] + a1 * B[1 * cols + c]);
+                }
+            }
+        }
+
+        // dst(rows) += w * A^T * e (A: 2 x rows)
+        SP_GENFUNC void addJtE(SP_REAL *dst, const SP_REAL *A, const int rows, const SP_REAL *e, const double w) {
+            for (int r = 0; r < rows; r++) {
+                dst[r] += static_cast<SP_REAL>((A[0 * rows + r] * e[0] + A[1 * rows + r] * e[1]) * w);
+            }
+        }
+    }
+
+    class BundleAdjust {
+
+    public:
+
+        // robust kernel
+        enum Kernel {
+            KERNEL_NULL = 0,
+            KERNEL_HUBER = 1,
+            KERNEL_TUKEY = 2
+        };
+
+    private:
+
+        struct Obs {
+            int cam, rig, pose, pnt;
+            Vec2 pix;
+        };
+
+        // parameter blocks
+        Mem1<CamParam> m_cams;
+        Mem1<Pose> m_rigs;
+        Mem1<Pose> m_poses;
+        Mem1<Vec3> m_pnts;
+
+        // fix flags
+        Mem1<bool> m_cfix;
+        Mem1<bool> m_rfix;
+        Mem1<bool> m_pfix;
+        Mem1<bool> m_xfix;
+
+        Mem1<Obs> m_obss;
+
+        Kernel m_kernel;
+        double m_thresh;
+
+        // residual per observation
+        Mem1<SP_REAL> m_errs;
+
+    private:
+
+        //--------------------------------------------------------------------------------
+        // work memory
+        //--------------------------------------------------------------------------------
+
+        // eliminate points (true) or poses (false)
+        bool m_epnt;
+        int m_esize;
+
+        // reduced block offset (-1: fixed or eliminated)
+        Mem1<int> m_ocam, m_orig, m_opose;
+        int m_rsize;
+
+        // eliminated block index per observation (-1: fixed)
+        Mem1<int> m_eids;
+        int m_enum;
+
+        // observations per eliminated block (csr)
+        Mem1<int> m_ebeg, m_elist;
+
+        // jacobian blocks, residual and weight per observation
+        Mem1<SP_REAL> m_jc, m_jr, m_jp, m_jx, m_res, m_wgt;
+
+    public:
+
+        BundleAdjust() {
+            clear();
+        }
+
+        void clear() {
+            m_cams.clear();
+            m_rigs.clear();
+            m_poses.clear();
+            m_pnts.clear();
+
+            m_cfix.clear();
+            m_rfix.clear();
+            m_pfix.clear();
+            m_xfix.clear();
+
+            m_obss.clear();
+            m_errs.clear();
+
+            m_kernel = KERNEL_HUBER;
+            m_thresh = 2.0;
+        }
+
+        //--------------------------------------------------------------------------------
+        // input parameter
+        //--------------------------------------------------------------------------------
+
+        void setKernel(const Kernel kernel, const double thresh) {
+            m_kernel = kernel;
+            m_thresh = thresh;
+        }
+
+        int addCam(const CamParam &cam, const bool fix = false) {
+            m_cams.push(cam);
+            m_cfix.push(fix);
+            return m_cams.size() - 1;
+        }
+
+        int addRig(const Pose &rig, const bool fix = false) {
+            m_rigs.push(rig);
+            m_rfix.push(fix);
+            return m_rigs.size() - 1;
+        }
+
+        int addPose(const Pose &pose, const bool fix = false) {
+            m_poses.push(pose);
+            m_pfix.push(fix);
+            return m_poses.size() - 1;
+        }
+
+        int addPnt(const Vec3 &pnt, const bool fix = false) {
+            m_pnts.push(pnt);
+            m_xfix.push(fix);
+            return m_pnts.size() - 1;
+        }
+
+        // rig: -1 (not used)
+        void addObs(const int cam, const int rig, const int pose, const int pnt, const Vec2 &pix) {
+            SP_ASSERT(cam >= 0 && cam < m_cams.size());
+            SP_ASSERT(rig < m_rigs.size());
+            SP_ASSERT(pose >= 0 && pose < m_poses.size());
+            SP_ASSERT(pnt >= 0 && pnt < m_pnts.size());
+
+            Obs obs;
+            obs.cam = cam;
+            obs.rig = rig;
+            obs.pose = pose;
+            obs.pnt = pnt;
+            obs.pix = pix;
+            m_obss.push(obs);
+        }
+
+        //--------------------------------------------------------------------------------
+        // output parameter
+        //--------------------------------------------------------------------------------
+
+        const CamParam& getCam(const int i) const {
+            return m_cams[i];
+        }
+
+        const Pose& getRig(const int i) const {
+            return m_rigs[i];
+        }
+
+        const Pose& getPose(const int i) const {
+            return m_poses[i];
+        }
+
+        const Vec3& getPnt(const int i) const {
+            return m_pnts[i];
+        }
+
+        // reprojection error per observation
+        const Mem1<SP_REAL>& getErrs() const {
+            return m_errs;
+        }
+
+        //--------------------------------------------------------------------------------
+        // execute
+        //--------------------------------------------------------------------------------
+
+        // levenberg-marquardt (return: rms of reprojection error, -1: failed)
+        SP_REAL execute(const int maxit = 20) {
+            if (m_obss.size() == 0) return -1.0;
+
+            init();
+
+            double lambda = 1e-4;
+            double cost = calcCost(m_errs, m_cams, m_rigs, m_poses, m_pnts);
+
+            Mem1<SP_REAL> U, gr, V, ge, dr, de;
+
+            Mem1<CamParam> cams;
+            Mem1<Pose> rigs, poses;
+            Mem1<Vec3> pnts;
+            Mem1<SP_REAL> errs;
+
+            for (int it = 0; it < maxit; it++) {
+                linearize();
+
+                build(U, gr, V, ge);
+
+                bool update = false;
+                for (int t = 0; t < 10; t++) {
+                    if (solve(dr, de, U, gr, V, ge, lambda) == true) {
+                        cams = m_cams;
+                        rigs = m_rigs;
+                        poses = m_poses;
+                        pnts = m_pnts;
+                        apply(cams, rigs, poses, pnts, dr, de);
+
+                        const double tcost = calcCost(errs, cams, rigs, poses, pnts);
+                        if (tcost < cost) {
+                            update = (cost - tcost > cost * 1e-6) ? true : false;
+                            m_cams = cams;
+                            m_rigs = rigs;
+                            m_poses = poses;
+                            m_pnts = pnts;
+                            m_errs = errs;
+
+                            cost = tcost;
+                            lambda = max(lambda / 3.0, 1e-9);
+                            break;
+                        }
+                    }
+                    lambda *= 4.0;
+                }
+
+                const SP_REAL rms = sqrt(sqmean(m_errs));
+                SP_PRINTD("i:%02d [mean: %9.6lf], [median: %9.6lf], [rms: %9.6lf]\n", it, mean(m_errs), median(m_errs), rms);
+
+                if (update == false) break;
+            }
+
+            return sqrt(sqmean(m_errs));
+        }
+
+    private:
+
+        //--------------------------------------------------------------------------------
+        // initialize
+        //--------------------------------------------------------------------------------
+
+        void init() {
+            const int onum = m_obss.size();
+
+            m_epnt = false;
+            for (int i = 0; i < m_pnts.size(); i++) {
+                if (m_xfix[i] == false) {
+                    m_epnt = true;
+                    break;
+                }
+            }
+            m_esize = (m_epnt == true) ? 3 : 6;
+
+            // reduced offset
+            m_rsize = 0;
+            m_ocam.resize(m_cams.size());
+            for (int i = 0; i < m_cams.size(); i++) {
+                m_ocam[i] = (m_cfix[i] == false) ? m_rsize : -1;
+                if (m_cfix[i] == false) m_rsize += 9;
+            }
+            m_orig.resize(m_rigs.size());
+            for (int i = 0; i < m_rigs.size(); i++) {
+                m_orig[i] = (m_rfix[i] == false) ? m_rsize : -1;
+                if (m_rfix[i] == false) m_rsize += 6;
+            }
+            m_opose.resize(m_poses.size());
+            for (int i = 0; i < m_poses.size(); i++) {
+                const bool valid = (m_epnt == true && m_pfix[i] == false);
+                m_opose[i] = (valid == true) ? m_rsize : -1;
+                if (valid == true) m_rsize += 6;
+            }
+
+            // eliminated block
+            m_enum = (m_epnt == true) ? m_pnts.size() : m_poses.size();
+            m_eids.resize(onum);
+            for (int o = 0; o < onum; o++) {
+                const Obs &obs = m_obss[o];
+                const int k = (m_epnt == true) ? obs.pnt : obs.pose;
+                const bool fix = (m_epnt == true) ? m_xfix[k] : m_pfix[k];
+                m_eids[o] = (fix == false) ? k : -1;
+            }
+
+            m_ebeg.resize(m_enum + 1);
+            m_ebeg.zero();
+            for (int o = 0; o < onum; o++) {
+                if (m_eids[o] >= 0) m_ebeg[m_eids[o] + 1]++;
+            }
+            for (int k = 0; k < m_enum; k++) {
+                m_ebeg[k + 1] += m_ebeg[k];
+            }
+            m_elist.resize(m_ebeg[m_enum]);
+            {
+                Mem1<int> cnts(m_enum);
+                cnts.zero();
+                for (int o = 0; o < onum; o++) {
+                    const int k = m_eids[o];
+                    if (k >= 0) m_elist[m_ebeg[k] + cnts[k]++] = o;
+                }
+            }
+
+            m_jc.resize(onum * 2 * 9);
+            m_jr.resize(onum * 2 * 6);
+            m_jp.resize(onum * 2 * 6);
+            m_jx.resize(onum * 2 * 3);
+            m_res.resize(onum * 2);
+            m_wgt.resize(onum);
+        }
+
+        //--------------------------------------------------------------------------------
+        // residual and jacobian
+        //--------------------------------------------------------------------------------
+
+        // robust weight and cost of squared residual
+        double kernel(double &cost, const double s) const {
+            const double t = m_thresh;
+            double w = 1.0;
+            cost = s;
+
+            switch (m_kernel) {
+            case KERNEL_HUBER:
+                if (s > t * t) {
+                    const double r = sqrt(s);
+                    w = t / r;
+                    cost = 2.0 * t * r - t * t;
+                }
+                break;
+            case KERNEL_TUKEY:
+                if (s < t * t) {
+                    const double v = 1.0 - s / (t * t);
+                    w = v * v;
+                    cost = t * t / 3.0 * (1.0 - v * v * v);
+                }
+                else {
+                    w = 0.0;
+                    cost = t * t / 3.0;
+                }
+                break;
+            default:
+                break;
+            }
+            return w;
+        }
+
+        Vec2 calcRes(const Obs &obs, const Mem1<CamParam> &cams, const Mem1<Pose> &rigs, const Mem1<Pose> &poses, const Mem1<Vec3> &pnts) const {
+            const Vec3 pos = poses[obs.pose] * pnts[obs.pnt];
+            const Vec3 cpos = (obs.rig >= 0) ? rigs[obs.rig] * pos : pos;
+            return obs.pix - mulCamD(cams[obs.cam], prjVec(cpos));
+        }
+
+        double calcCost(Mem1<SP_REAL> &errs, const Mem1<CamParam> &cams, const Mem1<Pose> &rigs, const Mem1<Pose> &poses, const Mem1<Vec3> &pnts) {
+            const int onum = m_obss.size();
+
+            errs.resize(onum);
+
+            Mem1<double> costs(onum);
+            parallel_for(0, onum, [&](const int o) {
+                const Obs &obs = m_obss[o];
+                const Vec2 err = calcRes(obs, cams, rigs, poses, pnts);
+                const double s = sqVec(err);
+
+                errs[o] = static_cast<SP_REAL>(sqrt(s));
+                kernel(costs[o], s);
+            });
+
+            double sum = 0.0;
+            for (int o = 0; o < onum; o++) {
+                sum += costs[o];
+            }
+            return sum;
+        }
+
+        void linearize() {
+            const int onum = m_obss.size();
+
+            parallel_for(0, onum, [&](const int o) {
+                const Obs &obs = m_obss[o];
+                const CamParam &cam = m_cams[obs.cam];
+                const Pose &pose = m_poses[obs.pose];
+                const Vec3 &pnt = m_pnts[obs.pnt];
+
+                const Vec3 pos = pose * pnt;
+                const Vec3 cpos = (obs.rig >= 0) ? m_rigs[obs.rig] * pos : pos;
+                const Vec2 npx = prjVec(cpos);
+
+                const Vec2 err = obs.pix - mulCamD(cam, npx);
+                SP_REAL *res = &m_res[o * 2];
+                res[0] = err.x;
+                res[1] = err.y;
+
+                double cost;
+                m_wgt[o] = static_cast<SP_REAL>(kernel(cost, sqVec(err)));
+
+                SP_REAL jCposToPix[2 * 3];
+                jacobPosToPix(jCposToPix, cam, cpos);
+
+                // jacobian of pos (before rig)
+                SP_REAL jPosToPix[2 * 3];
+                if (obs.rig >= 0) {
+                    SP_REAL rmat[3 * 3];
+                    getMat(rmat, 3, 3, m_rigs[obs.rig].rot);
+                    mulMat(jPosToPix, 2, 3, jCposToPix, 2, 3, rmat, 3, 3);
+                }
+                else {
+                    memcpy(jPosToPix, jCposToPix, sizeof(SP_REAL) * 2 * 3);
+                }
+
+                if (m_ocam[obs.cam] >= 0) {
+                    jacobCamToPix(&m_jc[o * 2 * 9], cam, npx);
+                }
+                if (obs.rig >= 0 && m_orig[obs.rig] >= 0) {
+                    SP_REAL jRigToPos[3 * 6];
+                    jacobPoseToPos(jRigToPos, m_rigs[obs.rig], pos);
+                    mulMat(&m_jr[o * 2 * 6], 2, 6, jCposToPix, 2, 3, jRigToPos, 3, 6);
+                }
+                if (m_pfix[obs.pose] == false) {
+                    SP_REAL jPoseToPos[3 * 6];
+                    jacobPoseToPos(jPoseToPos, pose, pnt);
+                    mulMat(&m_jp[o * 2 * 6], 2, 6, jPosToPix, 2, 3, jPoseToPos, 3, 6);
+                }
+                if (m_xfix[obs.pnt] == false) {
+                    SP_REAL rmat[3 * 3];
+                    getMat(rmat, 3, 3, pose.rot);
+                    mulMat(&m_jx[o * 2 * 3], 2, 3, jPosToPix, 2, 3, rmat, 3, 3);
+                }
+            });
+        }
+
+        // reduced blocks of observation (return: block number)
+        int getBlocks(const int o, int *offs, int *sizes, const SP_REAL **jacs) const {
+            const Obs &obs = m_obss[o];
+
+            int n = 0;
+            if (m_ocam[obs.cam] >= 0) {
+                offs[n] = m_ocam[obs.cam];
+                sizes[n] = 9;
+                jacs[n] = &m_jc[o * 2 * 9];
+                n++;
+            }
+            if (obs.rig >= 0 && m_orig[obs.rig] >= 0) {
+                offs[n] = m_orig[obs.rig];
+                sizes[n] = 6;
+                jacs[n] = &m_jr[o * 2 * 6];
+                n++;
+            }
+            if (m_opose[obs.pose] >= 0) {
+                offs[n] = m_opose[obs.pose];
+                sizes[n] = 6;
+                jacs[n] = &m_jp[o * 2 * 6];
+                n++;
+            }
+            return n;
+        }
+
+        const SP_REAL* getEJacob(const int o) const {
+            return (m_epnt == true) ? &m_jx[o * 2 * 3] : &m_jp[o * 2 * 6];
+        }
+
+        //--------------------------------------------------------------------------------
+        // normal equation
+        //--------------------------------------------------------------------------------
+
+        // U: reduced hessian, V: eliminated hessian blocks, g: gradient
+        void build(Mem1<SP_REAL> &U, Mem1<SP_REAL> &gr, Mem1<SP_REAL> &V, Mem1<SP_REAL> &ge) const {
+            const int rs = m_rsize;
+            const int es = m_esize;
+
+            U.resize(rs * rs);
+            gr.resize(rs);
+            V.resize(m_enum * es * es);
+            ge.resize(m_enum * es);
+            U.zero();
+            gr.zero();
+            V.zero();
+            ge.zero();
+
+            // eliminated blocks
+            parallel_for(0, m_enum, [&](const int k) {
+                SP_REAL *pv = &V[k * es * es];
+                SP_REAL *pg = &ge[k * es];
+                for (int i = m_ebeg[k]; i < m_ebeg[k + 1]; i++) {
+                    const int o = m_elist[i];
+                    const SP_REAL *je = getEJacob(o);
+                    _bundle::addJtJ(pv, es, je, es, je, es, m_wgt[o]);
+                    _bundle::addJtE(pg, je, es, &m_res[o * 2], m_wgt[o]);
+                }
+            });
+
+            // reduced blocks
+            for (int o = 0; o < m_obss.size(); o++) {
+                int offs[3], sizes[3];
+                const SP_REAL *jacs[3];
+                const int n = getBlocks(o, offs, sizes, jacs);
+
+                for (int a = 0; a < n; a++) {
+                    for (int b = a; b < n; b++) {
+                        _bundle::addJtJ(&U[offs[a] * rs + offs[b]], rs, jacs[a], sizes[a], jacs[b], sizes[b], m_wgt[o]);
+                    }
+                    _bundle::addJtE(&gr[offs[a]], jacs[a], sizes[a], &m_res[o * 2], m_wgt[o]);
+                }
+            }
+        }
+
+        // W blocks of eliminated block k (reduced block offset, size, W: size x es)
+        int getWBlocks(const int k, Mem1<int> &offs, Mem1<int> &sizes, Mem1<SP_REAL> &W) const {
+            const int es = m_esize;
+            const int BSTEP = 9 * 6;
+
+            int num = 0;
+            for (int i = m_ebeg[k]; i < m_ebeg[k + 1]; i++) {
+                const int o = m_elist[i];
+
+                int toffs[3], tsizes[3];
+                const SP_REAL *jacs[3];
+                const int n = getBlocks(o, toffs, tsizes, jacs);
+
+                for (int a = 0; a < n; a++) {
+                    int id = -1;
+                    for (int b = 0; b < num; b++) {
+                        if (offs[b] == toffs[a]) {
+                            id = b;
+                            break;
+                        }
+                    }
+                    if (id < 0) {
+                        id = num++;
+                        if (offs.size() < num) {
+                            offs.extend();
+                            sizes.extend();
+                            W.extend(BSTEP);
+                        }
+                        offs[id] = toffs[a];
+                        sizes[id] = tsizes[a];
+                        for (int j = 0; j < BSTEP; j++) {
+                            W[id * BSTEP + j] = 0.0;
+                        }
+                    }
+                    _bundle::addJtJ(&W[id * BSTEP], es, jacs[a], tsizes[a], getEJacob(o), es, m_wgt[o]);
+                }
+            }
+            return num;
+        }
+
+        // damped inverse of eliminated block
+        bool invV(SP_REAL *dst, const SP_REAL *V, const double lambda) const {
+            const int es = m_esize;
+
+            SP_REAL mat[6 * 6];
+            SP_REAL buf[6 * 6];
+            for (int i = 0; i < es * es; i++) {
+                mat[i] = V[i];
+            }
+            for (int i = 0; i < es; i++) {
+                mat[i * es + i] += static_cast<SP_REAL>(lambda * V[i * es + i] + SP_SMALL);
+            }
+            return (es == 3) ? invMat33(dst, mat) : invMat(dst, mat, es, es, buf);
+        }
+
+        bool solve(Mem1<SP_REAL> &dr, Mem1<SP_REAL> &de, const Mem1<SP_REAL> &U, const Mem1<SP_REAL> &gr, const Mem1<SP_REAL> &V, const Mem1<SP_REAL> &ge, const double lambda) const {
+            const int rs = m_rsize;
+            const int es = m_esize;
+            const int BSTEP = 9 * 6;
+
+            // schur complement (S = U - W * V^-1 * W^T)
+            Mem1<SP_REAL> S(rs * rs);
+            Mem1<SP_REAL> b(rs);
+            for (int r = 0; r < rs; r++) {
+                for (int c = r; c < rs; c++) {
+                    S[r * rs + c] = U[r * rs + c];
+                }
+                S[r * rs + r] += static_cast<SP_REAL>(lambda * U[r * rs + r] + SP_SMALL);
+                b[r] = gr[r];
+            }
+
+            Mem1<SP_REAL> Vinvs(m_enum * es * es);
+
+            Mem1<int> offs, sizes;
+            Mem1<SP_REAL> W, T;
+            for (int k = 0; k < m_enum; k++) {
+                SP_REAL *Vinv = &Vinvs[k * es * es];
+                if (m_ebeg[k] == m_ebeg[k + 1]) continue;
+                if (invV(Vinv, &V[k * es * es], lambda) == false) return false;
+
+                const int num = getWBlocks(k, offs, sizes, W);
+                T.resize(num * BSTEP);
+
+                // T = W * V^-1
+                for (int a = 0; a < num; a++) {
+                    mulMat(&T[a * BSTEP], sizes[a], es, &W[a * BSTEP], sizes[a], es, Vinv, es, es);
+                }
+
+                for (int a = 0; a < num; a++) {
+                    const SP_REAL *pt = &T[a * BSTEP];
+                    for (int c = 0; c < num; c++) {
+                        if (offs[c] < offs[a]) continue;
+
+                        const SP_REAL *pw = &W[c * BSTEP];
+                        for (int i = 0; i < sizes[a]; i++) {
+                            SP_REAL *ps = &S[(offs[a] + i) * rs + offs[c]];
+                            for (int j = 0; j < sizes[c]; j++) {
+                                double s = 0.0;
+                                for (int e = 0; e < es; e++) {
+                                    s += pt[i * es + e] * pw[j * es + e];
+                                }
+                                ps[j] -= static_cast<SP_REAL>(s);
+                            }
+                        }
+                    }
+                    for (int i = 0; i < sizes[a]; i++) {
+                        double s = 0.0;
+                        for (int e = 0; e < es; e++) {
+                            s += pt[i * es + e] * ge[k * es + e];
+                        }
+                        b[offs[a] + i] -= static_cast<SP_REAL>(s);
+                    }
+                }
+            }
+
+            // fill
+            for (int r = 0; r < rs; r++) {
+                for (int c = r + 1; c < rs; c++) {
+                    S[c * rs + r] = S[r * rs + c];
+                }
+            }
+
+            dr.resize(rs);
+            if (rs > 0 && _bundle::solveChol(dr.ptr, S.ptr, b.ptr, rs) == false) return false;
+
+            // back substitution (de = V^-1 * (ge - W^T * dr))
+            de.resize(m_enum * es);
+            de.zero();
+            for (int k = 0; k < m_enum; k++) {
+                if (m_ebeg[k] == m_ebeg[k + 1]) continue;
+
+                const int num = getWBlocks(k, offs, sizes, W);
+
+                double v[6];
+                for (int e = 0; e < es; e++) {
+                    v[e] = ge[k * es + e];
+                }
+                for (int a = 0; a < num; a++) {
+                    const SP_REAL *pw = &W[a * BSTEP];
+                    for (int i = 0; i < sizes[a]; i++) {
+                        for (int e = 0; e < es; e++) {
+                            v[e] -= pw[i * es + e] * dr[offs[a] + i];
+                        }
+                    }
+                }
+
+                const SP_REAL *Vinv = &Vinvs[k * es * es];
+                for (int r = 0; r < es; r++) {
+                    double s = 0.0;
+                    for (int c = 0; c < es; c++) {
+                        s += Vinv[r * es + c] * v[c];
+                    }
+                    de[k * es + r] = static_cast<SP_REAL>(s);
+                }
+            }
+            return true;
+        }
+
+        void apply(Mem1<CamParam> &cams, Mem1<Pose> &rigs, Mem1<Pose> &poses, Mem1<Vec3> &pnts, const Mem1<SP_REAL> &dr, const Mem1<SP_REAL> &de) const {
+            for (int i = 0; i < cams.size(); i++) {
+                if (m_ocam[i] >= 0) cams[i] = updateCam(cams[i], &dr[m_ocam[i]]);
+            }
+            for (int i = 0; i < rigs.size(); i++) {
+                if (m_orig[i] >= 0) rigs[i] = updatePose(rigs[i], &dr[m_orig[i]]);
+            }
+            for (int i = 0; i < poses.size(); i++) {
+                if (m_opose[i] >= 0) poses[i] = updatePose(poses[i], &dr[m_opose[i]]);
+                if (m_epnt == false && m_pfix[i] == false) poses[i] = updatePose(poses[i], &de[i * 6]);
+            }
+            for (int i = 0; i < pnts.size(); i++) {
+                if (m_epnt == true && m_xfix[i] == false) pnts[i] += getVec3(de[i * 3 + 0], de[i * 3 + 1], de[i * 3 + 2]);
+            }
+        }
+
+    };
+
+}
+
+#endif
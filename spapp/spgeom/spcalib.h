@@ -6,6 +6,7 @@
 #define __SP_CALIBRATION_H__
 
 #include "spcore/spcore.h"
+#include "spapp/spgeom/spbundle.h"
 
 
 namespace sp{
@@ -85,72 +86,30 @@ namespace sp{
                 vobjs.push(objs[i]);
             }
 
+            if (vposes.size() == 0) return -1.0;
 
-            int pmax = 0;
-            for (int i = 0; i < vposes.size(); i++){
-                pmax += vpixs[i].size();
-            }
-
-            SP_REAL ret = -1.0;
-
-            // gauss-newton
-            for (int it = 0; it < maxit; it++){
-                Mat J(pmax * 2, 9 + 6 * vposes.size());
-                J.zero();
-
-                Mat E(pmax * 2, 1);
-                Mem1<SP_REAL> errs(pmax);
-
-                int cnt = 0;
-                for (int i = 0; i < vposes.size(); i++){
-
-                    const Pose &pose = vposes[i];
+            // bundle adjustment (board points are fixed, board poses are eliminated)
+            BundleAdjust ba;
+            ba.setKernel(BundleAdjust::KERNEL_HUBER, 2.0);
 
-                    Mat jCamToPix(2, 9);
-                    Mat jPoseToPix(2, 6);
-
-                    const Mem1<Vec2> &tpixs = vpixs[i];
-                    const Mem1<Vec2> &tobjs = vobjs[i];
-                    for (int p = 0; p < tpixs.size(); p++){
-                        const Vec2 pix = tpixs[p];
-                        const Vec3 obj = getVec3(tobjs[p].x, tobjs[p].y, 0.0);
-
-                        jacobCamToPix(jCamToPix.ptr, cam, prjVec(pose * obj));
-                        jacobPoseToPix(jPoseToPix.ptr, cam, pose, obj);
-
-                        for (int r = 0; r < 2; r++){
-                            for (int c = 0; c < 9; c++){
-                                J(cnt * 2 + r, c) = jCamToPix(r, c);
-                            }
-                            for (int c = 0; c < 6; c++){
-                                J(cnt * 2 + r, c + 9 + i * 6) = jPoseToPix(r, c);
-                            }
-                        }
-
-                        const Vec2 err = pix - mulCamD(cam, prjVec(pose * obj));
-                        E(cnt * 2 + 0, 0) = err.x;
-                        E(cnt * 2 + 1, 0) = err.y;
+            const int c = ba.addCam(cam);
+            for (int i = 0; i < vposes.size(); i++){
+                const int p = ba.addPose(vposes[i]);
 
-                        errs[cnt] = normVec(err);
-                        cnt++;
-                    }
+                const Mem1<Vec2> &tpixs = vpixs[i];
+                const Mem1<Vec2> &tobjs = vobjs[i];
+                for (int j = 0; j < tpixs.size(); j++){
+                    const int x = ba.addPnt(getVec3(tobjs[j].x, tobjs[j].y, 0.0), true);
+                    ba.addObs(c, -1, p, x, tpixs[j]);
                 }
+            }
 
-                Mat delta;
-                if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return ret;
-
-                cam = updateCam(cam, &delta[0]);
+            const SP_REAL rms = ba.execute(maxit);
+            if (rms < 0.0) return rms;
 
-                for (int n = 0; n < vposes.size(); n++){
-                    vposes[n] = updatePose(vposes[n], &delta[9 + n * 6]);
-                }
-
-                const SP_REAL rms = sqrt(sqmean(errs));
-                SP_PRINTD("i:%02d [mean: %9.6lf], [median: %9.6lf], [rms: %9.6lf]\n", it, mean(errs), median(errs), rms);
-                ret = rms;
-            }
+            cam = ba.getCam(c);
 
-            return ret;
+            return rms;
         }
 
 
@@ -214,7 +173,7 @@ namespace sp{
                     const Pose pose0 = vposes[i];
                     const Pose pose1 = stereo * vposes[i];
 
-                    const Mat sR = getMat(stereo.rot);
+                    const MatN<3, 3> sR = getMatN(stereo.rot);
 
                     for (int p = 0; p < vobjs[i].size(); p++){
                         const Vec3 obj = getVec3(vobjs[i][p].x, vobjs[i][p].y, 0.0);
@@ -241,7 +200,7 @@ namespace sp{
                         E(p * 4 + 3, 0) = err1.y;
                     }
 
-                    Mat delta;
+                    MatN<6, 1> delta;
                     if (solver::solveAX_B(delta, J, E) == false) return false;
 
                     vposes[i] = updatePose(vposes[i], delta.ptr);
@@ -279,7 +238,7 @@ namespace sp{
                         }
                     }
 
-                    Mat delta;
+                    MatN<6, 1> delta;
                     if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return rms;
 
                     stereo = updatePose(stereo, delta.ptr);
@@ -415,154 +374,35 @@ namespace sp{
                 }
             }
 
-            int pmax = 0;
-            for (int i = 0; i < vposes.size(); i++) {
-                for (int j = 0; j < vpixs[i].size(); j++) {
-                    pmax += vpixs[i][j].size();
-                }
-            }
+            if (vposes.size() == 0) return -1.0;
 
-            SP_REAL rms = -1.0;
+            // bundle adjustment (camera rig poses, poses[0] is the base)
+            BundleAdjust ba;
+            ba.setKernel(BundleAdjust::KERNEL_HUBER, 2.0);
 
-            // gauss-newton
-            for (int it = 0; it < maxit; it++) {
-                // refine vpose
-                for (int i = 0; i < vposes.size(); i++) {
-                    int cnt = 0;
-                    for (int j = 0; j < cnum; j++) {
-                        cnt += vpixs[i][j].size();
-                    }
-
-                    Mat J(2 * cnt, 6);
-                    Mat E(2 * cnt, 1);
-                    Mem1<SP_REAL> errs(cnt);
-
-                    Mem1<Pose> rposes;
-                    Mem1<Mat> Rs;
-                    for (int j = 0; j < cnum; j++) {
-                        Pose pose = poses[j] * vposes[i];
-                        rposes.push(pose);
-                        Rs.push(getMat(poses[j].rot));
-                    }
-
-                    cnt = 0;
-                    for (int j = 0; j < cnum; j++) {
-                        for (int k = 0; k < vpixs[i][j].size(); k++) {
-                            const Vec2 pix = vpixs[i][j][k];
-                            const Vec3 obj = getVec3(vobjs[i][j][k].x, vobjs[i][j][k].y, 0.0);
-
-                            SP_REAL tmp[3 * 6] = { 0 };
-                            jacobPoseToPos(tmp, vposes[i], obj);
-
-                            SP_REAL jPoseToPos[3 * 6] = { 0 };
-                            mulMat(jPoseToPos, 3, 6, Rs[j].ptr, 3, 3, tmp, 3, 6);
-
-                            SP_REAL jPosToPix[2 * 3] = { 0 };
-                            jacobPosToPix(jPosToPix, cams[j], rposes[j] * obj);
-
-                            mulMat(&J(cnt * 2 + 0, 0), 2, 6, jPosToPix, 2, 3, jPoseToPos, 3, 6);
-
-                            const Vec2 prj = mulCamD(cams[j], prjVec(rposes[j] * obj));
-                            const Vec2 err = pix - prj;
-
-                            E(cnt * 2 + 0, 0) = err.x;
-                            E(cnt * 2 + 1, 0) = err.y;
-                            errs[cnt] = normVec(err);
-                            cnt++;
-                        }
-                    }
-
-                    Mat delta;
-                    if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return false;
-
-                    delta *= 0.5;
-                    vposes[i] = updatePose(vposes[i], delta.ptr);
-                }
-
-                // refine multi cam
-                for (int i = 0; i < cnum; i++) {
-                    int cnt = 0;
-                    for (int j = 0; j < vposes.size(); j++) {
-                        cnt += vpixs[j][i].size();
-                    }
-#if 0
-                    {
-                        Mat J(cnt * 2, 9);
-                        Mat E(cnt * 2, 1);
-                        Mem1<SP_REAL> errs(cnt);
-
-                        cnt = 0;
-                        for (int j = 0; j < vposes.size(); j++) {
-                            for (int k = 0; k < vpixs[j][i].size(); k++) {
-                                const Vec2 pix = vpixs[j][i][k];
-                                const Vec3 obj = getVec3(vobjs[j][i][k], 0.0);
-
-                                const Pose pose = poses[i] * vposes[j];
-
-                                jacobCamToPix(&J(cnt * 2 + 0, 0), cams[i], prjVec(pose * obj));
-
-                                const Vec2 err = pix - mulCamD(cams[i], prjVec(pose * obj));
-                                E(cnt * 2 + 0, 0) = err.x;
-                                E(cnt * 2 + 1, 0) = err.y;
-
-                                errs[cnt] = normVec(err);
-                                cnt++;
-                            }
-                        }
-
-                        Mat delta;
-                        if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return -1.0;
-                        cams[i] = updateCam(cams[i], &delta[0]);
-                    }
-#endif
-
-                    {
-                        Mat J(cnt * 2, 6);
-                        Mat E(cnt * 2, 1);
-                        Mem1<SP_REAL> errs(cnt);
-                        cnt = 0;
-                        for (int j = 0; j < vposes.size(); j++) {
-                            for (int k = 0; k < vpixs[j][i].size(); k++) {
-                                const Vec2 pix = vpixs[j][i][k];
-                                const Vec3 obj = getVec3(vobjs[j][i][k].x, vobjs[j][i][k].y, 0.0);
-
-                                const Pose pose = poses[i] * vposes[j];
-
-                                jacobPoseToPix(&J(cnt * 2 + 0, 0), cams[i], pose, obj);
-
-                                const Vec2 err = pix - mulCamD(cams[i], prjVec(pose * obj));
-                                E(cnt * 2 + 0, 0) = err.x;
-                                E(cnt * 2 + 1, 0) = err.y;
-
-                                errs[cnt] = normVec(err);
-                                cnt++;
-                            }
-                        }
+            for (int j = 0; j < cnum; j++) {
+                ba.addCam(cams[j], true);
+                ba.addRig(poses[j], (j == 0) ? true : false);
+            }
 
-                        Mat delta;
-                        if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return -1.0;
+            for (int i = 0; i < vposes.size(); i++) {
+                const int p = ba.addPose(vposes[i]);
 
-                        delta *= 0.5;
-                        poses[i] = updatePose(poses[i], &delta[0]);
+                for (int j = 0; j < cnum; j++) {
+                    for (int k = 0; k < vpixs[i][j].size(); k++) {
+                        const int x = ba.addPnt(getVec3(vobjs[i][j][k].x, vobjs[i][j][k].y, 0.0), true);
+                        ba.addObs(j, j, p, x, vpixs[i][j][k]);
                     }
                 }
-                {
-                    Pose base = poses[0];
-                    for (int i = 0; i < cnum; i++) {
-                        poses[i] = poses[i] * invPose(base);
-                    }
+            }
 
-                }
-                {
-                    Mem1<SP_REAL> errs;
-                    for (int i = 0; i < vposes.size(); i++) {
-                        for (int j = 0; j < cnum; j++) {
-                            errs.push(calcPrjErr(poses[j] * vposes[i], cams[j], vpixs[i][j], getVec3(vobjs[i][j], 0.0)));
-                        }
-                    }
+            const SP_REAL rms = ba.execute(maxit);
+            if (rms < 0.0) return rms;
 
-                    rms = sqrt(sqmean(errs));
-                    SP_PRINTD("i:%02d [mean: %9.6lf], [median: %9.6lf], [rms: %9.6lf]\n", it, mean(errs), median(errs), rms);
+            {
+                const Pose base = ba.getRig(0);
+                for (int j = 0; j < cnum; j++) {
+                    poses[j] = ba.getRig(j) * invPose(base);
                 }
             }
 
@@ -678,20 +518,20 @@ namespace sp{
                     const Mem1<Vec2> &tpixs = pixs[i];
                     const Mem1<Vec2> &tobjs = objs[i];
 
-                    Mat J0(2, 6);
-                    Mat J1(2, 6);
+                    MatN<2, 6> J0;
+                    MatN<2, 6> J1;
                     for (int j = 0; j < tobjs.size(); j++) {
                         {
                             jacobPoseToPix(J0.ptr, cam, X, (iB * iZ) * tobjs[j]);
                         }
                         {
-                            Mat J1_6D3D(3, 6);
+                            MatN<3, 6> J1_6D3D;
                             jacobPoseToPos(J1_6D3D.ptr, iZ, getVec3(tobjs[j].x, tobjs[j].y, 0.0));
 
-                            Mat J1_3D2D(2, 3);
+                            MatN<2, 3> J1_3D2D;
                             jacobPosToPix(J1_3D2D.ptr, cam, iZ * tobjs[j]);
 
-                            J1 = J1_3D2D * getMat((X * iB).rot) * J1_6D3D;
+                            J1 = J1_3D2D * getMatN((X * iB).rot) * J1_6D3D;
                         }
 
                         for (int p = 0; p < 6; p++) {
@@ -711,7 +551,7 @@ namespace sp{
                     }
                 }
 
-                Mat delta;
+                MatN<12, 1> delta;
                 if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return false;
 
                 X = updatePose(X, &delta[0]);
@@ -67,14 +67,13 @@ namespace sp {
         Mat E(poses.size() * 2, 1);
         Mem1<SP_REAL> errs(poses.size());
 
-        Mat jacob(2, 3);
+        MatN<2, 3> jacob;
         for (int it = 0; it < maxit; it++) {
             for (int i = 0; i < poses.size(); i++) {
                 const Vec3 pos = poses[i] * pnt;
 
                 jacobPosToNpx(jacob.ptr, pos);
-                const Mat R = getMat(poses[i].rot);
-                jacob = jacob * R;
+                jacob = jacob * getMatN(poses[i].rot);
                 memcpy(&J(i * 2, 0), jacob.ptr, jacob.size() * sizeof(SP_REAL));
 
                 const Vec2 err = npxs[i] - prjVec(pos);
@@ -83,7 +82,7 @@ namespace sp {
                 errs[i] = normVec(err);
             }
 
-            Mat result;
+            MatN<3, 1> result;
             if (solver::solveAX_B(result, J, E, solver::calcW(errs, 2)) == false) return false;
 
             pnt += getVec3(result[0], result[1], result[2]);
@@ -116,7 +115,7 @@ namespace sp {
         for (int i = 0; i < poses.size(); i++) {
             const Vec2 &npx = npxs[i];
 
-            const Mat R = getMat(poses[i].rot);
+            const MatN<3, 3> R = getMatN(poses[i].rot);
             const Vec3 &trn = poses[i].pos;
 
             M(i * 2 + 0, 0) = R(0, 0) - npx.x * R(2, 0);
@@ -131,7 +130,7 @@ namespace sp {
             V(i * 2 + 1, 0) = npx.y * trn.z - trn.y;
         }
 
-        Mat result;
+        MatN<3, 1> result;
         if (solver::solveAX_B(result, M, V) == false) return false;
 
         pnt = getVec3(result[0], result[1], result[2]);
@@ -197,9 +196,9 @@ namespace sp {
         const Vec2 &npx0 = invCamD(cam0, pix0);
 
         const Pose stereo = pose1 * invPose(pose0);
-        const Mat mat = getMat(stereo);
+        const MatN<3, 4> mat = getMatN(stereo);
 
-        const Mat E = skewMat(stereo.pos) * getMat(stereo.rot);
+        const MatN<3, 3> E = skewMatN(stereo.pos) * getMatN(stereo.rot);
 
         const Vec3 epi = E * getVec3(npx0.x, npx0.y, 1.0);
         const Vec2 npx1 = npxUndistX(cam1, epi, (pix1x - cam1.cx) / cam1.fx);
@@ -221,9 +220,9 @@ namespace sp {
         const Vec2 &npx0 = invCamD(cam0, pix0);
 
         const Pose stereo = pose1 * invPose(pose0);
-        const Mat mat = getMat(stereo);
+        const MatN<3, 4> mat = getMatN(stereo);
 
-        const Mat E = skewMat(stereo.pos) * getMat(stereo.rot);
+        const MatN<3, 3> E = skewMatN(stereo.pos) * getMatN(stereo.rot);
 
         const Vec3 epi = E * getVec3(npx0.x, npx0.y, 1.0);
         const Vec2 npx1 = npxUndistY(cam1, epi, (pix1y - cam1.cy) / cam1.fy);
@@ -331,7 +330,7 @@ namespace sp {
                 errs[i] = normVec(err);
             }
 
-            Mat delta;
+            MatN<6, 1> delta;
             if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 3)) == false) return false;
 
             pose = updatePose(pose, delta.ptr);
@@ -363,7 +362,7 @@ namespace sp {
                 errs[i] = normVec(err);
             }
 
-            Mat delta;
+            MatN<6, 1> delta;
             if (solver::solveAX_B(delta, J, E, solver::calcW(errs, 2)) == false) return false;
 
             pose = updatePose(pose, delta.ptr);
@@ -702,35 +701,13 @@ namespace sp {
             return calcPnt3d(pos, poses, cams, pixs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
+        const SP_REAL maxe = ransac(pos, num, unit, [&](Mem1<Vec3> &tests, const int *index) -> bool {
+            tests.resize(1);
+            return calcPnt3d(tests[0], ransacPick(poses, index, unit), ransacPick(cams, index, unit), ransacPick(pixs, index, unit));
+        }, [&](const Vec3 &test, const int i) {
+            return calcPrjErr(poses[i], cams[i], pixs[i], test);
+        }, thresh);
 
-        RandomSample<Pose> _poses(poses, unit);
-        RandomSample<CamParam> _cams(cams, unit);
-        RandomSample<Vec2> _pixs(pixs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Pose> rposes = _poses.gen(it);
-            const Mem1<CamParam> rcams = _cams.gen(it);
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-
-            Vec3 test;
-            if (calcPnt3d(test, rposes, rcams, rpixs) == false) continue;
-
-            const Mem1<SP_REAL> errs = calcPrjErr(poses, cams, pixs, test);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
-
-                pos = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -746,7 +723,7 @@ namespace sp {
     }
 
     // 3D-3D pose
-    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const Mem1<Vec3> &objs0, const Mem1<Vec3> &objs1, const SP_REAL thresh = 10.0) {
+    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const Mem1<Vec3> &objs0, const Mem1<Vec3> &objs1, const SP_REAL thresh = 10.0, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(objs0.size() == objs1.size());
       
         const int num = objs0.size();
@@ -757,36 +734,13 @@ namespace sp {
             return calcPose(pose, objs0, objs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec3> _objs0(objs0, unit);
-        RandomSample<Vec3> _objs1(objs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
+        const SP_REAL maxe = ransac(pose, num, unit, [&](Mem1<Pose> &tests, const int *index) -> bool {
+            tests.resize(1);
+            return calcPose(tests[0], ransacPick(objs0, index, unit), ransacPick(objs1, index, unit), 1);
+        }, [&](const Pose &test, const int i) {
+            return normVec(objs0[i] - test * objs1[i]);
+        }, thresh, quals);
 
-            const Mem1<Vec3> robjs0 = _objs0.gen(it);
-            const Mem1<Vec3> robjs1 = _objs1.gen(it);
-
-            Pose test;
-            if (calcPose(test, robjs0, robjs1, 1) == false) continue;
-
-            Mem1<SP_REAL> errs;
-            for (int i = 0; i < num; i++) {
-                errs.push(normVec(objs0[i] - test * objs1[i]));
-            }
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
-
-                pose = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -805,7 +759,7 @@ namespace sp {
     }
 
     // 2D-3D pose
-    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam, const Mem1<Vec2> &pixs, const Mem1<Vec3> &objs, const SP_REAL thresh = 4.0) {
+    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam, const Mem1<Vec2> &pixs, const Mem1<Vec3> &objs, const SP_REAL thresh = 4.0, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(pixs.size() == objs.size());
       
         const int num = pixs.size();
@@ -816,35 +770,12 @@ namespace sp {
             return calcPose(pose, cam, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec3> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec3> robjs = _objs.gen(it);
-
-            Mem1<Pose> tests;
-            if (calcPoseP3P(tests, cam, rpixs, robjs) == false) continue;
-
-            for (int i = 0; i < tests.size(); i++) {
+        const SP_REAL maxe = ransac(pose, num, unit, [&](Mem1<Pose> &tests, const int *index) -> bool {
+            return calcPoseP3P(tests, cam, ransacPick(pixs, index, unit), ransacPick(objs, index, unit));
+        }, [&](const Pose &test, const int i) {
+            return calcPrjErr(test, cam, pixs[i], objs[i]);
+        }, thresh, quals);
 
-                const Mem1<SP_REAL> errs = calcPrjErr(tests[i], cam, pixs, objs);
-                const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-                if (eval > maxe) {
-                    //SP_PRINTD("eval %lf\n", eval);
-                    maxe = eval;
-                    maxit = ransacAdaptiveStop(eval, unit);
-
-                    pose = tests[i];
-                }
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -860,7 +791,7 @@ namespace sp {
     }
 
     // 2D-2D pose (planar object)
-    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam, const Mem1<Vec2> &pixs, const Mem1<Vec2> &objs, const SP_REAL thresh = 4.0) {
+    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam, const Mem1<Vec2> &pixs, const Mem1<Vec2> &objs, const SP_REAL thresh = 4.0, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(pixs.size() == objs.size());
 
         const int num = pixs.size();
@@ -871,33 +802,13 @@ namespace sp {
             return calcPose(pose, cam, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
+        const SP_REAL maxe = ransac(pose, num, unit, [&](Mem1<Pose> &tests, const int *index) -> bool {
+            tests.resize(1);
+            return calcPose(tests[0], cam, ransacPick(pixs, index, unit), ransacPick(objs, index, unit), 1);
+        }, [&](const Pose &test, const int i) {
+            return calcPrjErr(test, cam, pixs[i], objs[i]);
+        }, thresh, quals);
 
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec2> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec2> robjs = _objs.gen(it);
-
-            Pose test;
-            if (calcPose(test, cam, rpixs, robjs, 1) == false) continue;
-
-            const Mem1<SP_REAL> errs = calcPrjErr(test, cam, pixs, getVec3(objs, 0.0));
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
-
-                pose = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -913,7 +824,7 @@ namespace sp {
     }
 
     // 2D-2D pose (stereo camera)
-    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam0, const Mem1<Vec2> &pixs0, const CamParam &cam1, const Mem1<Vec2> &pixs1, const SP_REAL thresh = 2.0) {
+    SP_CPUFUNC bool calcPoseRANSAC(Pose &pose, const CamParam &cam0, const Mem1<Vec2> &pixs0, const CamParam &cam1, const Mem1<Vec2> &pixs1, const SP_REAL thresh = 2.0, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(pixs0.size() == pixs1.size());
 
         const Mem1<Vec2> npxs0 = invCamD(cam0, pixs0);
@@ -922,7 +833,7 @@ namespace sp {
         const double nth = thresh / ((cam0.fx + cam0.fy + cam1.fx + cam1.fy) / 4.0);
 
         Mat E;
-        if (calcEMatRANSAC(E, npxs0, npxs1, nth) == false) return false;
+        if (calcEMatRANSAC(E, npxs0, npxs1, nth, quals) == false) return false;
         const Mem1<SP_REAL> errs = errMatType2(E, npxs0, npxs1);
 
         const Mem1<Vec2> dnpxs0 = filter(npxs0, errs, nth * 2);
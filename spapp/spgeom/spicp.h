@@ -6,6 +6,7 @@
 #define __SP_ICP_H__
 
 #include "spcore/spcore.h"
+#include "spapp/spalgo/spkdtree.h"
 
 namespace sp{
 
@@ -72,35 +73,6 @@ namespace sp{
         }
 
 
-        template <typename TYEP0, typename TYEP1>
-        SP_CPUFUNC void crsp(Mem1<TYEP0> &cpnts0, Mem1<TYEP1> &cpnts1, const Pose &pose, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1) {
-            cpnts0.clear();
-            cpnts1.clear();
-
-            cpnts0.reserve(pnts1.size());
-            cpnts1.reserve(pnts1.size());
-
-            for (int i = 0; i < pnts1.size(); i++){
-                const TYEP1 vec = pose * pnts1[i];
-
-                int c = -1;
-                SP_REAL minNorm = SP_INFINITY;
-                for (int j = 0; j < pnts0.size(); j++){
-                    if (checkOutlier(pnts0[j], vec) == false) continue;
-
-                    const SP_REAL norm = normVec(getPos(pnts0[j]) - getPos(vec));
-                    if (norm < minNorm){
-                        minNorm = norm;
-                        c = j;
-                    }
-                }
-                if (c < 0) continue;
-
-                cpnts0.push(pnts0[c]);
-                cpnts1.push(pnts1[i]);
-            }
-        }
-
         template <typename TYEP0, typename TYEP1>
         SP_CPUFUNC void crsp(Mem1<TYEP0> &cpnts0, Mem1<TYEP1> &cpnts1, const Pose &pose, const CamParam &cam, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1){
             cpnts0.clear();
@@ -155,7 +127,7 @@ namespace sp{
                 errs[i] = fabs(E(i, 0));
             }
 
-            Mat delta;
+            MatN<6, 1> delta;
             const bool ret = solver::solveAX_B(delta, J, E, solver::calcW(errs));
             if (ret == true) {
                 pose = updatePose(mpose, delta.ptr) * getPose(-mvec);
@@ -164,23 +136,321 @@ namespace sp{
         }
     }
 
+    //--------------------------------------------------------------------------------
+    // icp engine (model points are indexed by kd tree)
+    //--------------------------------------------------------------------------------
+    //
+    // correspondences are searched in parallel, the weighted normal equations are
+    // accumulated per thread and reduced, and pnts1 is subsampled coarse to fine
+    //
+
+    template<typename TYPE0>
+    class ICP {
+
+    public:
+
+        // per iteration log
+        struct Log {
+            // schedule level / subsampling step
+            int level;
+            int step;
+
+            // correspondence num
+            int crsp;
+
+            // rms of point to plane (or point) error
+            SP_REAL err;
+
+            // [ms]
+            double crspTime;
+            double solveTime;
+        };
+
+    private:
+
+        // model points
+        Mem1<TYPE0> m_pnts0;
+
+        // model position
+        Mem1<Vec3> m_pos0;
+
+        KdTree<SP_REAL> m_kdtree;
+
+        // subsampling step of each level (coarse to fine)
+        Mem1<int> m_steps;
+
+        // iteration num of each level
+        int m_maxit;
+
+        // max correspondence distance
+        SP_REAL m_maxDist;
+
+        Mem1<Log> m_logs;
+
+        // normal equations (AtA, AtB)
+        struct NormEq {
+            SP_REAL AtA[6 * 6];
+            SP_REAL AtB[6];
+        };
+
+    public:
+
+        ICP() {
+            m_steps.push(1);
+            m_maxit = 10;
+            m_maxDist = SP_INFINITY;
+        }
+
+        //--------------------------------------------------------------------------------
+        // parameter
+        //--------------------------------------------------------------------------------
+
+        void setModel(const Mem<TYPE0> &pnts0) {
+            SP_ASSERT(pnts0.dim == 1);
+
+            m_pnts0.resize(pnts0.size());
+            m_pos0.resize(pnts0.size());
+            for (int i = 0; i < pnts0.size(); i++) {
+                m_pnts0[i] = pnts0[i];
+                m_pos0[i] = _icp::getPos(pnts0[i]);
+            }
+
+            m_kdtree.init(3);
+            for (int i = 0; i < m_pos0.size(); i++) {
+                m_kdtree.addData(&m_pos0[i]);
+            }
+            m_kdtree.makeTree();
+        }
+
+        // subsampling steps (ex. { 16, 4, 1 })
+        void setSchedule(const Mem1<int> &steps) {
+            m_steps.clear();
+            for (int i = 0; i < steps.size(); i++) {
+                m_steps.push(max(1, steps[i]));
+            }
+            if (m_steps.size() == 0) {
+                m_steps.push(1);
+            }
+        }
+
+        // iteration num per level
+        void setMaxIt(const int maxit) {
+            m_maxit = maxit;
+        }
+
+        void setMaxDist(const SP_REAL maxDist) {
+            m_maxDist = maxDist;
+        }
+
+        const Mem1<Log>& getLogs() const {
+            return m_logs;
+        }
+
+        //--------------------------------------------------------------------------------
+        // execute (pnts0 <- pnts1 pose)
+        //--------------------------------------------------------------------------------
+
+        template<typename TYPE1>
+        bool execute(Pose &pose, const Mem<TYPE1> &pnts1) {
+            SP_ASSERT(pnts1.dim == 1);
+            m_logs.clear();
+
+            if (m_kdtree.size() == 0) return false;
+
+            for (int l = 0; l < m_steps.size(); l++) {
+                const int step = m_steps[l];
+
+                for (int it = 0; it < m_maxit; it++) {
+                    Log log;
+                    log.level = l;
+                    log.step = step;
+
+                    Mem1<int> crsps;
+                    {
+                        Timer timer;
+                        crsp(crsps, pose, pnts1, step);
+                        timer.stop();
+
+                        log.crsp = crsps.size() / 2;
+                        log.crspTime = timer.getms();
+                    }
+                    if (log.crsp < SP_ICP_MIN_CRSP) return false;
+
+                    {
+                        Timer timer;
+                        const bool ret = update(pose, log.err, crsps, pnts1);
+                        timer.stop();
+
+                        log.solveTime = timer.getms();
+                        if (ret == false) return false;
+                    }
+
+                    m_logs.push(log);
+                }
+            }
+
+            return true;
+        }
+
+    private:
+
+        // k nearest candidates (normal check)
+        static const int KNN = 8;
+
+        // crsps : (index0, index1) pairs
+        template<typename TYPE1>
+        void crsp(Mem1<int> &crsps, const Pose &pose, const Mem<TYPE1> &pnts1, const int step) const {
+            const int num = (pnts1.size() + step - 1) / step;
+
+            Mem1<int> idxs(num);
+
+            const bool check = isCheck(TYPE0(), TYPE1());
+            const SP_REAL maxDist2 = (m_maxDist < SP_INFINITY) ? m_maxDist * m_maxDist : SP_INFINITY;
+
+            parallel_for(0, num, [&](const int n) {
+                const int i = n * step;
+                const TYPE1 vec = pose * pnts1[i];
+                const Vec3 pos = _icp::getPos(vec);
+
+                int c = -1;
+                if (check == false) {
+                    c = m_kdtree.search(&pos);
+                }
+                else {
+                    const Mem1<int> list = m_kdtree.knn(&pos, KNN);
+                    for (int k = 0; k < list.size(); k++) {
+                        if (_icp::checkOutlier(m_pnts0[list[k]], vec) == true) {
+                            c = list[k];
+                            break;
+                        }
+                    }
+                }
+                if (c >= 0 && sqVec(m_pos0[c] - pos) > maxDist2) {
+                    c = -1;
+                }
+                idxs[n] = c;
+            }, 256);
+
+            crsps.clear();
+            crsps.reserve(2 * num);
+            for (int n = 0; n < num; n++) {
+                if (idxs[n] < 0) continue;
+                crsps.push(idxs[n]);
+                crsps.push(n * step);
+            }
+        }
+
+        // normals are compared only when both are VecPD3
+        template<typename T0, typename T1>
+        static bool isCheck(const T0 &, const T1 &) {
+            return false;
+        }
+
+        static bool isCheck(const VecPD3 &, const VecPD3 &) {
+            return true;
+        }
+
+        template<typename TYPE1>
+        bool update(Pose &pose, SP_REAL &rms, const Mem1<int> &crsps, const Mem<TYPE1> &pnts1) const {
+            const int num = crsps.size() / 2;
+
+            Vec3 mvec = getVec3(0.0, 0.0, 0.0);
+            for (int n = 0; n < num; n++) {
+                mvec += _icp::getPos(pnts1[crsps[n * 2 + 1]]);
+            }
+            mvec /= num;
+
+            const Pose mpose = pose * getPose(mvec);
+
+            // jacobian (6) + error (1)
+            Mem1<SP_REAL> JE(num * 7);
+            Mem1<SP_REAL> errs(num);
+
+            parallel_for(0, num, [&](const int n) {
+                const TYPE0 &pnt0 = m_pnts0[crsps[n * 2 + 0]];
+                const TYPE1 &pnt1 = pnts1[crsps[n * 2 + 1]];
+
+                const TYPE1 vec = pose * pnt1;
+
+                const Vec3 err = _icp::getPos(pnt0) - _icp::getPos(vec);
+                const Vec3 drc = _icp::getDrc(vec, pnt0);
+
+                SP_REAL jPoseToPos[3 * 6] = { 0 };
+                jacobPoseToPos(jPoseToPos, mpose, _icp::getPos(pnt1) - mvec);
+
+                SP_REAL jDrc[3] = { drc.x, drc.y, drc.z };
+                SP_REAL *je = &JE[n * 7];
+                mulMat(je, 1, 6, jDrc, 1, 3, jPoseToPos, 3, 6);
+
+                je[6] = dotVec(err, drc);
+                errs[n] = fabs(je[6]);
+            }, 1024);
+
+            // tukey weight (same as solver::calcW)
+            const double sigma = 1.4826 * median(errs);
+            const double thresh = max(3.0 * sigma, 0.1);
+
+            NormEq init;
+            memset(&init, 0, sizeof(NormEq));
+
+            const NormEq eq = parallel_reduce(0, num, init, [&](const int b, const int e, NormEq sum) {
+                for (int n = b; n < e; n++) {
+                    const SP_REAL *je = &JE[n * 7];
+                    const SP_REAL w = funcTukey(errs[n], thresh);
+                    if (w == 0.0) continue;
+
+                    for (int r = 0; r < 6; r++) {
+                        const SP_REAL a = je[r] * w;
+                        for (int c = r; c < 6; c++) {
+                            sum.AtA[r * 6 + c] += a * je[c];
+                        }
+                        sum.AtB[r] += a * je[6];
+                    }
+                }
+                return sum;
+            }, [](const NormEq &a, const NormEq &b) {
+                NormEq c;
+                for (int i = 0; i < 6 * 6; i++) c.AtA[i] = a.AtA[i] + b.AtA[i];
+                for (int i = 0; i < 6; i++) c.AtB[i] = a.AtB[i] + b.AtB[i];
+                return c;
+            }, 2048);
+
+            {
+                SP_REAL sum = 0.0;
+                for (int n = 0; n < num; n++) {
+                    sum += errs[n] * errs[n];
+                }
+                rms = sqrt(sum / num);
+            }
+
+            MatN<6, 6> AtA;
+            MatN<6, 1> AtB;
+            for (int r = 0; r < 6; r++) {
+                for (int c = 0; c < 6; c++) {
+                    AtA(r, c) = (c >= r) ? eq.AtA[r * 6 + c] : eq.AtA[c * 6 + r];
+                }
+                AtB(r, 0) = eq.AtB[r];
+            }
+
+            MatN<6, 1> delta;
+            if (solveMat(delta, AtA, AtB) == false) return false;
+
+            pose = updatePose(mpose, delta.ptr) * getPose(-mvec);
+            return true;
+        }
+    };
+
+
     // pnts0 <- pnts1 pose
     template<typename TYEP0, typename TYEP1>
     SP_CPUFUNC bool calcICP(Pose &pose, const Mem<TYEP0> &pnts0, const Mem<TYEP1> &pnts1, const int maxit = 10){
         SP_ASSERT(pnts0.dim == 1 && pnts1.dim == 1);
 
-        for (int it = 0; it < maxit; it++){
-            Mem1<TYEP0> cpnts0;
-            Mem1<TYEP1> cpnts1;    
-            
-            _icp::crsp(cpnts0, cpnts1, pose, pnts0, pnts1);
-            if (cpnts0.size() < SP_ICP_MIN_CRSP) return false;
-
-            if (_icp::update(pose, cpnts0, cpnts1) == false) return false;
-
-        }
+        ICP<TYEP0> icp;
+        icp.setModel(pnts0);
+        icp.setMaxIt(maxit);
 
-        return true;
+        return icp.execute(pose, pnts1);
     }
 
     // pnts0 <- pnts1 pose
@@ -0,0 +1,285 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_RANSAC_H__
+#define __SP_RANSAC_H__
+
+#include "spcore/spcore.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // ransac engine
+    //--------------------------------------------------------------------------------
+    //
+    // hypotheses are generated in batches and verified in parallel.
+    // the sample of hypothesis i depends only on (seed, i), and the batch results are
+    // merged in index order, so the result does not depend on the thread count.
+    //
+    // - PROSAC : with quality, samples are drawn from the top-n data (n grows by the PROSAC schedule)
+    // - SPRT   : the verification of a bad model stops when the likelihood ratio exceeds the threshold
+    // - bail out : the verification stops when the model can not beat the current best
+    //
+
+    // hypothesis number per batch
+#define SP_RANSAC_BATCH 8
+
+    namespace _ransac {
+
+        // SPRT threshold A (Matas & Chum, tm: model time / verification time, ms: models per sample)
+        SP_CPUFUNC double sprtThresh(const double eps, const double delta, const double tm = 200.0, const double ms = 1.0) {
+            const double C = (1.0 - delta) * log((1.0 - delta) / (1.0 - eps)) + delta * log(delta / eps);
+            const double a0 = tm * C / ms + 1.0;
+
+            double a = a0;
+            for (int i = 0; i < 10; i++) {
+                a = a0 + log(a);
+            }
+            return a;
+        }
+
+        // PROSAC growth function (top-n data used by sample t)
+        class ProsacSchedule {
+            int m_num;
+            int m_unit;
+
+            // current top-n
+            int m_n;
+
+            // T_n, T'_n
+            double m_tn;
+            int m_tdash;
+
+        public:
+            ProsacSchedule(const int num, const int unit) {
+                // samples after which PROSAC equals RANSAC
+                const double TN = 200000.0;
+
+                m_num = num;
+                m_unit = unit;
+                m_n = unit;
+
+                m_tn = TN;
+                for (int i = 0; i < unit; i++) {
+                    m_tn *= static_cast<double>(m_n - i) / (num - i);
+                }
+                m_tdash = 1;
+            }
+
+            int next(const int t) {
+                while (t > m_tdash && m_n < m_num) {
+                    m_n++;
+                    const double tn = m_tn * m_n / (m_n - m_unit);
+                    m_tdash += static_cast<int>(ceil(tn - m_tn));
+                    m_tn = tn;
+                }
+                return m_n;
+            }
+        };
+
+        struct Quality {
+            SP_REAL val;
+            int id;
+        };
+
+        SP_CPUFUNC int compare(const void *a, const void *b) {
+            const Quality &qa = *static_cast<const Quality*>(a);
+            const Quality &qb = *static_cast<const Quality*>(b);
+            if (qa.val != qb.val) return (qa.val > qb.val) ? -1 : +1;
+            return (qa.id < qb.id) ? -1 : (qa.id > qb.id) ? +1 : 0;
+        }
+
+        // unit distinct index from top-n (the n-th data is always used while n < num)
+        SP_CPUFUNC void sample(int *index, const int unit, const int n, const int num, const int *order, RandStream &rs) {
+            int cnt = 0;
+            if (n < num) {
+                index[cnt++] = order[n - 1];
+            }
+            const int range = (n < num) ? n - 1 : n;
+            while (cnt < unit) {
+                const int id = order[rand(rs) % range];
+
+                bool unique = true;
+                for (int i = 0; i < cnt; i++) {
+                    if (index[i] == id) {
+                        unique = false;
+                        break;
+                    }
+                }
+                if (unique == true) index[cnt++] = id;
+            }
+        }
+    }
+
+    // pick data[index[0 .. unit - 1]]
+    template<typename TYPE>
+    SP_CPUFUNC Mem1<TYPE> ransacPick(const Mem<TYPE> &data, const int *index, const int unit) {
+        Mem1<TYPE> dst(unit);
+        for (int i = 0; i < unit; i++) {
+            dst[i] = data[index[i]];
+        }
+        return dst;
+    }
+
+    // model : best model
+    // num   : data number
+    // unit  : data number per sample
+    // fit   : bool fit(Mem1<MODEL> &tests, const int *index) (models from data[index[0 .. unit - 1]])
+    // err   : SP_REAL err(const MODEL &test, const int i) (residual of data[i])
+    // qual  : match quality (higher is better, PROSAC ordering) or NULL
+    // return: inlier rate (same as ransacEval)
+    template<typename MODEL, typename FIT, typename ERR>
+    SP_CPUFUNC SP_REAL ransac(MODEL &model, const int num, const int unit, const FIT &fit, const ERR &err, const double thresh, const Mem<SP_REAL> *qual = NULL, const int seed = 0) {
+        if (num < unit || unit <= 0) return 0.0;
+
+        // sampling order (quality order for PROSAC)
+        Mem1<int> order(num);
+        {
+            if (qual != NULL) {
+                SP_ASSERT(qual->size() == num);
+
+                Mem1<_ransac::Quality> qs(num);
+                for (int i = 0; i < num; i++) {
+                    qs[i].val = (*qual)[i];
+                    qs[i].id = i;
+                }
+                sort(qs, _ransac::compare);
+                for (int i = 0; i < num; i++) {
+                    order[i] = qs[i].id;
+                }
+            }
+            else {
+                for (int i = 0; i < num; i++) {
+                    order[i] = i;
+                }
+            }
+        }
+
+        // verification order (random for SPRT)
+        const Mem1<int> vorder = shuffle(num, seed);
+
+        _ransac::ProsacSchedule prosac(num, unit);
+
+        // SPRT parameter
+        double eps = SP_RANSAC_MINEVAL;
+        double delta = 0.05;
+        double dsum = 0.0;
+        int dcnt = 0;
+
+        int maxc = unit;
+        SP_REAL maxe = 0.0;
+
+        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
+
+        const int BATCH = SP_RANSAC_BATCH;
+
+        Mem1<MODEL> bmodels(BATCH);
+        Mem1<int> bns(BATCH);
+        Mem1<int> bcnts(BATCH);
+        Mem1<int> brejs(BATCH);
+        Mem1<double> bdeltas(BATCH);
+
+        for (int it = 0; it < maxit; it += BATCH) {
+            const int bnum = min(BATCH, maxit - it);
+
+            for (int b = 0; b < bnum; b++) {
+                bns[b] = (qual != NULL) ? prosac.next(it + b + 1) : num;
+            }
+
+            // SPRT is used while a bad model is distinguishable from a good one
+            const double A = (delta < eps * 0.9) ? _ransac::sprtThresh(eps, delta) : SP_INFINITY;
+            const double rin = delta / eps;
+            const double rout = (1.0 - delta) / (1.0 - eps);
+
+            const int minc = maxc;
+
+            parallel_for(0, bnum, [&](const int b) {
+                bcnts[b] = -1;
+                brejs[b] = 0;
+                bdeltas[b] = 0.0;
+
+                RandStream rs = getRandStream(seed, it + b);
+
+                int index[32];
+                SP_ASSERT(unit <= 32);
+                _ransac::sample(index, unit, bns[b], num, order.ptr, rs);
+
+                Mem1<MODEL> tests;
+                if (fit(tests, index) == false) return;
+
+                for (int t = 0; t < tests.size(); t++) {
+                    double lambda = 1.0;
+                    bool reject = false;
+
+                    int cnt = 0;
+                    int j = 0;
+                    for (j = 0; j < num; j++) {
+                        if (err(tests[t], vorder[j]) < thresh) {
+                            cnt++;
+                            lambda *= rin;
+                        }
+                        else {
+                            lambda *= rout;
+                        }
+
+                        // SPRT
+                        if (lambda > A) {
+                            reject = true;
+                            break;
+                        }
+                        // bail out
+                        if (cnt + (num - j - 1) <= minc) {
+                            break;
+                        }
+                    }
+
+                    if (reject == true) {
+                        brejs[b]++;
+                        bdeltas[b] += static_cast<double>(cnt) / (j + 1);
+                        continue;
+                    }
+                    if (j == num && cnt > bcnts[b]) {
+                        bcnts[b] = cnt;
+                        bmodels[b] = tests[t];
+                    }
+                }
+            });
+
+            // merge in index order
+            for (int b = 0; b < bnum; b++) {
+                if (brejs[b] > 0) {
+                    dsum += bdeltas[b];
+                    dcnt += brejs[b];
+                }
+                if (bcnts[b] > maxc) {
+                    maxc = bcnts[b];
+                    maxe = static_cast<SP_REAL>(maxc - unit) / (num - unit);
+                    model = bmodels[b];
+
+                    eps = min(max(static_cast<double>(maxc) / num, SP_RANSAC_MINEVAL), 0.99);
+                    maxit = min(maxit, ransacAdaptiveStop(maxe, unit));
+                }
+            }
+
+            // PROSAC stop (inlier rate in the current top-n)
+            if (qual != NULL && maxe >= SP_RANSAC_MINEVAL) {
+                const int n = bns[bnum - 1];
+
+                int cnt = 0;
+                for (int i = 0; i < n; i++) {
+                    if (err(model, order[i]) < thresh) cnt++;
+                }
+                maxit = min(maxit, ransacAdaptiveStop(static_cast<double>(cnt) / n, unit));
+            }
+
+            // delta prior (0.05, weight 10)
+            delta = max((0.05 * 10 + dsum) / (10 + dcnt), 0.01);
+        }
+
+        return maxe;
+    }
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #define __SP_RAY_H__
 
 #include "spcore/spcore.h"
+#include <float.h>
 
 namespace sp {
 
@@ -62,11 +63,12 @@ namespace sp {
 
     SP_CPUFUNC bool tracePlane(SP_REAL *result, const VecPD3 &plane, const VecPD3 &ray, const double minv, const double maxv) {
 
-        const Vec3 p = dotVec(plane.drc, plane.pos - ray.pos) * plane.drc;
-        const Vec3 n = unitVec(p);
-        if (dotVec(n, ray.drc) > 0.0 && normVec(p) > 0.0)
+        // p = dn * plane.drc, s = |p| / (ray.drc, p / |p|)
+        const double dn = dotVec(plane.drc, plane.pos - ray.pos);
+        const double dd = dotVec(plane.drc, ray.drc);
+        if (dn * dd > 0.0)
         {
-            const double s = normVec(p) / dotVec(ray.drc, n);
+            const double s = dn * dotVec(plane.drc, plane.drc) / dd;
             if (s < minv || s > maxv) return false;
             result[0] = s;
             return true;
@@ -102,29 +104,629 @@ namespace sp {
     //--------------------------------------------------------------------------------
     // bounding volume hierarchy
     //--------------------------------------------------------------------------------
+    //
+    // nodes are built by binned SAH and stored depth first in a flat array (32 byte,
+    // two children side by side). leaf triangles are packed 4 by 4 (SoA) and tested
+    // with a 4-wide kernel, ray packets (up to 4 rays) are tested with a 4-wide box test
+    //
 
-    class BVH {
+    namespace _bvh {
 
-    public:
+        // 32 byte node
         struct Node {
-            int level;
+            float bmin[3];
 
+            // leaf : first item index, inner : first child index (children are base, base + 1)
             int base;
+
+            float bmax[3];
+
+            // leaf : item num (> 0), inner : -1 - split axis
             int size;
+        };
+
+        // 4 triangles (structure of arrays)
+        struct Tri4 {
+            double p0[3][4];
+            double e1[3][4];
+            double e2[3][4];
+
+            // mesh index (-1 : empty)
+            int id[4];
+        };
+
+        // single ray for box test
+        struct RayF {
+            // x, y, z, 0 (twice)
+            float org[8];
+            float idv[8];
+
+            // near (0-2) / far (4-6) plane offset in node (bmin : 0-2, bmax : 4-6)
+            int ofs[8];
+        };
 
-            Box3 box;
-            Node *n0, *n1;
+        // ray packet for box test
+        struct PacketF {
+            float org[3][4];
+            float idv[3][4];
         };
 
+        // robust box test (1 + 2 * gamma(3))
+        const float BOX_EPS = 1.0f + 2.0f * 3.0f * 0.5f * FLT_EPSILON;
+
+        SP_CPUFUNC float cnvf(const double v, const int rnd) {
+            float f = static_cast<float>(v);
+            if (rnd < 0 && f > v) f = nextafterf(f, -FLT_MAX);
+            if (rnd > 0 && f < v) f = nextafterf(f, +FLT_MAX);
+            return f;
+        }
+
+        SP_CPUFUNC void setBox(Node &node, const Box3 &box) {
+            for (int i = 0; i < 3; i++) {
+                node.bmin[i] = cnvf(acsv(box.pos[0], i), -1);
+                node.bmax[i] = cnvf(acsv(box.pos[1], i), +1);
+            }
+        }
+
+        SP_CPUFUNC Box3 getBox(const Node &node) {
+            return getBox3(getVec3(node.bmin[0], node.bmin[1], node.bmin[2]), getVec3(node.bmax[0], node.bmax[1], node.bmax[2]));
+        }
+
+        SP_CPUFUNC void setRay(RayF &rayf, const float *org, const float *idv) {
+            for (int i = 0; i < 4; i++) {
+                rayf.org[i] = rayf.org[4 + i] = (i < 3) ? org[i] : 0.0f;
+                rayf.idv[i] = rayf.idv[4 + i] = (i < 3) ? idv[i] : 0.0f;
+                rayf.ofs[i] = (i < 3 && idv[i] < 0.0f) ? 4 + i : i;
+                rayf.ofs[4 + i] = (i < 3 && idv[i] < 0.0f) ? i : 4 + i;
+            }
+        }
+
+        SP_CPUFUNC void setRay(RayF &rayf, const VecPD3 &ray) {
+            float org[3];
+            float idv[3];
+            for (int i = 0; i < 3; i++) {
+                org[i] = static_cast<float>(acsv(ray.pos, i));
+                idv[i] = 1.0f / static_cast<float>(acsv(ray.drc, i));
+            }
+            setRay(rayf, org, idv);
+        }
+
+        SP_CPUFUNC void setPacket(PacketF &pack, const VecPD3 *rays, const int num) {
+            for (int k = 0; k < 4; k++) {
+                const VecPD3 &ray = rays[min(k, num - 1)];
+                for (int i = 0; i < 3; i++) {
+                    pack.org[i][k] = static_cast<float>(acsv(ray.pos, i));
+                    pack.idv[i][k] = 1.0f / static_cast<float>(acsv(ray.drc, i));
+                }
+            }
+        }
+
+        SP_CPUFUNC void setTri(Tri4 &tri, const int k, const Mesh3 &mesh, const int id) {
+            const Vec3 e1 = mesh.pos[1] - mesh.pos[0];
+            const Vec3 e2 = mesh.pos[2] - mesh.pos[0];
+            for (int i = 0; i < 3; i++) {
+                tri.p0[i][k] = acsv(mesh.pos[0], i);
+                tri.e1[i][k] = acsv(e1, i);
+                tri.e2[i][k] = acsv(e2, i);
+            }
+            tri.id[k] = id;
+        }
+
+        // single ray vs box (NaN safe)
+        SP_CPUFUNC bool boxHit(float &tnear, const Node &node, const RayF &ray, const float minv, const float maxv) {
+            const float *p = reinterpret_cast<const float*>(&node);
+
+            float n = minv;
+            float f = maxv;
+            for (int i = 0; i < 3; i++) {
+                const float t0 = (p[ray.ofs[i]] - ray.org[i]) * ray.idv[i];
+                const float t1 = (p[ray.ofs[4 + i]] - ray.org[i]) * ray.idv[i] * BOX_EPS;
+                n = (t0 > n) ? t0 : n;
+                f = (t1 < f) ? t1 : f;
+            }
+            tnear = n;
+            return n <= f;
+        }
+
+        //--------------------------------------------------------------------------------
+        // scalar
+        //--------------------------------------------------------------------------------
+
+        // nearest hit lane (-1 : no hit), maxv is updated
+        SP_CPUFUNC int triHit4_c(const Tri4 &tri, const double *org, const double *drc, const double minv, double &maxv) {
+            int ret = -1;
+            for (int k = 0; k < 4; k++) {
+                const double e1x = tri.e1[0][k], e1y = tri.e1[1][k], e1z = tri.e1[2][k];
+                const double e2x = tri.e2[0][k], e2y = tri.e2[1][k], e2z = tri.e2[2][k];
+
+                const double px = drc[1] * e2z - drc[2] * e2y;
+                const double py = drc[2] * e2x - drc[0] * e2z;
+                const double pz = drc[0] * e2y - drc[1] * e2x;
+
+                const double det = e1x * px + e1y * py + e1z * pz;
+                if (fabs(det) < SP_SMALL) continue;
+                const double inv = 1.0 / det;
+
+                const double tx = org[0] - tri.p0[0][k];
+                const double ty = org[1] - tri.p0[1][k];
+                const double tz = org[2] - tri.p0[2][k];
+
+                const double u = (tx * px + ty * py + tz * pz) * inv;
+                if (u < -SP_SMALL || u > 1.0 + SP_SMALL) continue;
+
+                const double qx = ty * e1z - tz * e1y;
+                const double qy = tz * e1x - tx * e1z;
+                const double qz = tx * e1y - ty * e1x;
+
+                const double v = (drc[0] * qx + drc[1] * qy + drc[2] * qz) * inv;
+                if (v < -SP_SMALL || u + v > 1.0 + SP_SMALL) continue;
+
+                const double t = (e2x * qx + e2y * qy + e2z * qz) * inv;
+                if (t < minv || t > maxv) continue;
+
+                maxv = t;
+                ret = k;
+            }
+            return ret;
+        }
+
+        // 4 rays vs box (bit mask)
+        SP_CPUFUNC int boxHit4_c(float *tnear, const Node &node, const PacketF &pack, const float *minv, const float *maxv) {
+            int mask = 0;
+            for (int k = 0; k < 4; k++) {
+                const float org[3] = { pack.org[0][k], pack.org[1][k], pack.org[2][k] };
+                const float idv[3] = { pack.idv[0][k], pack.idv[1][k], pack.idv[2][k] };
+
+                RayF ray;
+                setRay(ray, org, idv);
+
+                if (boxHit(tnear[k], node, ray, minv[k], maxv[k]) == true) {
+                    mask |= (1 << k);
+                }
+            }
+            return mask;
+        }
+
+        // 4 rays vs sibling boxes (node[0] : bit 0-3, node[1] : bit 4-7), tnear is the min of hit rays
+        SP_CPUFUNC int boxHit4x2_c(float *tnear, const Node *node, const PacketF &pack, const float *minv, const float *maxv) {
+            int mask = 0;
+            for (int c = 0; c < 2; c++) {
+                float ts[4];
+                const int m = boxHit4_c(ts, node[c], pack, minv, maxv);
+
+                tnear[c] = FLT_MAX;
+                for (int k = 0; k < 4; k++) {
+                    if ((m >> k) & 1) tnear[c] = min(tnear[c], ts[k]);
+                }
+                mask |= m << (4 * c);
+            }
+            return mask;
+        }
+
+        // single ray vs sibling boxes (node[0], node[1]), bit mask
+        SP_CPUFUNC int boxHit2_c(float *tnear, const Node *node, const RayF &ray, const float minv, const float maxv) {
+            int mask = 0;
+            for (int k = 0; k < 2; k++) {
+                if (boxHit(tnear[k], node[k], ray, minv, maxv) == true) {
+                    mask |= (1 << k);
+                }
+            }
+            return mask;
+        }
+
+#if SP_USE_SIMD
+
+        //--------------------------------------------------------------------------------
+        // sse4.1
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_SSE4 SP_CPUFUNC int triHit4_sse4(const Tri4 &tri, const double *org, const double *drc, const double minv, double &maxv) {
+            const __m128d dx = _mm_set1_pd(drc[0]);
+            const __m128d dy = _mm_set1_pd(drc[1]);
+            const __m128d dz = _mm_set1_pd(drc[2]);
+            const __m128d sign = _mm_set1_pd(-0.0);
+            const __m128d small = _mm_set1_pd(SP_SMALL);
+            const __m128d msmall = _mm_set1_pd(-SP_SMALL);
+            const __m128d one = _mm_set1_pd(1.0 + SP_SMALL);
+            const __m128d tmin = _mm_set1_pd(minv);
+
+            double ts[4];
+            int mask = 0;
+
+            // 2 lanes x 2
+            for (int h = 0; h < 4; h += 2) {
+                const __m128d e1x = _mm_loadu_pd(&tri.e1[0][h]), e1y = _mm_loadu_pd(&tri.e1[1][h]), e1z = _mm_loadu_pd(&tri.e1[2][h]);
+                const __m128d e2x = _mm_loadu_pd(&tri.e2[0][h]), e2y = _mm_loadu_pd(&tri.e2[1][h]), e2z = _mm_loadu_pd(&tri.e2[2][h]);
+
+                const __m128d px = _mm_sub_pd(_mm_mul_pd(dy, e2z), _mm_mul_pd(dz, e2y));
+                const __m128d py = _mm_sub_pd(_mm_mul_pd(dz, e2x), _mm_mul_pd(dx, e2z));
+                const __m128d pz = _mm_sub_pd(_mm_mul_pd(dx, e2y), _mm_mul_pd(dy, e2x));
+
+                const __m128d det = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1x, px), _mm_mul_pd(e1y, py)), _mm_mul_pd(e1z, pz));
+                __m128d m = _mm_cmpge_pd(_mm_andnot_pd(sign, det), small);
+                const __m128d inv = _mm_div_pd(_mm_set1_pd(1.0), det);
+
+                const __m128d tx = _mm_sub_pd(_mm_set1_pd(org[0]), _mm_loadu_pd(&tri.p0[0][h]));
+                const __m128d ty = _mm_sub_pd(_mm_set1_pd(org[1]), _mm_loadu_pd(&tri.p0[1][h]));
+                const __m128d tz = _mm_sub_pd(_mm_set1_pd(org[2]), _mm_loadu_pd(&tri.p0[2][h]));
+
+                const __m128d u = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(tx, px), _mm_mul_pd(ty, py)), _mm_mul_pd(tz, pz)), inv);
+                m = _mm_and_pd(m, _mm_and_pd(_mm_cmpge_pd(u, msmall), _mm_cmple_pd(u, one)));
+
+                const __m128d qx = _mm_sub_pd(_mm_mul_pd(ty, e1z), _mm_mul_pd(tz, e1y));
+                const __m128d qy = _mm_sub_pd(_mm_mul_pd(tz, e1x), _mm_mul_pd(tx, e1z));
+                const __m128d qz = _mm_sub_pd(_mm_mul_pd(tx, e1y), _mm_mul_pd(ty, e1x));
+
+                const __m128d v = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, qx), _mm_mul_pd(dy, qy)), _mm_mul_pd(dz, qz)), inv);
+                m = _mm_and_pd(m, _mm_and_pd(_mm_cmpge_pd(v, msmall), _mm_cmple_pd(_mm_add_pd(u, v), one)));
+
+                const __m128d t = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(e2x, qx), _mm_mul_pd(e2y, qy)), _mm_mul_pd(e2z, qz)), inv);
+                m = _mm_and_pd(m, _mm_and_pd(_mm_cmpge_pd(t, tmin), _mm_cmple_pd(t, _mm_set1_pd(maxv))));
+
+                _mm_storeu_pd(&ts[h], t);
+                mask |= _mm_movemask_pd(m) << h;
+            }
+
+            int ret = -1;
+            for (int k = 0; k < 4; k++) {
+                if (((mask >> k) & 1) && ts[k] <= maxv) {
+                    maxv = ts[k];
+                    ret = k;
+                }
+            }
+            return ret;
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC int boxHit4_sse4(float *tnear, const Node &node, const PacketF &pack, const float *minv, const float *maxv) {
+            __m128 n = _mm_loadu_ps(minv);
+            __m128 f = _mm_loadu_ps(maxv);
+            for (int i = 0; i < 3; i++) {
+                const __m128 o = _mm_loadu_ps(pack.org[i]);
+                const __m128 d = _mm_loadu_ps(pack.idv[i]);
+                const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmin[i]), o), d);
+                const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bmax[i]), o), d);
+
+                // swap by the sign of idv, NaN is ignored (min / max return the second operand)
+                n = _mm_max_ps(_mm_blendv_ps(t0, t1, d), n);
+                f = _mm_min_ps(_mm_mul_ps(_mm_blendv_ps(t1, t0, d), _mm_set1_ps(BOX_EPS)), f);
+            }
+            _mm_storeu_ps(tnear, n);
+            return _mm_movemask_ps(_mm_cmple_ps(n, f));
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC int boxHit4x2_sse4(float *tnear, const Node *node, const PacketF &pack, const float *minv, const float *maxv) {
+            const __m128 vmin = _mm_loadu_ps(minv);
+            const __m128 vmax = _mm_loadu_ps(maxv);
+            const __m128 eps = _mm_set1_ps(BOX_EPS);
+
+            __m128 n0 = vmin, f0 = vmax;
+            __m128 n1 = vmin, f1 = vmax;
+            for (int i = 0; i < 3; i++) {
+                const __m128 o = _mm_loadu_ps(pack.org[i]);
+                const __m128 d = _mm_loadu_ps(pack.idv[i]);
+
+                const __m128 a0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node[0].bmin[i]), o), d);
+                const __m128 b0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node[0].bmax[i]), o), d);
+                const __m128 a1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node[1].bmin[i]), o), d);
+                const __m128 b1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node[1].bmax[i]), o), d);
+
+                n0 = _mm_max_ps(_mm_blendv_ps(a0, b0, d), n0);
+                f0 = _mm_min_ps(_mm_mul_ps(_mm_blendv_ps(b0, a0, d), eps), f0);
+                n1 = _mm_max_ps(_mm_blendv_ps(a1, b1, d), n1);
+                f1 = _mm_min_ps(_mm_mul_ps(_mm_blendv_ps(b1, a1, d), eps), f1);
+            }
+            const __m128 h0 = _mm_cmple_ps(n0, f0);
+            const __m128 h1 = _mm_cmple_ps(n1, f1);
+
+            // min of hit rays
+            const __m128 fmax = _mm_set1_ps(FLT_MAX);
+            __m128 t0 = _mm_blendv_ps(fmax, n0, h0);
+            __m128 t1 = _mm_blendv_ps(fmax, n1, h1);
+            t0 = _mm_min_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(2, 3, 0, 1)));
+            t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 3, 0, 1)));
+            t0 = _mm_min_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(1, 0, 3, 2)));
+            t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+            tnear[0] = _mm_cvtss_f32(t0);
+            tnear[1] = _mm_cvtss_f32(t1);
+
+            return _mm_movemask_ps(h0) | (_mm_movemask_ps(h1) << 4);
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // avx2
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_AVX2 SP_CPUFUNC int triHit4_avx2(const Tri4 &tri, const double *org, const double *drc, const double minv, double &maxv) {
+            const __m256d dx = _mm256_set1_pd(drc[0]);
+            const __m256d dy = _mm256_set1_pd(drc[1]);
+            const __m256d dz = _mm256_set1_pd(drc[2]);
+
+            const __m256d e1x = _mm256_loadu_pd(tri.e1[0]), e1y = _mm256_loadu_pd(tri.e1[1]), e1z = _mm256_loadu_pd(tri.e1[2]);
+            const __m256d e2x = _mm256_loadu_pd(tri.e2[0]), e2y = _mm256_loadu_pd(tri.e2[1]), e2z = _mm256_loadu_pd(tri.e2[2]);
+
+            const __m256d px = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+            const __m256d py = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+            const __m256d pz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+
+            const __m256d det = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, px), _mm256_mul_pd(e1y, py)), _mm256_mul_pd(e1z, pz));
+            __m256d m = _mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.0), det), _mm256_set1_pd(SP_SMALL), _CMP_GE_OQ);
+            const __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0), det);
+
+            const __m256d tx = _mm256_sub_pd(_mm256_set1_pd(org[0]), _mm256_loadu_pd(tri.p0[0]));
+            const __m256d ty = _mm256_sub_pd(_mm256_set1_pd(org[1]), _mm256_loadu_pd(tri.p0[1]));
+            const __m256d tz = _mm256_sub_pd(_mm256_set1_pd(org[2]), _mm256_loadu_pd(tri.p0[2]));
+
+            const __m256d msmall = _mm256_set1_pd(-SP_SMALL);
+            const __m256d one = _mm256_set1_pd(1.0 + SP_SMALL);
+
+            const __m256d u = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx, px), _mm256_mul_pd(ty, py)), _mm256_mul_pd(tz, pz)), inv);
+            m = _mm256_and_pd(m, _mm256_and_pd(_mm256_cmp_pd(u, msmall, _CMP_GE_OQ), _mm256_cmp_pd(u, one, _CMP_LE_OQ)));
+
+            const __m256d qx = _mm256_sub_pd(_mm256_mul_pd(ty, e1z), _mm256_mul_pd(tz, e1y));
+            const __m256d qy = _mm256_sub_pd(_mm256_mul_pd(tz, e1x), _mm256_mul_pd(tx, e1z));
+            const __m256d qz = _mm256_sub_pd(_mm256_mul_pd(tx, e1y), _mm256_mul_pd(ty, e1x));
+
+            const __m256d v = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx), _mm256_mul_pd(dy, qy)), _mm256_mul_pd(dz, qz)), inv);
+            m = _mm256_and_pd(m, _mm256_and_pd(_mm256_cmp_pd(v, msmall, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ)));
+
+            const __m256d t = _mm256_mul_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, qx), _mm256_mul_pd(e2y, qy)), _mm256_mul_pd(e2z, qz)), inv);
+            m = _mm256_and_pd(m, _mm256_and_pd(_mm256_cmp_pd(t, _mm256_set1_pd(minv), _CMP_GE_OQ), _mm256_cmp_pd(t, _mm256_set1_pd(maxv), _CMP_LE_OQ)));
+
+            const int mask = _mm256_movemask_pd(m);
+            if (mask == 0) return -1;
+
+            double ts[4];
+            _mm256_storeu_pd(ts, t);
+
+            int ret = -1;
+            for (int k = 0; k < 4; k++) {
+                if (((mask >> k) & 1) && ts[k] <= maxv) {
+                    maxv = ts[k];
+                    ret = k;
+                }
+            }
+            return ret;
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC int boxHit2_avx2(float *tnear, const Node *node, const RayF &ray, const float minv, const float maxv) {
+            const __m256i ofs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ray.ofs));
+            const __m256 o = _mm256_loadu_ps(ray.org);
+            const __m256 d = _mm256_loadu_ps(ray.idv);
+
+            // near planes (lane 0-2) / far planes (lane 4-6)
+            const __m256 a = _mm256_mul_ps(_mm256_sub_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(&node[0])), ofs), o), d);
+            const __m256 b = _mm256_mul_ps(_mm256_sub_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(&node[1])), ofs), o), d);
+
+            const __m256 vmin = _mm256_set1_ps(minv);
+            const __m256 vmax = _mm256_set1_ps(maxv);
+
+            // node[0] : lane 0-3, node[1] : lane 4-7 (lane 3 / 7 are not used)
+            __m256 n = _mm256_blend_ps(_mm256_permute2f128_ps(a, b, 0x20), vmin, 0x88);
+            __m256 f = _mm256_blend_ps(_mm256_mul_ps(_mm256_permute2f128_ps(a, b, 0x31), _mm256_set1_ps(BOX_EPS)), vmax, 0x88);
+
+            // NaN is ignored (min / max return the second operand)
+            n = _mm256_max_ps(n, vmin);
+            f = _mm256_min_ps(f, vmax);
+
+            n = _mm256_max_ps(n, _mm256_permute_ps(n, _MM_SHUFFLE(2, 3, 0, 1)));
+            n = _mm256_max_ps(n, _mm256_permute_ps(n, _MM_SHUFFLE(1, 0, 3, 2)));
+            f = _mm256_min_ps(f, _mm256_permute_ps(f, _MM_SHUFFLE(2, 3, 0, 1)));
+            f = _mm256_min_ps(f, _mm256_permute_ps(f, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            float ns[8];
+            _mm256_storeu_ps(ns, n);
+            tnear[0] = ns[0];
+            tnear[1] = ns[4];
+
+            const int mask = _mm256_movemask_ps(_mm256_cmp_ps(n, f, _CMP_LE_OQ));
+            return (mask & 0x01) | ((mask >> 3) & 0x02);
+        }
+
+#endif
+
+        struct Kernel {
+            int(*triHit4)(const Tri4 &tri, const double *org, const double *drc, const double minv, double &maxv);
+            int(*boxHit4)(float *tnear, const Node &node, const PacketF &pack, const float *minv, const float *maxv);
+            int(*boxHit4x2)(float *tnear, const Node *node, const PacketF &pack, const float *minv, const float *maxv);
+            int(*boxHit2)(float *tnear, const Node *node, const RayF &ray, const float minv, const float maxv);
+        };
+
+        SP_CPUFUNC Kernel getKernel() {
+            Kernel ker = { triHit4_c, boxHit4_c, boxHit4x2_c, boxHit2_c };
+#if SP_USE_SIMD
+            if (getSimdLevel() >= SimdLevel_SSE4) {
+                Kernel tmp = { triHit4_sse4, boxHit4_sse4, boxHit4x2_sse4, boxHit2_c };
+                ker = tmp;
+            }
+            if (getSimdLevel() >= SimdLevel_AVX2) {
+                Kernel tmp = { triHit4_avx2, boxHit4_sse4, boxHit4x2_sse4, boxHit2_avx2 };
+                ker = tmp;
+            }
+#endif
+            return ker;
+        }
+
+        //--------------------------------------------------------------------------------
+        // binned sah builder
+        //--------------------------------------------------------------------------------
+
+        const int BIN_NUM = 16;
+
+        // sah split depth (deeper nodes are split by count, tree depth <= MAX_DEPTH + 32)
+        const int MAX_DEPTH = 64;
+
+        // traversal stack size (one entry per level)
+        const int STACK_MAX = MAX_DEPTH + 64;
+
+        // nodes : depth first, items : reordered item index
+        SP_CPUFUNC void build(Mem1<Node> &nodes, Mem1<int> &items, const Mem1<Box3> &boxes, const int leafMax) {
+            const int num = boxes.size();
+
+            nodes.clear();
+            items.resize(num);
+            if (num == 0) return;
+
+            Mem1<Vec3> cents(num);
+            for (int i = 0; i < num; i++) {
+                items[i] = i;
+                cents[i] = getBoxCent(boxes[i]);
+            }
+
+            // cost of traversal step / item test
+            const double CT = 1.0;
+            const double CI = 0.3;
+
+            struct Task {
+                int node;
+                int base;
+                int size;
+                int depth;
+            };
+
+            nodes.reserve(2 * num);
+            nodes.extend();
+
+            Mem1<Task> stack;
+            stack.reserve(64);
+            {
+                Task task = { 0, 0, num, 0 };
+                stack.push(task);
+            }
+
+            while (stack.size() > 0) {
+                const Task task = stack[stack.size() - 1];
+                stack.pop();
+
+                Box3 box = nullBox3();
+                Box3 cbox = nullBox3();
+                for (int i = task.base; i < task.base + task.size; i++) {
+                    box = orBox(box, boxes[items[i]]);
+                    cbox = orBox(cbox, cents[items[i]]);
+                }
+
+                setBox(nodes[task.node], box);
+
+                int axis = -1;
+                int split = -1;
+
+                if (task.depth >= MAX_DEPTH) {
+                    // median split (keeps the depth in log2(num))
+                    if (task.size > leafMax) axis = 3;
+                }
+                else if (task.size > 1) {
+                    double minc = (task.size <= leafMax) ? CI * task.size : SP_INFINITY;
+                    const double area = max(getBoxArea(box), SP_SMALL);
+
+                    for (int a = 0; a < 3; a++) {
+                        const double bmin = acsv(cbox.pos[0], a);
+                        const double bmax = acsv(cbox.pos[1], a);
+                        if (bmax - bmin <= SP_SMALL) continue;
+
+                        const double scale = BIN_NUM / (bmax - bmin);
+
+                        Box3 bboxes[BIN_NUM];
+                        int bcnts[BIN_NUM] = { 0 };
+                        for (int b = 0; b < BIN_NUM; b++) {
+                            bboxes[b] = nullBox3();
+                        }
+                        for (int i = task.base; i < task.base + task.size; i++) {
+                            const int b = min(BIN_NUM - 1, static_cast<int>((acsv(cents[items[i]], a) - bmin) * scale));
+                            bboxes[b] = orBox(bboxes[b], boxes[items[i]]);
+                            bcnts[b]++;
+                        }
+
+                        // right sweep
+                        double rareas[BIN_NUM];
+                        int rcnts[BIN_NUM];
+                        {
+                            Box3 rbox = nullBox3();
+                            int rcnt = 0;
+                            for (int b = BIN_NUM - 1; b > 0; b--) {
+                                rbox = orBox(rbox, bboxes[b]);
+                                rcnt += bcnts[b];
+                                rareas[b] = (rcnt > 0) ? getBoxArea(rbox) : 0.0;
+                                rcnts[b] = rcnt;
+                            }
+                        }
+
+                        // left sweep
+                        Box3 lbox = nullBox3();
+                        int lcnt = 0;
+                        for (int b = 1; b < BIN_NUM; b++) {
+                            lbox = orBox(lbox, bboxes[b - 1]);
+                            lcnt += bcnts[b - 1];
+                            if (lcnt == 0 || rcnts[b] == 0) continue;
+
+                            const double cost = CT + CI * (getBoxArea(lbox) * lcnt + rareas[b] * rcnts[b]) / area;
+                            if (cost < minc) {
+                                minc = cost;
+                                axis = a;
+                                split = b;
+                            }
+                        }
+                    }
+
+                    // degenerated centroids (split by count)
+                    if (axis < 0 && task.size > leafMax) {
+                        axis = 3;
+                    }
+                }
+
+                if (axis < 0) {
+                    nodes[task.node].base = task.base;
+                    nodes[task.node].size = task.size;
+                    continue;
+                }
+
+                int mid = task.base + task.size / 2;
+                if (axis < 3) {
+                    const double bmin = acsv(cbox.pos[0], axis);
+                    const double scale = BIN_NUM / (acsv(cbox.pos[1], axis) - bmin);
+
+                    int *l = &items[task.base];
+                    int *r = &items[task.base + task.size - 1];
+                    while (l <= r) {
+                        const int b = min(BIN_NUM - 1, static_cast<int>((acsv(cents[*l], axis) - bmin) * scale));
+                        if (b < split) {
+                            l++;
+                        }
+                        else {
+                            const int t = *l; *l = *r; *r = t;
+                            r--;
+                        }
+                    }
+                    mid = static_cast<int>(l - items.ptr);
+                }
+                else {
+                    axis = 0;
+                }
+
+                const int c = nodes.size();
+                nodes.extend(2);
+
+                nodes[task.node].base = c;
+                nodes[task.node].size = -1 - axis;
+
+                // right first (left is processed next)
+                Task rtask = { c + 1, mid, task.base + task.size - mid, task.depth + 1 };
+                Task ltask = { c + 0, task.base, mid - task.base, task.depth + 1 };
+                stack.push(rtask);
+                stack.push(ltask);
+            }
+        }
+    }
+
+    class BVH {
+
+    public:
+        typedef _bvh::Node Node;
+
         struct Data {
             Mesh3 mesh;
             Material mat;
         };
 
-        struct Index {
-            int id;
-        };
-
         struct Hit {
             bool calc;
             bool find;
@@ -137,38 +739,71 @@ namespace sp {
             int uid;
             Mat pose;
             Mat invp;
+
+            // rotation part of pose / invp
+            Mat nrot;
+            Mat irot;
             double scale;
         };
 
         struct Unit {
             Mem1<Data> data;
 
-
+            // depth first nodes
             Mem1<Node> nodes;
-            Mem1<Index> idxs;
+
+            // leaf triangles (leaf base / size are Tri4 index)
+            Mem1<_bvh::Tri4> tris;
         };
+
     private:
 
+        // leaf triangle num
+        static const int LEAF_MAX = 8;
+
+        static const int STACK_MAX = _bvh::STACK_MAX;
+
         Mem1<Layout> m_layouts;
         MemP<Unit> m_units;
+
+        // instance nodes (leaf base / size are m_idxs index)
         Mem1<Node> m_nodes;
-        Mem1<Index> m_idxs;
+        Mem1<int> m_idxs;
 
     public:
         BVH() {
             clear();
         }
 
-        Mem1<const Node*> getNodes(const int i, const int level) const {
-            Mem1<const Node*> nodes;
+        // boxes of unit i at the level (0 : root)
+        Mem1<Box3> getNodes(const int i, const int level) const {
+            Mem1<Box3> boxes;
 
             const Unit &unit = m_units[i];
-            for (int i = 0; i < unit.nodes.size(); i++) {
-                if (unit.nodes[i].level == level) {
-                    nodes.push(&unit.nodes[i]);
+            if (unit.nodes.size() == 0) return boxes;
+
+            Mem1<int> stack;
+            stack.push(0);
+            stack.push(0);
+            while (stack.size() > 0) {
+                const int lv = stack[stack.size() - 1];
+                const int ni = stack[stack.size() - 2];
+                stack.pop();
+                stack.pop();
+
+                const Node &n = unit.nodes[ni];
+                if (lv == level) {
+                    boxes.push(_bvh::getBox(n));
+                    continue;
+                }
+                if (n.size < 0) {
+                    stack.push(n.base + 1);
+                    stack.push(lv + 1);
+                    stack.push(n.base + 0);
+                    stack.push(lv + 1);
                 }
             }
-            return nodes;
+            return boxes;
         }
 
         void clear() {
@@ -187,294 +822,404 @@ namespace sp {
                 layout.uid = m_units.size();
                 layout.pose = poses[i];
                 layout.invp = invMat(poses[i]);
+                layout.nrot = layout.pose.part(0, 0, 3, 3);
+                layout.irot = layout.invp.part(0, 0, 3, 3);
 
-                const Vec3 n = layout.pose.part(0, 0, 3, 3) * getVec3(0.0, 0.0, 1.0);
+                const Vec3 n = layout.nrot * getVec3(0.0, 0.0, 1.0);
                 layout.scale = normVec(n);
             }
 
             Unit &unit = *m_units.malloc();
             unit.data.resize(meshes.size());
-            unit.idxs.resize(meshes.size());
             for (int i = 0; i < meshes.size(); i++) {
                 unit.data[i].mesh = meshes[i];
                 unit.data[i].mat = mats[i];
-                unit.idxs[i].id = i;
             }
+            unit.nodes.clear();
+            unit.tris.clear();
         }
 
         void build() {
             if (m_layouts.size() == 0) return;
 
-            struct IndexEx : public Index {
-                Box3 box;
-                Vec3 cent;
-            };
+            // unit (mesh) level
+            for (int u = 0; u < m_units.size(); u++) {
+                Unit &unit = m_units[u];
 
-            typedef int(*CMP)(const void*, const void*);
-            CMP cmp[3];
-            cmp[0] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.x < ((IndexEx*)i2)->cent.x) ? +1 : -1; };
-            cmp[1] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.y < ((IndexEx*)i2)->cent.y) ? +1 : -1; };
-            cmp[2] = [](const void* i1, const void* i2) -> int { return (((IndexEx*)i1)->cent.z < ((IndexEx*)i2)->cent.z) ? +1 : -1; };
-      
-            auto initn = [&](Mem1<Node> &nodes, Mem1<IndexEx> &idxs, const int level, const int base, const int size) -> Node* {
-                Node *n = NULL;
-#if SP_USE_OMP
-#pragma omp critical
-#endif
-                {
-                    n = nodes.extend();
-                }
-                n->level = level;
-                n->base = base;
-                n->size = size;
-                n->n0 = NULL;
-                n->n1 = NULL;
-
-                n->box = nullBox3();
-                for (int i = base; i < base + size; i++) {
-                    n->box = orBox(n->box, idxs[i].box);
+                Mem1<Box3> boxes(unit.data.size());
+                for (int i = 0; i < boxes.size(); i++) {
+                    boxes[i] = getBox3(unit.data[i].mesh);
                 }
-                return n;
-            };
-            auto sorti = [&](Node &n, Mem1<IndexEx> &idxs, Mem1<SP_REAL> &buff) -> int {
-                int di = 0;
-                int da = 0;
 
-                if (n.size < 100) {
-                    double mina = SP_INFINITY;
-                    for (int a = 0; a < 3; a++) {
-                        sort(&idxs[n.base], n.size, cmp[a]);
-                        Box3 bl = nullBox3();
-                        Box3 br = nullBox3();
-
-                        for (int i = 1; i < n.size; i++) {
-                            const int l = i;
-                            bl = orBox(bl, idxs[n.base + l - 1].box);
-                            buff[n.base + l] = 0;
-                            buff[n.base + l] += getBoxArea(bl) * i;
-                        }
-                        for (int i = 1; i < n.size; i++) {
-                            const int r = n.size - i;
-                            br = orBox(br, idxs[n.base + r].box);
-                            buff[n.base + r] += getBoxArea(br) * i;
-                        }
-
-                        for (int i = 1; i < n.size; i++) {
-                            //const double area = 1.0 + (buff(i, 0) + buff(i, 1)) / getBoxArea(n.box);
-                            if (buff[n.base + i] < mina) {
-                                mina = buff[n.base + i];
-                                di = i;
-                                da = a;
-                            }
-                        }
-                    }
-                    if (da != 2) {
-                        sort(&idxs[n.base], n.size, cmp[da]);
-                    }
-                }
-                else {
-                    const double x = fabs(n.box.pos[1].x - n.box.pos[0].x);
-                    const double y = fabs(n.box.pos[1].y - n.box.pos[0].y);
-                    const double z = fabs(n.box.pos[1].z - n.box.pos[0].z);
-                    if (x > max(y, z)) {
-                        da = 0;
-                    }
-                    else if(y > z) {
-                        da = 1;
-                    }
-                    else {
-                        da = 2;
-                    }
-                    sort(&idxs[n.base], n.size, cmp[da]);
-                    di = n.size / 2;
-                }
-                return di;
-            };
-            
-            {
-                for (int i = 0; i < m_units.size(); i++) {
-                    Unit &unit = m_units[i];
-                    Mem1<IndexEx> idxs(unit.idxs.size());
-
-                    for (int i = 0; i < idxs.size(); i++) {
-                        idxs[i].id = unit.idxs[i].id;
-                        idxs[i].box = getBox3(unit.data[idxs[i].id].mesh);
-                        idxs[i].cent = getMeshCent(unit.data[idxs[i].id].mesh);
-                    }
-
-                    unit.nodes.clear();
-                    unit.nodes.reserve(2 * idxs.size() - 1);
+                Mem1<int> items;
+                _bvh::build(unit.nodes, items, boxes, LEAF_MAX);
 
-                    Mem1<SP_REAL> buff(idxs.size());
-                    
-                    initn(unit.nodes, idxs, 0, 0, idxs.size());
+                // pack leaf triangles by 4
+                unit.tris.clear();
+                unit.tris.reserve(unit.nodes.size() * 2);
+                for (int ni = 0; ni < unit.nodes.size(); ni++) {
+                    Node &n = unit.nodes[ni];
+                    if (n.size < 0) continue;
 
-                    Mem1<Mem1<Node*> > tnodes;
-                    if (idxs.size() > 1000) {
-                        const int level = 5;
+                    const int base = unit.tris.size();
+                    const int size = (n.size + 3) / 4;
 
-                        tnodes.reserve(256);
-                        for (int ni = 0; ni < unit.nodes.size(); ni++) {
-                            Node& n = unit.nodes[ni];
-                            if (n.size == 1) continue;
+                    _bvh::Tri4 *tris = unit.tris.extend(size);
+                    memset(tris, 0, sizeof(_bvh::Tri4) * size);
 
-                            if (n.level < level) {
-                                const int di = sorti(n, idxs, buff);
-                                n.n0 = initn(unit.nodes, idxs, n.level + 1, n.base, di);
-                                n.n1 = initn(unit.nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                            }
-                            else {
-                                Mem1<Node*> &nodes = *tnodes.extend();
-                                nodes.reserve(2 * n.size - 1);
-                                nodes.push(&n);
-                            }
+                    for (int i = 0; i < size * 4; i++) {
+                        _bvh::Tri4 &tri = tris[i / 4];
+                        if (i < n.size) {
+                            const int id = items[n.base + i];
+                            _bvh::setTri(tri, i % 4, unit.data[id].mesh, id);
                         }
-                    }
-                    else {
-                        Mem1<Node*> &nodes = *tnodes.extend();
-                        nodes.push(&unit.nodes[0]);
-                    }
-
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-                    for (int i = 0; i < tnodes.size(); i++) {
-                        for (int ni = 0; ni < tnodes[i].size(); ni++) {
-                            Node& n = *tnodes[i][ni];
-                            if (n.size == 1) continue;
-
-                            const int di = sorti(n, idxs, buff);
-
-                            n.n0 = initn(unit.nodes, idxs, n.level + 1, n.base, di);
-                            n.n1 = initn(unit.nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                            tnodes[i].push(n.n0);
-                            tnodes[i].push(n.n1);
+                        else {
+                            tri.id[i % 4] = -1;
                         }
                     }
-
-                    for (int i = 0; i < idxs.size(); i++) {
-                        unit.idxs[i].id = idxs[i].id;
-                    }
+                    n.base = base;
+                    n.size = size;
                 }
             }
-            {
 
-                Mem1<IndexEx> idxs(m_layouts.size());
-                m_idxs.resize(m_layouts.size());
+            // layout (instance) level
+            {
+                Mem1<Box3> boxes(m_layouts.size());
+                for (int i = 0; i < boxes.size(); i++) {
+                    const Unit &unit = m_units[m_layouts[i].uid];
+                    const Box3 ubox = _bvh::getBox(unit.nodes[0]);
 
-                for (int i = 0; i < idxs.size(); i++) {
-                    Unit &unit = m_units[m_layouts[i].uid];
-                    idxs[i].id = i;
-                    idxs[i].box = nullBox3();
+                    boxes[i] = nullBox3();
                     for (int j = 0; j < 8; j++) {
                         const int a = (j & 0x01) ? 1 : 0;
                         const int b = (j & 0x02) ? 1 : 0;
                         const int c = (j & 0x04) ? 1 : 0;
-                        const Vec3 v = getVec3(unit.nodes[0].box.pos[a].x, unit.nodes[0].box.pos[b].y, unit.nodes[0].box.pos[c].z);
-                        idxs[i].box = orBox(idxs[i].box, m_layouts[i].pose * v);
+                        const Vec3 v = getVec3(ubox.pos[a].x, ubox.pos[b].y, ubox.pos[c].z);
+                        boxes[i] = orBox(boxes[i], m_layouts[i].pose * v);
                     }
-                    idxs[i].cent = getBoxCent(idxs[i].box);
                 }
 
-                m_nodes.clear();
-                m_nodes.reserve(2 * idxs.size() - 1);
+                _bvh::build(m_nodes, m_idxs, boxes, 1);
+            }
+        }
 
-                Mem1<SP_REAL> buff(idxs.size());
-                
-                initn(m_nodes, idxs, 0, 0, idxs.size());
+        // nearest hit
+        bool trace(Hit &hit, const VecPD3 &ray, const double minv, const double maxv) const {
+            return _trace<false>(hit, ray, minv, maxv);
+        }
 
-                Mem1<Node*> tnodes;
-                {
-                    tnodes.push(&m_nodes[0]);
-                }
+        // any hit (for shadow ray)
+        bool check(const VecPD3 &ray, const double minv, const double maxv) const {
+            Hit hit;
+            return _trace<true>(hit, ray, minv, maxv);
+        }
+
+        // nearest hit of coherent rays (num <= 4)
+        void trace(Hit *hits, const VecPD3 *rays, const int num, const double minv, const double maxv) const {
+            SP_ASSERT(num > 0 && num <= 4);
+            const _bvh::Kernel ker = _bvh::getKernel();
+
+            for (int k = 0; k < num; k++) {
+                memset(&hits[k], 0, sizeof(Hit));
+                hits[k].calc = true;
+            }
+            if (m_nodes.size() == 0) return;
+
+            double maxvA[4];
+            float minfA[4];
+            float maxfA[4];
+            for (int k = 0; k < 4; k++) {
+                maxvA[k] = maxv;
+                minfA[k] = (k < num) ? static_cast<float>(minv) : +FLT_MAX;
+                maxfA[k] = (k < num) ? static_cast<float>(min(maxv, static_cast<double>(FLT_MAX))) : -FLT_MAX;
+            }
+
+            _bvh::PacketF packA;
+            _bvh::setPacket(packA, rays, num);
+
+            const int full = (1 << num) - 1;
 
-                for (int ni = 0; ni < tnodes.size(); ni++) {
-                    Node& n = *tnodes[ni];
-                    if (n.size == 1) continue;
+            int stackA[STACK_MAX];
+            int spA = 0;
+            stackA[spA++] = 0;
 
-                    const int di = sorti(n, idxs, buff);
+            while (spA > 0) {
+                const Node &na = m_nodes[stackA[--spA]];
+                float tnear[4];
+                if ((ker.boxHit4(tnear, na, packA, minfA, maxfA) & full) == 0) continue;
 
-                    n.n0 = initn(m_nodes, idxs, n.level + 1, n.base, di);
-                    n.n1 = initn(m_nodes, idxs, n.level + 1, n.base + di, n.size - di);
-                    tnodes.push(n.n0);
-                    tnodes.push(n.n1);
+                if (na.size < 0) {
+                    // near child first (by the first ray)
+                    const bool neg = acsv(rays[0].drc, -1 - na.size) < 0.0;
+                    stackA[spA++] = na.base + (neg ? 0 : 1);
+                    stackA[spA++] = na.base + (neg ? 1 : 0);
+                    continue;
                 }
 
-                for (int i = 0; i < idxs.size(); i++) {
-                    m_idxs[i].id = idxs[i].id;
+                for (int l = na.base; l < na.base + na.size; l++) {
+                    const Layout &layout = m_layouts[m_idxs[l]];
+                    const Unit &unit = m_units[layout.uid];
+
+                    VecPD3 brays[4];
+                    double maxvB[4];
+                    float minfB[4];
+                    float maxfB[4];
+                    int minid[4];
+                    for (int k = 0; k < 4; k++) {
+                        brays[k] = (k < num) ? cnvRay(layout, rays[k]) : brays[k - 1];
+                        maxvB[k] = maxvA[k] / layout.scale;
+                        minfB[k] = (k < num) ? static_cast<float>(minv / layout.scale) : +FLT_MAX;
+                        maxfB[k] = (k < num) ? static_cast<float>(min(maxvB[k], static_cast<double>(FLT_MAX))) : -FLT_MAX;
+                        minid[k] = -1;
+                    }
+                    const double minvB = minv / layout.scale;
+
+                    _bvh::PacketF packB;
+                    _bvh::setPacket(packB, brays, num);
+
+                    // node index / active ray mask / near distance
+                    int stackB[STACK_MAX];
+                    int maskB[STACK_MAX];
+                    float nearB[STACK_MAX];
+                    int spB = 0;
+
+                    int ni = 0;
+                    int mask = 0;
+                    {
+                        float tnear[4];
+                        mask = ker.boxHit4(tnear, unit.nodes[0], packB, minfB, maxfB) & full;
+                    }
+
+                    while (mask != 0) {
+                        const Node &nb = unit.nodes[ni];
+
+                        if (nb.size < 0) {
+                            const int c0 = nb.base + 0;
+                            const int c1 = nb.base + 1;
+
+                            float ts[2];
+                            const int m = ker.boxHit4x2(ts, &unit.nodes[c0], packB, minfB, maxfB);
+                            const int m0 = (m >> 0) & mask;
+                            const int m1 = (m >> 4) & mask;
+
+                            if (m0 != 0 && m1 != 0) {
+                                const float n0 = ts[0];
+                                const float n1 = ts[1];
+                                if (n0 <= n1) {
+                                    stackB[spB] = c1; maskB[spB] = m1; nearB[spB] = n1; spB++;
+                                    ni = c0; mask = m0;
+                                }
+                                else {
+                                    stackB[spB] = c0; maskB[spB] = m0; nearB[spB] = n0; spB++;
+                                    ni = c1; mask = m1;
+                                }
+                                continue;
+                            }
+                            if (m0 != 0) {
+                                ni = c0; mask = m0;
+                                continue;
+                            }
+                            if (m1 != 0) {
+                                ni = c1; mask = m1;
+                                continue;
+                            }
+                        }
+                        else {
+                            for (int k = 0; k < num; k++) {
+                                if (((mask >> k) & 1) == 0) continue;
+
+                                const double org[3] = { brays[k].pos.x, brays[k].pos.y, brays[k].pos.z };
+                                const double drc[3] = { brays[k].drc.x, brays[k].drc.y, brays[k].drc.z };
+
+                                for (int t = nb.base; t < nb.base + nb.size; t++) {
+                                    const _bvh::Tri4 &tri = unit.tris[t];
+                                    const int r = ker.triHit4(tri, org, drc, minvB, maxvB[k]);
+                                    if (r >= 0) {
+                                        minid[k] = tri.id[r];
+                                    }
+                                }
+                                maxfB[k] = _bvh::cnvf(maxvB[k], +1);
+                            }
+                        }
+
+                        // pop (skip nodes behind the current hits)
+                        mask = 0;
+                        while (spB > 0) {
+                            spB--;
+                            float maxf = -FLT_MAX;
+                            for (int k = 0; k < num; k++) {
+                                if ((maskB[spB] >> k) & 1) maxf = max(maxf, maxfB[k]);
+                            }
+                            if (nearB[spB] <= maxf) {
+                                ni = stackB[spB];
+                                mask = maskB[spB];
+                                break;
+                            }
+                        }
+                    }
+
+                    for (int k = 0; k < num; k++) {
+                        if (minid[k] < 0) continue;
+
+                        maxvA[k] = maxvB[k] * layout.scale;
+                        maxfA[k] = _bvh::cnvf(maxvA[k], +1);
+
+                        setHit(hits[k], layout, unit, brays[k], maxvB[k], minid[k]);
+                    }
                 }
             }
         }
 
-        bool trace(Hit &hit, const VecPD3 &ray, const double minv, const double maxv) const {
+    private:
+
+        // world to unit (affine pose)
+        VecPD3 cnvRay(const Layout &layout, const VecPD3 &ray) const {
+            VecPD3 dst;
+            dst.pos = mulMat(layout.invp.ptr, 3, 4, ray.pos);
+            dst.drc = unitVec(mulMat(layout.irot.ptr, 3, 3, ray.drc));
+            return dst;
+        }
+
+        void setHit(Hit &hit, const Layout &layout, const Unit &unit, const VecPD3 &bray, const double t, const int id) const {
+            hit.find = true;
+            hit.mat = unit.data[id].mat;
+
+            hit.vec.pos = mulMat(layout.pose.ptr, 3, 4, bray.pos + bray.drc * t);
+            hit.vec.drc = unitVec(layout.nrot * getMeshNrm(unit.data[id].mesh));
+        }
+
+        template<bool ANY>
+        bool _trace(Hit &hit, const VecPD3 &ray, const double minv, const double maxv) const {
             memset(&hit, 0, sizeof(Hit));
             hit.calc = true;
 
-            const int QUE_MAX = 100;
-            const Node* queA[QUE_MAX];
-            const Node* queB[QUE_MAX];
+            if (m_nodes.size() == 0) return false;
+
+            const _bvh::Kernel ker = _bvh::getKernel();
 
-            double minvA = minv;
             double maxvA = maxv;
-            if (m_nodes.size() > 0) {
-                int stackA = 0;
-                queA[stackA++] = &m_nodes[0];
 
-                while (stackA > 0) {
-                    const Node *n = queA[--stackA];
+            _bvh::RayF rayA;
+            _bvh::setRay(rayA, ray);
 
-                    if (checkHit(n->box, ray, minvA, maxvA) == false) {
-                        continue;
-                    }
-                    if (n->n0 != NULL && n->n1 != NULL && stackA < QUE_MAX - 2) {
-                        queA[stackA++] = n->n0;
-                        queA[stackA++] = n->n1;
-                        continue;
-                    }
+            const float minfA = static_cast<float>(minv);
+            float maxfA = static_cast<float>(min(maxv, static_cast<double>(FLT_MAX)));
 
-                    const Layout &layout = m_layouts[m_idxs[n->base].id];
+            int stackA[STACK_MAX];
+            int spA = 0;
+            stackA[spA++] = 0;
+
+            while (spA > 0) {
+                const Node &na = m_nodes[stackA[--spA]];
+
+                float tnear;
+                if (_bvh::boxHit(tnear, na, rayA, minfA, maxfA) == false) continue;
+
+                if (na.size < 0) {
+                    // near child first
+                    const bool neg = acsv(ray.drc, -1 - na.size) < 0.0;
+                    stackA[spA++] = na.base + (neg ? 0 : 1);
+                    stackA[spA++] = na.base + (neg ? 1 : 0);
+                    continue;
+                }
+
+                for (int l = na.base; l < na.base + na.size; l++) {
+                    const Layout &layout = m_layouts[m_idxs[l]];
                     const Unit &unit = m_units[layout.uid];
 
-                    const VecPD3 bray = layout.invp * ray;
+                    const VecPD3 bray = cnvRay(layout, ray);
 
-                    int minid = -1;
+                    const double org[3] = { bray.pos.x, bray.pos.y, bray.pos.z };
+                    const double drc[3] = { bray.drc.x, bray.drc.y, bray.drc.z };
+
+                    _bvh::RayF rayB;
+                    _bvh::setRay(rayB, bray);
 
-                    double minvB = minvA / layout.scale;
+                    const double minvB = minv / layout.scale;
                     double maxvB = maxvA / layout.scale;
-                    
-                    int stackB = 0;
-                    queB[stackB++] = &unit.nodes[0];
 
-                    while (stackB > 0) {
-                        const Node *n = queB[--stackB];
+                    const float minfB = static_cast<float>(minvB);
+                    float maxfB = static_cast<float>(min(maxvB, static_cast<double>(FLT_MAX)));
 
-                        if (checkHit(n->box, bray, minvB, maxvB) == false) {
-                            continue;
+                    int minid = -1;
+
+                    // node index / near distance
+                    int stackB[STACK_MAX];
+                    float nearB[STACK_MAX];
+                    int spB = 0;
+
+                    int ni = 0;
+                    {
+                        float tnear;
+                        if (_bvh::boxHit(tnear, unit.nodes[0], rayB, minfB, maxfB) == false) continue;
+                    }
+
+                    while (true) {
+                        const Node &nb = unit.nodes[ni];
+
+                        if (nb.size < 0) {
+                            const int c0 = nb.base + 0;
+                            const int c1 = nb.base + 1;
+
+                            float ts[2];
+                            const int mask = ker.boxHit2(ts, &unit.nodes[c0], rayB, minfB, maxfB);
+                            const bool h0 = (mask & 0x01) != 0;
+                            const bool h1 = (mask & 0x02) != 0;
+                            const float t0 = ts[0];
+                            const float t1 = ts[1];
+
+                            if (h0 == true && h1 == true) {
+                                if (t0 <= t1) {
+                                    stackB[spB] = c1; nearB[spB] = t1; spB++;
+                                    ni = c0;
+                                }
+                                else {
+                                    stackB[spB] = c0; nearB[spB] = t0; spB++;
+                                    ni = c1;
+                                }
+                                continue;
+                            }
+                            if (h0 == true) {
+                                ni = c0;
+                                continue;
+                            }
+                            if (h1 == true) {
+                                ni = c1;
+                                continue;
+                            }
                         }
-                        if (n->n0 != NULL && n->n1 != NULL && stackB < QUE_MAX - 2) {
-                            queB[stackB++] = n->n0;
-                            queB[stackB++] = n->n1;
-                            continue;
+                        else {
+                            for (int t = nb.base; t < nb.base + nb.size; t++) {
+                                const _bvh::Tri4 &tri = unit.tris[t];
+                                const int r = ker.triHit4(tri, org, drc, minvB, maxvB);
+                                if (r >= 0) {
+                                    minid = tri.id[r];
+                                    if (ANY == true) {
+                                        hit.find = true;
+                                        return true;
+                                    }
+                                }
+                            }
+                            maxfB = _bvh::cnvf(maxvB, +1);
                         }
-                        {
-                            const int id = unit.idxs[n->base].id;
 
-                            SP_REAL result[3] = { 0 };
-                            if (traceMesh(result, unit.data[id].mesh, bray, minvB, maxvB) == true) {
-
-                                maxvA = result[0] * layout.scale;
-                                maxvB = result[0];
-                                minid = id;
+                        // pop (skip far nodes)
+                        ni = -1;
+                        while (spB > 0) {
+                            spB--;
+                            if (nearB[spB] <= maxfB) {
+                                ni = stackB[spB];
+                                break;
                             }
                         }
+                        if (ni < 0) break;
                     }
 
                     if (minid >= 0) {
-                        hit.find = true;
-                        hit.mat = unit.data[minid].mat;
+                        maxvA = maxvB * layout.scale;
+                        maxfA = _bvh::cnvf(maxvA, +1);
 
-                        hit.vec.pos = layout.pose * (bray.pos + bray.drc * maxvB);
-                        hit.vec.drc = unitVec(layout.pose.part(0, 0, 3, 3)  * getMeshNrm(unit.data[minid].mesh));
+                        setHit(hit, layout, unit, bray, maxvB, minid);
                     }
                 }
             }
@@ -570,6 +1315,9 @@ namespace sp {
         const static int LEVEL_MAX = 5;
         const static int LIGHT_MAX = 4;
 
+        // tile size (pixel) handed out to workers
+        const static int TILE_SIZE = 16;
+
         struct Data {
             Col4f col;
             float sdw;
@@ -596,17 +1344,32 @@ namespace sp {
         Cnt m_cnt;
         Cnt m_lim;
 
-        Mem2<MemA<BVH::Hit, SAMPLE_UNIT * SAMPLE_UNIT> > m_hitmap;
-        Mem2<MemA<VecPD3, SAMPLE_UNIT * SAMPLE_UNIT> > m_raymap;
+        // next tile in the current pass (0 : pass is not started)
+        int m_tile;
+
+        // cam to world
+        Pose m_wpose;
+        Mat m_wrot;
 
         // objects
         Light m_ambient;
         Mem1<PntLight> m_plights;
         Plane m_plane;
 
+    private:
+
+        // lights requested in the middle of a pass (applied at the end of the pass)
+        Light m_reqAmbient;
+        Mem1<PntLight> m_reqPLights;
+        int m_reqAmbLim, m_reqDifLim;
+        bool m_reqAmb, m_reqDif;
+
     public:
 
         PathTrace() {
+            m_reqAmb = false;
+            m_reqDif = false;
+
             memset(&m_lim, 0, sizeof(Cnt));
             m_lim.msk = SAMPLE_UNIT * SAMPLE_UNIT;
 
@@ -623,6 +1386,9 @@ namespace sp {
             m_img.resize(m_cam.dsize);
             m_img.zero();
             memset(&m_cnt, 0, sizeof(Cnt));
+            m_tile = 0;
+
+            applyLights();
         }
 
 
@@ -648,40 +1414,8 @@ namespace sp {
             m_cam = cam;
             m_pose = pose;
 
-            m_hitmap.resize(m_cam.dsize);
-            m_hitmap.zero();
-
-            m_raymap.resize(m_cam.dsize);
-
-            const Pose wpose = invPose(m_pose);
-            const Mat wrot = getMat(wpose.rot);
-
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int v = 0; v < m_cam.dsize[1]; v++) {
-                for (int u = 0; u < m_cam.dsize[0]; u++) {
-
-                    for (int i = 0; i < (SAMPLE_UNIT * SAMPLE_UNIT); i++) {
-                        const double delta = 1.0 / (SAMPLE_UNIT + 1);
-                        const double du = ((i / SAMPLE_UNIT) + 1) * delta;
-                        const double dv = ((i % SAMPLE_UNIT) + 1) * delta;
-
-                        const Vec2 npx = invCam(m_cam, getVec2(u - 0.5 + du, v - 0.5 + dv));
-
-                        VecPD3 &vec = m_raymap(u, v)[i];
-                        if (m_cam.type == CamParam_Pers) {
-                            vec.pos = wpose.pos;
-                            vec.drc = wrot * unitVec(prjVec(npx, 1.0, true));
-                        }
-                        else {
-                            vec.pos = wpose.pos + wrot * getVec3(npx.x, npx.y, -1000.0 * 10);
-                            vec.drc = wrot * getVec3(0.0, 0.0, 1.0);
-                        }
-                    }
-
-                }
-            }
+            m_wpose = invPose(m_pose);
+            m_wrot = getMat(m_wpose.rot);
 
             reset();
         }
@@ -700,27 +1434,22 @@ namespace sp {
             m_plane = plane;
         }
 
+        // the tiles done in the current pass have been blended with the current lights,
+        // so a change is held until the pass ends
         void setAmbient(const Light &light, const int lim = 100) {
-            m_ambient = light;
-            m_lim.amb = lim;
-            if (light.valid == false) {
-                m_cnt.amb = 0;
-                m_lim.amb = 0;
-            }
+            m_reqAmbient = light;
+            m_reqAmbLim = lim;
+            m_reqAmb = true;
+            if (m_tile == 0) applyLights();
         }
 
         void setPntLights(const Mem1<PntLight> &lights, const int lim = 30) {
             SP_ASSERT(lights.size() <= LIGHT_MAX);
 
-            for (int i = 0; i < LIGHT_MAX; i++) {
-                if (i >= min(m_plights.size(), lights.size()) || lights[i].pos != m_plights[i].pos) {
-                    m_cnt.dif[i] = 0;
-                }
-                
-                m_lim.dif[i] = (lights.size() > 0) ? lim : 0;
-            }
-
-            m_plights = lights;
+            m_reqPLights = lights;
+            m_reqDifLim = lim;
+            m_reqDif = true;
+            if (m_tile == 0) applyLights();
         }
 
         void addModel(const Mem1<Mesh3> &meshes, const Mem1<Material> &mats, const Mem1<Mat> &poses) {
@@ -731,27 +1460,103 @@ namespace sp {
             m_bvh.build();
         }
 
-        bool update() {
-            if (prog() == 1.0f) return false;
-            
-            const int t = SAMPLE_UNIT * SAMPLE_UNIT;
+    private:
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int v = 0; v < m_cam.dsize[1]; v++) {
-                for (int u = 0; u < m_cam.dsize[0]; u++) {
-                    if (m_cnt.msk >= m_lim.msk && m_img(u, v).msk == static_cast<SP_REAL>(0.0)) continue;
+        // (m_tile == 0)
+        void applyLights() {
+            if (m_reqAmb == true) {
+                m_reqAmb = false;
 
-                    calc(m_img(u, v), m_hitmap(u, v), m_raymap(u, v));
+                m_ambient = m_reqAmbient;
+                m_lim.amb = m_reqAmbLim;
+                if (m_ambient.valid == false) {
+                    m_cnt.amb = 0;
+                    m_lim.amb = 0;
                 }
             }
+
+            if (m_reqDif == true) {
+                m_reqDif = false;
+
+                const Mem1<PntLight> &lights = m_reqPLights;
+                for (int i = 0; i < LIGHT_MAX; i++) {
+                    if (i >= min(m_plights.size(), lights.size()) || lights[i].pos != m_plights[i].pos) {
+                        m_cnt.dif[i] = 0;
+                    }
+
+                    m_lim.dif[i] = (lights.size() > 0) ? m_reqDifLim : 0;
+                }
+
+                m_plights = lights;
+            }
+        }
+
+    public:
+
+        // ms : time budget of this call (<= 0 : until the end of the pass)
+        // the image is updated tile by tile, render() shows the partial result
+        bool update(const double ms = 0.0) {
+            if (prog() == 1.0f) return false;
+
+            const int t = SAMPLE_UNIT * SAMPLE_UNIT;
+
+            // sample index used in this pass
+            bool samples[SAMPLE_UNIT * SAMPLE_UNIT] = { false };
             {
+                if (m_cnt.amb < m_lim.amb) samples[m_cnt.amb % t] = true;
+                for (int i = 0; i < m_plights.size(); i++) {
+                    if (m_cnt.dif[i] < m_lim.dif[i]) samples[m_cnt.dif[i] % t] = true;
+                }
+                if (m_cnt.msk < m_lim.msk) samples[m_cnt.msk % t] = true;
+            }
+
+            // light position (same for all pixels in this pass)
+            Mem1<Vec3> lposs(m_plights.size());
+            for (int i = 0; i < m_plights.size(); i++) {
+                RandStream rs = getRandStream(m_cnt.dif[i], i);
+                lposs[i] = m_plights[i].pos + randgVec3(1.0, 1.0, 1.0, rs) * 1.0;
+            }
+
+            const int tw = (m_cam.dsize[0] + TILE_SIZE - 1) / TILE_SIZE;
+            const int th = (m_cam.dsize[1] + TILE_SIZE - 1) / TILE_SIZE;
+            const int tnum = tw * th;
+
+            const int begin = m_tile;
+            std::atomic<int> next(begin);
+
+            const Timer::Point start = Timer::now();
+
+            // workers take tiles in order until the budget is used up (the first tile is always done)
+            ThreadPool *pool = ThreadPool::instance();
+            parallel_for(0, pool->size(), [&](const int w) {
+                while (true) {
+                    if (ms > 0.0 && next > begin && Timer::dif(start, Timer::now()) > ms) break;
+
+                    const int tile = next++;
+                    if (tile >= tnum) break;
+
+                    const int x0 = (tile % tw) * TILE_SIZE;
+                    const int y0 = (tile / tw) * TILE_SIZE;
+                    const int x1 = min(x0 + TILE_SIZE, m_cam.dsize[0]);
+                    const int y1 = min(y0 + TILE_SIZE, m_cam.dsize[1]);
+
+                    calcTile(x0, y0, x1, y1, samples, lposs);
+                }
+            }, 1, pool);
+
+            m_tile = min(static_cast<int>(next), tnum);
+
+            // end of the pass
+            if (m_tile == tnum) {
+                m_tile = 0;
+
                 m_cnt.amb = min(m_lim.amb, m_cnt.amb + 1);
                 for (int i = 0; i < m_plights.size(); i++) {
                     m_cnt.dif[i] = min(m_lim.dif[i], m_cnt.dif[i] + 1);
                 }
                 m_cnt.msk = min(m_lim.msk, m_cnt.msk + 1);
+
+                applyLights();
             }
             return true;
         }
@@ -777,13 +1582,13 @@ namespace sp {
                     float sum = 0.0f;
 
                     for (int l = 0; l < m_plights.size(); l++) {
-                        if (m_cnt.dif[l] > 0) {
+                        if (started(m_cnt.dif[l], m_lim.dif[l]) == true) {
                             blend(col, im.dif[l], m_plights[l]);
                             sum += m_plights[l].val;
                         }
                     }
                     if (m_ambient.valid == true) {
-                        if (m_cnt.amb > 0) {
+                        if (started(m_cnt.amb, m_lim.amb) == true) {
                             blend(col, im.amb, m_ambient);
                             sum += m_ambient.val;
                         }
@@ -804,6 +1609,71 @@ namespace sp {
 
     private:
 
+        // sampled at least once (including the current pass)
+        bool started(const int cnt, const int lim) const {
+            return cnt > 0 || (m_tile > 0 && cnt < lim);
+        }
+
+        VecPD3 getRay(const int u, const int v, const int i) const {
+            const double delta = 1.0 / (SAMPLE_UNIT + 1);
+            const double du = ((i / SAMPLE_UNIT) + 1) * delta;
+            const double dv = ((i % SAMPLE_UNIT) + 1) * delta;
+
+            const Vec2 npx = invCam(m_cam, getVec2(u - 0.5 + du, v - 0.5 + dv));
+
+            VecPD3 vec;
+            if (m_cam.type == CamParam_Pers) {
+                vec.pos = m_wpose.pos;
+                vec.drc = m_wrot * unitVec(prjVec(npx, 1.0, true));
+            }
+            else {
+                vec.pos = m_wpose.pos + m_wrot * getVec3(npx.x, npx.y, -1000.0 * 10);
+                vec.drc = m_wrot * getVec3(0.0, 0.0, 1.0);
+            }
+            return vec;
+        }
+
+        void calcTile(const int x0, const int y0, const int x1, const int y1, const bool *samples, const Mem1<Vec3> &lposs) {
+            const int t = SAMPLE_UNIT * SAMPLE_UNIT;
+
+            for (int v = y0; v < y1; v++) {
+                for (int u = x0; u < x1; u += 4) {
+
+                    int us[4];
+                    int num = 0;
+                    for (int k = u; k < min(u + 4, x1); k++) {
+                        if (m_cnt.msk >= m_lim.msk && m_img(k, v).msk == static_cast<SP_REAL>(0.0)) continue;
+                        us[num++] = k;
+                    }
+                    if (num == 0) continue;
+
+                    // primary rays (packets of neighboring pixels)
+                    VecPD3 rays[4][SAMPLE_UNIT * SAMPLE_UNIT];
+                    BVH::Hit hits[4][SAMPLE_UNIT * SAMPLE_UNIT];
+
+                    for (int i = 0; i < t; i++) {
+                        if (samples[i] == false) continue;
+
+                        VecPD3 prays[4];
+                        BVH::Hit phits[4];
+                        for (int k = 0; k < num; k++) {
+                            prays[k] = getRay(us[k], v, i);
+                        }
+
+                        trace(phits, prays, num, 0.0, SP_INFINITY);
+                        for (int k = 0; k < num; k++) {
+                            rays[k][i] = prays[k];
+                            hits[k][i] = phits[k];
+                        }
+                    }
+
+                    for (int k = 0; k < num; k++) {
+                        calc(m_img(us[k], v), hits[k], rays[k], lposs);
+                    }
+                }
+            }
+        }
+
         bool trace(BVH::Hit &hit, const VecPD3 &ray, const double minv, const double maxv) {
             bool ret = false;
             double maxt = maxv;
@@ -828,14 +1698,45 @@ namespace sp {
             return ret;
         }
 
-        void calc(Img &img, MemA<BVH::Hit, SAMPLE_UNIT * SAMPLE_UNIT> &hits, const MemA<VecPD3, SAMPLE_UNIT * SAMPLE_UNIT> &rays) {
+        void trace(BVH::Hit *hits, const VecPD3 *rays, const int num, const double minv, const double maxv) {
+            m_bvh.trace(hits, rays, num, minv, maxv);
+
+            if (m_plane.valid == true) {
+                for (int k = 0; k < num; k++) {
+                    const BVH::Hit &hit = hits[k];
+                    const VecPD3 &ray = rays[k];
+                    const double maxt = (hit.find == true) ? normVec(hit.vec.pos - ray.pos) : maxv;
+
+                    SP_REAL result[3];
+                    double min = (m_cam.type == CamParam_Pers) ? 0.0 : -SP_INFINITY;
+                    if (tracePlane(result, m_plane.vec, ray, min, maxt)) {
+                        hits[k].calc = true;
+                        hits[k].find = true;
+                        hits[k].mat = m_plane.mat;
+                        hits[k].vec.pos = ray.pos + ray.drc * result[0];
+                        hits[k].vec.drc = m_plane.vec.drc;
+                    }
+                }
+            }
+        }
+
+        // any hit (plane first, it is cheaper)
+        bool check(const VecPD3 &ray, const double minv, const double maxv) {
+            if (m_plane.valid == true) {
+                SP_REAL result[3];
+                double min = (m_cam.type == CamParam_Pers) ? 0.0 : -SP_INFINITY;
+                if (tracePlane(result, m_plane.vec, ray, min, maxv)) return true;
+            }
+
+            return m_bvh.check(ray, minv, maxv);
+        }
+
+        // hits / rays : primary hits of the sample index used in this pass
+        void calc(Img &img, const BVH::Hit *hits, const VecPD3 *rays, const Mem1<Vec3> &lposs) {
 
             auto precalc = [&](BVH::Hit &hit, VecPD3 &ray, const int i){
                 ray = rays[i % (SAMPLE_UNIT * SAMPLE_UNIT)];
                 hit = hits[i % (SAMPLE_UNIT * SAMPLE_UNIT)];
-                if (hit.calc == false) {
-                    trace(hit, ray, 0.0, SP_INFINITY);
-                }
             };
 
             {
@@ -869,7 +1770,7 @@ namespace sp {
                     }
                     if (hit.find == true) {
                         Data data;
-                        calc_dif(data, ray, hit, m_plights[i].pos + randgVec3(1.0, 1.0, 1.0, m_cnt.dif[i]) * 1.0, 0, m_cnt.dif[i]);
+                        calc_dif(data, ray, hit, lposs[i], 0, m_cnt.dif[i]);
                         img.dif[i].col = blendCol(img.dif[i].col, m_cnt.dif[i], data.col, 1.0);
                         img.dif[i].sdw = blendCol(img.dif[i].sdw, m_cnt.dif[i], data.sdw, 1.0);
                     }
@@ -899,8 +1800,7 @@ namespace sp {
             next.drc = unitVec(lpos - base.vec.pos);
 
             const SP_REAL d = dotVec(base.vec.drc, next.drc);
-            BVH::Hit hit;
-            if (d > 0.0 && trace(hit, next, 0.0, SP_INFINITY) == false) {
+            if (d > 0.0 && check(next, 0.0, SP_INFINITY) == false) {
                 data.sdw = 0.0;
             }
             else {
@@ -961,7 +1861,7 @@ namespace sp {
                             continue;
                         }
                         else {
-                            calc_amb(d, next, hit, level + 1, seed + 1);
+                            calc_amb(d, next, hit, level + 1, seed);
                             break;
                         }
                     }
@@ -982,7 +1882,8 @@ namespace sp {
 
             VecPD3 next;
             next.pos = base.vec.pos + base.vec.drc * delta;
-            next.drc = unitVec(base.vec.drc * (1.0 + delta) + randuVec3(1.0, 1.0, 1.0, seed));
+            RandStream rs = getRandStream(seed, level);
+            next.drc = unitVec(base.vec.drc * (1.0 + delta) + randuVec3(1.0, 1.0, 1.0, rs));
 
             BVH::Hit hit;
 
@@ -992,7 +1893,7 @@ namespace sp {
             float tmp = 1.0;
 
             if (1) {
-                ret = trace(hit, next, 0.0, SP_INFINITY);
+                ret = check(next, 0.0, SP_INFINITY);
                 if (ret) {
                     data.sdw = 1.0f;
                 }
@@ -117,69 +117,215 @@ namespace sp{
     }
 
 
-    template <typename TYPE, typename ELEM>
-    SP_CPUFUNC void indexingKd(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src) {
-        dst.clear();
-        idxs.clear();
-        if (src.size() == 0) return;
-
-        const int dim = sizeof(TYPE) / sizeof(ELEM);
-        const int num = src.size() * dim;
+    //--------------------------------------------------------------------------------
+    // vertex welding
+    //--------------------------------------------------------------------------------
+    //
+    // src[i] is mapped to the earliest unique vertex within tol (greedy in index order),
+    // so dst keeps the order of first appearance and the result is stable.
+    // - tol == 0 : exact match of the bytes (same as the hash, so -0.0 and 0.0 are different)
+    // - tol > 0  : spatial hash (cell size = 2 * tol), 2^dim cells on the near side are searched
+    // the hash keys are computed in parallel.
+    // indexing() matches by operator == (1e-6 per component) on the spatial hash.
+    //
+
+    namespace _vertex {
+
+        SP_CPUFUNC unsigned int hashByte(const void *ptr, const int size) {
+            const Byte *p = static_cast<const Byte*>(ptr);
+            unsigned int h = 2166136261u;
+            for (int i = 0; i < size; i++) {
+                h = (h ^ p[i]) * 16777619u;
+            }
+            return h;
+        }
 
-        KdTree<ELEM> kdtree(dim);
+        SP_CPUFUNC unsigned int hashCell(const long long *cell, const int dim) {
+            unsigned int h = 0;
+            for (int i = 0; i < dim; i++) {
+                const unsigned long long c = static_cast<unsigned long long>(cell[i]);
+                h ^= static_cast<unsigned int>(c ^ (c >> 32)) * 2654435761u + 0x9e3779b9u + (h << 6) + (h >> 2);
+            }
+            return h;
+        }
 
-        for (int i = 0; i < src.size(); i++) {
-            kdtree.addData(&src[i]);
+        // cell index (64 bit, clamped to +-2^62 so that the near cell does not overflow)
+        SP_CPUFUNC long long getCell(const double c) {
+            const double lim = 4611686018427387904.0;
+            if (c < lim && c > -lim) return static_cast<long long>(c);
+            return (c >= lim) ? (1LL << 62) : -(1LL << 62);
         }
-        kdtree.makeTree();
 
-        dst.clear();
-        idxs.resize(src.size());
+        // open addressing table (key -> first index, the others are linked by next)
+        class HashTable {
+            Mem1<int> m_slots;
+            unsigned int m_mask;
 
-        Mem1<int> refs(src.size());
-        for (int i = 0; i < src.size(); i++) {
-            refs[i] = -1;
+        public:
+            void init(const int num) {
+                int size = 16;
+                while (size < 2 * num) size *= 2;
 
-            const Mem1<int> index = kdtree.search(&src[i], 0.0001);
-            int minv = num;
-            for (int k = 0; k < index.size(); k++) {
-                minv = min(minv, index[k]);
+                m_slots.resize(size);
+                for (int i = 0; i < size; i++) {
+                    m_slots[i] = -1;
+                }
+                m_mask = size - 1;
             }
 
-            if (i == minv) {
-                refs[i] = dst.size();
-                dst.push(src[i]);
+            // equal : bool (const int id)
+            template<typename EQUAL>
+            int& find(const unsigned int hash, const EQUAL &equal) {
+                unsigned int s = hash & m_mask;
+                while (m_slots[s] >= 0 && equal(m_slots[s]) == false) {
+                    s = (s + 1) & m_mask;
+                }
+                return m_slots[s];
             }
-            idxs[i] = refs[minv];
-        }
+        };
 
-    }
+        // box : |u - v| < tol for each component (otherwise euclidean distance <= tol)
+        template <typename TYPE, typename ELEM>
+        SP_CPUFUNC void weld(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src, const double tol, const bool box) {
+            dst.clear();
+            idxs.clear();
+            if (src.size() == 0) return;
 
-    template <typename TYPE>
-    SP_CPUFUNC void indexing(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src) {
-        dst.clear();
-        idxs.clear();
-        if (src.size() == 0) return;
-
-        dst.clear();
-        idxs.resize(src.size());
-
-        for (int i = 0; i < src.size(); i++) {
-            int ref = -1;
-            for (int j = 0; j < dst.size(); j++) {
-                if (src[i] == dst[j]) {
-                    ref = j;
+            const int num = src.size();
+            idxs.resize(num);
+            dst.reserve(num);
+
+            // unique index of each unique vertex (-1 : not unique)
+            Mem1<int> refs(num);
+
+            Mem1<int> next(num);
+            Mem1<unsigned int> hashs(num);
+
+            _vertex::HashTable table;
+            table.init(num);
+
+            if (tol <= 0.0) {
+                parallel_for(0, num, [&](const int i) {
+                    hashs[i] = _vertex::hashByte(&src[i], sizeof(TYPE));
+                });
+
+                for (int i = 0; i < num; i++) {
+                    int &head = table.find(hashs[i], [&](const int r) { return ::memcmp(&src[r], &src[i], sizeof(TYPE)) == 0; });
+                    if (head >= 0) {
+                        idxs[i] = refs[head];
+                    }
+                    else {
+                        head = i;
+                        refs[i] = dst.size();
+                        idxs[i] = dst.size();
+                        dst.push(src[i]);
+                    }
                 }
+                return;
             }
-            if (ref >= 0) {
-                idxs[i] = ref;
+
+            const int dim = sizeof(TYPE) / sizeof(ELEM);
+            SP_ASSERT(dim >= 1 && dim <= 4);
+
+            const double unit = 2.0 * tol;
+
+            // cell and near side (-1 / +1) of each dimension
+            Mem1<long long> cells(num * dim);
+            Mem1<char> sides(num * dim);
+            parallel_for(0, num, [&](const int i) {
+                const ELEM *v = reinterpret_cast<const ELEM*>(&src[i]);
+                for (int d = 0; d < dim; d++) {
+                    const double c = ::floor(v[d] / unit);
+                    cells[i * dim + d] = _vertex::getCell(c);
+                    sides[i * dim + d] = (v[d] / unit - c < 0.5) ? -1 : +1;
+                }
+                hashs[i] = _vertex::hashCell(&cells[i * dim], dim);
+            });
+
+            const int ncnt = 1 << dim;
+            const double sqtol = tol * tol;
+
+            for (int i = 0; i < num; i++) {
+                const ELEM *v = reinterpret_cast<const ELEM*>(&src[i]);
+
+                int best = -1;
+                for (int n = 0; n < ncnt; n++) {
+                    long long cell[4];
+                    for (int d = 0; d < dim; d++) {
+                        cell[d] = cells[i * dim + d] + (((n >> d) & 1) ? sides[i * dim + d] : 0);
+                    }
+
+                    const unsigned int hash = (n == 0) ? hashs[i] : _vertex::hashCell(cell, dim);
+                    const int head = table.find(hash, [&](const int r) { return cmp(&cells[r * dim], cell, dim); });
+                    for (int r = head; r >= 0; r = next[r]) {
+                        if (best >= 0 && r > best) continue;
+
+                        const ELEM *u = reinterpret_cast<const ELEM*>(&src[r]);
+                        bool same = true;
+                        if (box == true) {
+                            for (int d = 0; d < dim; d++) {
+                                const double dif = u[d] - v[d];
+                                same &= (dif < tol && dif > -tol);
+                            }
+                        }
+                        else {
+                            double sum = 0.0;
+                            for (int d = 0; d < dim; d++) {
+                                sum += (u[d] - v[d]) * (u[d] - v[d]);
+                            }
+                            same = (sum <= sqtol);
+                        }
+                        if (same == true) best = r;
+                    }
+                }
+
+                if (best >= 0) {
+                    idxs[i] = refs[best];
+                }
+                else {
+                    int &head = table.find(hashs[i], [&](const int r) { return cmp(&cells[r * dim], &cells[i * dim], dim); });
+                    next[i] = head;
+                    head = i;
+
+                    refs[i] = dst.size();
+                    idxs[i] = dst.size();
+                    dst.push(src[i]);
+                }
             }
-            else {
-                idxs[i] = dst.size();
-                dst.push(src[i]);
+        }
+    }
+
+    template <typename TYPE, typename ELEM = SP_REAL>
+    SP_CPUFUNC void weldVertex(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src, const double tol = 0.0) {
+        _vertex::weld<TYPE, ELEM>(dst, idxs, src, tol, false);
+    }
+
+    // vertex (welded) and index (3 per mesh)
+    SP_CPUFUNC void weldMesh(Mem1<Vec3> &vtxs, Mem1<int> &idxs, const Mem1<Mesh3> &meshes, const double tol = 0.0) {
+        Mem1<Vec3> pnts(meshes.size() * 3);
+        for (int i = 0; i < meshes.size(); i++) {
+            for (int j = 0; j < 3; j++) {
+                pnts[i * 3 + j] = meshes[i].pos[j];
             }
         }
+        weldVertex(vtxs, idxs, pnts, tol);
+    }
 
+    template <typename TYPE, typename ELEM>
+    SP_CPUFUNC void indexingKd(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src) {
+        weldVertex<TYPE, ELEM>(dst, idxs, src, 0.0001);
+    }
+
+    // same vertex : operator == (SP_REAL vector, 1e-6 per component), otherwise exact bytes
+    template <typename TYPE>
+    SP_CPUFUNC void indexing(Mem1<TYPE> &dst, Mem1<int> &idxs, const Mem1<TYPE> &src) {
+        const int dim = sizeof(TYPE) / sizeof(SP_REAL);
+        if (sizeof(TYPE) % sizeof(SP_REAL) == 0 && dim >= 1 && dim <= 4) {
+            _vertex::weld<TYPE, SP_REAL>(dst, idxs, src, 1.0e-6, true);
+        }
+        else {
+            _vertex::weld<TYPE, SP_REAL>(dst, idxs, src, 0.0, false);
+        }
     }
 }
 #endif
\ No newline at end of file
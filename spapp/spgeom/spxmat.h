@@ -6,6 +6,7 @@
 #define __SP_XMAT_H__
 
 #include "spcore/spcore.h"
+#include "spapp/spgeom/spransac.h"
 
 namespace sp{
 
@@ -188,8 +189,9 @@ namespace sp{
         const Vec3 n0 = getVec3(vec0.x, vec0.y, 1.0);
         const Vec3 n1 = getVec3(vec1.x, vec1.y, 1.0);
 
-        const Vec3 M0 = M * n0;
-        const Vec3 M1 = trnMat(M) * n1;
+        const SP_REAL *m = M.ptr;
+        const Vec3 M0 = getVec3(m[0] * n0.x + m[1] * n0.y + m[2] * n0.z, m[3] * n0.x + m[4] * n0.y + m[5] * n0.z, m[6] * n0.x + m[7] * n0.y + m[8] * n0.z);
+        const Vec3 M1 = getVec3(m[0] * n1.x + m[3] * n1.y + m[6] * n1.z, m[1] * n1.x + m[4] * n1.y + m[7] * n1.z, m[2] * n1.x + m[5] * n1.y + m[8] * n1.z);
 
         // |a*x + b*y + c| / sqrt(a*a + b*b)
         const SP_REAL err0 = fabs(dotVec(n1, M0)) / max(pythag(M0.x, M0.y), SP_SMALL);
@@ -697,7 +699,8 @@ namespace sp{
     // RANSAC + refine
     //--------------------------------------------------------------------------------
 
-    SP_CPUFUNC bool calcHMatRANSAC(Mat &H, const Mem<Vec2> &pixs, const Mem<Vec2> &objs, const SP_REAL thresh = 5.0) {
+    // quals : match quality (PROSAC ordering) or NULL
+    SP_CPUFUNC bool calcHMatRANSAC(Mat &H, const Mem<Vec2> &pixs, const Mem<Vec2> &objs, const SP_REAL thresh = 5.0, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(pixs.size() == objs.size());
 
         const int num = pixs.size();
@@ -708,33 +711,13 @@ namespace sp{
             return calcHMat(H, pixs, objs);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
+        const SP_REAL maxe = ransac(H, num, unit, [&](Mem1<Mat> &tests, const int *index) -> bool {
+            tests.resize(1);
+            return calcHMat(tests[0], ransacPick(pixs, index, unit), ransacPick(objs, index, unit), 1);
+        }, [&](const Mat &test, const int i) {
+            return errHMat(test, pixs[i], objs[i]);
+        }, thresh, quals);
 
-        RandomSample<Vec2> _pixs(pixs, unit);
-        RandomSample<Vec2> _objs(objs, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rpixs = _pixs.gen(it);
-            const Mem1<Vec2> robjs = _objs.gen(it);
-
-            Mat test;
-            if (calcHMat(test, rpixs, robjs, 1) == false) continue;
-
-            const Mem1<SP_REAL> errs = errHMat(test, pixs, objs);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = ransacAdaptiveStop(eval, unit);
-
-                H = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d rate %.2lf\n", it, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -746,7 +729,7 @@ namespace sp{
     }
 
     // calc essential matrix
-    SP_CPUFUNC bool calcEMatRANSAC(Mat &E, const Mem1<Vec2> &npxs0, const Mem1<Vec2> &npxs1, const SP_REAL thresh = 2.0 * 1.0e-3) {
+    SP_CPUFUNC bool calcEMatRANSAC(Mat &E, const Mem1<Vec2> &npxs0, const Mem1<Vec2> &npxs1, const SP_REAL thresh = 2.0 * 1.0e-3, const Mem<SP_REAL> *quals = NULL) {
         SP_ASSERT(npxs0.size() == npxs1.size());
 
         const int num = npxs0.size();
@@ -757,35 +740,12 @@ namespace sp{
             return calcEMat(E, npxs0, npxs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _npxs0(npxs0, unit);
-        RandomSample<Vec2> _npxs1(npxs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
-
-            const Mem1<Vec2> rnpxs0 = _npxs0.gen(it);
-            const Mem1<Vec2> rnpxs1 = _npxs1.gen(it);
-
-            Mem1<Mat> tests;
-            if (calcEMat(tests, rnpxs0, rnpxs1) == false) continue;
+        const SP_REAL maxe = ransac(E, num, unit, [&](Mem1<Mat> &tests, const int *index) -> bool {
+            return calcEMat(tests, ransacPick(npxs0, index, unit), ransacPick(npxs1, index, unit));
+        }, [&](const Mat &test, const int i) {
+            return errEMat(test, npxs0[i], npxs1[i]);
+        }, thresh, quals);
 
-            for (int i = 0; i < tests.size(); i++) {
-                const Mem1<SP_REAL> errs = errEMat(tests[i], npxs0, npxs1);
-                const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-                if (eval > maxe) {
-                    //SP_PRINTD("eval %lf\n", eval);
-                    maxe = eval;
-                    maxit = min(maxit, ransacAdaptiveStop(eval, unit));
-
-                    E = tests[i];
-                }
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d num %d rate %.2lf\n", it, num, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
@@ -801,7 +761,7 @@ namespace sp{
     }
 
     // calc fundamental matrix
-    SP_CPUFUNC bool calcFMatRANSAC(Mat &F, const Mem1<Vec2> &pixs0, const Mem1<Vec2> &pixs1, const SP_REAL thresh = 2.0){
+    SP_CPUFUNC bool calcFMatRANSAC(Mat &F, const Mem1<Vec2> &pixs0, const Mem1<Vec2> &pixs1, const SP_REAL thresh = 2.0, const Mem<SP_REAL> *quals = NULL){
         SP_ASSERT(pixs0.size() == pixs1.size());
 
         const int num = pixs0.size();
@@ -812,33 +772,13 @@ namespace sp{
             return calcFMat(F, pixs0, pixs1);
         }
 
-        int maxit = ransacAdaptiveStop(SP_RANSAC_MINEVAL, unit);
-
-        RandomSample<Vec2> _pixs0(pixs0, unit);
-        RandomSample<Vec2> _pixs1(pixs1, unit);
-
-        SP_REAL maxe = 0.0;
-        int it = 0;
-        for (it = 0; it < maxit; it++) {
+        const SP_REAL maxe = ransac(F, num, unit, [&](Mem1<Mat> &tests, const int *index) -> bool {
+            tests.resize(1);
+            return calcEMat8p(tests[0], ransacPick(pixs0, index, unit), ransacPick(pixs1, index, unit));
+        }, [&](const Mat &test, const int i) {
+            return errFMat(test, pixs0[i], pixs1[i]);
+        }, thresh, quals);
 
-            const Mem1<Vec2> rpixs0 = _pixs0.gen(it);
-            const Mem1<Vec2> rpixs1 = _pixs1.gen(it);
-
-            Mat test;
-            if (calcEMat8p(test, rpixs0, rpixs1) == false) continue;
-
-            const Mem1<SP_REAL> errs = errFMat(test, pixs0, pixs1);
-            const SP_REAL eval = ransacEval(errs, unit, thresh);
-
-            if (eval > maxe) {
-                //SP_PRINTD("eval %lf\n", eval);
-                maxe = eval;
-                maxit = min(maxit, ransacAdaptiveStop(eval, unit));
-
-                F = test;
-            }
-        }
-        //SP_PRINTD("RANSAC iteration %d num %d rate %.2lf\n", it, num, maxe);
         if (maxe < SP_RANSAC_MINEVAL) return false;
 
         // refine
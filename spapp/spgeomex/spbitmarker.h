@@ -243,6 +243,8 @@ namespace sp{
 
     private:
         bool _execute(const Mem2<Byte> &img){
+            // frame arena for temporary buffers
+            MemFrame frame;
 
             // set default camera parameter
             if (cmp(m_cam.dsize, img.dsize, 2) == false) {
@@ -149,6 +149,8 @@ namespace sp{
     private:
 
         bool _execute(const Mem2<Byte> &img){
+            // frame arena for temporary buffers
+            MemFrame frame;
 
             // set default camera parameter
             if (cmp(m_cam.dsize, img.dsize, 2) == false) {
@@ -220,13 +222,14 @@ namespace sp{
             }
 
             Mem2<int> labelMap;
+            Mem1<LabelInfo> labelInfos;
             {
 
                 Mem2<Byte> minBin;
                 binalizeBlock(minBin, minImg, round(BIN_BLOCKSIZE * MIN_IMGSIZE));
                 invert(minBin, minBin);
 
-                labeling(labelMap, minBin);
+                labeling(labelMap, labelInfos, minBin);
                  
                 SP_HOLDER_SET("labelMap", labelMap);
             }
@@ -234,7 +237,7 @@ namespace sp{
             // get label center (and refine center)
             {
 
-                getBlob(pixs, img, minImg, labelMap, getMinScale());
+                getBlob(pixs, img, minImg, getLabelRect(labelInfos), getMinScale());
 
                 SP_HOLDER_SET("pixs", pixs);
             }
@@ -305,9 +308,7 @@ namespace sp{
         // modules
         //--------------------------------------------------------------------------------
 
-        void getBlob(Mem1<Vec2> &pixs, const Mem2<Byte> &orgImg, const Mem2<Byte> &minImg, const Mem2<int> &labelMap, const SP_REAL minScale){
-
-            const Mem1<Rect2> rects = getLabelRect(labelMap);
+        void getBlob(Mem1<Vec2> &pixs, const Mem2<Byte> &orgImg, const Mem2<Byte> &minImg, const Mem1<Rect2> &rects, const SP_REAL minScale){
 
             for (int i = 0; i < rects.size(); i++) {
                 const Rect2 minRect = extRect(rects[i], 1);
@@ -211,18 +211,19 @@ namespace sp{
 
         void detect(Mem1<Vec2> &pixs, Mem1<SP_REAL> &scales, const Mem2<Byte> &img) {
             Mem2<int> labelMap;
+            Mem1<LabelInfo> labelInfos;
             {
                 Mem2<Byte> bin;
                 binalizeAdapt(bin, img);
 
-                labeling(labelMap, bin);
+                labeling(labelMap, labelInfos, bin);
 
                 SP_HOLDER_SET("labelMap", labelMap);
             }
 
             // get label center (and refine center)
             {
-                getBlob(pixs, scales, labelMap);
+                getBlob(pixs, scales, labelMap, getLabelRect(labelInfos));
 
                 SP_HOLDER_SET("pixs", pixs);
             }
@@ -275,9 +276,7 @@ namespace sp{
         // modules
         //--------------------------------------------------------------------------------
 
-        void getBlob(Mem1<Vec2> &pixs, Mem1<SP_REAL> &scales, const Mem2<int> &labelMap) {
-
-            const Mem1<Rect2> rects = getLabelRect(labelMap);
+        void getBlob(Mem1<Vec2> &pixs, Mem1<SP_REAL> &scales, const Mem2<int> &labelMap, const Mem1<Rect2> &rects) {
 
             for (int i = 0; i < rects.size(); i++) {
                 const Rect2 rect = extRect(rects[i], 1);
@@ -92,7 +92,7 @@ namespace sp{
                     errs[i] = normVec(err);
                 }
                 
-                Mat delta;
+                MatN<6, 1> delta;
                 if (solver::solveAX_B(delta, J, E, solver::calcW(errs)) == false) return false;
 
                 pose = updatePose(pose, delta.ptr);
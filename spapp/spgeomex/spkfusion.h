@@ -8,15 +8,33 @@
 #include "spcore/spcore.h"
 #include "spapp/spgeom/spdepth.h"
 #include "spapp/spgeomex/spvoxel.h"
+#include "spapp/spgeomex/spvoxelhash.h"
 
 namespace sp{
 
     class KinectFusion{
 
+    public:
+
+        // tsdf map type
+        enum MapType {
+            // dense voxel (size^3)
+            Dense,
+
+            // voxel block hashing (blocks near the surface only)
+            Hash
+        };
+
     private:
+        // tsdf map type
+        MapType m_type;
+
         // tsdf map
         Voxel<> m_tsdf;
 
+        // tsdf map (sparse)
+        VoxelHash m_hash;
+
         // casted pn
         Mem2<VecPD3> m_cast;
 
@@ -35,8 +53,18 @@ namespace sp{
             init(100, 2.0, getCamParam(0, 0), zeroPose());
         }
 
-        void init(const int size, const double unit, const CamParam &cam, const Pose &base) {
-            m_tsdf.init(size, unit);
+        // size : voxel num per side (Dense only)
+        void init(const int size, const double unit, const CamParam &cam, const Pose &base, const MapType type = Dense) {
+            m_type = type;
+
+            if (m_type == Dense) {
+                m_tsdf.init(size, unit);
+                m_hash.clear();
+            }
+            else {
+                m_tsdf = Voxel<>();
+                m_hash.init(unit);
+            }
 
             m_cast.resize(cam.dsize);
             m_cast.zero();
@@ -71,8 +99,16 @@ namespace sp{
             return (m_track == true) ? &m_cast : NULL; ;
         }
 
+        MapType getMapType() const {
+            return m_type;
+        }
+
         const Voxel<>* getMap() const {
-            return (m_track == true) ? &m_tsdf : NULL; ;
+            return (m_track == true && m_type == Dense) ? &m_tsdf : NULL; ;
+        }
+
+        const VoxelHash* getHashMap() const {
+            return (m_track == true && m_type == Hash) ? &m_hash : NULL; ;
         }
 
 
@@ -90,13 +126,21 @@ namespace sp{
         bool _execute(const Mem2<SP_REAL> &depth){
             SP_LOGGER_SET("KinectFusion::execute");
 
+            // frame arena for temporary buffers
+            MemFrame frame;
+
             if (cmp(m_cam.dsize, depth.dsize, 2) == false) {
                 return false;
             }
 
             // clear data
             if (m_track == false){
-                m_tsdf.zero();
+                if (m_type == Dense) {
+                    m_tsdf.zero();
+                }
+                else {
+                    m_hash.zero();
+                }
                 m_cast.zero();
             }
 
@@ -118,12 +162,22 @@ namespace sp{
 
                 {
                     SP_LOGGER_SET("KinectFusion::updateTSDF");
-                    updateTSDF(m_tsdf, m_cam, m_pose, depth);
+                    if (m_type == Dense) {
+                        updateTSDF(m_tsdf, m_cam, m_pose, depth);
+                    }
+                    else {
+                        updateTSDF(m_hash, m_cam, m_pose, depth);
+                    }
                 }
 
                 {
                     SP_LOGGER_SET("KinectFusion::rayCasting");
-                    rayCasting(m_cast, m_cam, m_pose, m_tsdf);
+                    if (m_type == Dense) {
+                        rayCasting(m_cast, m_cam, m_pose, m_tsdf);
+                    }
+                    else {
+                        rayCasting(m_cast, m_cam, m_pose, m_hash);
+                    }
                 }
                 m_track = true;
             }
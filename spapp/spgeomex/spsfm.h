@@ -7,7 +7,9 @@
 
 #include "spcore/spcore.h"
 #include "spapp/spimgex/spfeature.h"
+#include "spapp/spimgex/spdscindex.h"
 #include "spapp/spgeom/spgeom.h"
+#include "spapp/spgeom/spbundle.h"
 
 namespace sp {
 
@@ -40,6 +42,9 @@ namespace sp {
             // fix flag
             bool fix;
 
+            // descriptor index
+            DscIndex index;
+
             ViewEx() : View() {
                 state = POSE_NULL;
 
@@ -66,6 +71,8 @@ namespace sp {
 
                 fix = view.fix;
 
+                index = view.index;
+
                 return *this;
             }
         };
@@ -215,6 +222,12 @@ namespace sp {
             return true;
         }
 
+        // global refinement (bundle adjustment of valid views and map points)
+        bool refine(const int maxit = 10) {
+
+            return refine(m_views, m_mpnts, maxit);
+        }
+
 
     private:
 
@@ -228,6 +241,8 @@ namespace sp {
 
         int MAX_UPDATE = 3;
 
+        int REFINE_CYCLE = 4;
+
         double MAX_NEARPOSE = 30.0 * SP_PI / 180.0;
 
 
@@ -288,6 +303,11 @@ namespace sp {
                     view.upcnt = min(m_views.size(), view.upcnt + 1);
                 }
 
+                // global refinement
+                if ((m_update + 1) % REFINE_CYCLE == 0) {
+                    refine(m_views, m_mpnts, 10);
+                }
+
                 m_update++;
             }
             catch (const char *str) {
@@ -328,6 +348,7 @@ namespace sp {
             view.img = img;
             view.cam = cam;
             view.ftrs = SIFT::getFtrs(img);
+            view.index.build(view.ftrs);
 
             if (hint != NULL) {
                 view.state = ViewEx::POSE_HINT;
@@ -353,7 +374,7 @@ namespace sp {
             pair.a = a;
             pair.b = b;
 
-            pair.matches = findMatch(views[a]->ftrs, views[b]->ftrs);
+            pair.matches = findMatch(views[a]->index, views[b]->index);
             pair.eval = getMatchEval(pair.matches);
 
             if (pair.eval > MIN_MATCHEVAL) {
@@ -743,6 +764,69 @@ namespace sp {
             return true;
         }
 
+        bool refine(Mem1<ViewEx*> &views, Mem1<MapPnt*> &mpnts, const int maxit) {
+
+            BundleAdjust ba;
+            ba.setKernel(BundleAdjust::KERNEL_TUKEY, MPNT_PRJERR);
+
+            // views (the first valid view is fixed)
+            Mem1<int> vids(views.size());
+            int vnum = 0;
+            for (int v = 0; v < views.size(); v++) {
+                vids[v] = -1;
+                if (views[v]->state != ViewEx::POSE_VALID) continue;
+
+                const bool fix = (views[v]->fix == true || vnum == 0) ? true : false;
+                ba.addCam(views[v]->cam, true);
+                vids[v] = ba.addPose(views[v]->pose, fix);
+                vnum++;
+            }
+            if (vnum < 2) return false;
+
+            // map points (observed by 2 or more valid views)
+            Mem1<int> mids(mpnts.size());
+            for (int m = 0; m < mpnts.size(); m++) {
+                mids[m] = -1;
+
+                const MapPnt &mpnt = *mpnts[m];
+                if (mpnt.valid == false) continue;
+
+                Mem1<int> tids;
+                for (int i = 0; i < mpnt.views.size(); i++) {
+                    int id = -1;
+                    for (int v = 0; v < views.size(); v++) {
+                        if (views[v] == mpnt.views[i]) {
+                            id = vids[v];
+                            break;
+                        }
+                    }
+                    tids.push(id);
+                }
+
+                int cnt = 0;
+                for (int i = 0; i < tids.size(); i++) {
+                    if (tids[i] >= 0) cnt++;
+                }
+                if (cnt < 2) continue;
+
+                mids[m] = ba.addPnt(mpnt.pos);
+                for (int i = 0; i < tids.size(); i++) {
+                    if (tids[i] >= 0) ba.addObs(tids[i], -1, tids[i], mids[m], mpnt.ftrs[i]->pix);
+                }
+            }
+
+            if (ba.execute(maxit) < 0.0) return false;
+
+            for (int v = 0; v < views.size(); v++) {
+                if (vids[v] >= 0) setView(*views[v], ba.getPose(vids[v]));
+            }
+            for (int m = 0; m < mpnts.size(); m++) {
+                if (mids[m] >= 0) setMPnt(*mpnts[m], ba.getPnt(mids[m]));
+            }
+
+            return true;
+        }
+
     public:
 
         //--------------------------------------------------------------------------------
@@ -721,7 +721,11 @@ namespace sp {
             }
 #endif
             {
-                meshes.reserve(voxel.vmap.size() * 10);
+                int num = 0;
+                for (int i = 0; i < zms.size(); i++) {
+                    num += zms[i].size();
+                }
+                meshes.reserve(num);
 
                 for (int z = vrect.dbase[2]; z < vrect.dbase[2] + vrect.dsize[2]; z++) {
                     const int mz = z - vrect.dbase[2];
@@ -0,0 +1,511 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_VOXELHASH_H__
+#define __SP_VOXELHASH_H__
+
+#include "spcore/spcore.h"
+#include "spapp/spgeomex/spvoxel.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // voxel hash (sparse tsdf)
+    //--------------------------------------------------------------------------------
+    //
+    // voxels are stored in 8^3 blocks that are allocated only near the observed
+    // surface, blocks are found by open addressing hash of the block index.
+    // voxel (x, y, z) is located at (x, y, z) * unit
+    //
+
+#define SP_VOXELHASH_BLOCK 8
+
+    class VoxelHash {
+
+    public:
+        static const int BSIZE = SP_VOXELHASH_BLOCK;
+        static const int BNUM = BSIZE * BSIZE * BSIZE;
+
+        struct Block {
+            // block index
+            int bx, by, bz;
+
+            // value map
+            char vmap[BNUM];
+
+            // weight map
+            char wmap[BNUM];
+        };
+
+        // voxel unit length
+        SP_REAL unit;
+
+    private:
+
+        struct Entry {
+            int bx, by, bz;
+            int id;
+        };
+
+        // hash table (power of 2)
+        Mem1<Entry> m_table;
+
+        // allocated blocks
+        Mem1<Block> m_blocks;
+
+        // allocated block range
+        int m_bmin[3];
+        int m_bmax[3];
+
+    public:
+
+        VoxelHash() {
+            unit = 0.0;
+            clear();
+        }
+
+        VoxelHash(const VoxelHash &voxel) {
+            *this = voxel;
+        }
+
+        VoxelHash& operator = (const VoxelHash &voxel) {
+            unit = voxel.unit;
+
+            m_table = voxel.m_table;
+            m_blocks = voxel.m_blocks;
+
+            for (int i = 0; i < 3; i++) {
+                m_bmin[i] = voxel.m_bmin[i];
+                m_bmax[i] = voxel.m_bmax[i];
+            }
+            return *this;
+        }
+
+        void init(const double unit) {
+            this->unit = unit;
+            zero();
+        }
+
+        // free all blocks
+        void clear() {
+            m_table.clear();
+            m_blocks.clear();
+            for (int i = 0; i < 3; i++) {
+                m_bmin[i] = +SP_INTMAX;
+                m_bmax[i] = -SP_INTMAX;
+            }
+        }
+
+        // remove all blocks (keep memory)
+        void zero() {
+            m_blocks.resize(0);
+            for (int i = 0; i < m_table.size(); i++) {
+                m_table[i].id = -1;
+            }
+            for (int i = 0; i < 3; i++) {
+                m_bmin[i] = +SP_INTMAX;
+                m_bmax[i] = -SP_INTMAX;
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // block
+        //--------------------------------------------------------------------------------
+
+        int size() const {
+            return m_blocks.size();
+        }
+
+        Block& getBlock(const int id) {
+            return m_blocks[id];
+        }
+
+        const Block& getBlock(const int id) const {
+            return m_blocks[id];
+        }
+
+        // block index of voxel (floor division)
+        static int bidx(const int x) {
+            return (x >= 0) ? x / BSIZE : (x + 1) / BSIZE - 1;
+        }
+
+        int find(const int bx, const int by, const int bz) const {
+            if (m_table.size() == 0) return -1;
+
+            const int mask = m_table.size() - 1;
+            for (int h = hash(bx, by, bz) & mask; ; h = (h + 1) & mask) {
+                const Entry &e = m_table[h];
+                if (e.id < 0) break;
+                if (e.bx == bx && e.by == by && e.bz == bz) return e.id;
+            }
+            return -1;
+        }
+
+        // find or allocate block (not thread safe)
+        int alloc(const int bx, const int by, const int bz) {
+            const int id = find(bx, by, bz);
+            if (id >= 0) return id;
+
+            if (2 * (m_blocks.size() + 1) > m_table.size()) {
+                rehash(max(1024, 2 * m_table.size()));
+            }
+
+            Block &block = *m_blocks.extend();
+            block.bx = bx;
+            block.by = by;
+            block.bz = bz;
+            memset(block.vmap, -SP_VOXEL_VMAX, BNUM);
+            memset(block.wmap, 0, BNUM);
+
+            insert(bx, by, bz, m_blocks.size() - 1);
+
+            const int b[3] = { bx, by, bz };
+            for (int i = 0; i < 3; i++) {
+                m_bmin[i] = min(m_bmin[i], b[i]);
+                m_bmax[i] = max(m_bmax[i], b[i]);
+            }
+            return m_blocks.size() - 1;
+        }
+
+        // allocated range [voxel]
+        bool getRange(int *minv, int *maxv) const {
+            if (m_blocks.size() == 0) return false;
+            for (int i = 0; i < 3; i++) {
+                minv[i] = m_bmin[i] * BSIZE;
+                maxv[i] = m_bmax[i] * BSIZE + BSIZE - 1;
+            }
+            return true;
+        }
+
+        // memory size [byte]
+        size_t bytes() const {
+            return sizeof(Block) * m_blocks.size() + sizeof(Entry) * m_table.size();
+        }
+
+        //--------------------------------------------------------------------------------
+        // voxel
+        //--------------------------------------------------------------------------------
+
+        static int vidx(const int x, const int y, const int z) {
+            const int bx = x - bidx(x) * BSIZE;
+            const int by = y - bidx(y) * BSIZE;
+            const int bz = z - bidx(z) * BSIZE;
+            return (bz * BSIZE + by) * BSIZE + bx;
+        }
+
+        static void update(Block &block, const int i, const double srcv) {
+            if (srcv > +1.0) return;
+
+            char &val = block.vmap[i];
+            char &wei = block.wmap[i];
+
+            val = cast<char>((val * wei + SP_VOXEL_VMAX * srcv) / (wei + 1.0));
+            wei = min(wei + 1, SP_VOXEL_WMAX);
+        }
+
+        char getv(const int x, const int y, const int z) const {
+            const int id = find(bidx(x), bidx(y), bidx(z));
+            return (id >= 0) ? m_blocks[id].vmap[vidx(x, y, z)] : SP_VOXEL_NULL;
+        }
+
+        char getw(const int x, const int y, const int z) const {
+            const int id = find(bidx(x), bidx(y), bidx(z));
+            return (id >= 0) ? m_blocks[id].wmap[vidx(x, y, z)] : 0;
+        }
+
+        // trilinear interpolation
+        double getv(const Vec3 &pos) const {
+            const int x = static_cast<int>(floor(pos.x));
+            const int y = static_cast<int>(floor(pos.y));
+            const int z = static_cast<int>(floor(pos.z));
+            const double ax = pos.x - x;
+            const double ay = pos.y - y;
+            const double az = pos.z - z;
+
+            double val = 0.0;
+            for (int i = 0; i < 8; i++) {
+                const int dx = (i >> 0) & 1;
+                const int dy = (i >> 1) & 1;
+                const int dz = (i >> 2) & 1;
+                const double w = (dx ? ax : 1.0 - ax) * (dy ? ay : 1.0 - ay) * (dz ? az : 1.0 - az);
+                val += w * getv(x + dx, y + dy, z + dz);
+            }
+            return val;
+        }
+
+        Vec3 getn(const int x, const int y, const int z) const {
+            const double vx = getv(x + 1, y, z) - getv(x - 1, y, z);
+            const double vy = getv(x, y + 1, z) - getv(x, y - 1, z);
+            const double vz = getv(x, y, z + 1) - getv(x, y, z - 1);
+            return unitVec(getVec3(-vx, -vy, -vz));
+        }
+
+    private:
+
+        static int hash(const int bx, const int by, const int bz) {
+            const unsigned int h = static_cast<unsigned int>(bx) * 73856093u ^ static_cast<unsigned int>(by) * 19349669u ^ static_cast<unsigned int>(bz) * 83492791u;
+            return static_cast<int>(h & 0x7FFFFFFF);
+        }
+
+        void insert(const int bx, const int by, const int bz, const int id) {
+            const int mask = m_table.size() - 1;
+            int h = hash(bx, by, bz) & mask;
+            while (m_table[h].id >= 0) {
+                h = (h + 1) & mask;
+            }
+            Entry &e = m_table[h];
+            e.bx = bx;
+            e.by = by;
+            e.bz = bz;
+            e.id = id;
+        }
+
+        void rehash(const int tsize) {
+            m_table.resize(tsize);
+            for (int i = 0; i < m_table.size(); i++) {
+                m_table[i].id = -1;
+            }
+            for (int i = 0; i < m_blocks.size(); i++) {
+                const Block &block = m_blocks[i];
+                insert(block.bx, block.by, block.bz, i);
+            }
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // truncated signed distance function
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC void updateTSDF(VoxelHash &voxel, const CamParam &cam, const Pose &pose, const Mem2<SP_REAL> &depth, const SP_REAL mu = 5.0) {
+        const int B = VoxelHash::BSIZE;
+
+        const SP_REAL step = mu * voxel.unit;
+        const Pose ipose = invPose(pose);
+
+        // blocks on the truncation band of each ray
+        Mem1<Mem1<int> > bids(depth.dsize[1]);
+
+        parallel_for(0, depth.dsize[1], [&](const int v) {
+            Mem1<int> &list = bids[v];
+            list.reserve(depth.dsize[0] * 3);
+
+            for (int u = 0; u < depth.dsize[0]; u++) {
+                const SP_REAL d = depth(u, v);
+                if (d == 0.0) continue;
+
+                const Vec3 cvec = getVec3(invCam(cam, getVec2(u, v)), 1.0);
+
+                int pre[3] = { SP_INTMAX, SP_INTMAX, SP_INTMAX };
+                for (SP_REAL z = max(d - step, SP_SMALL); ; z += 0.5 * B * voxel.unit) {
+                    const SP_REAL cz = min(z, d + step);
+
+                    const Vec3 mpos = (ipose * (cvec * cz)) / voxel.unit;
+                    const int b[3] = {
+                        VoxelHash::bidx(round(mpos.x)), VoxelHash::bidx(round(mpos.y)), VoxelHash::bidx(round(mpos.z))
+                    };
+
+                    if (b[0] != pre[0] || b[1] != pre[1] || b[2] != pre[2]) {
+                        list.push(b, 3);
+                        memcpy(pre, b, sizeof(int) * 3);
+                    }
+                    if (cz >= d + step) break;
+                }
+            }
+        }, 8);
+
+        // allocate and list blocks to update
+        Mem1<int> ids;
+        {
+            Mem1<Byte> flags;
+            for (int v = 0; v < bids.size(); v++) {
+                const Mem1<int> &list = bids[v];
+                for (int i = 0; i < list.size(); i += 3) {
+                    const int id = voxel.alloc(list[i + 0], list[i + 1], list[i + 2]);
+
+                    if (id >= flags.size()) {
+                        const int s = flags.size();
+                        flags.extend(max(1, id + 1 - s));
+                        memset(&flags[s], 0, flags.size() - s);
+                    }
+                    if (flags[id] == 0) {
+                        flags[id] = 1;
+                        ids.push(id);
+                    }
+                }
+            }
+        }
+
+        // integrate only the listed blocks
+        parallel_for(0, ids.size(), [&](const int i) {
+            VoxelHash::Block &block = voxel.getBlock(ids[i]);
+
+            for (int z = 0; z < B; z++) {
+                for (int y = 0; y < B; y++) {
+                    for (int x = 0; x < B; x++) {
+                        const Vec3 mpos = getVec3(block.bx * B + x, block.by * B + y, block.bz * B + z);
+                        const Vec3 cpos = pose * (mpos * voxel.unit);
+                        if (cpos.z <= 0.0) continue;
+
+                        const Vec2 pix = mulCam(cam, prjVec(cpos));
+                        if (inRect(depth.dsize, pix.x, pix.y) == false) continue;
+
+                        const SP_REAL d = depth(round(pix.x), round(pix.y));
+                        if (d == 0.0) continue;
+
+                        const SP_REAL dist = max(cpos.z - d, -step) / step;
+                        VoxelHash::update(block, (z * B + y) * B + x, dist);
+                    }
+                }
+            }
+        }, 4);
+    }
+
+    SP_CPUFUNC void rayCasting(Mem2<VecPD3> &map, const CamParam &cam, const Pose &pose, const VoxelHash &voxel, const SP_REAL mu = 5.0) {
+
+        map.resize(cam.dsize);
+        map.zero();
+
+        int vmin[3], vmax[3];
+        if (voxel.getRange(vmin, vmax) == false) return;
+
+        const Pose ipose = invPose(pose);
+
+        // allocated block flags on the allocated range, empty blocks are rejected without hash lookups
+        // (unallocated blocks are stepped at mu voxels, the mean chord of an 8^3 block is 16/3 voxels
+        // so skipping to the block exit does not reduce samples at mu = 5)
+        const int B = VoxelHash::BSIZE;
+        const int bmin[3] = { vmin[0] / B, vmin[1] / B, vmin[2] / B };
+        const int bnum[3] = { (vmax[0] + 1) / B - bmin[0], (vmax[1] + 1) / B - bmin[1], (vmax[2] + 1) / B - bmin[2] };
+
+        Mem1<Byte> flags;
+        if (static_cast<double>(bnum[0]) * bnum[1] * bnum[2] <= (1 << 24)) {
+            flags.resize(bnum[0] * bnum[1] * bnum[2]);
+            flags.zero();
+            for (int i = 0; i < voxel.size(); i++) {
+                const VoxelHash::Block &block = voxel.getBlock(i);
+                flags[((block.bz - bmin[2]) * bnum[1] + block.by - bmin[1]) * bnum[0] + block.bx - bmin[0]] = 1;
+            }
+        }
+
+        parallel_for(0, map.dsize[1], [&](const int v) {
+            // last accessed block
+            int pre[3] = { SP_INTMAX, SP_INTMAX, SP_INTMAX };
+            int pid = -1;
+
+            auto getvw = [&](char &val, char &wei, const Vec3 &mpos) {
+                const int x = round(mpos.x);
+                const int y = round(mpos.y);
+                const int z = round(mpos.z);
+                const int b[3] = { VoxelHash::bidx(x), VoxelHash::bidx(y), VoxelHash::bidx(z) };
+
+                if (b[0] != pre[0] || b[1] != pre[1] || b[2] != pre[2]) {
+                    const int f[3] = { b[0] - bmin[0], b[1] - bmin[1], b[2] - bmin[2] };
+                    const bool out = (f[0] < 0 || f[0] >= bnum[0] || f[1] < 0 || f[1] >= bnum[1] || f[2] < 0 || f[2] >= bnum[2]);
+
+                    if (flags.size() > 0 && (out == true || flags[(f[2] * bnum[1] + f[1]) * bnum[0] + f[0]] == 0)) {
+                        pid = -1;
+                    }
+                    else {
+                        pid = voxel.find(b[0], b[1], b[2]);
+                    }
+                    memcpy(pre, b, sizeof(int) * 3);
+                }
+                if (pid < 0) {
+                    val = SP_VOXEL_NULL;
+                    wei = 0;
+                }
+                else {
+                    const int i = VoxelHash::vidx(x, y, z);
+                    val = voxel.getBlock(pid).vmap[i];
+                    wei = voxel.getBlock(pid).wmap[i];
+                }
+            };
+
+            for (int u = 0; u < map.dsize[0]; u++) {
+                const Vec3 cvec = getVec3(invCam(cam, getVec2(u, v)), 1.0);
+                const Vec3 mvec = ipose.rot * cvec;
+
+                // ray range (slab test on the allocated range)
+                double minv = SP_SMALL;
+                double maxv = +SP_INFINITY;
+                for (int i = 0; i < 3; i++) {
+                    const double a = (vmin[i] - 0.5) * voxel.unit;
+                    const double b = (vmax[i] + 0.5) * voxel.unit;
+                    const double p = acsv(ipose.pos, i);
+                    const double m = acsv(mvec, i);
+
+                    if (fabs(m) > SP_SMALL) {
+                        const double s0 = (a - p) / m;
+                        const double s1 = (b - p) / m;
+                        minv = max(minv, min(s0, s1));
+                        maxv = min(maxv, max(s0, s1));
+                    }
+                    else if (p < a || p > b) {
+                        maxv = -SP_INFINITY;
+                    }
+                }
+                if (minv >= maxv) continue;
+
+                SP_REAL detect = -1.0;
+
+                char pre = 0;
+                SP_REAL prd = minv;
+                SP_REAL step = mu;
+                bool fine = false;
+
+                for (SP_REAL d = minv; d < maxv; d += step * voxel.unit) {
+                    const Vec3 mpos = (ipose.pos + mvec * d) / voxel.unit;
+
+                    char val, wei;
+                    getvw(val, wei, mpos);
+
+                    if (wei == 0) {
+                        pre = 0;
+                        step = mu;
+                        fine = false;
+                        continue;
+                    }
+
+                    if (val >= 0 && pre < 0) {
+                        if (step == 1.0) {
+                            detect = d - step * voxel.unit * val / (val - pre);
+
+                            // refine by interpolated values
+                            const double v0 = voxel.getv((ipose.pos + mvec * prd) / voxel.unit);
+                            const double v1 = voxel.getv(mpos);
+                            if (v0 < 0.0 && v1 >= 0.0) {
+                                detect = d - (d - prd) * v1 / (v1 - v0);
+                            }
+                            break;
+                        }
+
+                        // back to the previous sample and search finely
+                        d = prd - voxel.unit;
+                        pre = 0;
+                        step = 1.0;
+                        fine = true;
+                        continue;
+                    }
+                    pre = val;
+                    prd = d;
+
+                    step = (fine == true || val > -0.9 * SP_VOXEL_VMAX) ? 1.0 : mu;
+                }
+
+                if (detect > 0.0) {
+                    const Vec3 mpos = (ipose.pos + mvec * detect) / voxel.unit;
+                    const Vec3 mnrm = voxel.getn(round(mpos.x), round(mpos.y), round(mpos.z));
+
+                    const Vec3 cpos = cvec * detect;
+                    const Vec3 cnrm = pose.rot * mnrm;
+
+                    map(u, v) = getVecPD3(cpos, cnrm);
+                }
+            }
+        }, 4);
+    }
+}
+
+#endif
@@ -12,19 +12,9 @@ namespace sp{
 
     SP_CPUFUNC void binalize(Mem2<Byte> &dst, const Mem2<Byte> &src, const int thresh, const bool inv = false){
         dst.resize(src.dsize);
-        const Mem2<Byte> &tmp = (&dst != &src) ? src : clone(src);
-
-        if (inv == false) {
-            for (int i = 0; i < dst.size(); i++) {
-                dst[i] = (tmp[i] >= thresh) ? 255 : 0;
-            }
-        }
-        else {
-            for (int i = 0; i < dst.size(); i++) {
-                dst[i] = (tmp[i] < thresh) ? 255 : 0;
-            }
-        }
 
+        // element-wise, in place is allowed
+        simdThresh(dst.ptr, src.ptr, dst.size(), thresh, inv);
     }
 
     SP_CPUFUNC void binalizeAdapt(Mem2<Byte> &dst, const Mem2<Byte> &src, const bool inv = false){
@@ -83,35 +73,23 @@ namespace sp{
                 Byte maxv = 0;
                 Byte minv = SP_BYTEMAX;
 
+                // clamped region (same as tmp(x, y) with border clamp)
                 const int margin = blockSize / 2;
-                for (int y = v - margin; y < sizeY + margin; y++){
-                    for (int x = u - margin; x < sizeX + margin; x++){
-                        const Byte val = tmp(x, y);
-                        maxv = max(maxv, val);
-                        minv = min(minv, val);
-                    }
-                }
+                const int x0 = max(0, u - margin);
+                const int x1 = min(src.dsize[0], sizeX + margin);
+                const int y0 = max(0, v - margin);
+                const int y1 = min(src.dsize[1], sizeY + margin);
+
+                simdMinMax(minv, maxv, &pSrc[y0 * step + x0], step, x1 - x0, y1 - y0);
 
                 const int thresh = (maxv + minv) / 2;
-                if (inv == false) {
-                    for (int y = v; y < sizeY; y++) {
-                        for (int x = u; x < sizeX; x++) {
-                            pDst[y * step + x] = (pSrc[y * step + x] >= thresh) ? 255 : 0;
-                        }
-                    }
-                }
-                else {
-                    for (int y = v; y < sizeY; y++) {
-                        for (int x = u; x < sizeX; x++) {
-                            pDst[y * step + x] = (pSrc[y * step + x] < thresh) ? 255 : 0;
-                        }
-                    }
+                for (int y = v; y < sizeY; y++) {
+                    simdThresh(&pDst[y * step + u], &pSrc[y * step + u], sizeX - u, thresh, inv);
                 }
             }
         }
     }
 
-
 }
 
 #endif
\ No newline at end of file
@@ -127,6 +127,234 @@ namespace sp{
         }
     }
 
+    //--------------------------------------------------------------------------------
+    // separable filter (tiled, x/y pass fused)
+    //--------------------------------------------------------------------------------
+
+    namespace _sepfilter {
+
+        // working set per tile [byte]
+        static const int TILE_CACHE = 128 * 1024;
+
+        // fixed point shift for Byte
+        static const int FIX_SHIFT = 14;
+
+        // accumulator type
+        template<typename ELEM> struct Acc { typedef double TYPE; };
+        template<> struct Acc<Byte> { typedef int TYPE; };
+
+        // tap weights for interior (id = 0) and border positions (id = 1..2*half)
+        template<typename ACC> struct Axis {
+            int half;
+            int size;
+
+            Mem1<ACC> w;
+            Mem1<int> lo, hi;
+            Mem1<double> div;
+
+            int id(const int p) const {
+                if (p - half >= 0 && p + half < size) return 0;
+                return 1 + ((p < half) ? p : half + p - (size - half));
+            }
+
+            // weights (centered, k = lo..hi)
+            ACC* taps(const int id) {
+                return &w[id * (2 * half + 1) + half];
+            }
+            const ACC* taps(const int id) const {
+                return &w[id * (2 * half + 1) + half];
+            }
+        };
+
+        SP_CPUFUNC void setTaps(double *w, double &div, const Mem<SP_REAL> &kernel, const int lo, const int hi) {
+            const int half = kernel.size() / 2;
+
+            // same summation order as filterX/filterY
+            div = 0.0;
+            for (int k = lo; k <= hi; k++) {
+                w[k] = kernel[k + half];
+                div += fabs(kernel[k + half]);
+            }
+        }
+
+        SP_CPUFUNC void setTaps(int *w, double &div, const Mem<SP_REAL> &kernel, const int lo, const int hi) {
+            const int half = kernel.size() / 2;
+            const double one = static_cast<double>(1 << FIX_SHIFT);
+
+            div = 0.0;
+            double sum = 0.0;
+            for (int k = lo; k <= hi; k++) {
+                div += fabs(kernel[k + half]);
+                sum += kernel[k + half];
+            }
+            if (div <= 0.0) return;
+
+            // normalized weights, rounding error is put on the center tap
+            int wsum = 0;
+            for (int k = lo; k <= hi; k++) {
+                w[k] = round(kernel[k + half] / div * one);
+                wsum += w[k];
+            }
+            w[0] += round(sum / div * one) - wsum;
+        }
+
+        template<typename ACC>
+        SP_CPUFUNC void setAxis(Axis<ACC> &axis, const Mem<SP_REAL> &kernel, const int size) {
+            const int half = kernel.size() / 2;
+            const int bnum = 2 * half + 1;
+
+            axis.half = half;
+            axis.size = size;
+            axis.w.resize(bnum * bnum);
+            axis.w.zero();
+            axis.lo.resize(bnum);
+            axis.hi.resize(bnum);
+            axis.div.resize(bnum);
+
+            // interior
+            axis.lo[0] = -half;
+            axis.hi[0] = +half;
+            setTaps(axis.taps(0), axis.div[0], kernel, -half, +half);
+
+            // border
+            for (int p = 0; p < size; p++) {
+                const int id = axis.id(p);
+                if (id == 0) continue;
+
+                axis.lo[id] = max(-half, -p);
+                axis.hi[id] = min(+half, size - 1 - p);
+                setTaps(axis.taps(id), axis.div[id], kernel, axis.lo[id], axis.hi[id]);
+            }
+        }
+
+        template<typename ACC, typename ELEM>
+        SP_CPUFUNC void accum(ACC *acc, const ELEM *src, const int num, const ACC w) {
+            for (int i = 0; i < num; i++) {
+                acc[i] += w * src[i];
+            }
+        }
+
+        template<typename ELEM>
+        SP_CPUFUNC void store(ELEM *dst, const double *acc, const int num, const double div) {
+            for (int i = 0; i < num; i++) {
+                dst[i] = cast<ELEM>((div > 0.0) ? acc[i] / div : 0.0);
+            }
+        }
+
+        SP_CPUFUNC void store(Byte *dst, const int *acc, const int num, const double div) {
+            const int half = 1 << (FIX_SHIFT - 1);
+            const int maxv = SP_BYTEMAX << FIX_SHIFT;
+            for (int i = 0; i < num; i++) {
+                const int a = acc[i];
+                dst[i] = static_cast<Byte>(((a < 0) ? 0 : (a > maxv) ? maxv : a + half) >> FIX_SHIFT);
+            }
+        }
+
+        // x pass of one row in [u0, u1)
+        template<typename ELEM, typename ACC>
+        SP_CPUFUNC void rowX(ELEM *dst, ACC *acc, const ELEM *src, const int ch, const int u0, const int u1, const Axis<ACC> &ax) {
+            const int half = ax.half;
+            const int ib = max(u0, half);
+            const int ie = min(u1, ax.size - half);
+
+            // interior
+            if (ib < ie) {
+                const int num = (ie - ib) * ch;
+                for (int i = 0; i < num; i++) {
+                    acc[i] = 0;
+                }
+                const ACC *w = ax.taps(0);
+                for (int k = -half; k <= half; k++) {
+                    accum(acc, &src[(ib + k) * ch], num, w[k]);
+                }
+                store(&dst[(ib - u0) * ch], acc, num, ax.div[0]);
+            }
+
+            // border
+            for (int u = u0; u < u1; u++) {
+                if (u == ib && ib < ie) u = ie;
+                if (u >= u1) break;
+
+                const int id = ax.id(u);
+                const ACC *w = ax.taps(id);
+                for (int c = 0; c < ch; c++) {
+                    acc[c] = 0;
+                    for (int k = ax.lo[id]; k <= ax.hi[id]; k++) {
+                        acc[c] += w[k] * src[(u + k) * ch + c];
+                    }
+                }
+                store(&dst[(u - u0) * ch], acc, ch, ax.div[id]);
+            }
+        }
+
+        template<typename ELEM, typename ACC>
+        SP_CPUFUNC void filterTile(ELEM *dst, const ELEM *src, const int *dsize, const int ch, const int u0, const int u1, const int v0, const int v1, const Axis<ACC> &ax, const Axis<ACC> &ay) {
+            const int step = dsize[0] * ch;
+            const int tw = (u1 - u0) * ch;
+            const int rnum = 2 * ay.half + 1;
+
+            // x filtered rows (ring buffer)
+            Mem1<ELEM> ring(rnum * tw);
+            Mem1<ACC> acc(tw);
+
+            int next = max(0, v0 - ay.half);
+            for (int v = v0; v < v1; v++) {
+                for (const int e = min(dsize[1] - 1, v + ay.half); next <= e; next++) {
+                    rowX(&ring[(next % rnum) * tw], acc.ptr, &src[next * step], ch, u0, u1, ax);
+                }
+
+                const int id = ay.id(v);
+                const ACC *w = ay.taps(id);
+                for (int i = 0; i < tw; i++) {
+                    acc[i] = 0;
+                }
+                for (int k = ay.lo[id]; k <= ay.hi[id]; k++) {
+                    accum(acc.ptr, &ring[((v + k) % rnum) * tw], tw, w[k]);
+                }
+                store(&dst[v * step + u0 * ch], acc.ptr, tw, ay.div[id]);
+            }
+        }
+    }
+
+    // separable filter (same result as filterX -> filterY, Byte is computed in fixed point)
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void sepFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const Mem<SP_REAL> &kernelX, const Mem<SP_REAL> &kernelY) {
+        using namespace _sepfilter;
+        typedef typename Acc<ELEM>::TYPE ACC;
+
+        Mem<TYPE> cpy;
+        if (&dst == &src) cpy = src;
+
+        const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+        dst.resize(2, tmp.dsize);
+
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        const int *dsize = tmp.dsize;
+        if (dsize[0] <= 0 || dsize[1] <= 0) return;
+
+        Axis<ACC> ax, ay;
+        setAxis(ax, kernelX, dsize[0]);
+        setAxis(ay, kernelY, dsize[1]);
+
+        // column strips fit the ring buffer in cache, row strips share the work
+        const int rnum = 2 * ay.half + 1;
+        const int tw = min(dsize[0], max(64, TILE_CACHE / (ch * static_cast<int>(rnum * sizeof(ELEM) + sizeof(ACC)))));
+        const int th = min(dsize[1], max(32, 4 * rnum));
+
+        const int tnum0 = (dsize[0] + tw - 1) / tw;
+        const int tnum1 = (dsize[1] + th - 1) / th;
+
+        const ELEM *psrc = reinterpret_cast<const ELEM*>(tmp.ptr);
+        ELEM *pdst = reinterpret_cast<ELEM*>(dst.ptr);
+
+        parallel_for(0, tnum0 * tnum1, [&](const int t) {
+            const int u0 = (t % tnum0) * tw;
+            const int v0 = (t / tnum0) * th;
+            filterTile(pdst, psrc, dsize, ch, u0, min(u0 + tw, dsize[0]), v0, min(v0 + th, dsize[1]), ax, ay);
+        }, 1);
+    }
+
+
     //--------------------------------------------------------------------------------
     // gaussian filter 
     //--------------------------------------------------------------------------------
@@ -148,9 +376,7 @@ namespace sp{
             kernel(k + half) = exp(-r / (2.0 * sq(sigma)));
         }
 
-        Mem2<TYPE> tmp;
-        filterX<TYPE, ELEM>(tmp, src, kernel);
-        filterY<TYPE, ELEM>(dst, tmp, kernel);
+        sepFilter<TYPE, ELEM>(dst, src, kernel, kernel);
     }
 
     template <typename TYPE, typename TYPE0>
@@ -204,18 +430,144 @@ namespace sp{
     //--------------------------------------------------------------------------------
     // box filter 
     //--------------------------------------------------------------------------------
+    //
+    // running sums: the column sums of the window rows are updated by adding the incoming row
+    // and subtracting the outgoing row (whole row at once), and the window sum slides along the row.
+    // the cost does not depend on the window size. the window is clipped at the image border
+    // and the mean is taken over the clipped window.
+    // all channels of an interleaved image (e.g. packed moments) are filtered in one pass.
+    //
+
+    namespace _boxfilter {
+
+        // accumulator type
+        template<typename ELEM> struct Acc { typedef double TYPE; };
+        template<> struct Acc<Byte> { typedef int TYPE; };
+
+        // inv = 1 / div
+        template<typename ELEM, typename ACC>
+        SP_CPUFUNC void store(ELEM *dst, const ACC *sum, const int ch, const int div, const double inv) {
+            for (int c = 0; c < ch; c++) {
+                dst[c] = cast<ELEM>(sum[c] * inv);
+            }
+        }
+
+        // same as (sum + div / 2) / div (the fraction is at least 0.5 / div from the next integer)
+        SP_CPUFUNC void store(Byte *dst, const int *sum, const int ch, const int div, const double inv) {
+            for (int c = 0; c < ch; c++) {
+                dst[c] = static_cast<Byte>((sum[c] + (div / 2) + 0.5) * inv);
+            }
+        }
+
+        // update of the running sums
+        template<typename ACC, typename ELEM>
+        SP_CPUFUNC void addRow(ACC *col, const ELEM *src, const int num) {
+            for (int i = 0; i < num; i++) {
+                col[i] += src[i];
+            }
+        }
+
+        template<typename ACC, typename ELEM>
+        SP_CPUFUNC void subRow(ACC *col, const ELEM *src, const int num) {
+            for (int i = 0; i < num; i++) {
+                col[i] -= src[i];
+            }
+        }
+
+        // rows in [v0, v1)
+        template<typename ELEM, typename ACC>
+        SP_CPUFUNC void filterStrip(ELEM *dst, const ELEM *src, const int *dsize, const int ch, const int half, const int v0, const int v1) {
+            const int w = dsize[0];
+            const int h = dsize[1];
+            const int step = w * ch;
+
+            Mem1<ACC> col(step);
+            Mem1<ACC> sum(ch);
+            for (int i = 0; i < step; i++) {
+                col[i] = 0;
+            }
+
+            // window of v0 - 1 (except the incoming row)
+            for (int v = max(0, v0 - half - 1); v < min(h, v0 + half); v++) {
+                addRow(col.ptr, &src[v * step], step);
+            }
+
+            for (int v = v0; v < v1; v++) {
+                if (v + half < h) {
+                    addRow(col.ptr, &src[(v + half) * step], step);
+                }
+                if (v - half - 1 >= 0) {
+                    subRow(col.ptr, &src[(v - half - 1) * step], step);
+                }
+                const int ny = min(h - 1, v + half) - max(0, v - half) + 1;
+
+                for (int c = 0; c < ch; c++) {
+                    sum[c] = 0;
+                }
+                for (int u = 0; u < min(w, half); u++) {
+                    addRow(sum.ptr, &col[u * ch], ch);
+                }
+
+                // [0, ib): left border, [ib, ie): interior, [ie, w): right border
+                const int ib = min(w, half + 1);
+                const int ie = max(ib, w - half);
+
+                ELEM *pd = &dst[v * step];
+                for (int u = 0; u < ib; u++) {
+                    if (u + half < w) {
+                        addRow(sum.ptr, &col[(u + half) * ch], ch);
+                    }
+                    const int div = (min(w - 1, u + half) + 1) * ny;
+                    store(&pd[u * ch], sum.ptr, ch, div, 1.0 / div);
+                }
+                {
+                    const int div = (2 * half + 1) * ny;
+                    const double inv = 1.0 / div;
+                    for (int u = ib; u < ie; u++) {
+                        addRow(sum.ptr, &col[(u + half) * ch], ch);
+                        subRow(sum.ptr, &col[(u - half - 1) * ch], ch);
+                        store(&pd[u * ch], sum.ptr, ch, div, inv);
+                    }
+                }
+                for (int u = ie; u < w; u++) {
+                    subRow(sum.ptr, &col[(u - half - 1) * ch], ch);
+                    const int div = (w - (u - half)) * ny;
+                    store(&pd[u * ch], sum.ptr, ch, div, 1.0 / div);
+                }
+            }
+        }
+
+        // interleaved channels (dst != src)
+        template<typename ELEM>
+        SP_CPUFUNC void filter(ELEM *dst, const ELEM *src, const int *dsize, const int ch, const int winSize) {
+            typedef typename Acc<ELEM>::TYPE ACC;
+            if (dsize[0] <= 0 || dsize[1] <= 0) return;
+
+            const int half = winSize / 2;
+
+            // row strips (the window rows are summed again at the top of each strip)
+            const int th = min(dsize[1], max(32, 4 * (2 * half + 1)));
+            const int tnum = (dsize[1] + th - 1) / th;
+
+            parallel_for(0, tnum, [&](const int t) {
+                const int v0 = t * th;
+                filterStrip<ELEM, ACC>(dst, src, dsize, ch, half, v0, min(v0 + th, dsize[1]));
+            }, 1);
+        }
+    }
 
+    // mean in (winSize / 2 * 2 + 1)^2 window (clipped at the image border)
     template <typename TYPE, typename ELEM = TYPE>
     SP_CPUFUNC void boxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
 
-        Mem1<SP_REAL> kernel(winSize);
-        for (int k = 0; k < winSize; k++) {
-            kernel(k) = static_cast<SP_REAL>(1.0);
-        }
+        Mem<TYPE> cpy;
+        if (&dst == &src) cpy = src;
 
-        Mem2<TYPE> tmp;
-        filterX<TYPE, ELEM>(tmp, src, kernel);
-        filterY<TYPE, ELEM>(dst, tmp, kernel);
+        const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+        dst.resize(2, tmp.dsize);
+
+        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        _boxfilter::filter(reinterpret_cast<ELEM*>(dst.ptr), reinterpret_cast<const ELEM*>(tmp.ptr), tmp.dsize, ch, winSize);
     }
     
     template <typename TYPE, typename TYPE0>
@@ -272,59 +624,155 @@ namespace sp{
     // max/min filter 
     //--------------------------------------------------------------------------------
 
-    template <typename TYPE>
-    SP_CPUFUNC void maxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+    namespace _maxmin {
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
+        // window size to use van Herk / Gil-Werman (smaller windows scan directly)
+        // 1280 x 720 float, 3x3: direct 10.9 ms, vhgw 14.4 ms / 5x5: direct 26.5 ms, vhgw 11.9 ms
+        static const int VHGW_MIN = 5;
 
-        const int offset = winSize / 2;
+        // column strip width for y pass
+        static const int STRIP = 256;
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+        struct MaxOp {
+            template <typename TYPE> TYPE operator()(const TYPE &a, const TYPE &b) const { return max(a, b); }
+        };
+
+        struct MinOp {
+            template <typename TYPE> TYPE operator()(const TYPE &a, const TYPE &b) const { return min(a, b); }
+        };
+
+        template <typename TYPE, typename OP>
+        SP_CPUFUNC void filterNaive(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize, const OP &op) {
+
+            Mem<TYPE> cpy;
+            if (&dst == &src) cpy = src;
 
-                TYPE maxv = acs2(tmp, u, v);
+            const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+            dst.resize(2, tmp.dsize);
 
-                for (int ky = 0; ky < winSize; ky++){
-                    for (int kx = 0; kx < winSize; kx++) {
+            const int offset = winSize / 2;
 
-                        const TYPE &val = acs2(tmp, u + kx - offset, v + ky - offset);
-                        maxv = max(maxv, val);
+            for (int v = 0; v < dst.dsize[1]; v++) {
+                for (int u = 0; u < dst.dsize[0]; u++) {
+
+                    TYPE val = acs2(tmp, u, v);
+
+                    for (int ky = 0; ky < winSize; ky++) {
+                        for (int kx = 0; kx < winSize; kx++) {
+                            val = op(val, acs2(tmp, u + kx - offset, v + ky - offset));
+                        }
                     }
-                }
 
-                acs2(dst, u, v) = cast<TYPE>(maxv);
+                    acs2(dst, u, v) = val;
+                }
             }
         }
-    }
 
-    template <typename TYPE>
-    SP_CPUFUNC void minFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
-        SP_ASSERT(checkPtr(src, 2));
+        // 1d running max/min (van Herk / Gil-Werman), 3 ops per element for any window size
+        // dst[i] = op(src[i - offset], ..., src[i - offset + win - 1]) with border clamp,
+        // each element is a vector of vw values and elements are placed with step
+        template <typename TYPE, typename OP>
+        SP_CPUFUNC void vhgw(TYPE *dst, const TYPE *src, const int num, const int step, const int vw, const int win, const int offset, TYPE *g, TYPE *h, const OP &op) {
+            const int enm = num + win - 1;
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
+            // prefix in each block
+            for (int i = 0; i < enm; i++) {
+                const TYPE *e = &src[max(0, min(num - 1, i - offset)) * step];
+                TYPE *pg = &g[i * vw];
+
+                if (i % win == 0) {
+                    for (int x = 0; x < vw; x++) pg[x] = e[x];
+                }
+                else {
+                    const TYPE *pp = &g[(i - 1) * vw];
+                    for (int x = 0; x < vw; x++) pg[x] = op(pp[x], e[x]);
+                }
+            }
 
-        const int offset = winSize / 2;
+            // suffix in each block
+            for (int i = enm - 1; i >= 0; i--) {
+                const TYPE *e = &src[max(0, min(num - 1, i - offset)) * step];
+                TYPE *ph = &h[i * vw];
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+                if (i % win == win - 1 || i == enm - 1) {
+                    for (int x = 0; x < vw; x++) ph[x] = e[x];
+                }
+                else {
+                    const TYPE *pp = &h[(i + 1) * vw];
+                    for (int x = 0; x < vw; x++) ph[x] = op(pp[x], e[x]);
+                }
+            }
 
-                TYPE minv = acs2(tmp, u, v);
+            for (int i = 0; i < num; i++) {
+                const TYPE *ph = &h[i * vw];
+                const TYPE *pg = &g[(i + win - 1) * vw];
+                TYPE *pd = &dst[i * step];
+                for (int x = 0; x < vw; x++) pd[x] = op(ph[x], pg[x]);
+            }
+        }
+
+        // separable (x pass -> y pass), same result as filterNaive
+        template <typename TYPE, typename OP>
+        SP_CPUFUNC void filterVHGW(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize, const OP &op) {
+
+            const int dsize0 = src.dsize[0];
+            const int dsize1 = src.dsize[1];
+            const int offset = winSize / 2;
+
+            Mem<TYPE> tmp(2, src.dsize);
 
-                for (int ky = 0; ky < winSize; ky++) {
-                    for (int kx = 0; kx < winSize; kx++) {
+            // x pass (row blocks)
+            {
+                const int rb = 16;
+                const TYPE *psrc = src.ptr;
+                TYPE *ptmp = tmp.ptr;
 
-                        const TYPE &val = acs2(tmp, u + kx - offset, v + ky - offset);
-                        minv = min(minv, val);
+                parallel_for(0, (dsize1 + rb - 1) / rb, [&](const int b) {
+                    Mem1<TYPE> g(dsize0 + winSize - 1), h(dsize0 + winSize - 1);
+                    for (int v = b * rb; v < min((b + 1) * rb, dsize1); v++) {
+                        vhgw(&ptmp[v * dsize0], &psrc[v * dsize0], dsize0, 1, 1, winSize, offset, g.ptr, h.ptr, op);
                     }
-                }
+                }, 1);
+            }
+
+            dst.resize(2, src.dsize);
 
-                cnvVal(acs2(dst, u, v), minv);
+            // y pass (column strips)
+            {
+                const TYPE *ptmp = tmp.ptr;
+                TYPE *pdst = dst.ptr;
+
+                parallel_for(0, (dsize0 + STRIP - 1) / STRIP, [&](const int b) {
+                    const int u0 = b * STRIP;
+                    const int vw = min(STRIP, dsize0 - u0);
+
+                    Mem1<TYPE> g((dsize1 + winSize - 1) * vw), h((dsize1 + winSize - 1) * vw);
+                    vhgw(&pdst[u0], &ptmp[u0], dsize1, dsize0, vw, winSize, offset, g.ptr, h.ptr, op);
+                }, 1);
             }
         }
     }
 
+    template <typename TYPE>
+    SP_CPUFUNC void maxFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        if (winSize >= _maxmin::VHGW_MIN) {
+            _maxmin::filterVHGW(dst, src, winSize, _maxmin::MaxOp());
+        }
+        else {
+            _maxmin::filterNaive(dst, src, winSize, _maxmin::MaxOp());
+        }
+    }
+
+    template <typename TYPE>
+    SP_CPUFUNC void minFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        if (winSize >= _maxmin::VHGW_MIN) {
+            _maxmin::filterVHGW(dst, src, winSize, _maxmin::MinOp());
+        }
+        else {
+            _maxmin::filterNaive(dst, src, winSize, _maxmin::MinOp());
+        }
+    }
+
 
     //--------------------------------------------------------------------------------
     // laplacian filter 
@@ -506,32 +954,251 @@ namespace sp{
     // median filter 
     //--------------------------------------------------------------------------------
 
-    template <typename TYPE, typename ELEM = TYPE>
-    SP_CPUFUNC void medianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+    namespace _median {
 
-        dst.resize(2, src.dsize);
-        const Mem<TYPE> &tmp = (&dst != &src) ? src : clone(src);
+        // window size to use histogram median for Byte (count is held in 16 bit)
+        // 3x3 uses the sorting network (512 x 512 Byte: network 4.4 ms, histogram 18.5 ms, scan 113 ms)
+        static const int HIST_MIN = 5;
+        static const int HIST_MAX = 255;
 
-        const int offset = winSize / 2;
-        const int ch = sizeof(TYPE) / sizeof(ELEM);
+        template <typename ELEM> struct IsByte { enum { value = 0 }; };
+        template <> struct IsByte<Byte> { enum { value = 1 }; };
 
-        Mem1<ELEM> list;
-        list.resize(winSize * winSize);
+        template <typename TYPE, typename ELEM>
+        SP_CPUFUNC void filterNaive(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
+            Mem<TYPE> cpy;
+            if (&dst == &src) cpy = src;
 
-                for (int c = 0; c < ch; c++) {
-                    for (int ky = 0; ky < winSize; ky++) {
-                        for (int kx = 0; kx < winSize; kx++) {
-                            ELEM val = acs2<TYPE, ELEM>(src, u + kx - offset, v + ky - offset, c);
-                            list[ky * winSize + kx] = val;
+            const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+            dst.resize(2, tmp.dsize);
+
+            const int offset = winSize / 2;
+            const int ch = sizeof(TYPE) / sizeof(ELEM);
+
+            Mem1<ELEM> list;
+            list.resize(winSize * winSize);
+
+            for (int v = 0; v < dst.dsize[1]; v++) {
+                for (int u = 0; u < dst.dsize[0]; u++) {
+
+                    for (int c = 0; c < ch; c++) {
+                        for (int ky = 0; ky < winSize; ky++) {
+                            for (int kx = 0; kx < winSize; kx++) {
+                                ELEM val = acs2<TYPE, ELEM>(tmp, u + kx - offset, v + ky - offset, c);
+                                list[ky * winSize + kx] = val;
+                            }
+                        }
+                        acs2<TYPE, ELEM>(dst, u, v, c) = median(list);
+                    }
+                }
+            }
+        }
+
+        template <typename ELEM>
+        SP_CPUFUNC void sort2(ELEM &a, ELEM &b) {
+            const ELEM t = min(a, b);
+            b = max(a, b);
+            a = t;
+        }
+
+        // median of 9 (sorting network, 19 compare-swap)
+        template <typename ELEM>
+        SP_CPUFUNC ELEM median9(ELEM *p) {
+            sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+            sort2(p[0], p[1]); sort2(p[3], p[4]); sort2(p[6], p[7]);
+            sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+            sort2(p[0], p[3]); sort2(p[5], p[8]); sort2(p[4], p[7]);
+            sort2(p[3], p[6]); sort2(p[1], p[4]); sort2(p[2], p[5]);
+            sort2(p[4], p[7]); sort2(p[2], p[4]); sort2(p[4], p[6]);
+            sort2(p[2], p[4]);
+            return p[4];
+        }
+
+        // same result as filterNaive (winSize = 3)
+        template <typename TYPE, typename ELEM>
+        SP_CPUFUNC void filter3x3(Mem<TYPE> &dst, const Mem<TYPE> &src) {
+
+            Mem<TYPE> cpy;
+            if (&dst == &src) cpy = src;
+
+            const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+            dst.resize(2, tmp.dsize);
+
+            const int ch = sizeof(TYPE) / sizeof(ELEM);
+            const int dsize0 = tmp.dsize[0];
+            const int dsize1 = tmp.dsize[1];
+
+            const ELEM *psrc = reinterpret_cast<const ELEM*>(tmp.ptr);
+            ELEM *pdst = reinterpret_cast<ELEM*>(dst.ptr);
+
+            parallel_for(0, dsize1, [&](const int v) {
+                const ELEM *prow[3];
+                for (int y = 0; y < 3; y++) {
+                    prow[y] = &psrc[max(0, min(dsize1 - 1, v + y - 1)) * dsize0 * ch];
+                }
+
+                ELEM *pd = &pdst[v * dsize0 * ch];
+                for (int u = 0; u < dsize0; u++) {
+                    const int xs[3] = { max(0, u - 1) * ch, u * ch, min(dsize0 - 1, u + 1) * ch };
+
+                    for (int c = 0; c < ch; c++) {
+                        ELEM p[9];
+                        for (int y = 0; y < 3; y++) {
+                            for (int x = 0; x < 3; x++) {
+                                p[y * 3 + x] = prow[y][xs[x] + c];
+                            }
                         }
+                        pd[u * ch + c] = median9(p);
+                    }
+                }
+            }, 16);
+        }
+
+        // column histograms + coarse (16) / fine (256) kernel histogram (Perreault and Hebert)
+        struct Hist {
+            unsigned short fine[256];
+            unsigned short coarse[16];
+        };
+
+        // kernel histogram, fine segments are updated lazily (only the segment holding the median)
+        struct Kern {
+            unsigned short fine[256];
+            unsigned short coarse[16];
+
+            // column position where each fine segment is valid
+            int luc[16];
+        };
+
+        // value of the (rank + 1)-th smallest element at column u
+        // col(x) : column histogram of x (x is clamped), window [u - offset, u - offset + winSize)
+        template<typename COL>
+        SP_CPUFUNC Byte findHist(Kern &kern, const int rank, const int u, const int offset, const int winSize, const COL &col) {
+            int sum = 0;
+            int k = 0;
+            while (sum + kern.coarse[k] <= rank) {
+                sum += kern.coarse[k++];
+            }
+
+            unsigned short *fine = &kern.fine[k * 16];
+            if ((u - kern.luc[k]) * 2 >= winSize) {
+                // rebuild the segment
+                memset(fine, 0, 16 * sizeof(unsigned short));
+                for (int x = u - offset; x < u - offset + winSize; x++) {
+                    const unsigned short *cf = &col(x).fine[k * 16];
+                    for (int i = 0; i < 16; i++) fine[i] += cf[i];
+                }
+            }
+            else {
+                for (int j = kern.luc[k] + 1; j <= u; j++) {
+                    const unsigned short *ca = &col(j - offset + winSize - 1).fine[k * 16];
+                    const unsigned short *cs = &col(j - 1 - offset).fine[k * 16];
+                    for (int i = 0; i < 16; i++) fine[i] += ca[i] - cs[i];
+                }
+            }
+            kern.luc[k] = u;
+
+            int i = 0;
+            while (sum + fine[i] <= rank) {
+                sum += fine[i++];
+            }
+            return static_cast<Byte>(k * 16 + i);
+        }
+
+        // rows [v0, v1), each row band rebuilds its column histograms
+        SP_CPUFUNC void filterBand(Byte *dst, const Byte *src, const int *dsize, const int ch, const int winSize, const int v0, const int v1) {
+            const int offset = winSize / 2;
+            const int rank = (winSize * winSize) / 2;
+            const int step = dsize[0] * ch;
+
+            Mem1<Hist> cols(dsize[0] * ch);
+            cols.zero();
+
+            Kern kern;
+
+            const auto updateRow = [&](const int y, const int add) {
+                const Byte *ps = &src[max(0, min(dsize[1] - 1, y)) * step];
+                for (int i = 0; i < step; i++) {
+                    cols[i].fine[ps[i]] += add;
+                    cols[i].coarse[ps[i] >> 4] += add;
+                }
+            };
+
+            for (int y = v0 - offset; y < v0 - offset + winSize; y++) {
+                updateRow(y, +1);
+            }
+
+            for (int v = v0; v < v1; v++) {
+                if (v > v0) {
+                    updateRow(v - 1 - offset, -1);
+                    updateRow(v - 1 - offset + winSize, +1);
+                }
+
+                Byte *pd = &dst[v * step];
+                for (int c = 0; c < ch; c++) {
+                    const auto col = [&](const int x) -> const Hist& {
+                        return cols[max(0, min(dsize[0] - 1, x)) * ch + c];
+                    };
+
+                    memset(kern.coarse, 0, sizeof(kern.coarse));
+                    for (int k = 0; k < 16; k++) {
+                        kern.luc[k] = -winSize;
+                    }
+                    for (int x = -offset; x < -offset + winSize; x++) {
+                        const unsigned short *cc = col(x).coarse;
+                        for (int k = 0; k < 16; k++) kern.coarse[k] += cc[k];
+                    }
+                    pd[c] = findHist(kern, rank, 0, offset, winSize, col);
+
+                    for (int u = 1; u < dsize[0]; u++) {
+                        const unsigned short *ca = col(u - offset + winSize - 1).coarse;
+                        const unsigned short *cs = col(u - 1 - offset).coarse;
+                        for (int k = 0; k < 16; k++) kern.coarse[k] += ca[k] - cs[k];
+
+                        pd[u * ch + c] = findHist(kern, rank, u, offset, winSize, col);
                     }
-                    acs2<TYPE, ELEM>(dst, u, v, c) = median(list);
                 }
             }
         }
+
+        // same result as filterNaive, constant time per pixel
+        template <typename TYPE>
+        SP_CPUFUNC void filterHist(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+
+            Mem<TYPE> cpy;
+            if (&dst == &src) cpy = src;
+
+            const Mem<TYPE> &tmp = (&dst == &src) ? cpy : src;
+            dst.resize(2, tmp.dsize);
+
+            const int ch = sizeof(TYPE) / sizeof(Byte);
+            const int *dsize = tmp.dsize;
+            if (dsize[0] <= 0 || dsize[1] <= 0) return;
+
+            const Byte *psrc = reinterpret_cast<const Byte*>(tmp.ptr);
+            Byte *pdst = reinterpret_cast<Byte*>(dst.ptr);
+
+            // row bands (the column histograms are built once per band)
+            const int bh = max(64, 4 * winSize);
+            const int bnum = (dsize[1] + bh - 1) / bh;
+
+            parallel_for(0, bnum, [&](const int b) {
+                filterBand(pdst, psrc, dsize, ch, winSize, b * bh, min((b + 1) * bh, dsize[1]));
+            }, 1);
+        }
+    }
+
+    template <typename TYPE, typename ELEM = TYPE>
+    SP_CPUFUNC void medianFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const int winSize) {
+        if (winSize == 3) {
+            _median::filter3x3<TYPE, ELEM>(dst, src);
+        }
+        else if (_median::IsByte<ELEM>::value && winSize >= _median::HIST_MIN && winSize <= _median::HIST_MAX) {
+            _median::filterHist(dst, src, winSize);
+        }
+        else {
+            _median::filterNaive<TYPE, ELEM>(dst, src, winSize);
+        }
     }
 
 
@@ -551,8 +1218,7 @@ namespace sp{
                 kernel(k) = static_cast<SP_REAL>(1.0);
             }
 
-            filterX<TYPE, ELEM>(tmp, src, kernel);
-            filterY<TYPE, ELEM>(tmp, tmp, kernel);
+            sepFilter<TYPE, ELEM>(tmp, src, kernel, kernel);
         }
 
         const int ch = sizeof(TYPE) / sizeof(ELEM);
@@ -49,24 +49,48 @@ namespace sp{
 
     SP_CPUFUNC void rescaleFast(Mem<Byte> &dst, const Mem<Byte> &src, const double dscale0, const double dscale1) {
 
-        const Mem<Byte> &tmp = (&dst != &src) ? src : clone(src);
+        Mem<Byte> cpy;
+        if (&dst == &src) cpy = src;
+        const Mem<Byte> &tmp = (&dst == &src) ? cpy : src;
 
-        const int dsize0 = round(tmp.dsize[0] * dscale0);
-        const int dsize1 = round(tmp.dsize[1] * dscale1);
+        const int sdsize0 = tmp.dsize[0];
+        const int sdsize1 = tmp.dsize[1];
+
+        const int dsize0 = round(sdsize0 * dscale0);
+        const int dsize1 = round(sdsize1 * dscale1);
 
         const int dsize[2] = { dsize0, dsize1 };
         dst.resize(2, dsize);
 
-        //const Byte *pSrc = tmp.ptr;
+        // column table (same as acs2(src, su, sv))
+        Mem1<int> x0(dsize0), x1(dsize0);
+        Mem1<double> wx0(dsize0), wx1(dsize0);
+
+        for (int u = 0; u < dsize0; u++) {
+            const double su = u / dscale0;
+
+            const int id0 = static_cast<int>(su);
+            const double ad0 = su - id0;
+
+            x0[u] = max(0, min(sdsize0 - 1, id0 + 0));
+            x1[u] = max(0, min(sdsize0 - 1, id0 + 1));
+            wx0[u] = 1 - ad0;
+            wx1[u] = 0 + ad0;
+        }
+
+        const Byte *pSrc = tmp.ptr;
         Byte *pDst = dst.ptr;
 
-        for (int v = 0; v < dst.dsize[1]; v++) {
-            for (int u = 0; u < dst.dsize[0]; u++) {
-                const double su = u / dscale0;
-                const double sv = v / dscale1;
+        for (int v = 0; v < dsize1; v++) {
+            const double sv = v / dscale1;
 
-                *pDst++ = cast<Byte>(acs2<Byte>(tmp, su, sv));
-            }
+            const int id1 = static_cast<int>(sv);
+            const double ad1 = sv - id1;
+
+            const int y0 = max(0, min(sdsize1 - 1, id1 + 0));
+            const int y1 = max(0, min(sdsize1 - 1, id1 + 1));
+
+            simdRescale(&pDst[v * dsize0], &pSrc[y0 * sdsize0], &pSrc[y1 * sdsize0], 1 - ad1, 0 + ad1, x0.ptr, x1.ptr, wx0.ptr, wx1.ptr, dsize0);
         }
     }
 
@@ -138,6 +162,35 @@ namespace sp{
         }
     }
 
+    SP_CPUFUNC void pyrdown(Mem<Byte> &dst, const Mem<Byte> &src) {
+
+        Mem<Byte> cpy;
+        if (&dst == &src) cpy = src;
+        const Mem<Byte> &tmp = (&dst == &src) ? cpy : src;
+
+        const int sdsize0 = tmp.dsize[0];
+        const int sdsize1 = tmp.dsize[1];
+
+        const int ddsize0 = (sdsize0 + 1) / 2;
+        const int ddsize1 = (sdsize1 + 1) / 2;
+        const int ddsize[2] = { ddsize0, ddsize1 };
+
+        dst.resize(2, ddsize);
+
+        const Byte *psrc = tmp.ptr;
+        Byte *pdst = dst.ptr;
+
+        for (int v = 0; v < ddsize1; v++) {
+            const int sv = 2 * v;
+
+            const int sv0 = sv + ((sv == 0) ? 0 : -1);
+            const int sv1 = sv + 0;
+            const int sv2 = sv + ((sv == sdsize1 - 1) ? 0 : +1);
+
+            simdPyrdown(&pdst[v * ddsize0], &psrc[sv0 * sdsize0], &psrc[sv1 * sdsize0], &psrc[sv2 * sdsize0], sdsize0, ddsize0);
+        }
+    }
+
 
     //--------------------------------------------------------------------------------
     // crop 
@@ -231,6 +284,48 @@ namespace sp{
         }
     }
 
+    namespace _blend {
+        template <typename TYPE>
+        SP_CPUFUNC void blendByte(Mem<TYPE> &dst, const Mem<TYPE> &src0, const double r0, const Mem<TYPE> &src1, const double r1) {
+            SP_ASSERT(cmp(src0.dsize, src1.dsize, 2));
+
+            Mem<TYPE> cpy0, cpy1;
+            if (&dst == &src0) cpy0 = src0;
+            if (&dst == &src1) cpy1 = src1;
+            const Mem<TYPE> &tmp0 = (&dst == &src0) ? cpy0 : src0;
+            const Mem<TYPE> &tmp1 = (&dst == &src1) ? cpy1 : src1;
+
+            dst.resize(2, src0.dsize);
+
+            const int num = dst.size() * sizeof(TYPE);
+            Byte *pdst = reinterpret_cast<Byte*>(dst.ptr);
+            const Byte *psrc0 = reinterpret_cast<const Byte*>(tmp0.ptr);
+            const Byte *psrc1 = reinterpret_cast<const Byte*>(tmp1.ptr);
+
+            // same special cases as blendCol
+            if (r0 + r1 == 0.0f) {
+                dst.zero();
+            }
+            else if (r0 == 0.0) {
+                memcpy(pdst, psrc1, num);
+            }
+            else if (r1 == 0.0) {
+                memcpy(pdst, psrc0, num);
+            }
+            else {
+                simdBlend(pdst, psrc0, r0, psrc1, r1, num);
+            }
+        }
+    }
+
+    SP_CPUFUNC void blend(Mem<Byte> &dst, const Mem<Byte> &src0, const double r0, const Mem<Byte> &src1, const double r1) {
+        _blend::blendByte(dst, src0, r0, src1, r1);
+    }
+
+    SP_CPUFUNC void blend(Mem<Col3> &dst, const Mem<Col3> &src0, const double r0, const Mem<Col3> &src1, const double r1) {
+        _blend::blendByte(dst, src0, r0, src1, r1);
+    }
+
     //--------------------------------------------------------------------------------
     // invert
     //--------------------------------------------------------------------------------
@@ -244,6 +339,11 @@ namespace sp{
 
         const int ch = sizeof(TYPE) / sizeof(ELEM);
 
+        if (sizeof(ELEM) == sizeof(Byte)) {
+            simdInvert(reinterpret_cast<Byte*>(dst.ptr), reinterpret_cast<const Byte*>(tmp.ptr), dst.size() * ch);
+            return;
+        }
+
         for (int v = 0; v < dst.dsize[1]; v++) {
             for (int u = 0; u < dst.dsize[0]; u++) {
                 for (int c = 0; c < ch; c++) {
@@ -371,6 +471,13 @@ namespace sp{
             dst[i] = cast<DST>(src[i]);
         }
     }
+
+    SP_CPUFUNC void cnvImg(Mem<Byte> &dst, const Mem<Col3> &src) {
+
+        dst.resize(2, src.dsize);
+
+        simdCnvGry(dst.ptr, src.ptr, dst.size());
+    }
         
     template <typename TYPE0, typename TYPE1>
     SP_CPUFUNC void cnvDepthToImg(Mem<TYPE0> &dst, const Mem<TYPE1> &src, const double nearPlane = 100.0, const double farPlane = 10000.0){
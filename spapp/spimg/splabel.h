@@ -13,101 +13,361 @@ namespace sp{
     //--------------------------------------------------------------------------------
     // labeling
     //--------------------------------------------------------------------------------
+    //
+    // two pass labeling with union-find (the root of a set is its smallest label).
+    // - 4 nears : pixel scan (left, up)
+    // - 8 nears : 2x2 block scan (block based decision, Grana et al.)
+    // the rows are split into strips labeled in parallel, and the strip borders are merged.
+    // labels are numbered in raster order of the first pixel (first 2x2 block for 8 nears),
+    // so the result does not depend on the thread count.
+    //
+
+    struct LabelInfo {
+        // pixel count
+        int area;
+
+        // bounding box
+        Rect2 rect;
+
+        // centroid
+        Vec2 center;
+    };
+
+    namespace _label {
+
+        SP_CPUFUNC int find(int *table, int a) {
+            while (table[a] != a) {
+                table[a] = table[table[a]];
+                a = table[a];
+            }
+            return a;
+        }
 
-    SP_CPUFUNC int labeling(Mem2<int> &map, const Mem2<Byte> &bin, const bool near8 = false){
-        
-        const int step = bin.dsize[0];
+        SP_CPUFUNC void unite(int *table, const int a, const int b) {
+            const int ra = find(table, a);
+            const int rb = find(table, b);
+            if (ra < rb) table[rb] = ra;
+            if (rb < ra) table[ra] = rb;
+        }
 
-        map.resize(bin.dsize);
+        SP_CPUFUNC void link(int *table, int &crnt, const int ref) {
+            if (crnt < 0) {
+                crnt = ref;
+            }
+            else if (crnt != ref) {
+                unite(table, crnt, ref);
+            }
+        }
 
-        Mem1<int> table;
-        table.reserve(bin.size());
+        struct Acc {
+            int area;
+            double sx, sy;
+            int x0, y0, x1, y1;
+        };
 
-        const Rect2 rect = getRect2(bin.dsize);
+        SP_CPUFUNC void initAcc(Acc &acc) {
+            acc.area = 0;
+            acc.sx = 0.0;
+            acc.sy = 0.0;
+            acc.x0 = SP_INTMAX;
+            acc.y0 = SP_INTMAX;
+            acc.x1 = -1;
+            acc.y1 = -1;
+        }
 
-        const int linkNum = (near8 == true) ? 4 : 2;
-        const int link[][2] = { { -1, 0 }, { 0, -1 }, { -1, -1 }, { +1, -1 } };
+        SP_CPUFUNC void addAcc(Acc &acc, const int x, const int y) {
+            acc.area++;
+            acc.sx += x;
+            acc.sy += y;
+            acc.x0 = min(acc.x0, x);
+            acc.y0 = min(acc.y0, y);
+            acc.x1 = max(acc.x1, x);
+            acc.y1 = max(acc.y1, y);
+        }
 
-        const Byte *pBin = bin.ptr;
-        int *pMap = map.ptr;
-        int *pTable = table.ptr;
+        SP_CPUFUNC void mrgAcc(Acc &dst, const Acc &src) {
+            dst.area += src.area;
+            dst.sx += src.sx;
+            dst.sy += src.sy;
+            dst.x0 = min(dst.x0, src.x0);
+            dst.y0 = min(dst.y0, src.y0);
+            dst.x1 = max(dst.x1, src.x1);
+            dst.y1 = max(dst.y1, src.y1);
+        }
 
-        for (int v = 0; v < bin.dsize[1]; v++){
-            for (int u = 0; u < bin.dsize[0]; u++){
-                pMap[v * step + u] = -1;
-                if (pBin[v * step + u] == 0) continue;
+        class Labeler {
+        public:
+            const Mem2<Byte> &bin;
+            const int w, h;
+            const bool near8;
 
-                int crntLabel = table.size();
+            // scan unit (pixel or 2x2 block)
+            int uw, uh;
 
-                int *pTmp[4] = { 0 };
+            // provisional label of each unit, union-find table
+            Mem1<int> umap, table;
 
-                // check min label
-                for (int i = 0; i < linkNum; i++){
-                    const int ru = u + link[i][0];
-                    const int rv = v + link[i][1];
+            // strip [sbase[s], sbase[s + 1]) in unit rows, used labels [offset, offset + snum[s])
+            Mem1<int> sbase, snum;
 
-                    if (inRect(rect, ru, rv) == false) continue;
-                    if (pBin[rv * step + ru] == 0) continue;
+            Labeler(const Mem2<Byte> &bin, const bool near8) : bin(bin), w(bin.dsize[0]), h(bin.dsize[1]), near8(near8) {
+                uw = (near8 == true) ? (w + 1) / 2 : w;
+                uh = (near8 == true) ? (h + 1) / 2 : h;
 
-                    const int refLabel = table[pMap[rv * step + ru]];
-                    pTmp[i] = &pMap[rv * step + ru];
-                    if (refLabel < crntLabel){
-                        crntLabel = refLabel;
-                    }
+                const int strip = max(1, min(ThreadPool::instance()->size() * 2, uh / 16));
+                sbase.resize(strip + 1);
+                snum.resize(strip);
+                for (int s = 0; s <= strip; s++) {
+                    sbase[s] = uh * s / strip;
                 }
+            }
 
-                if (crntLabel == table.size()){
-                    table.push(crntLabel);
-                }
-                else{
-                    for (int i = 0; i < linkNum; i++){
-                        if (pTmp[i] != NULL) {
-                            pTable[*pTmp[i]] = crntLabel;
+            // label capacity per unit row
+            int cap() const {
+                return (near8 == true) ? uw : (uw + 1) / 2;
+            }
+
+            bool px(const int x, const int y) const {
+                return (x >= 0 && y >= 0 && x < w && y < h && bin.ptr[y * w + x] != 0);
+            }
+
+            // 4 nears (u : pixel)
+            void scanPix(const int s) {
+                const Byte *pb = bin.ptr;
+                int *pm = umap.ptr;
+                int *pt = table.ptr;
+
+                const int offset = sbase[s] * cap();
+                int num = 0;
+
+                for (int y = sbase[s]; y < sbase[s + 1]; y++) {
+                    for (int x = 0; x < w; x++) {
+                        const int i = y * w + x;
+                        if (pb[i] == 0) {
+                            pm[i] = -1;
+                            continue;
+                        }
+
+                        const bool l = (x > 0 && pb[i - 1] != 0);
+                        const bool u = (y > sbase[s] && pb[i - w] != 0);
+
+                        int crnt;
+                        if (l == true && u == true) {
+                            crnt = pm[i - 1];
+                            // left and up are already connected through the up-left pixel
+                            if (pb[i - w - 1] == 0) unite(pt, crnt, pm[i - w]);
+                        }
+                        else if (l == true) {
+                            crnt = pm[i - 1];
                         }
+                        else if (u == true) {
+                            crnt = pm[i - w];
+                        }
+                        else {
+                            crnt = offset + num++;
+                            pt[crnt] = crnt;
+                        }
+                        pm[i] = crnt;
                     }
                 }
+                snum[s] = num;
+            }
+
+            // links from block (bx, by) to the upper block row
+            void linkUp(int &crnt, const int bx, const int by) {
+                const int x = bx * 2;
+                const int y = by * 2;
+                const int i = by * uw + bx;
+
+                const bool a = px(x, y);
+                const bool b = px(x + 1, y);
+                const bool qc = px(x, y - 1);
+                const bool qd = px(x + 1, y - 1);
+
+                if ((a || b) && (qc || qd)) link(table.ptr, crnt, umap[i - uw]);
 
-                pMap[v * step + u] = crntLabel;
+                // P (up-left) / R (up-right) are connected through Q when qc / qd is set
+                if (a && !qc && px(x - 1, y - 1)) link(table.ptr, crnt, umap[i - uw - 1]);
+                if (b && !qd && px(x + 2, y - 1)) link(table.ptr, crnt, umap[i - uw + 1]);
             }
-        }
 
-        const int tableNum = table.size();
+            // 8 nears (u : 2x2 block)
+            void scanBlk(const int s) {
+                int *pm = umap.ptr;
+                int *pt = table.ptr;
+
+                const int offset = sbase[s] * cap();
+                int num = 0;
+
+                for (int by = sbase[s]; by < sbase[s + 1]; by++) {
+                    for (int bx = 0; bx < uw; bx++) {
+                        const int x = bx * 2;
+                        const int y = by * 2;
+                        const int i = by * uw + bx;
+
+                        const bool a = px(x, y);
+                        const bool c = px(x, y + 1);
+                        if (!a && !c && !px(x + 1, y) && !px(x + 1, y + 1)) {
+                            pm[i] = -1;
+                            continue;
+                        }
+
+                        int crnt = -1;
+                        if (by > sbase[s]) {
+                            linkUp(crnt, bx, by);
+                        }
+                        // S (left)
+                        if ((a || c) && (px(x - 1, y) || px(x - 1, y + 1))) {
+                            link(pt, crnt, pm[i - 1]);
+                        }
 
-        // update table
-        for (int i = 0; i < tableNum; i++){
-            int p = i;
-            while (pTable[p] != p){
-                p = pTable[p];
+                        if (crnt < 0) {
+                            crnt = offset + num++;
+                            pt[crnt] = crnt;
+                        }
+                        pm[i] = crnt;
+                    }
+                }
+                snum[s] = num;
             }
-            pTable[i] = p;
-        }
 
-        int labelNum = 0;
+            void merge(const int s) {
+                const int y = sbase[s];
+                for (int x = 0; x < uw; x++) {
+                    const int i = y * uw + x;
+                    if (umap[i] < 0) continue;
 
-        // update label
-        int maxv = -1;
-        for (int i = 0; i < tableNum; i++){
-            if (pTable[i] > maxv){
-                maxv = pTable[i];
+                    if (near8 == true) {
+                        int crnt = umap[i];
+                        linkUp(crnt, x, y);
+                    }
+                    else {
+                        if (umap[i - uw] >= 0) unite(table.ptr, umap[i], umap[i - uw]);
+                    }
+                }
+            }
 
-                for (int j = i; j < tableNum; j++){
-                    if (pTable[j] == maxv){
-                        pTable[j] = labelNum;
+            // provisional label -> final label (raster order)
+            int flatten() {
+                int cnt = 0;
+                for (int s = 0; s < snum.size(); s++) {
+                    const int offset = sbase[s] * cap();
+                    for (int l = offset; l < offset + snum[s]; l++) {
+                        table[l] = (table[l] < l) ? table[table[l]] : cnt++;
                     }
                 }
-                labelNum++;
+                return cnt;
             }
-        }
 
-        // update map
-        for (int i = 0; i < bin.size(); i++){
-            int &id = pMap[i];
-            if (id < 0) continue;
+            int execute(Mem2<int> &map, Mem1<LabelInfo> *infos) {
+                map.resize(bin.dsize);
+                if (w == 0 || h == 0) {
+                    if (infos != NULL) infos->clear();
+                    return 0;
+                }
+
+                umap.resize(uw * uh);
+                table.resize(uh * cap());
+
+                const int strip = snum.size();
+
+                parallel_for(0, strip, [&](const int s) {
+                    if (near8 == true) {
+                        scanBlk(s);
+                    }
+                    else {
+                        scanPix(s);
+                    }
+                }, 1);
+
+                for (int s = 1; s < strip; s++) {
+                    if (sbase[s] < sbase[s + 1]) merge(s);
+                }
+
+                const int labelNum = flatten();
+
+                // final map (and statistics per provisional label, disjoint per strip)
+                Mem1<Acc> accs((infos != NULL) ? table.size() : 0);
 
-            id = pTable[id];
+                parallel_for(0, strip, [&](const int s) {
+                    Acc *acc = (infos != NULL) ? accs.ptr : NULL;
+                    if (acc != NULL) {
+                        const int offset = sbase[s] * cap();
+                        for (int l = offset; l < offset + snum[s]; l++) {
+                            initAcc(acc[l]);
+                        }
+                    }
+
+                    const int y0 = (near8 == true) ? sbase[s] * 2 : sbase[s];
+                    const int y1 = min((near8 == true) ? sbase[s + 1] * 2 : sbase[s + 1], h);
+                    for (int y = y0; y < y1; y++) {
+                        for (int x = 0; x < w; x++) {
+                            const int i = y * w + x;
+                            if (bin.ptr[i] == 0) {
+                                map.ptr[i] = -1;
+                                continue;
+                            }
+                            const int u = (near8 == true) ? (y / 2) * uw + x / 2 : i;
+                            map.ptr[i] = table[umap[u]];
+
+                            if (acc != NULL) addAcc(acc[umap[u]], x, y);
+                        }
+                    }
+                }, 1);
+
+                if (infos != NULL) {
+                    Mem1<Acc> roots(labelNum);
+                    for (int l = 0; l < labelNum; l++) {
+                        initAcc(roots[l]);
+                    }
+                    for (int s = 0; s < strip; s++) {
+                        const int offset = sbase[s] * cap();
+                        for (int l = offset; l < offset + snum[s]; l++) {
+                            mrgAcc(roots[table[l]], accs[l]);
+                        }
+                    }
+
+                    infos->resize(labelNum);
+                    for (int l = 0; l < labelNum; l++) {
+                        const Acc &acc = roots[l];
+
+                        LabelInfo &info = (*infos)[l];
+                        info.area = acc.area;
+                        info.rect = getRect2(acc.x0, acc.y0, acc.x1 - acc.x0 + 1, acc.y1 - acc.y0 + 1);
+                        info.center = getVec2(acc.sx / acc.area, acc.sy / acc.area);
+                    }
+                }
+
+                return labelNum;
+            }
+        };
+    }
+
+    // infos : area, bounding box and centroid of each label
+    SP_CPUFUNC int labeling(Mem2<int> &map, Mem1<LabelInfo> &infos, const Mem2<Byte> &bin, const bool near8 = false) {
+        _label::Labeler labeler(bin, near8);
+        return labeler.execute(map, &infos);
+    }
+
+    SP_CPUFUNC int labeling(Mem2<int> &map, const Mem2<Byte> &bin, const bool near8 = false) {
+        _label::Labeler labeler(bin, near8);
+        return labeler.execute(map, NULL);
+    }
+
+    SP_CPUFUNC Mem1<int> getLabelCount(const Mem1<LabelInfo> &infos) {
+        Mem1<int> dst(infos.size());
+        for (int i = 0; i < dst.size(); i++) {
+            dst[i] = infos[i].area;
         }
+        return dst;
+    }
 
-        return labelNum;
+    SP_CPUFUNC Mem1<Rect2> getLabelRect(const Mem1<LabelInfo> &infos) {
+        Mem1<Rect2> dst(infos.size());
+        for (int i = 0; i < dst.size(); i++) {
+            dst[i] = infos[i].rect;
+        }
+        return dst;
     }
 
     SP_CPUFUNC Mem1<int> getLabelCount(const Mem2<int> &map) {
@@ -327,95 +327,344 @@ namespace sp{
     //--------------------------------------------------------------------------------
     // render geom
     //--------------------------------------------------------------------------------
-    
-    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mesh3 &mesh) {
+    //
+    // triangles are rasterized with homogeneous edge functions.
+    // for the ray d = (x, y, 1) of a pixel and the vertices P0, P1, P2 (camera coordinate),
+    //   l_i = dot(d, cross(P_j, P_k)) / dot(P0, cross(P1, P2))   (i, j, k: cyclic)
+    // the ray hits the triangle when l_0, l_1, l_2 >= 0, and the hit point is d / (l_0 + l_1 + l_2)
+    // (perspective correct, no matrix inversion per pixel).
+    // l_i is linear in d, so it is updated incrementally along a row if the camera has no distortion.
+    //
+    // the image is split into tiles, triangles are binned into the tiles by their bounding box,
+    // and the tiles are rasterized in parallel (triangle order is kept in each tile).
+    // each block in a tile holds its max depth to reject occluded triangles early (hierarchical z).
+    //
 
-        if (cmp(dst.dsize, cam.dsize, 2) == false) {
-            dst.resize(2, cam.dsize);
-            dst.zero();
+    namespace _render {
+
+        // tile size for binning
+        const int TILE = 32;
+
+        // block size for hierarchical z
+        const int BLOCK = 8;
+
+        struct Tri {
+            // edge function coefficients
+            Vec3 e[3];
+
+            // mesh normal
+            Vec3 nrm;
+
+            // min depth of vertices
+            SP_REAL zmin;
+
+            Rect2 rect;
+        };
+
+        SP_CPUFUNC bool isDistorted(const CamParam &cam) {
+            return cam.k1 != 0.0 || cam.k2 != 0.0 || cam.k3 != 0.0 || cam.k4 != 0.0 || cam.p1 != 0.0 || cam.p2 != 0.0;
         }
 
-        Rect2 rect;
+        SP_CPUFUNC bool setTri(Tri &tri, const CamParam &cam, const bool distorted, const Rect2 &img, const Mesh3 &pm) {
+            {
+                int xs = img.dsize[0];
+                int xe = 0;
 
-        const Mesh3 pm = pose * mesh;
-        {
-            int xs = dst.dsize[0];
-            int xe = 0;
+                int ys = img.dsize[1];
+                int ye = 0;
 
-            int ys = dst.dsize[1];
-            int ye = 0;
+                bool valid = false;
+                for (int i = 0; i < 3; i++) {
+                    if (pm.pos[i].z < SP_SMALL) continue;
 
-            bool valid = false;
-            for (int i = 0; i < 3; i++) {
-                if (pm.pos[i].z < SP_SMALL) continue;
+                    valid |= true;
 
-                valid |= true;
+                    const Vec2 npx = prjVec(pm.pos[i]);
+                    const Vec2 pix = (distorted == true) ? mulCamD(cam, npx) : mulCam(cam, npx);
 
-                const Vec2 pix = mulCamD(cam, prjVec(pm.pos[i]));
+                    xs = min(xs, floor(pix.x + 1));
+                    xe = max(xe, floor(pix.x + 1));
 
-                xs = min(xs, floor(pix.x + 1));
-                xe = max(xe, floor(pix.x + 1));
+                    ys = min(ys, floor(pix.y + 1));
+                    ye = max(ye, floor(pix.y + 1));
+                }
+                if (valid == false) return false;
 
-                ys = min(ys, floor(pix.y + 1));
-                ye = max(ye, floor(pix.y + 1));
+                tri.rect = andRect(img, getRect2(xs, ys, xe - xs, ye - ys));
+                if (tri.rect.dsize[0] <= 0 || tri.rect.dsize[1] <= 0) return false;
+            }
+
+            const Vec3 c0 = crsVec(pm.pos[1], pm.pos[2]);
+            const Vec3 c1 = crsVec(pm.pos[2], pm.pos[0]);
+            const Vec3 c2 = crsVec(pm.pos[0], pm.pos[1]);
+
+            const SP_REAL det = dotVec(pm.pos[0], c0);
+            if (fabs(det) < SP_SMALL) return false;
+
+            tri.e[0] = c0 / det;
+            tri.e[1] = c1 / det;
+            tri.e[2] = c2 / det;
+
+            tri.nrm = getMeshNrm(pm);
+            tri.zmin = min(pm.pos[0].z, min(pm.pos[1].z, pm.pos[2].z));
+            return true;
+        }
+
+        // hierarchical z (empty pixel count and max depth of a block)
+        struct HiZ {
+            int cnt;
+            SP_REAL zmax;
+        };
+
+        SP_CPUFUNC HiZ getHiZ(const Mem<VecPD3> &dst, const Rect2 &rect) {
+            HiZ hiz;
+            hiz.cnt = 0;
+            hiz.zmax = 0.0;
+            for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
+                const VecPD3 *ptr = &acs2(dst, rect.dbase[0], v);
+                for (int u = 0; u < rect.dsize[0]; u++) {
+                    const SP_REAL z = ptr[u].pos.z;
+                    if (z == 0.0) {
+                        hiz.cnt++;
+                    }
+                    else {
+                        hiz.zmax = max(hiz.zmax, z);
+                    }
+                }
             }
-            if (valid == false) return;
+            return hiz;
+        }
+
+        // rays : undistorted rays (NULL for no distortion camera)
+        // hiz  : updated conservatively (zmax does not decrease)
+        SP_CPUFUNC void rasterize(Mem<VecPD3> &dst, HiZ &hiz, const CamParam &cam, const Mem2<Vec2> *rays, const Tri &tri, const Rect2 &rect) {
+            const Vec3 e0 = tri.e[0];
+            const Vec3 e1 = tri.e[1];
+            const Vec3 e2 = tri.e[2];
+
+            // ray step along x
+            const SP_REAL dx = 1.0 / cam.fx;
+
+            for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
+                const int u0 = rect.dbase[0];
+                VecPD3 *ptr = &acs2(dst, u0, v);
+
+                Vec2 npx = invCam(cam, getVec2(u0, v));
+                SP_REAL l0 = e0.x * npx.x + e0.y * npx.y + e0.z;
+                SP_REAL l1 = e1.x * npx.x + e1.y * npx.y + e1.z;
+                SP_REAL l2 = e2.x * npx.x + e2.y * npx.y + e2.z;
+
+                for (int u = 0; u < rect.dsize[0]; u++) {
+                    if (rays != NULL) {
+                        npx = (*rays)(u0 + u, v);
+                        l0 = e0.x * npx.x + e0.y * npx.y + e0.z;
+                        l1 = e1.x * npx.x + e1.y * npx.y + e1.z;
+                        l2 = e2.x * npx.x + e2.y * npx.y + e2.z;
+                    }
+                    else if (u > 0) {
+                        npx.x += dx;
+                        l0 += e0.x * dx;
+                        l1 += e1.x * dx;
+                        l2 += e2.x * dx;
+                    }
+
+                    if (l0 < 0.0 || l1 < 0.0 || l2 < 0.0) continue;
 
-            rect = andRect(getRect2(dst.dsize), getRect2(xs, ys, xe - xs, ye - ys));
+                    const SP_REAL depth = 1.0 / (l0 + l1 + l2);
+                    if (depth < SP_SMALL) continue;
+
+                    const SP_REAL ref = ptr[u].pos.z;
+                    if (ref == 0.0 || depth < ref) {
+                        ptr[u] = getVecPD3(getVec3(npx.x, npx.y, 1.0) * depth, tri.nrm);
+
+                        if (ref == 0.0) {
+                            hiz.cnt--;
+                            hiz.zmax = max(hiz.zmax, depth);
+                        }
+                    }
+                }
+            }
         }
 
-        const Vec3 nrm = getMeshNrm(pm);
+        SP_CPUFUNC bool cmpCam(const CamParam &cam0, const CamParam &cam1) {
+            return cam0.type == cam1.type && cmp(cam0.dsize, cam1.dsize, 2) == true
+                && cam0.fx == cam1.fx && cam0.fy == cam1.fy && cam0.cx == cam1.cx && cam0.cy == cam1.cy
+                && cam0.k1 == cam1.k1 && cam0.k2 == cam1.k2 && cam0.k3 == cam1.k3 && cam0.k4 == cam1.k4
+                && cam0.p1 == cam1.p1 && cam0.p2 == cam1.p2;
+        }
 
-        const Vec3 base = pm.pos[0];
-        const Vec3 A = pm.pos[1] - base;
-        const Vec3 B = pm.pos[2] - base;
+        // undistorted rays of each pixel (tables of the last CACHE cameras are kept)
+        class RayCache {
+            static const int CACHE = 2;
 
-        SP_REAL mat[3 * 3] = { -A.x, -B.x, 0.0, -A.y, -B.y, 0.0, -A.z, -B.z, 0.0 };
-        SP_REAL val[3] = { base.x, base.y, base.z };
+            std::mutex m_mtx;
+            Mem1<CamParam> m_cams;
+            Mem1<Mem2<Vec2> > m_rays;
+            int m_next;
 
-        for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
-            for (int u = rect.dbase[0]; u < rect.dbase[0] + rect.dsize[0]; u++) {
-                const Vec2 prj = npxUndist(cam, invCam(cam, getVec2(u, v)));
-                const Vec3 vec = getVec3(prj.x, prj.y, 1.0);
+        public:
+            RayCache() {
+                m_cams.resize(CACHE);
+                m_rays.resize(CACHE);
+                m_next = 0;
+            }
 
-                mat[0 * 3 + 2] = vec.x;
-                mat[1 * 3 + 2] = vec.y;
-                mat[2 * 3 + 2] = vec.z;
+            void get(Mem2<Vec2> &rays, const CamParam &cam) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    for (int i = 0; i < CACHE; i++) {
+                        if (m_rays[i].size() > 0 && cmpCam(m_cams[i], cam) == true) {
+                            rays = m_rays[i];
+                            return;
+                        }
+                    }
+                }
 
-                SP_REAL inv[3 * 3];
-                if (invMat33(inv, mat) == false) continue;
+                // build outside the lock
+                rays.resize(cam.dsize);
+                parallel_for(0, rays.dsize[1], [&](const int v) {
+                    for (int u = 0; u < rays.dsize[0]; u++) {
+                        rays(u, v) = npxUndist(cam, invCam(cam, getVec2(u, v)));
+                    }
+                });
 
-                SP_REAL result[3];
-                mulMat(result, 3, 1, inv, 3, 3, val, 3, 1);
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_cams[m_next] = cam;
+                m_rays[m_next] = rays;
+                m_next = (m_next + 1) % CACHE;
+            }
+        };
 
-                if (result[0] < 0.0 || result[1] < 0.0 || result[0] + result[1] > 1.0) continue;
+        SP_CPUFUNC void getRays(Mem2<Vec2> &rays, const CamParam &cam) {
+            static RayCache cache;
+            cache.get(rays, cam);
+        }
+    }
+
+    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mesh3 *meshes, const int num) {
+
+        if (cmp(dst.dsize, cam.dsize, 2) == false) {
+            dst.resize(2, cam.dsize);
+            dst.zero();
+        }
+
+        const Rect2 img = getRect2(dst.dsize);
+
+        const bool distorted = _render::isDistorted(cam);
 
-                const SP_REAL depth = result[2];
-                if (depth < SP_SMALL) continue;
+        SP_REAL mat[3 * 4];
+        getMat(mat, 3, 4, pose);
 
-                const SP_REAL ref = extractZ(acs2(dst, u, v));
-                if (ref == 0.0 || depth < ref) {
-                    acs2(dst, u, v) = getVecPD3(vec * depth, nrm);
+        Mem1<_render::Tri> tris(num);
+        Mem1<bool> valids(num);
+        parallel_for(0, num, [&](const int i) {
+            valids[i] = _render::setTri(tris[i], cam, distorted, img, mulMat(mat, 3, 4, meshes[i]));
+        });
+
+        Mem2<Vec2> rayMap;
+        if (distorted == true) {
+            _render::getRays(rayMap, cam);
+        }
+        const Mem2<Vec2> *rays = (distorted == true) ? &rayMap : NULL;
+
+        // binning
+        const int TILE = _render::TILE;
+        const int BLOCK = _render::BLOCK;
+
+        const int tw = (dst.dsize[0] + TILE - 1) / TILE;
+        const int th = (dst.dsize[1] + TILE - 1) / TILE;
+
+        Mem1<int> offsets(tw * th + 1);
+        offsets.zero();
+
+        Mem1<int> bins;
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < tris.size(); i++) {
+                if (valids[i] == false) continue;
+
+                const Rect2 &rect = tris[i].rect;
+                const int xs = rect.dbase[0] / TILE;
+                const int xe = (rect.dbase[0] + rect.dsize[0] - 1) / TILE;
+                const int ys = rect.dbase[1] / TILE;
+                const int ye = (rect.dbase[1] + rect.dsize[1] - 1) / TILE;
+                for (int y = ys; y <= ye; y++) {
+                    for (int x = xs; x <= xe; x++) {
+                        if (pass == 0) {
+                            offsets[y * tw + x + 1]++;
+                        }
+                        else {
+                            bins[offsets[y * tw + x]++] = i;
+                        }
+                    }
+                }
+            }
+            if (pass == 0) {
+                for (int t = 0; t < tw * th; t++) {
+                    offsets[t + 1] += offsets[t];
                 }
+                bins.resize(offsets[tw * th]);
+            }
+            else {
+                // restore begin offsets
+                for (int t = tw * th; t > 0; t--) {
+                    offsets[t] = offsets[t - 1];
+                }
+                offsets[0] = 0;
             }
         }
 
+        // one task per tile (the costs are uneven)
+        parallel_for(0, tw * th, [&](const int t) {
+            if (offsets[t] == offsets[t + 1]) return;
+
+            const Rect2 tile = andRect(img, getRect2((t % tw) * TILE, (t / tw) * TILE, TILE, TILE));
+
+            const int bw = (tile.dsize[0] + BLOCK - 1) / BLOCK;
+            const int bh = (tile.dsize[1] + BLOCK - 1) / BLOCK;
+
+            Rect2 blocks[(TILE / BLOCK) * (TILE / BLOCK)];
+            _render::HiZ hizs[(TILE / BLOCK) * (TILE / BLOCK)];
+            for (int b = 0; b < bw * bh; b++) {
+                blocks[b] = andRect(tile, getRect2(tile.dbase[0] + (b % bw) * BLOCK, tile.dbase[1] + (b / bw) * BLOCK, BLOCK, BLOCK));
+                hizs[b] = _render::getHiZ(dst, blocks[b]);
+            }
+
+            for (int i = offsets[t]; i < offsets[t + 1]; i++) {
+                const _render::Tri &tri = tris[bins[i]];
+
+                const Rect2 rect = andRect(tile, tri.rect);
+                const int xs = (rect.dbase[0] - tile.dbase[0]) / BLOCK;
+                const int xe = (rect.dbase[0] + rect.dsize[0] - 1 - tile.dbase[0]) / BLOCK;
+                const int ys = (rect.dbase[1] - tile.dbase[1]) / BLOCK;
+                const int ye = (rect.dbase[1] + rect.dsize[1] - 1 - tile.dbase[1]) / BLOCK;
+
+                for (int y = ys; y <= ye; y++) {
+                    for (int x = xs; x <= xe; x++) {
+                        const int b = y * bw + x;
+
+                        // early reject
+                        if (hizs[b].cnt == 0 && tri.zmin >= hizs[b].zmax) continue;
+
+                        _render::rasterize(dst, hizs[b], cam, rays, tri, andRect(blocks[b], rect));
+                    }
+                }
+            }
+        }, 1);
     }
 
-    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
+    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mesh3 &mesh) {
+        renderVecPD(dst, cam, pose, &mesh, 1);
+    }
 
-        for (int i = 0; i < meshes.size(); i++) {
-            renderVecPD(dst, cam, pose, meshes[i]);
-        }
+    SP_CPUFUNC void renderVecPD(Mem<VecPD3> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
+        renderVecPD(dst, cam, pose, meshes.ptr, meshes.size());
     }
 
     template<typename DEPTH>
     SP_CPUFUNC void renderDepth(Mem<DEPTH> &dst, const CamParam &cam, const Pose &pose, const Mem<Mesh3> &meshes) {
 
         Mem<VecPD3> pnmap;
-        for (int i = 0; i < meshes.size(); i++) {
-            renderVecPD(pnmap, cam, pose, meshes[i]);
-        }
+        renderVecPD(pnmap, cam, pose, meshes);
 
         dst.resize(2, cam.dsize);
         for (int i = 0; i < dst.size(); i++) {
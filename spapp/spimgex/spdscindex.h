@@ -0,0 +1,970 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_DSCINDEX_H__
+#define __SP_DSCINDEX_H__
+
+#include "spcore/spcore.h"
+#include "spapp/spimgex/spfeature.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // descriptor index (approximate nearest neighbour)
+    //--------------------------------------------------------------------------------
+    //
+    // KdForest : randomized kd trees on dsc.val (best bin first over all trees)
+    // LSH      : multi-probe locality sensitive hash on dsc.bin
+    //
+    // candidates pass the same sign / binary tests as findMatch(const Ftr&, ...) and
+    // are ranked by squared L2 distance of dsc.val (= 2 - 2 ncc for unit vectors),
+    // a match is accepted when ncc > MIN_NCC and, if ratio < 1, d1 < ratio^2 * d2
+    //
+    // ratio = 1 (default) keeps the brute-force result, the kd forest returns the
+    // same matches as findMatch(ftrs0, ftrs1) when checks >= size
+    //
+
+    class DscIndex {
+
+    public:
+
+        enum Type {
+            KdForest = 0,
+            LSH = 1
+        };
+
+        // search work buffer (one per thread, reuse it over queries)
+        struct Work {
+            // visited stamp
+            Mem1<int> stamp;
+            int cnt;
+
+            // branch heap (kd forest)
+            Mem1<Vec2> heap;
+
+            // min matched bits (binary test)
+            int minCnt;
+
+            Work() {
+                cnt = 0;
+                minCnt = 0;
+            }
+        };
+
+    private:
+
+        struct Node {
+            // div dimension (-1 : leaf)
+            int div;
+
+            // div value
+            float val;
+
+            // 0 : left node, 1 : right node (leaf : [begin, end) of m_ids)
+            int sub[2];
+        };
+
+        Type m_type;
+
+        // descriptor type
+        Dsc::Type m_dtype;
+
+        // descriptor dimension
+        int m_dim;
+
+        // descriptor binary size
+        int m_bsize;
+
+        // point num
+        int m_size;
+
+        // descriptors
+        Mem1<float> m_vals;
+        Mem1<Byte> m_bins;
+        Mem1<int> m_signs;
+
+        // kd forest
+        int m_treeNum;
+        int m_leafSize;
+        int m_checks;
+
+        Mem1<Node> m_nodes;
+        Mem1<int> m_roots;
+
+        // lsh (key bits, 0 : auto)
+        int m_tableNum;
+        int m_keyBits;
+        int m_bits;
+
+        Mem1<int> m_keys;
+        Mem1<int> m_offs;
+
+        // sorted point index (tree leafs / hash buckets)
+        Mem1<int> m_ids;
+
+    public:
+
+        DscIndex() {
+            m_type = KdForest;
+            m_dtype = Dsc::DSC_NULL;
+            m_dim = 0;
+            m_bsize = 0;
+            m_size = 0;
+
+            m_treeNum = 4;
+            m_leafSize = 8;
+            m_checks = 128;
+
+            m_tableNum = 6;
+            m_keyBits = 0;
+            m_bits = 0;
+        }
+
+        DscIndex(const Mem1<Ftr> &ftrs, const Type type = KdForest) {
+            *this = DscIndex();
+            build(ftrs, type);
+        }
+
+        //--------------------------------------------------------------------------------
+        // parameter
+        //--------------------------------------------------------------------------------
+
+        // kd forest (tree num, max leaf checks per query)
+        void setKdParam(const int treeNum, const int checks) {
+            m_treeNum = max(1, treeNum);
+            m_checks = max(1, checks);
+        }
+
+        // lsh (table num, key bits, 0 : ceil(log2(size)) in [8, 16])
+        // bucket offsets take 4 * 2^bits byte per table
+        void setLSHParam(const int tableNum, const int keyBits = 0) {
+            m_tableNum = max(1, tableNum);
+            m_keyBits = (keyBits > 0) ? min(keyBits, 20) : 0;
+        }
+
+        int size() const {
+            return m_size;
+        }
+
+        Type type() const {
+            return m_type;
+        }
+
+        Dsc::Type dscType() const {
+            return m_dtype;
+        }
+
+        //--------------------------------------------------------------------------------
+        // build
+        //--------------------------------------------------------------------------------
+
+        void build(const Mem1<Ftr> &ftrs, const Type type = KdForest) {
+            m_type = type;
+            m_size = ftrs.size();
+
+            m_nodes.clear();
+            m_roots.clear();
+            m_keys.clear();
+            m_offs.clear();
+            m_ids.clear();
+
+            m_dtype = (m_size > 0) ? ftrs[0].dsc.type : Dsc::DSC_NULL;
+            m_dim = (m_size > 0) ? ftrs[0].dsc.dim : 0;
+            m_bsize = (m_size > 0) ? ftrs[0].dsc.bin.size() : 0;
+
+            m_vals.resize(m_size * m_dim);
+            m_bins.resize(m_size * m_bsize);
+            m_signs.resize(m_size);
+
+            for (int i = 0; i < m_size; i++) {
+                const Dsc &dsc = ftrs[i].dsc;
+                SP_ASSERT(dsc.type == m_dtype && dsc.dim == m_dim && dsc.bin.size() == m_bsize);
+
+                memcpy(&m_vals[i * m_dim], dsc.val.ptr, m_dim * sizeof(float));
+                memcpy(&m_bins[i * m_bsize], dsc.bin.ptr, m_bsize);
+                m_signs[i] = (ftrs[i].cst > 0.0) ? +1 : (ftrs[i].cst < 0.0) ? -1 : 0;
+            }
+            if (m_size == 0) return;
+
+            if (m_type == KdForest) {
+                buildKdForest();
+            }
+            else {
+                buildLSH();
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // search
+        //--------------------------------------------------------------------------------
+
+        // stored descriptor i as a query
+        const float* getVal(const int i) const {
+            return &m_vals[i * m_dim];
+        }
+
+        const Byte* getBin(const int i) const {
+            return &m_bins[i * m_bsize];
+        }
+
+        int getSign(const int i) const {
+            return m_signs[i];
+        }
+
+        // return matched index (-1 : not found)
+        int search(Work &work, const float *val, const Byte *bin, const int sign, const SP_REAL ratio = 1.0) const {
+            if (m_size == 0 || sign == 0) return -1;
+
+            SP_REAL MIN_NCC, MIN_BIN;
+            if (getCriteria(m_dtype, MIN_NCC, MIN_BIN) == false) return -1;
+
+            // btest = cnt / dim >= MIN_BIN
+            work.minCnt = 0;
+            while (static_cast<SP_REAL>(work.minCnt) / m_dim < MIN_BIN) work.minCnt++;
+
+            if (work.stamp.size() != m_size) {
+                work.stamp.resize(m_size);
+                work.stamp.zero();
+                work.cnt = 0;
+            }
+            if (++work.cnt == SP_INTMAX) {
+                work.stamp.zero();
+                work.cnt = 1;
+            }
+
+            int id[2] = { -1, -1 };
+            float dist[2] = { SP_INFINITY, SP_INFINITY };
+
+            if (m_type == KdForest) {
+                searchKdForest(work, id, dist, val, bin, sign);
+            }
+            else {
+                searchLSH(work, id, dist, val, bin, sign);
+            }
+            if (id[0] < 0) return -1;
+
+            // ratio test
+            if (ratio < 1.0 && id[1] >= 0 && dist[0] >= ratio * ratio * dist[1]) return -1;
+
+            // ncc test
+            {
+                const float *data = &m_vals[id[0] * m_dim];
+                SP_REAL sum = 0.0;
+                for (int d = 0; d < m_dim; d++) {
+                    sum += val[d] * data[d];
+                }
+                if (sum <= MIN_NCC) return -1;
+            }
+
+            return id[0];
+        }
+
+        int search(Work &work, const Ftr &ftr, const SP_REAL ratio = 1.0) const {
+            if (ftr.dsc.type != m_dtype) return -1;
+            return search(work, reinterpret_cast<const float*>(ftr.dsc.val.ptr), ftr.dsc.bin.ptr, getSign(ftr), ratio);
+        }
+
+        // batched query
+        Mem1<int> search(const Mem1<Ftr> &ftrs, const SP_REAL ratio = 1.0) const {
+            Mem1<int> ids(ftrs.size());
+
+            const int block = 64;
+            parallel_for(0, (ftrs.size() + block - 1) / block, [&](const int b) {
+                Work work;
+                for (int i = b * block; i < min((b + 1) * block, ftrs.size()); i++) {
+                    ids[i] = search(work, ftrs[i], ratio);
+                }
+            }, 1);
+
+            return ids;
+        }
+
+    private:
+
+        static int getSign(const Ftr &ftr) {
+            return (ftr.cst > 0.0) ? +1 : (ftr.cst < 0.0) ? -1 : 0;
+        }
+
+        // match criteria (same as findMatch(const Ftr&, ...)), false : unsupported type
+        static bool getCriteria(const Dsc::Type type, SP_REAL &minNcc, SP_REAL &minBin) {
+            switch (type) {
+            case Dsc::DSC_SIFT:
+            case Dsc::DSC_CFBlob:
+                minNcc = 0.9f;
+                minBin = minNcc * 0.9f;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        SP_REAL calcDist(const float *val, const int i, const float limit) const {
+            const float *data = &m_vals[i * m_dim];
+
+            float sum = 0.0f;
+            for (int d = 0; d < m_dim; d += 16) {
+                for (int k = d; k < min(d + 16, m_dim); k++) {
+                    const float v = val[k] - data[k];
+                    sum += v * v;
+                }
+                if (sum >= limit) break;
+            }
+            return sum;
+        }
+
+        void check(Work &work, int *id, float *dist, const float *val, const Byte *bin, const int sign, const int i) const {
+            if (work.stamp[i] == work.cnt) return;
+            work.stamp[i] = work.cnt;
+
+            if (sign * m_signs[i] <= 0) return;
+            if (cntBit(bin, &m_bins[i * m_bsize], m_bsize) < work.minCnt) return;
+
+            const float d = static_cast<float>(calcDist(val, i, dist[1]));
+            if (d < dist[0]) {
+                id[1] = id[0];
+                dist[1] = dist[0];
+                id[0] = i;
+                dist[0] = d;
+            }
+            else if (d < dist[1]) {
+                id[1] = i;
+                dist[1] = d;
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // kd forest
+        //--------------------------------------------------------------------------------
+
+        void buildKdForest() {
+            m_ids.resize(m_treeNum * m_size);
+            m_roots.resize(m_treeNum);
+            m_nodes.reserve(m_treeNum * 2 * (m_size / max(1, m_leafSize / 2) + 1));
+
+            unsigned int seed = 0;
+            for (int t = 0; t < m_treeNum; t++) {
+                int *ids = &m_ids[t * m_size];
+                for (int i = 0; i < m_size; i++) {
+                    ids[i] = i;
+                }
+                // shuffle (split statistics are sampled from the head of each range)
+                for (int i = m_size - 1; i > 0; i--) {
+                    seed = _snext(seed);
+                    swap(ids[i], ids[(seed >> 1) % (i + 1)]);
+                }
+                m_roots[t] = buildNode(ids, t * m_size, m_size, seed);
+            }
+        }
+
+        int buildNode(int *ids, const int base, const int num, unsigned int &seed) {
+            const int n = m_nodes.size();
+            m_nodes.push(Node());
+
+            if (num <= m_leafSize) {
+                setLeaf(n, base, num);
+                return n;
+            }
+
+            // variance of sampled points
+            const int snum = min(num, 100);
+
+            Mem1<double> mean(m_dim), var(m_dim);
+            mean.zero();
+            var.zero();
+            for (int i = 0; i < snum; i++) {
+                const float *data = &m_vals[ids[i] * m_dim];
+                for (int d = 0; d < m_dim; d++) {
+                    mean[d] += data[d];
+                }
+            }
+            mean /= snum;
+            for (int i = 0; i < snum; i++) {
+                const float *data = &m_vals[ids[i] * m_dim];
+                for (int d = 0; d < m_dim; d++) {
+                    var[d] += (data[d] - mean[d]) * (data[d] - mean[d]);
+                }
+            }
+
+            // random div from top variance dimensions
+            const int TOP = 5;
+            int top[TOP];
+            int tnum = 0;
+            for (int d = 0; d < m_dim; d++) {
+                int p = min(tnum, TOP - 1);
+                if (tnum == TOP && var[d] <= var[top[p]]) continue;
+                while (p > 0 && var[top[p - 1]] < var[d]) {
+                    top[p] = top[p - 1];
+                    p--;
+                }
+                top[p] = d;
+                tnum = min(tnum + 1, TOP);
+            }
+            seed = _snext(seed);
+            const int div = top[(seed >> 1) % tnum];
+            const float val = static_cast<float>(mean[div]);
+
+            int cnt = 0;
+            for (int i = 0; i < num; i++) {
+                if (m_vals[ids[i] * m_dim + div] < val) {
+                    swap(ids[i], ids[cnt++]);
+                }
+            }
+            if (cnt == 0 || cnt == num) {
+                setLeaf(n, base, num);
+                return n;
+            }
+
+            const int sub0 = buildNode(ids, base, cnt, seed);
+            const int sub1 = buildNode(ids + cnt, base + cnt, num - cnt, seed);
+
+            Node &node = m_nodes[n];
+            node.div = div;
+            node.val = val;
+            node.sub[0] = sub0;
+            node.sub[1] = sub1;
+            return n;
+        }
+
+        void setLeaf(const int n, const int base, const int num) {
+            Node &node = m_nodes[n];
+            node.div = -1;
+            node.val = 0.0f;
+            node.sub[0] = base;
+            node.sub[1] = base + num;
+        }
+
+        // heap of (bin dist, node)
+        static void pushHeap(Mem1<Vec2> &heap, const SP_REAL dist, const int node) {
+            heap.push(getVec2(dist, node));
+            int i = heap.size() - 1;
+            while (i > 0) {
+                const int p = (i - 1) / 2;
+                if (heap[p].x <= heap[i].x) break;
+                swap(heap[p], heap[i]);
+                i = p;
+            }
+        }
+
+        static Vec2 popHeap(Mem1<Vec2> &heap) {
+            const Vec2 top = heap[0];
+            heap[0] = heap[heap.size() - 1];
+            heap.pop();
+
+            int i = 0;
+            while (true) {
+                const int a = 2 * i + 1;
+                const int b = 2 * i + 2;
+                int m = i;
+                if (a < heap.size() && heap[a].x < heap[m].x) m = a;
+                if (b < heap.size() && heap[b].x < heap[m].x) m = b;
+                if (m == i) break;
+                swap(heap[m], heap[i]);
+                i = m;
+            }
+            return top;
+        }
+
+        void descend(Work &work, int *id, float *dist, int &checks, const float *val, const Byte *bin, const int sign, int n, const float bdist) const {
+            while (m_nodes[n].div >= 0) {
+                const Node &node = m_nodes[n];
+                const float diff = val[node.div] - node.val;
+                const int near = (diff < 0.0f) ? 0 : 1;
+
+                const float fdist = bdist + diff * diff;
+                if (fdist < dist[1]) {
+                    pushHeap(work.heap, fdist, node.sub[1 - near]);
+                }
+                n = node.sub[near];
+            }
+
+            const Node &leaf = m_nodes[n];
+            for (int i = leaf.sub[0]; i < leaf.sub[1]; i++) {
+                check(work, id, dist, val, bin, sign, m_ids[i]);
+                checks++;
+            }
+        }
+
+        void searchKdForest(Work &work, int *id, float *dist, const float *val, const Byte *bin, const int sign) const {
+            work.heap.clear();
+
+            int checks = 0;
+            for (int t = 0; t < m_roots.size(); t++) {
+                descend(work, id, dist, checks, val, bin, sign, m_roots[t], 0.0f);
+            }
+
+            while (work.heap.size() > 0 && checks < m_checks) {
+                const Vec2 b = popHeap(work.heap);
+                if (b.x >= dist[1]) break;
+
+                descend(work, id, dist, checks, val, bin, sign, static_cast<int>(b.y), static_cast<float>(b.x));
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // lsh
+        //--------------------------------------------------------------------------------
+
+        int getKey(const Byte *bin, const int t) const {
+            const int *keys = &m_keys[t * m_bits];
+
+            int key = 0;
+            for (int k = 0; k < m_bits; k++) {
+                const int p = keys[k];
+                key |= ((bin[p / 8] >> (p % 8)) & 0x01) << k;
+            }
+            return key;
+        }
+
+        void buildLSH() {
+            m_bits = m_keyBits;
+            if (m_bits == 0) {
+                m_bits = 8;
+                while (m_bits < 16 && (1 << m_bits) < m_size) m_bits++;
+            }
+
+            const int bnum = 1 << m_bits;
+            const int bits = m_bsize * 8;
+
+            m_keys.resize(m_tableNum * m_bits);
+            m_offs.resize(m_tableNum * (bnum + 1));
+            m_ids.resize(m_tableNum * m_size);
+
+            unsigned int seed = 0;
+            for (int t = 0; t < m_tableNum; t++) {
+                int *keys = &m_keys[t * m_bits];
+                for (int k = 0; k < m_bits; k++) {
+                    seed = _snext(seed);
+                    keys[k] = (seed >> 1) % bits;
+                }
+
+                // bucket sort
+                Mem1<int> tkeys(m_size);
+                int *offs = &m_offs[t * (bnum + 1)];
+                memset(offs, 0, (bnum + 1) * sizeof(int));
+
+                for (int i = 0; i < m_size; i++) {
+                    tkeys[i] = getKey(&m_bins[i * m_bsize], t);
+                    offs[tkeys[i] + 1]++;
+                }
+                for (int b = 0; b < bnum; b++) {
+                    offs[b + 1] += offs[b];
+                }
+
+                Mem1<int> pos(bnum);
+                memcpy(pos.ptr, offs, bnum * sizeof(int));
+
+                int *ids = &m_ids[t * m_size];
+                for (int i = 0; i < m_size; i++) {
+                    ids[pos[tkeys[i]]++] = i;
+                }
+            }
+        }
+
+        void searchLSH(Work &work, int *id, float *dist, const float *val, const Byte *bin, const int sign) const {
+            const int bnum = 1 << m_bits;
+
+            for (int t = 0; t < m_tableNum; t++) {
+                const int *offs = &m_offs[t * (bnum + 1)];
+                const int *ids = &m_ids[t * m_size];
+                const int key = getKey(bin, t);
+
+                // probe the bucket and its 1-bit neighbours
+                for (int k = -1; k < m_bits; k++) {
+                    const int b = (k < 0) ? key : key ^ (1 << k);
+                    for (int i = offs[b]; i < offs[b + 1]; i++) {
+                        check(work, id, dist, val, bin, sign, ids[i]);
+                    }
+                }
+            }
+        }
+
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // quantized descriptor set
+    //--------------------------------------------------------------------------------
+    //
+    // dsc.val is stored as int8 (per descriptor scale = max|v| / 127) in SoA blocks
+    // of 8 descriptors, [block][dim / 4][8][4], so that one query is scored against
+    // 8 candidates per instruction, dsc.bin is stored as [block][8][bsize]
+    //
+
+    namespace _dscset {
+
+        static const int BLOCK = 8;
+
+        // dot[k] = sum_d qry[d] * blk[d / 4][k][d % 4] (values in [-127, 127], as quantized in DscSet)
+        SP_CPUFUNC void dotBlock_c(int *dot, const signed char *qry, const signed char *blk, const int dim) {
+            for (int k = 0; k < BLOCK; k++) {
+                dot[k] = 0;
+            }
+            for (int g = 0; g < dim / 4; g++) {
+                const signed char *q = &qry[g * 4];
+                const signed char *c = &blk[g * 4 * BLOCK];
+                for (int k = 0; k < BLOCK; k++) {
+                    dot[k] += q[0] * c[k * 4 + 0] + q[1] * c[k * 4 + 1] + q[2] * c[k * 4 + 2] + q[3] * c[k * 4 + 3];
+                }
+            }
+        }
+
+        // cnt[k] = matched bits of qry and blk[k]
+        SP_CPUFUNC void bitBlock_c(int *cnt, const Byte *qry, const Byte *blk, const int bsize) {
+            for (int k = 0; k < BLOCK; k++) {
+                cnt[k] = cntBit(qry, &blk[k * bsize], bsize);
+            }
+        }
+
+#if SP_USE_SIMD
+
+        SP_TARGET_SSE4 SP_CPUFUNC void dotBlock_sse4(int *dot, const signed char *qry, const signed char *blk, const int dim) {
+            const __m128i one = _mm_set1_epi16(1);
+
+            __m128i acc0 = _mm_setzero_si128();
+            __m128i acc1 = _mm_setzero_si128();
+            for (int g = 0; g < dim / 4; g++) {
+                int v;
+                memcpy(&v, &qry[g * 4], 4);
+                const __m128i q = _mm_set1_epi32(v);
+                const __m128i a = _mm_abs_epi8(q);
+
+                const __m128i c0 = _mm_loadu_si128((const __m128i*)&blk[g * 4 * BLOCK + 0]);
+                const __m128i c1 = _mm_loadu_si128((const __m128i*)&blk[g * 4 * BLOCK + 16]);
+
+                // |q| * sign(c, q) = q * c
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_maddubs_epi16(a, _mm_sign_epi8(c0, q)), one));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_maddubs_epi16(a, _mm_sign_epi8(c1, q)), one));
+            }
+            _mm_storeu_si128((__m128i*)&dot[0], acc0);
+            _mm_storeu_si128((__m128i*)&dot[4], acc1);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void bitBlock_sse4(int *cnt, const Byte *qry, const Byte *blk, const int bsize) {
+            if (bsize != 16) {
+                bitBlock_c(cnt, qry, blk, bsize);
+                return;
+            }
+            const __m128i lut = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            const __m128i low = _mm_set1_epi8(0x0F);
+            const __m128i q = _mm_loadu_si128((const __m128i*)qry);
+
+            for (int k = 0; k < BLOCK; k++) {
+                const __m128i x = _mm_xor_si128(q, _mm_loadu_si128((const __m128i*)&blk[k * 16]));
+                const __m128i p = _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(x, low)), _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(x, 4), low)));
+                const __m128i s = _mm_sad_epu8(p, _mm_setzero_si128());
+                cnt[k] = 128 - (_mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4));
+            }
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void dotBlock_avx2(int *dot, const signed char *qry, const signed char *blk, const int dim) {
+            const __m256i one = _mm256_set1_epi16(1);
+
+            __m256i acc = _mm256_setzero_si256();
+            for (int g = 0; g < dim / 4; g++) {
+                int v;
+                memcpy(&v, &qry[g * 4], 4);
+                const __m256i q = _mm256_set1_epi32(v);
+                const __m256i c = _mm256_loadu_si256((const __m256i*)&blk[g * 4 * BLOCK]);
+
+                // |q| * sign(c, q) = q * c
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_abs_epi8(q), _mm256_sign_epi8(c, q)), one));
+            }
+            _mm256_storeu_si256((__m256i*)dot, acc);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void bitBlock_avx2(int *cnt, const Byte *qry, const Byte *blk, const int bsize) {
+            if (bsize != 16) {
+                bitBlock_c(cnt, qry, blk, bsize);
+                return;
+            }
+            const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i low = _mm256_set1_epi8(0x0F);
+            const __m256i q = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)qry));
+
+            // 2 candidates per register
+            for (int k = 0; k < BLOCK; k += 2) {
+                const __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256((const __m256i*)&blk[k * 16]));
+                const __m256i p = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, low)), _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+                __m256i s = _mm256_sad_epu8(p, _mm256_setzero_si256());
+                s = _mm256_add_epi64(s, _mm256_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+
+                cnt[k + 0] = 128 - _mm_cvtsi128_si32(_mm256_castsi256_si128(s));
+                cnt[k + 1] = 128 - _mm_cvtsi128_si32(_mm256_extracti128_si256(s, 1));
+            }
+        }
+
+#endif
+
+        struct Kernel {
+            void (*dotBlock)(int *dot, const signed char *qry, const signed char *blk, const int dim);
+            void (*bitBlock)(int *cnt, const Byte *qry, const Byte *blk, const int bsize);
+        };
+
+        SP_CPUFUNC Kernel getKernel() {
+            Kernel ker = { dotBlock_c, bitBlock_c };
+#if SP_USE_SIMD
+            if (getSimdLevel() >= SimdLevel_SSE4) {
+                Kernel tmp = { dotBlock_sse4, bitBlock_sse4 };
+                ker = tmp;
+            }
+            if (getSimdLevel() >= SimdLevel_AVX2) {
+                Kernel tmp = { dotBlock_avx2, bitBlock_avx2 };
+                ker = tmp;
+            }
+#endif
+            return ker;
+        }
+    }
+
+    class DscSet {
+
+    private:
+
+        // descriptor num
+        int m_size;
+
+        // descriptor dimension (padded to 4)
+        int m_dim;
+
+        // descriptor binary size
+        int m_bsize;
+
+        // block num
+        int m_bnum;
+
+        Mem1<signed char> m_vals;
+        Mem1<float> m_scls;
+        Mem1<Byte> m_bins;
+        Mem1<int> m_signs;
+
+    public:
+
+        DscSet() {
+            m_size = 0;
+            m_dim = 0;
+            m_bsize = 0;
+            m_bnum = 0;
+        }
+
+        DscSet(const Mem1<Ftr> &ftrs) {
+            *this = DscSet();
+            build(ftrs);
+        }
+
+        int size() const {
+            return m_size;
+        }
+
+        int dim() const {
+            return m_dim;
+        }
+
+        int bsize() const {
+            return m_bsize;
+        }
+
+        // working set [byte]
+        int bytes() const {
+            return m_vals.size() + m_scls.size() * sizeof(float) + m_bins.size() + m_signs.size() * sizeof(int);
+        }
+
+        //--------------------------------------------------------------------------------
+        // build
+        //--------------------------------------------------------------------------------
+
+        void build(const Mem1<Ftr> &ftrs) {
+            const int BLOCK = _dscset::BLOCK;
+
+            m_size = ftrs.size();
+            m_dim = (m_size > 0) ? (ftrs[0].dsc.dim + 3) / 4 * 4 : 0;
+            m_bsize = (m_size > 0) ? ftrs[0].dsc.bin.size() : 0;
+            m_bnum = (m_size + BLOCK - 1) / BLOCK;
+
+            m_vals.resize(m_bnum * BLOCK * m_dim);
+            m_scls.resize(m_bnum * BLOCK);
+            m_bins.resize(m_bnum * BLOCK * m_bsize);
+            m_signs.resize(m_bnum * BLOCK);
+
+            m_vals.zero();
+            m_scls.zero();
+            m_bins.zero();
+            m_signs.zero();
+
+            for (int i = 0; i < m_size; i++) {
+                const Dsc &dsc = ftrs[i].dsc;
+                SP_ASSERT((dsc.dim + 3) / 4 * 4 == m_dim && dsc.bin.size() == m_bsize);
+
+                const float *val = reinterpret_cast<const float*>(dsc.val.ptr);
+
+                float maxv = 0.0f;
+                for (int d = 0; d < dsc.dim; d++) {
+                    maxv = max(maxv, static_cast<float>(fabs(val[d])));
+                }
+                const float scl = (maxv > 0.0f) ? maxv / 127.0f : 1.0f;
+
+                const int b = i / BLOCK;
+                const int k = i % BLOCK;
+                signed char *blk = &m_vals[b * BLOCK * m_dim];
+                for (int d = 0; d < dsc.dim; d++) {
+                    blk[(d / 4) * 4 * BLOCK + k * 4 + d % 4] = static_cast<signed char>(floor(val[d] / scl + 0.5f));
+                }
+                m_scls[i] = scl;
+
+                memcpy(&m_bins[(b * BLOCK + k) * m_bsize], dsc.bin.ptr, m_bsize);
+                m_signs[i] = (ftrs[i].cst > 0.0) ? +1 : (ftrs[i].cst < 0.0) ? -1 : 0;
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // search
+        //--------------------------------------------------------------------------------
+
+        // copy descriptor i (qry : dim, bin : bsize)
+        void getQuery(signed char *qry, Byte *bin, float &scl, int &sign, const int i) const {
+            const int BLOCK = _dscset::BLOCK;
+
+            const int b = i / BLOCK;
+            const int k = i % BLOCK;
+            const signed char *blk = &m_vals[b * BLOCK * m_dim];
+            for (int d = 0; d < m_dim; d++) {
+                qry[d] = blk[(d / 4) * 4 * BLOCK + k * 4 + d % 4];
+            }
+            memcpy(bin, &m_bins[i * m_bsize], m_bsize);
+            scl = m_scls[i];
+            sign = m_signs[i];
+        }
+
+        // best ncc candidate (same criteria as findMatch(const Ftr&, ...)), -1 : not found
+        int search(const _dscset::Kernel &ker, const signed char *qry, const Byte *bin, const float scl, const int sign) const {
+            const int BLOCK = _dscset::BLOCK;
+
+            const SP_REAL MIN_NCC = 0.9f;
+            const SP_REAL MIN_BIN = MIN_NCC * 0.9f;
+
+            const int bits = m_bsize * 8;
+
+            SP_REAL maxv = MIN_NCC;
+            int id = -1;
+
+            if (sign == 0) return id;
+
+            // btest = cnt / bits >= MIN_BIN
+            int minCnt = 0;
+            while (static_cast<SP_REAL>(minCnt) / bits < MIN_BIN) minCnt++;
+
+            int dot[BLOCK];
+            int cnt[BLOCK];
+
+            for (int b = 0; b < m_bnum; b++) {
+                ker.bitBlock(cnt, bin, &m_bins[b * BLOCK * m_bsize], m_bsize);
+
+                const int num = min(BLOCK, m_size - b * BLOCK);
+
+                // binary test first, dot products only for blocks with candidates
+                int pass = 0;
+                for (int k = 0; k < num; k++) {
+                    const int i = b * BLOCK + k;
+                    const bool valid = (sign * m_signs[i] > 0) && (cnt[k] >= minCnt);
+                    pass |= (valid ? 1 : 0) << k;
+                }
+                if (pass == 0) continue;
+
+                ker.dotBlock(dot, qry, &m_vals[b * BLOCK * m_dim], m_dim);
+
+                for (int k = 0; k < num; k++) {
+                    if (((pass >> k) & 1) == 0) continue;
+
+                    const int i = b * BLOCK + k;
+                    const SP_REAL ncc = dot[k] * scl * m_scls[i];
+                    if (ncc > maxv) {
+                        maxv = ncc;
+                        id = i;
+                    }
+                }
+            }
+            return id;
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // match
+    //--------------------------------------------------------------------------------
+
+    // match index0 -> index1 (batched, parallel), ratio < 1 adds the ratio test
+    SP_CPUFUNC Mem1<int> findMatch(const DscIndex &index0, const DscIndex &index1, const bool crossCheck = true, const SP_REAL ratio = 1.0) {
+        Mem1<int> matches(index0.size());
+        if (index0.dscType() != index1.dscType()) {
+            setElm(matches, -1);
+            return matches;
+        }
+
+        const int block = 64;
+        parallel_for(0, (index0.size() + block - 1) / block, [&](const int b) {
+            DscIndex::Work work0, work1;
+
+            for (int i = b * block; i < min((b + 1) * block, index0.size()); i++) {
+                matches[i] = -1;
+
+                int j, k;
+                {
+                    j = index1.search(work1, index0.getVal(i), index0.getBin(i), index0.getSign(i), ratio);
+                    if (j < 0) continue;
+                }
+
+                // cross check
+                if (crossCheck == true)
+                {
+                    k = index0.search(work0, index1.getVal(j), index1.getBin(j), index1.getSign(j), ratio);
+                    if (k != i) continue;
+                }
+
+                matches[i] = j;
+            }
+        }, 1);
+
+        return matches;
+    }
+
+    // match set0 -> set1 (quantized, batched, parallel)
+    SP_CPUFUNC Mem1<int> findMatch(const DscSet &set0, const DscSet &set1, const bool crossCheck = true) {
+        Mem1<int> matches(set0.size());
+
+        const _dscset::Kernel ker = _dscset::getKernel();
+
+        const int block = 32;
+        parallel_for(0, (set0.size() + block - 1) / block, [&](const int b) {
+            Mem1<signed char> qry(max(set0.dim(), set1.dim()));
+            Mem1<Byte> bin(max(set0.bsize(), set1.bsize()));
+            float scl;
+            int sign;
+
+            for (int i = b * block; i < min((b + 1) * block, set0.size()); i++) {
+                matches[i] = -1;
+
+                int j, k;
+                {
+                    set0.getQuery(qry.ptr, bin.ptr, scl, sign, i);
+                    j = set1.search(ker, qry.ptr, bin.ptr, scl, sign);
+                    if (j < 0) continue;
+                }
+
+                // cross check
+                if (crossCheck == true)
+                {
+                    set1.getQuery(qry.ptr, bin.ptr, scl, sign, j);
+                    k = set0.search(ker, qry.ptr, bin.ptr, scl, sign);
+                    if (k != i) continue;
+                }
+
+                matches[i] = j;
+            }
+        }, 1);
+
+        return matches;
+    }
+
+}
+
+#endif
@@ -346,27 +346,24 @@ namespace sp {
     SP_CPUFUNC Mem1<int> findMatch(const Mem1<Ftr> &ftrs0, const Mem1<Ftr> &ftrs1, const bool crossCheck = true) {
         Mem1<int> matches(ftrs0.size());
 
-//#if SP_USE_OMP
-//#pragma omp parallel for
-//#endif
-        for (int i = 0; i < ftrs0.size(); i++) {
+        parallel_for(0, ftrs0.size(), [&](const int i) {
             matches[i] = -1;
 
             int j, k;
             {
                 j = findMatch(ftrs0[i], ftrs1);
-                if (j < 0) continue;
+                if (j < 0) return;
             }
 
             // cross check
             if (crossCheck == true) 
             {
                 k = findMatch(ftrs1[j], ftrs0);
-                if (k != i) continue;
+                if (k != i) return;
             }
 
             matches[i] = j;
-        }
+        }, 16);
 
         return matches;
     }
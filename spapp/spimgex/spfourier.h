@@ -10,96 +10,66 @@
 
 namespace sp{
 
-    namespace _fourier {
-        
-        SP_CPUFUNC void calcHor(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat srcIm = Mat(), const bool flag = true) {
-
-            const int M = srcRe.dsize[0];
-            
-            const int sign = (flag == true) ? +1 : -1;
-            const int offset = M / 2;
-            const bool useIm = (srcIm.size() != 0) ? true : false;
-
-            dstRe.resize(srcRe.dsize);
-            dstIm.resize(srcRe.dsize);
-
-            for (int y = 0; y < srcRe.dsize[1]; y++) {
-                for (int x = 0; x < srcRe.dsize[0]; x++) {
-
-                    SP_REAL sumr = 0.0;
-                    SP_REAL sumi = 0.0;
-
-                    for (int k = 0; k < srcRe.dsize[0]; k++) {
-                        const SP_REAL w = (flag == true) ? k * (x - offset) : (k - offset) * x;
-
-                        const SP_REAL r = acs2(srcRe, k, y);
-                        const SP_REAL a = sign * 2 * SP_PI * w / M;
-
-                        if (useIm == false) {
-                            sumr += +r * cos(a);
-                            sumi += -r * sin(a);
-                        }
-                        else {
-                            const SP_REAL i = acs2(srcIm, k, y);
-                            sumr += +r * cos(a) + i * sin(a);
-                            sumi += -r * sin(a) + i * cos(a);
-                        }
-                    }
-
-                    if (flag == true) {
-                        acs2(dstRe, x, y) = sumr;
-                        acs2(dstIm, x, y) = sumi;
-                    }
-                    else {
-                        acs2(dstRe, x, y) = sumr / M;
-                        acs2(dstIm, x, y) = sumi / M;
-                    }
-                }
-            }
-        }
-
-        SP_CPUFUNC void calcVer(Mat &dstRe, Mat &dstIm, const Mat &srcRe, const Mat &srcIm = Mat(), bool flag = true) {
-
-            calcHor(dstRe, dstIm, trnMat(srcRe), trnMat(srcIm), flag);
-
-            dstRe = trnMat(dstRe);
-            dstIm = trnMat(dstIm);
-        }
-    }
-
-    using namespace _fourier;
+    //--------------------------------------------------------------------------------
+    // dft (centered spectrum, frequency (0, 0) at (w / 2, h / 2))
+    //--------------------------------------------------------------------------------
 
     template<typename TYPE>
     SP_CPUFUNC void dft(Mem<SP_REAL> &re, Mem<SP_REAL> &im, const Mem<TYPE> &img) {
 
-        Mat mat;
-        cnvMem(mat, img);
+        Mem2<SP_REAL> src;
+        cnvMem(src, img);
 
-        Mat horRe, horIm;
-        calcHor(horRe, horIm, mat);
+        Mem2<Cmp> half;
+        rfft2(half, src);
 
-        Mat verRe, verIm;
-        calcVer(verRe, verIm, horRe, horIm);
+        const int w = src.dsize[0];
+        const int h = src.dsize[1];
+        const int hw = half.dsize[0];
 
-        re = verRe;
-        im = verIm;
+        re.resize(2, src.dsize);
+        im.resize(2, src.dsize);
+
+        for (int y = 0; y < h; y++) {
+            const int v = (y - h / 2 + h) % h;
+            for (int x = 0; x < w; x++) {
+                const int u = (x - w / 2 + w) % w;
+
+                // hermitian symmetry for u > w / 2
+                const Cmp c = (u < hw) ? half[v * hw + u] : _fft::conj(half[((h - v) % h) * hw + (w - u)]);
+                re[y * w + x] = c.re;
+                im[y * w + x] = c.im;
+            }
+        }
     }
 
     template<typename TYPE>
     SP_CPUFUNC void idft(Mem<TYPE> &img, const Mem<SP_REAL> &re, const Mem<SP_REAL> &im) {
         SP_ASSERT(cmp(re.dsize, im.dsize, 2));
 
-        Mat mRe, mIm;
-        cnvMem(mRe, re);
-        cnvMem(mIm, im);
-
-        Mat horRe, horIm;
-        calcHor(horRe, horIm, mRe, mIm, false);
+        const int w = re.dsize[0];
+        const int h = re.dsize[1];
+        const int hw = w / 2 + 1;
+
+        // hermitian part of the spectrum (the real part of the result)
+        Mem2<Cmp> half(hw, h);
+        for (int v = 0; v < h; v++) {
+            const int y0 = (v + h / 2) % h;
+            const int y1 = ((h - v) % h + h / 2) % h;
+            for (int u = 0; u < hw; u++) {
+                const int x0 = (u + w / 2) % w;
+                const int x1 = ((w - u) % w + w / 2) % w;
+
+                const int i0 = y0 * w + x0;
+                const int i1 = y1 * w + x1;
+                half[v * hw + u] = getCmp((re[i0] + re[i1]) * 0.5, (im[i0] - im[i1]) * 0.5);
+            }
+        }
 
-        Mat verRe, verIm;
-        calcVer(verRe, verIm, horRe, horIm, false);
+        Mem2<SP_REAL> dst;
+        irfft2(dst, half, w);
 
-        cnvMem(img, verRe);
+        cnvMem(img, dst);
     }
 
 
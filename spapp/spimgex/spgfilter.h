@@ -18,12 +18,18 @@
 
 namespace sp{
 
+    //--------------------------------------------------------------------------------
+    // guided filter
+    //--------------------------------------------------------------------------------
+    //
+    // the window means (I, I^2, I*I', p, I*p, a, b) are packed into interleaved channels
+    // and filtered together by boxFilter (running sums, cost does not depend on winSize).
+    //
+
     class Guide1 {
     public:
         Mem2<SP_REAL> I;
-        Mem2<SP_REAL> I2;
         Mem2<SP_REAL> mean_I;
-        Mem2<SP_REAL> mean_I2;
         Mem1<SP_REAL> inv;
 
         template<typename TYPE>
@@ -33,23 +39,27 @@ namespace sp{
 
         template<typename TYPE>
         void set(const Mem<TYPE> &src, const int winSize, const SP_REAL epsilon) {
+            typedef MemA<SP_REAL, 2> Moment;
 
             I.resize(src.dsize);
-            I2.resize(src.dsize);
 
+            // I, I^2
+            Mem2<Moment> m(src.dsize);
             for (int i = 0; i < src.size(); i++) {
-                const TYPE &g = src[i];
+                const SP_REAL g = static_cast<SP_REAL>(src[i]);
 
-                I[i] = static_cast<SP_REAL>(g);
-                I2[i] = static_cast<SP_REAL>(g * g);
+                I[i] = g;
+                m[i][0] = g;
+                m[i][1] = g * g;
             }
 
-            boxFilter(mean_I, I, winSize);
-            boxFilter(mean_I2, I2, winSize);
+            boxFilter<Moment, SP_REAL>(m, m, winSize);
 
+            mean_I.resize(src.dsize);
             inv.resize(src.size());
             for (int i = 0; i < src.size(); i++) {
-                const double var = mean_I2[i] - mean_I[i] * mean_I[i];
+                const double var = m[i][1] - m[i][0] * m[i][0];
+                mean_I[i] = m[i][0];
                 inv[i] = static_cast<SP_REAL>(1.0 / (var + epsilon));
             }
         }
@@ -58,11 +68,7 @@ namespace sp{
     class Guide3 {
     public:
         Mem2<Vec3> I;
-        Mem2<Vec3> I2;
-        Mem2<Vec3> Ic;
         Mem2<Vec3> mean_I;
-        Mem2<Vec3> mean_I2;
-        Mem2<Vec3> mean_Ic;
         Mem1<SP_REAL> inv;
 
         Guide3(const Mem<Col3> &src, const int winSize, const SP_REAL epsilon) {
@@ -70,11 +76,12 @@ namespace sp{
         }
 
         void set(const Mem<Col3> &src, const int winSize, const SP_REAL epsilon) {
+            typedef MemA<SP_REAL, 9> Moment;
 
             I.resize(src.dsize);
-            I2.resize(src.dsize);
-            Ic.resize(src.dsize);
 
+            // I (rgb), I^2 (rr, gg, bb), I*I' (rg, gb, br)
+            Mem2<Moment> m(src.dsize);
             for (int i = 0; i < src.size(); i++) {
                 const Col3 &g = src[i];
 
@@ -82,29 +89,36 @@ namespace sp{
                 I[i].y = static_cast<SP_REAL>(g.g);
                 I[i].z = static_cast<SP_REAL>(g.b);
 
-                I2[i].x = static_cast<SP_REAL>(g.r * g.r);
-                I2[i].y = static_cast<SP_REAL>(g.g * g.g);
-                I2[i].z = static_cast<SP_REAL>(g.b * g.b);
+                SP_REAL *p = m[i].ptr;
+                p[0] = I[i].x;
+                p[1] = I[i].y;
+                p[2] = I[i].z;
+
+                p[3] = I[i].x * I[i].x;
+                p[4] = I[i].y * I[i].y;
+                p[5] = I[i].z * I[i].z;
 
-                Ic[i].x = static_cast<SP_REAL>(g.r * g.g);
-                Ic[i].y = static_cast<SP_REAL>(g.g * g.b);
-                Ic[i].z = static_cast<SP_REAL>(g.b * g.r);
+                p[6] = I[i].x * I[i].y;
+                p[7] = I[i].y * I[i].z;
+                p[8] = I[i].z * I[i].x;
             }
 
-            boxFilter<Vec3, SP_REAL>(mean_I, I, winSize);
-            boxFilter<Vec3, SP_REAL>(mean_I2, I2, winSize);
-            boxFilter<Vec3, SP_REAL>(mean_Ic, Ic, winSize);
+            boxFilter<Moment, SP_REAL>(m, m, winSize);
 
+            mean_I.resize(src.dsize);
             inv.resize(src.size() * 3 * 3);
             for (int i = 0; i < src.size(); i++) {
+                const SP_REAL *p = m[i].ptr;
+                mean_I[i] = getVec3(p[0], p[1], p[2]);
+
                 SP_REAL var[3 * 3];
-                var[0 * 3 + 0] = mean_I2[i].x - mean_I[i].x * mean_I[i].x;
-                var[1 * 3 + 1] = mean_I2[i].y - mean_I[i].y * mean_I[i].y;
-                var[2 * 3 + 2] = mean_I2[i].z - mean_I[i].z * mean_I[i].z;
+                var[0 * 3 + 0] = p[3] - p[0] * p[0];
+                var[1 * 3 + 1] = p[4] - p[1] * p[1];
+                var[2 * 3 + 2] = p[5] - p[2] * p[2];
 
-                var[0 * 3 + 1] = var[1 * 3 + 0] = mean_Ic[i].x - mean_I[i].x * mean_I[i].y;
-                var[1 * 3 + 2] = var[2 * 3 + 1] = mean_Ic[i].y - mean_I[i].y * mean_I[i].z;
-                var[2 * 3 + 0] = var[0 * 3 + 2] = mean_Ic[i].z - mean_I[i].z * mean_I[i].x;
+                var[0 * 3 + 1] = var[1 * 3 + 0] = p[6] - p[0] * p[1];
+                var[1 * 3 + 2] = var[2 * 3 + 1] = p[7] - p[1] * p[2];
+                var[2 * 3 + 0] = var[0 * 3 + 2] = p[8] - p[2] * p[0];
 
                 var[0 * 3 + 0] += epsilon;
                 var[1 * 3 + 1] += epsilon;
@@ -118,176 +132,139 @@ namespace sp{
 
     template<typename TYPE>
     SP_CPUFUNC void guidedFilter(Mem<TYPE> &dst, const Mem<TYPE> &src, const Guide1 &guide, const int winSize) {
+        typedef MemA<SP_REAL, 2> Moment;
 
-        Mem2<SP_REAL> p(src.dsize);
-        Mem2<SP_REAL> Ip(src.dsize);
-
+        // p, I*p
+        Mem2<Moment> m(src.dsize);
         for (int i = 0; i < src.size(); i++) {
-            const TYPE &v = src[i];
-            const SP_REAL &g = guide.I[i];
-            p[i] = v;
-            Ip[i] = g * v;
+            const SP_REAL v = static_cast<SP_REAL>(src[i]);
+            m[i][0] = v;
+            m[i][1] = guide.I[i] * v;
         }
 
-        Mem2<SP_REAL> mean_p;
-        boxFilter(mean_p, p, winSize);
-
-        Mem2<SP_REAL> mean_Ip;
-        boxFilter(mean_Ip, Ip, winSize);
-
-        Mem2<SP_REAL> a(src.dsize);
-        Mem2<SP_REAL> b(src.dsize);
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
+        // a, b
         for (int i = 0; i < src.size(); i++) {
-            const SP_REAL cov = mean_Ip[i] - guide.mean_I[i] * mean_p[i];
+            const SP_REAL mean_p = m[i][0];
+            const SP_REAL cov = m[i][1] - guide.mean_I[i] * mean_p;
 
-            a[i] = guide.inv[i] * cov;
-            b[i] = mean_p[i] - a[i] * guide.mean_I[i];
+            const SP_REAL a = guide.inv[i] * cov;
+            m[i][0] = a;
+            m[i][1] = mean_p - a * guide.mean_I[i];
         }
 
-        boxFilter(a, a, winSize);
-        boxFilter(b, b, winSize);
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
         dst.resize(2, src.dsize);
         for (int i = 0; i < src.size(); i++) {
-            dst[i] = cast<TYPE>(a[i] * guide.I[i] + b[i]);
+            dst[i] = cast<TYPE>(m[i][0] * guide.I[i] + m[i][1]);
         }
     }
 
     SP_CPUFUNC void guidedFilter(Mem<Byte> &dst, const Mem<Byte> &src, const Guide3 &guide, const int winSize) {
+        typedef MemA<SP_REAL, 4> Moment;
 
-        Mem2<SP_REAL> p(src.dsize);
-
-        Mem2<Vec3> Ip(src.dsize);
-
+        // p, I*p (rgb)
+        Mem2<Moment> m(src.dsize);
         for (int i = 0; i < src.size(); i++) {
-            const Byte &v = src[i];
+            const SP_REAL v = static_cast<SP_REAL>(src[i]);
             const Vec3 &g = guide.I[i];
 
-            p[i] = v;
-
-            Ip[i].x = g.x * v;
-            Ip[i].y = g.y * v;
-            Ip[i].z = g.z * v;
+            SP_REAL *p = m[i].ptr;
+            p[0] = v;
+            p[1] = g.x * v;
+            p[2] = g.y * v;
+            p[3] = g.z * v;
         }
 
-        Mem2<SP_REAL> mean_p;
-        boxFilter(mean_p, p, winSize);
-
-        Mem2<Vec3> mean_Ip;
-        boxFilter<Vec3, SP_REAL>(mean_Ip, Ip, winSize);
-
-        Mem2<Vec3> a(src.dsize);
-        Mem2<SP_REAL> b(src.dsize);
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
+        // a (rgb), b
         for (int i = 0; i < src.size(); i++) {
+            SP_REAL *p = m[i].ptr;
+            const Vec3 &mean_I = guide.mean_I[i];
+            const SP_REAL mean_p = p[0];
 
             SP_REAL cov[3];
-            cov[0] = (mean_Ip[i].x - guide.mean_I[i].x * mean_p[i]);
-            cov[1] = (mean_Ip[i].y - guide.mean_I[i].y * mean_p[i]);
-            cov[2] = (mean_Ip[i].z - guide.mean_I[i].z * mean_p[i]);
+            cov[0] = p[1] - mean_I.x * mean_p;
+            cov[1] = p[2] - mean_I.y * mean_p;
+            cov[2] = p[3] - mean_I.z * mean_p;
 
-            SP_REAL tmp[3];
-            mulMat(tmp, 3, 1, &guide.inv[i * 3 * 3], 3, 3, cov, 3, 1);
+            SP_REAL a[3];
+            mulMat(a, 3, 1, &guide.inv[i * 3 * 3], 3, 3, cov, 3, 1);
 
-            a[i].x = tmp[0];
-            a[i].y = tmp[1];
-            a[i].z = tmp[2];
-            b[i] = mean_p[i] - tmp[0] * guide.mean_I[i].x - tmp[1] * guide.mean_I[i].y - tmp[2] * guide.mean_I[i].z;
+            p[0] = a[0];
+            p[1] = a[1];
+            p[2] = a[2];
+            p[3] = mean_p - a[0] * mean_I.x - a[1] * mean_I.y - a[2] * mean_I.z;
         }
 
-        boxFilter<Vec3, SP_REAL>(a, a, winSize);
-        boxFilter(b, b, winSize);
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
         dst.resize(2, src.dsize);
         for (int i = 0; i < src.size(); i++) {
+            const SP_REAL *p = m[i].ptr;
             const Vec3 &g = guide.I[i];
-            dst[i] = cast<Byte>(min(255.0, a[i].x * g.x + a[i].y * g.y + a[i].z * g.z + b[i]));
+            dst[i] = cast<Byte>(min(255.0, p[0] * g.x + p[1] * g.y + p[2] * g.z + p[3]));
         }
     }
 
     SP_CPUFUNC void guidedFilter(Mem<Col3> &dst, const Mem<Col3> &src, const Guide3 &guide, const int winSize) {
+        typedef MemA<SP_REAL, 12> Moment;
 
-        Mem2<Vec3> p(src.dsize);
-
-        Mem2<Vec3> Ip[3];
-        Ip[0].resize(src.dsize);
-        Ip[1].resize(src.dsize);
-        Ip[2].resize(src.dsize);
-
+        // p (rgb), I*p (rgb x rgb)
+        Mem2<Moment> m(src.dsize);
         for (int i = 0; i < src.size(); i++) {
             const Col3 &v = src[i];
             const Vec3 &g = guide.I[i];
 
-            p[i].x = v.r;
-            p[i].y = v.g;
-            p[i].z = v.b;
+            const SP_REAL vs[3] = { static_cast<SP_REAL>(v.r), static_cast<SP_REAL>(v.g), static_cast<SP_REAL>(v.b) };
 
-            Ip[0][i].x = g.x * v.r;
-            Ip[0][i].y = g.y * v.r;
-            Ip[0][i].z = g.z * v.r;
-
-            Ip[1][i].x = g.x * v.g;
-            Ip[1][i].y = g.y * v.g;
-            Ip[1][i].z = g.z * v.g;
-
-            Ip[2][i].x = g.x * v.b;
-            Ip[2][i].y = g.y * v.b;
-            Ip[2][i].z = g.z * v.b;
-        }
-
-        Mem2<Vec3> mean_p;
-        boxFilter<Vec3, SP_REAL>(mean_p, p, winSize);
-
-        Mem2<Vec3> mean_Ip[3];
-        for (int c = 0; c < 3; c++) {
-            boxFilter<Vec3, SP_REAL>(mean_Ip[c], Ip[c], winSize);
+            SP_REAL *p = m[i].ptr;
+            for (int c = 0; c < 3; c++) {
+                p[c] = vs[c];
+                p[3 + c * 3 + 0] = g.x * vs[c];
+                p[3 + c * 3 + 1] = g.y * vs[c];
+                p[3 + c * 3 + 2] = g.z * vs[c];
+            }
         }
 
-        Mem2<Vec3> a[3];
-        a[0].resize(src.dsize);
-        a[1].resize(src.dsize);
-        a[2].resize(src.dsize);
-
-        Mem2<SP_REAL> b[3];
-        b[0].resize(src.dsize);
-        b[1].resize(src.dsize);
-        b[2].resize(src.dsize);
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
+        // a (rgb x rgb), b (rgb)
         for (int i = 0; i < src.size(); i++) {
+            SP_REAL *p = m[i].ptr;
+            const Vec3 &mean_I = guide.mean_I[i];
 
-            SP_REAL mp[3];
-            mp[0] = mean_p[i].x;
-            mp[1] = mean_p[i].y;
-            mp[2] = mean_p[i].z;
-
+            SP_REAL ab[12];
             for (int c = 0; c < 3; c++) {
+                const SP_REAL mean_p = p[c];
+
                 SP_REAL cov[3];
-                cov[0] = (mean_Ip[c][i].x - guide.mean_I[i].x * mp[c]);
-                cov[1] = (mean_Ip[c][i].y - guide.mean_I[i].y * mp[c]);
-                cov[2] = (mean_Ip[c][i].z - guide.mean_I[i].z * mp[c]);
+                cov[0] = p[3 + c * 3 + 0] - mean_I.x * mean_p;
+                cov[1] = p[3 + c * 3 + 1] - mean_I.y * mean_p;
+                cov[2] = p[3 + c * 3 + 2] - mean_I.z * mean_p;
 
-                SP_REAL tmp[3];
-                mulMat(tmp, 3, 1, &guide.inv[i * 3 * 3], 3, 3, cov, 3, 1);
+                SP_REAL *a = &ab[c * 3];
+                mulMat(a, 3, 1, &guide.inv[i * 3 * 3], 3, 3, cov, 3, 1);
 
-                a[c][i].x = tmp[0];
-                a[c][i].y = tmp[1];
-                a[c][i].z = tmp[2];
-                b[c][i] = mp[c] - tmp[0] * guide.mean_I[i].x - tmp[1] * guide.mean_I[i].y - tmp[2] * guide.mean_I[i].z;
+                ab[9 + c] = mean_p - a[0] * mean_I.x - a[1] * mean_I.y - a[2] * mean_I.z;
+            }
+            for (int k = 0; k < 12; k++) {
+                p[k] = ab[k];
             }
         }
 
-        for (int c = 0; c < 3; c++) {
-            boxFilter<Vec3, SP_REAL>(a[c], a[c], winSize);
-            boxFilter(b[c], b[c], winSize);
-        }
+        boxFilter<Moment, SP_REAL>(m, m, winSize);
 
         dst.resize(2, src.dsize);
         for (int i = 0; i < src.size(); i++) {
+            const SP_REAL *p = m[i].ptr;
             const Vec3 &g = guide.I[i];
-            dst[i].r = cast<Byte>(min(255.0, a[0][i].x * g.x + a[0][i].y * g.y + a[0][i].z * g.z + b[0][i]));
-            dst[i].g = cast<Byte>(min(255.0, a[1][i].x * g.x + a[1][i].y * g.y + a[1][i].z * g.z + b[1][i]));
-            dst[i].b = cast<Byte>(min(255.0, a[2][i].x * g.x + a[2][i].y * g.y + a[2][i].z * g.z + b[2][i]));
+            dst[i].r = cast<Byte>(min(255.0, p[0] * g.x + p[1] * g.y + p[2] * g.z + p[9]));
+            dst[i].g = cast<Byte>(min(255.0, p[3] * g.x + p[4] * g.y + p[5] * g.z + p[10]));
+            dst[i].b = cast<Byte>(min(255.0, p[6] * g.x + p[7] * g.y + p[8] * g.z + p[11]));
         }
     }
 
@@ -122,6 +122,9 @@ namespace sp{
         bool _execute(const Mem2<Byte> &img){
             SP_LOGGER_SET("SIFT.execute");
 
+            // frame arena for temporary buffers
+            MemFrame frame;
+
             // clear data
             {
                 m_ftrs.clear();
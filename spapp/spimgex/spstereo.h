@@ -12,6 +12,471 @@
 
 namespace sp{
 
+    //--------------------------------------------------------------------------------
+    // stereo cost engine
+    //--------------------------------------------------------------------------------
+    //
+    // cost volume rows are built with running box sums (column sums are slid in y,
+    // window sums are slid in x), disparity lanes are contiguous and padded to 16
+    //
+
+    namespace _stereo {
+
+        // invalid cost for padded lanes (sgm)
+        static const unsigned short COST_INF = 0x3FFF;
+
+        // cost unit for sgm (mean absolute difference * COST_SCALE)
+        static const int COST_SCALE = 16;
+
+        SP_CPUFUNC int padDisp(const int dnum) {
+            return (dnum + 15) / 16 * 16;
+        }
+
+        //--------------------------------------------------------------------------------
+        // scalar
+        //--------------------------------------------------------------------------------
+
+        // col[k * dp + d] += sign * |src[k] - line[(dir > 0 ? k : num - 1 - k) + d]|
+        SP_CPUFUNC void colRow_c(unsigned short *col, const Byte *src, const Byte *line, const int dir, const int num, const int dp, const int sign) {
+            for (int k = 0; k < num; k++) {
+                const Byte *pl = &line[(dir > 0) ? k : num - 1 - k];
+                unsigned short *pc = &col[k * dp];
+                const int sv = src[k];
+                for (int d = 0; d < dp; d++) {
+                    pc[d] = static_cast<unsigned short>(pc[d] + sign * abs(sv - pl[d]));
+                }
+            }
+        }
+
+        // sad[d] += add[d] - sub[d]
+        SP_CPUFUNC void sadSlide_c(unsigned int *sad, const unsigned short *add, const unsigned short *sub, const int dp) {
+            for (int d = 0; d < dp; d++) {
+                sad[d] += add[d] - sub[d];
+            }
+        }
+
+        // first index of the minimum
+        SP_CPUFUNC unsigned int minSearch_c(int &idx, const unsigned int *sad, const int dnum) {
+            unsigned int minv = sad[0];
+            idx = 0;
+            for (int d = 1; d < dnum; d++) {
+                if (sad[d] < minv) {
+                    minv = sad[d];
+                    idx = d;
+                }
+            }
+            return minv;
+        }
+
+        // cost[d] = (sad[d] * scale) >> 16
+        SP_CPUFUNC void storeCost_c(unsigned short *cost, const unsigned int *sad, const int dp, const int dnum, const unsigned int scale) {
+            for (int d = 0; d < dp; d++) {
+                cost[d] = (d < dnum) ? static_cast<unsigned short>((sad[d] * scale) >> 16) : COST_INF;
+            }
+        }
+
+        // sgm path: lcur[d] = cost[d] + min(lp[d], lp[d -+ 1] + p1, minLp + p2) - minLp, sum[d] += lcur[d]
+        // lp[-1] and lp[dp] are guards (COST_INF)
+        SP_CPUFUNC int pathStep_c(unsigned short *lcur, unsigned short *sum, const unsigned short *lp, const unsigned short *cost, const int dp, const int p1, const int p2, const int minLp) {
+            int minv = 0xFFFF;
+            for (int d = 0; d < dp; d++) {
+                int t = lp[d];
+                t = min(t, lp[d - 1] + p1);
+                t = min(t, lp[d + 1] + p1);
+                t = min(t, minLp + p2);
+
+                const int l = cost[d] + t - minLp;
+                lcur[d] = static_cast<unsigned short>(l);
+                sum[d] = static_cast<unsigned short>(min(sum[d] + l, 0xFFFF));
+                minv = min(minv, l);
+            }
+            return minv;
+        }
+
+        SP_CPUFUNC unsigned int minSearch16_c(int &idx, const unsigned short *sum, const int dnum) {
+            unsigned int minv = sum[0];
+            idx = 0;
+            for (int d = 1; d < dnum; d++) {
+                if (sum[d] < minv) {
+                    minv = sum[d];
+                    idx = d;
+                }
+            }
+            return minv;
+        }
+
+#if SP_USE_SIMD
+
+        //--------------------------------------------------------------------------------
+        // sse4.1
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_SSE4 SP_CPUFUNC void colRow_sse4(unsigned short *col, const Byte *src, const Byte *line, const int dir, const int num, const int dp, const int sign) {
+            const __m128i zero = _mm_setzero_si128();
+            for (int k = 0; k < num; k++) {
+                const Byte *pl = &line[(dir > 0) ? k : num - 1 - k];
+                unsigned short *pc = &col[k * dp];
+                const __m128i sv = _mm_set1_epi8(static_cast<char>(src[k]));
+
+                for (int d = 0; d < dp; d += 16) {
+                    const __m128i a = _mm_loadu_si128((const __m128i*)&pl[d]);
+                    const __m128i ad = _mm_sub_epi8(_mm_max_epu8(a, sv), _mm_min_epu8(a, sv));
+                    const __m128i lo = _mm_unpacklo_epi8(ad, zero);
+                    const __m128i hi = _mm_unpackhi_epi8(ad, zero);
+
+                    __m128i *p = (__m128i*)&pc[d];
+                    if (sign > 0) {
+                        _mm_storeu_si128(p + 0, _mm_add_epi16(_mm_loadu_si128(p + 0), lo));
+                        _mm_storeu_si128(p + 1, _mm_add_epi16(_mm_loadu_si128(p + 1), hi));
+                    }
+                    else {
+                        _mm_storeu_si128(p + 0, _mm_sub_epi16(_mm_loadu_si128(p + 0), lo));
+                        _mm_storeu_si128(p + 1, _mm_sub_epi16(_mm_loadu_si128(p + 1), hi));
+                    }
+                }
+            }
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void sadSlide_sse4(unsigned int *sad, const unsigned short *add, const unsigned short *sub, const int dp) {
+            for (int d = 0; d < dp; d += 8) {
+                const __m128i a = _mm_loadu_si128((const __m128i*)&add[d]);
+                const __m128i b = _mm_loadu_si128((const __m128i*)&sub[d]);
+                const __m128i a0 = _mm_cvtepu16_epi32(a);
+                const __m128i a1 = _mm_cvtepu16_epi32(_mm_srli_si128(a, 8));
+                const __m128i b0 = _mm_cvtepu16_epi32(b);
+                const __m128i b1 = _mm_cvtepu16_epi32(_mm_srli_si128(b, 8));
+
+                __m128i *p = (__m128i*)&sad[d];
+                _mm_storeu_si128(p + 0, _mm_add_epi32(_mm_loadu_si128(p + 0), _mm_sub_epi32(a0, b0)));
+                _mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), _mm_sub_epi32(a1, b1)));
+            }
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC unsigned int minSearch_sse4(int &idx, const unsigned int *sad, const int dnum) {
+            const int vnum = dnum / 4 * 4;
+            if (vnum == 0) return minSearch_c(idx, sad, dnum);
+
+            __m128i mn = _mm_loadu_si128((const __m128i*)&sad[0]);
+            for (int d = 4; d < vnum; d += 4) {
+                mn = _mm_min_epu32(mn, _mm_loadu_si128((const __m128i*)&sad[d]));
+            }
+            mn = _mm_min_epu32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+            mn = _mm_min_epu32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            unsigned int minv = static_cast<unsigned int>(_mm_cvtsi128_si32(mn));
+            idx = -1;
+            for (int d = 0; d < vnum; d += 4) {
+                const int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&sad[d]), mn)));
+                if (m != 0) {
+                    idx = d + ((m & 1) ? 0 : (m & 2) ? 1 : (m & 4) ? 2 : 3);
+                    break;
+                }
+            }
+            for (int d = vnum; d < dnum; d++) {
+                if (sad[d] < minv) {
+                    minv = sad[d];
+                    idx = d;
+                }
+            }
+            return minv;
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void storeCost_sse4(unsigned short *cost, const unsigned int *sad, const int dp, const int dnum, const unsigned int scale) {
+            const __m128i sc = _mm_set1_epi32(static_cast<int>(scale));
+            for (int d = 0; d < dp; d += 8) {
+                const __m128i a0 = _mm_srli_epi32(_mm_mullo_epi32(_mm_loadu_si128((const __m128i*)&sad[d + 0]), sc), 16);
+                const __m128i a1 = _mm_srli_epi32(_mm_mullo_epi32(_mm_loadu_si128((const __m128i*)&sad[d + 4]), sc), 16);
+                _mm_storeu_si128((__m128i*)&cost[d], _mm_packus_epi32(a0, a1));
+            }
+            for (int d = dnum; d < dp; d++) {
+                cost[d] = COST_INF;
+            }
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC int pathStep_sse4(unsigned short *lcur, unsigned short *sum, const unsigned short *lp, const unsigned short *cost, const int dp, const int p1, const int p2, const int minLp) {
+            const __m128i vp1 = _mm_set1_epi16(static_cast<short>(p1));
+            const __m128i vmp = _mm_set1_epi16(static_cast<short>(minLp));
+            const __m128i vmp2 = _mm_set1_epi16(static_cast<short>(minLp + p2));
+
+            __m128i mn = _mm_set1_epi16(-1);
+            for (int d = 0; d < dp; d += 8) {
+                const __m128i l0 = _mm_loadu_si128((const __m128i*)&lp[d]);
+                const __m128i lm = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)&lp[d - 1]), vp1);
+                const __m128i lq = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)&lp[d + 1]), vp1);
+                const __m128i t = _mm_min_epu16(_mm_min_epu16(l0, vmp2), _mm_min_epu16(lm, lq));
+
+                const __m128i l = _mm_add_epi16(_mm_loadu_si128((const __m128i*)&cost[d]), _mm_sub_epi16(t, vmp));
+                _mm_storeu_si128((__m128i*)&lcur[d], l);
+                _mm_storeu_si128((__m128i*)&sum[d], _mm_adds_epu16(_mm_loadu_si128((const __m128i*)&sum[d]), l));
+                mn = _mm_min_epu16(mn, l);
+            }
+            return _mm_extract_epi16(_mm_minpos_epu16(mn), 0);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC unsigned int minSearch16_sse4(int &idx, const unsigned short *sum, const int dnum) {
+            const int vnum = dnum / 8 * 8;
+            if (vnum == 0) return minSearch16_c(idx, sum, dnum);
+
+            __m128i mn = _mm_loadu_si128((const __m128i*)&sum[0]);
+            for (int d = 8; d < vnum; d += 8) {
+                mn = _mm_min_epu16(mn, _mm_loadu_si128((const __m128i*)&sum[d]));
+            }
+            const __m128i mp = _mm_minpos_epu16(mn);
+            unsigned int minv = static_cast<unsigned int>(_mm_extract_epi16(mp, 0));
+            const __m128i vm = _mm_set1_epi16(static_cast<short>(minv));
+
+            idx = -1;
+            for (int d = 0; d < vnum; d += 8) {
+                const int m = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)&sum[d]), vm));
+                if (m != 0) {
+                    int b = 0;
+                    while (((m >> (2 * b)) & 1) == 0) b++;
+                    idx = d + b;
+                    break;
+                }
+            }
+            for (int d = vnum; d < dnum; d++) {
+                if (sum[d] < minv) {
+                    minv = sum[d];
+                    idx = d;
+                }
+            }
+            return minv;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // avx2
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_AVX2 SP_CPUFUNC void colRow_avx2(unsigned short *col, const Byte *src, const Byte *line, const int dir, const int num, const int dp, const int sign) {
+            for (int k = 0; k < num; k++) {
+                const Byte *pl = &line[(dir > 0) ? k : num - 1 - k];
+                unsigned short *pc = &col[k * dp];
+                const __m256i sv = _mm256_set1_epi16(src[k]);
+
+                for (int d = 0; d < dp; d += 16) {
+                    const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)&pl[d]));
+                    const __m256i ad = _mm256_abs_epi16(_mm256_sub_epi16(a, sv));
+
+                    __m256i *p = (__m256i*)&pc[d];
+                    if (sign > 0) {
+                        _mm256_storeu_si256(p, _mm256_add_epi16(_mm256_loadu_si256(p), ad));
+                    }
+                    else {
+                        _mm256_storeu_si256(p, _mm256_sub_epi16(_mm256_loadu_si256(p), ad));
+                    }
+                }
+            }
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void sadSlide_avx2(unsigned int *sad, const unsigned short *add, const unsigned short *sub, const int dp) {
+            for (int d = 0; d < dp; d += 8) {
+                const __m256i a = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&add[d]));
+                const __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&sub[d]));
+
+                __m256i *p = (__m256i*)&sad[d];
+                _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), _mm256_sub_epi32(a, b)));
+            }
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC unsigned int minSearch_avx2(int &idx, const unsigned int *sad, const int dnum) {
+            const int vnum = dnum / 8 * 8;
+            if (vnum == 0) return minSearch_c(idx, sad, dnum);
+
+            __m256i mn = _mm256_loadu_si256((const __m256i*)&sad[0]);
+            for (int d = 8; d < vnum; d += 8) {
+                mn = _mm256_min_epu32(mn, _mm256_loadu_si256((const __m256i*)&sad[d]));
+            }
+            mn = _mm256_min_epu32(mn, _mm256_permute2x128_si256(mn, mn, 0x01));
+            mn = _mm256_min_epu32(mn, _mm256_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+            mn = _mm256_min_epu32(mn, _mm256_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            unsigned int minv = static_cast<unsigned int>(_mm_cvtsi128_si32(_mm256_castsi256_si128(mn)));
+            idx = -1;
+            for (int d = 0; d < vnum; d += 8) {
+                const int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)&sad[d]), mn)));
+                if (m != 0) {
+                    int b = 0;
+                    while (((m >> b) & 1) == 0) b++;
+                    idx = d + b;
+                    break;
+                }
+            }
+            for (int d = vnum; d < dnum; d++) {
+                if (sad[d] < minv) {
+                    minv = sad[d];
+                    idx = d;
+                }
+            }
+            return minv;
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void storeCost_avx2(unsigned short *cost, const unsigned int *sad, const int dp, const int dnum, const unsigned int scale) {
+            const __m256i sc = _mm256_set1_epi32(static_cast<int>(scale));
+            for (int d = 0; d < dp; d += 16) {
+                const __m256i a0 = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)&sad[d + 0]), sc), 16);
+                const __m256i a1 = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)&sad[d + 8]), sc), 16);
+                _mm256_storeu_si256((__m256i*)&cost[d], _mm256_permute4x64_epi64(_mm256_packus_epi32(a0, a1), 0xD8));
+            }
+            for (int d = dnum; d < dp; d++) {
+                cost[d] = COST_INF;
+            }
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC int pathStep_avx2(unsigned short *lcur, unsigned short *sum, const unsigned short *lp, const unsigned short *cost, const int dp, const int p1, const int p2, const int minLp) {
+            const __m256i vp1 = _mm256_set1_epi16(static_cast<short>(p1));
+            const __m256i vmp = _mm256_set1_epi16(static_cast<short>(minLp));
+            const __m256i vmp2 = _mm256_set1_epi16(static_cast<short>(minLp + p2));
+
+            __m256i mn = _mm256_set1_epi16(-1);
+            for (int d = 0; d < dp; d += 16) {
+                const __m256i l0 = _mm256_loadu_si256((const __m256i*)&lp[d]);
+                const __m256i lm = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)&lp[d - 1]), vp1);
+                const __m256i lq = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)&lp[d + 1]), vp1);
+                const __m256i t = _mm256_min_epu16(_mm256_min_epu16(l0, vmp2), _mm256_min_epu16(lm, lq));
+
+                const __m256i l = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)&cost[d]), _mm256_sub_epi16(t, vmp));
+                _mm256_storeu_si256((__m256i*)&lcur[d], l);
+                _mm256_storeu_si256((__m256i*)&sum[d], _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)&sum[d]), l));
+                mn = _mm256_min_epu16(mn, l);
+            }
+            const __m128i m = _mm_min_epu16(_mm256_castsi256_si128(mn), _mm256_extracti128_si256(mn, 1));
+            return _mm_extract_epi16(_mm_minpos_epu16(m), 0);
+        }
+
+#endif
+
+        //--------------------------------------------------------------------------------
+        // kernel set
+        //--------------------------------------------------------------------------------
+
+        struct Kernel {
+            void (*colRow)(unsigned short *col, const Byte *src, const Byte *line, const int dir, const int num, const int dp, const int sign);
+            void (*sadSlide)(unsigned int *sad, const unsigned short *add, const unsigned short *sub, const int dp);
+            unsigned int (*minSearch)(int &idx, const unsigned int *sad, const int dnum);
+            void (*storeCost)(unsigned short *cost, const unsigned int *sad, const int dp, const int dnum, const unsigned int scale);
+            int (*pathStep)(unsigned short *lcur, unsigned short *sum, const unsigned short *lp, const unsigned short *cost, const int dp, const int p1, const int p2, const int minLp);
+            unsigned int (*minSearch16)(int &idx, const unsigned short *sum, const int dnum);
+        };
+
+        SP_CPUFUNC Kernel getKernel() {
+            Kernel ker = { colRow_c, sadSlide_c, minSearch_c, storeCost_c, pathStep_c, minSearch16_c };
+#if SP_USE_SIMD
+            if (getSimdLevel() >= SimdLevel_SSE4) {
+                Kernel tmp = { colRow_sse4, sadSlide_sse4, minSearch_sse4, storeCost_sse4, pathStep_sse4, minSearch16_sse4 };
+                ker = tmp;
+            }
+            if (getSimdLevel() >= SimdLevel_AVX2) {
+                Kernel tmp = { colRow_avx2, sadSlide_avx2, minSearch_avx2, storeCost_avx2, pathStep_avx2, minSearch16_sse4 };
+                ker = tmp;
+            }
+#endif
+            return ker;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // cost rows
+        //--------------------------------------------------------------------------------
+
+        struct CostParam {
+            // disparity range (lane d -> disparity dmin + d)
+            int dmin, dnum, dp;
+
+            // window size
+            int win;
+
+            // output range [u0, u1) x [v0, v1)
+            int u0, u1, v0, v1;
+
+            // StereoL (+1) / StereoR (-1)
+            int order;
+        };
+
+        // src / ref lines of row y (clamped), ref is ordered so that disparity lanes are contiguous
+        SP_CPUFUNC void getLines(Byte *sline, Byte *rline, const Mem2<Byte> &src, const Mem2<Byte> &ref, const CostParam &prm, const int y) {
+            const int offset = prm.win / 2;
+            const int xnum = (prm.u1 - prm.u0) + prm.win - 1;
+            const int x0 = prm.u0 - offset;
+
+            for (int k = 0; k < xnum; k++) {
+                sline[k] = src(x0 + k, y);
+            }
+
+            // order > 0: ref(x - d) -> rline[xnum - 1 - k + d], order < 0: ref(x + d) -> rline[k + d]
+            const int base = (prm.order > 0) ? x0 + xnum - 1 - prm.dmin : x0 + prm.dmin;
+            const int sgn = (prm.order > 0) ? -1 : +1;
+            for (int j = 0; j < xnum + prm.dp; j++) {
+                rline[j] = ref(base + sgn * j, y);
+            }
+        }
+
+        // func(u, v, sad) for pixels in [u0, u1) x [vb, ve), sad[d] is the window sum of lane d
+        template <typename FUNC>
+        SP_CPUFUNC void costBand(const Kernel &ker, const Mem2<Byte> &src, const Mem2<Byte> &ref, const CostParam &prm, const int vb, const int ve, const FUNC &func) {
+            const int offset = prm.win / 2;
+            const int xnum = (prm.u1 - prm.u0) + prm.win - 1;
+            const int dir = (prm.order > 0) ? -1 : +1;
+            const int dp = prm.dp;
+
+            // column sums of rows [v - offset, v - offset + win)
+            Mem1<unsigned short> col(xnum * dp);
+            col.zero();
+
+            Mem1<unsigned int> sad(dp);
+            Mem1<unsigned short> zero(dp);
+            zero.zero();
+
+            Mem1<Byte> sline(xnum), rline(xnum + dp);
+
+            for (int y = vb - offset; y < vb - offset + prm.win; y++) {
+                getLines(sline.ptr, rline.ptr, src, ref, prm, y);
+                ker.colRow(col.ptr, sline.ptr, rline.ptr, dir, xnum, dp, +1);
+            }
+
+            for (int v = vb; v < ve; v++) {
+                if (v > vb) {
+                    getLines(sline.ptr, rline.ptr, src, ref, prm, v - 1 - offset);
+                    ker.colRow(col.ptr, sline.ptr, rline.ptr, dir, xnum, dp, -1);
+                    getLines(sline.ptr, rline.ptr, src, ref, prm, v - 1 - offset + prm.win);
+                    ker.colRow(col.ptr, sline.ptr, rline.ptr, dir, xnum, dp, +1);
+                }
+
+                sad.zero();
+                for (int k = 0; k < prm.win; k++) {
+                    ker.sadSlide(sad.ptr, &col[k * dp], zero.ptr, dp);
+                }
+                for (int u = prm.u0; u < prm.u1; u++) {
+                    const int k = u - prm.u0;
+                    if (k > 0) {
+                        ker.sadSlide(sad.ptr, &col[(k + prm.win - 1) * dp], &col[(k - 1) * dp], dp);
+                    }
+                    func(u, v, sad.ptr);
+                }
+            }
+        }
+
+        // rows are split into bands (each band rebuilds its column sums)
+        template <typename FUNC>
+        SP_CPUFUNC void costRows(const Mem2<Byte> &src, const Mem2<Byte> &ref, const CostParam &prm, const FUNC &func) {
+            const Kernel ker = getKernel();
+
+            const int rows = prm.v1 - prm.v0;
+            if (rows <= 0 || prm.u1 <= prm.u0 || prm.dnum <= 0) return;
+
+            const int bh = max(2 * prm.win, rows / (4 * max(1, ThreadPool::instance()->size())));
+            const int bnum = (rows + bh - 1) / bh;
+
+            parallel_for(0, bnum, [&](const int b) {
+                const int vb = prm.v0 + b * bh;
+                const int ve = min(vb + bh, prm.v1);
+                costBand(ker, src, ref, prm, vb, ve, func);
+            }, 1);
+        }
+    }
+
+
     class StereoBase {
     private:
 
@@ -24,6 +489,12 @@ namespace sp{
         // window size
         int m_winSize;
 
+        // matching method
+        int m_method;
+
+        // sgm penalty (small / large disparity change)
+        int m_penalty[2];
+
         // camera parameter
         CamParam m_cam[2];
 
@@ -46,6 +517,11 @@ namespace sp{
             StereoR = -1
         };
 
+        enum Method{
+            BM = 0,
+            SGM = 1
+        };
+
     public:
 
         StereoBase() {
@@ -57,6 +533,10 @@ namespace sp{
             m_minDisp = 0;
 
             m_winSize = 21;
+
+            m_method = BM;
+            m_penalty[0] = 4;
+            m_penalty[1] = 32;
         }
 
 
@@ -79,6 +559,16 @@ namespace sp{
             m_winSize = winSize;
         }
 
+        void setMethod(const Method method) {
+            m_method = method;
+        }
+
+        // penalty in intensity units (sgm)
+        void setPenalty(const int p1, const int p2) {
+            m_penalty[0] = max(p1, 0);
+            m_penalty[1] = max(p2, m_penalty[0]);
+        }
+
         Mem2<float>& getDispMap(const Order &order) {
             return m_dispMap[order == Order::StereoL ? 0 : 1];
         }
@@ -117,8 +607,14 @@ namespace sp{
             m_dsize[0] = srcL.dsize[0];
             m_dsize[1] = srcL.dsize[1];
             {
-                correspBM(m_dispMap[0], m_evalMap[0], srcL, srcR, StereoL);
-                correspBM(m_dispMap[1], m_evalMap[1], srcR, srcL, StereoR);
+                if (m_method == SGM) {
+                    correspSGM(m_dispMap[0], m_evalMap[0], srcL, srcR, StereoL);
+                    correspSGM(m_dispMap[1], m_evalMap[1], srcR, srcL, StereoR);
+                }
+                else {
+                    correspBM(m_dispMap[0], m_evalMap[0], srcL, srcR, StereoL);
+                    correspBM(m_dispMap[1], m_evalMap[1], srcR, srcL, StereoR);
+                }
 
                 consistencyCheck(m_dispMap[0], m_evalMap[0], m_dispMap[1], m_evalMap[1], 2.0, StereoL);
                 consistencyCheck(m_dispMap[1], m_evalMap[1], m_dispMap[0], m_evalMap[0], 2.0, StereoR);
@@ -148,36 +644,146 @@ namespace sp{
             return rect;
         }
 
+        _stereo::CostParam getCostParam(const int order) {
+            const Rect2 rect = getDispRect(order);
+
+            _stereo::CostParam prm;
+            prm.dmin = m_minDisp;
+            prm.dnum = m_maxDisp - m_minDisp + 1;
+            prm.dp = _stereo::padDisp(prm.dnum);
+            prm.win = m_winSize;
+            prm.u0 = rect.dbase[0];
+            prm.u1 = rect.dbase[0] + rect.dsize[0];
+            prm.v0 = rect.dbase[1];
+            prm.v1 = rect.dbase[1] + rect.dsize[1];
+            prm.order = order;
+            return prm;
+        }
+
         void correspBM(Mem2<float> &dispMap, Mem2<float> &evalMap, const Mem2<Byte> &src, const Mem2<Byte> &ref, const int order) {
 
-            const Rect2 rect = getDispRect(order);
+            dispMap.resize(m_dsize);
+            dispMap.zero();
+            evalMap.resize(m_dsize);
+            evalMap.zero();
+
+            const _stereo::CostParam prm = getCostParam(order);
+            const _stereo::Kernel ker = _stereo::getKernel();
+
+            // column sums are held in 16 bits
+            SP_ASSERT(m_winSize * SP_BYTEMAX <= 0xFFFF);
+
+            const int maxv = SP_BYTEMAX * m_winSize * m_winSize;
+
+            _stereo::costRows(src, ref, prm, [&](const int u, const int v, const unsigned int *sad) {
+                int idx;
+                const int e = maxv - static_cast<int>(ker.minSearch(idx, sad, prm.dnum));
+
+                // winner take all (first minimum)
+                if (e > 0) {
+                    dispMap(u, v) = static_cast<float>(prm.dmin + idx);
+                    evalMap(u, v) = static_cast<float>(e);
+                }
+            });
+        }
+
+        void correspSGM(Mem2<float> &dispMap, Mem2<float> &evalMap, const Mem2<Byte> &src, const Mem2<Byte> &ref, const int order) {
 
             dispMap.resize(m_dsize);
             dispMap.zero();
             evalMap.resize(m_dsize);
             evalMap.zero();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int v = rect.dbase[1]; v < rect.dbase[1] + rect.dsize[1]; v++) {
-                for (int d = m_minDisp; d <= m_maxDisp; d++) {
+            const _stereo::CostParam prm = getCostParam(order);
+            const _stereo::Kernel ker = _stereo::getKernel();
 
-                    int sad = -1;
-                    for (int u = rect.dbase[0]; u < rect.dbase[0] + rect.dsize[0]; u++) {
-                        float &disp = dispMap(u, v);
-                        float &eval = evalMap(u, v);
+            SP_ASSERT(m_winSize * SP_BYTEMAX <= 0xFFFF);
 
-                        sad = calcSAD(src, ref, u, v, d, order, sad);
-                        const int e = (SP_BYTEMAX * m_winSize * m_winSize) - sad;
+            const int un = prm.u1 - prm.u0;
+            const int vn = prm.v1 - prm.v0;
+            const int dp = prm.dp;
+            if (un <= 0 || vn <= 0 || prm.dnum <= 0) return;
 
-                        if (e > eval) {
-                            eval = static_cast<float>(e);
-                            disp = static_cast<float>(d);
+            // cost volume [v][u][d] (mean absolute difference * COST_SCALE)
+            Mem1<unsigned short> cost(vn * un * dp);
+            {
+                const unsigned int scale = (_stereo::COST_SCALE << 16) / (m_winSize * m_winSize);
+                _stereo::costRows(src, ref, prm, [&](const int u, const int v, const unsigned int *sad) {
+                    ker.storeCost(&cost[((v - prm.v0) * un + (u - prm.u0)) * dp], sad, dp, prm.dnum, scale);
+                });
+            }
+
+            // aggregated cost (sum of 4 paths)
+            Mem1<unsigned short> sum(vn * un * dp);
+            sum.zero();
+
+            const int p1 = m_penalty[0] * _stereo::COST_SCALE;
+            const int p2 = min(m_penalty[1], static_cast<int>(SP_BYTEMAX)) * _stereo::COST_SCALE;
+
+            // path buffers have a guard lane at both ends
+            const int lsize = dp + 2;
+            const unsigned short GUARD = 0xFFFF;
+
+            // horizontal paths
+            parallel_for(0, vn, [&](const int v) {
+                Mem1<unsigned short> buf(2 * lsize);
+                for (int dir = -1; dir <= +1; dir += 2) {
+                    buf.zero();
+                    buf[0] = buf[lsize - 1] = buf[lsize] = buf[2 * lsize - 1] = GUARD;
+                    
+                    unsigned short *lp = &buf[1];
+                    unsigned short *lc = &buf[lsize + 1];
+
+                    int minLp = 0;
+                    for (int i = 0; i < un; i++) {
+                        const int u = (dir > 0) ? i : un - 1 - i;
+                        const int p = (v * un + u) * dp;
+                        minLp = ker.pathStep(lc, &sum[p], lp, &cost[p], dp, p1, p2, minLp);
+                        swap(lp, lc);
+                    }
+                }
+            }, 4);
+
+            // vertical paths (column strips)
+            const int strip = 64;
+            parallel_for(0, (un + strip - 1) / strip, [&](const int b) {
+                const int ub = b * strip;
+                const int ue = min(ub + strip, un);
+                const int cn = ue - ub;
+
+                Mem1<unsigned short> buf(2 * cn * lsize);
+                Mem1<int> minLp(cn);
+
+                for (int dir = -1; dir <= +1; dir += 2) {
+                    buf.zero();
+                    minLp.zero();
+                    for (int c = 0; c < 2 * cn; c++) {
+                        buf[c * lsize] = buf[c * lsize + lsize - 1] = GUARD;
+                    }
+
+                    for (int i = 0; i < vn; i++) {
+                        const int v = (dir > 0) ? i : vn - 1 - i;
+                        unsigned short *lp = &buf[((i + 0) % 2) * cn * lsize + 1];
+                        unsigned short *lc = &buf[((i + 1) % 2) * cn * lsize + 1];
+
+                        for (int c = 0; c < cn; c++) {
+                            const int p = (v * un + ub + c) * dp;
+                            minLp[c] = ker.pathStep(&lc[c * lsize], &sum[p], &lp[c * lsize], &cost[p], dp, p1, p2, minLp[c]);
                         }
                     }
                 }
-            }
+            }, 1);
+
+            // winner take all
+            parallel_for(0, vn, [&](const int v) {
+                for (int u = 0; u < un; u++) {
+                    int idx;
+                    const unsigned int s = ker.minSearch16(idx, &sum[(v * un + u) * dp], prm.dnum);
+
+                    dispMap(prm.u0 + u, prm.v0 + v) = static_cast<float>(prm.dmin + idx);
+                    evalMap(prm.u0 + u, prm.v0 + v) = static_cast<float>(0xFFFF - s);
+                }
+            }, 4);
         }
 
         void consistencyCheck(Mem2<float> &dispMap0, Mem2<float> &evalMap0, const Mem2<float> &dispMap1, const Mem2<float> &evalMap1, const double thresh, const int order) {
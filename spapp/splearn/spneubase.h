@@ -9,6 +9,116 @@
 
 namespace sp{
 
+    //--------------------------------------------------------------------------------
+    // tensor (mini batch)
+    //--------------------------------------------------------------------------------
+    //
+    // contiguous N x C x H x W data. sample n is a Mem-like block (dim, dsize[0..2]) at ptr(n).
+    // resize keeps the buffer when the size does not grow, so layer buffers are reused.
+    //
+
+    template<typename TYPE> class Tensor4 {
+
+        Mem1<TYPE> m_data;
+
+    public:
+
+        // sample dim (1 - 3)
+        int dim;
+
+        // dsize (x, y, c, n)
+        int dsize[4];
+
+    public:
+
+        Tensor4() {
+            dim = 0;
+            for (int i = 0; i < 4; i++) {
+                dsize[i] = 0;
+            }
+        }
+
+        Tensor4(const int num, const int dim, const int *dsize) {
+            resize(num, dim, dsize);
+        }
+
+        // sample (dim, dsize) x num
+        void resize(const int num, const int dim, const int *dsize) {
+            this->dim = max(dim, 1);
+            for (int i = 0; i < 3; i++) {
+                this->dsize[i] = (i < dim && dsize != NULL) ? max(dsize[i], 1) : 1;
+            }
+            this->dsize[3] = num;
+
+            m_data.resize(size());
+        }
+
+        // num
+        int num() const {
+            return dsize[3];
+        }
+
+        // sample size
+        int step() const {
+            return dsize[0] * dsize[1] * dsize[2];
+        }
+
+        int size() const {
+            return step() * dsize[3];
+        }
+
+        TYPE* ptr(const int n = 0) {
+            return &m_data.ptr[n * step()];
+        }
+
+        const TYPE* ptr(const int n = 0) const {
+            return &m_data.ptr[n * step()];
+        }
+
+        TYPE& operator [](const int i) {
+            return m_data.ptr[i];
+        }
+
+        const TYPE& operator [](const int i) const {
+            return m_data.ptr[i];
+        }
+
+        void zero() {
+            m_data.zero();
+        }
+    };
+
+    template<typename TYPE0, typename TYPE1>
+    SP_CPUFUNC void cnvTensor(Tensor4<TYPE0> &dst, const Mem1<Mem<TYPE1> > &src) {
+        if (src.size() == 0) {
+            dst.resize(0, 1, NULL);
+            return;
+        }
+        dst.resize(src.size(), src[0].dim, src[0].dsize);
+
+        TYPE0 *pd = dst.ptr();
+        for (int n = 0; n < src.size(); n++) {
+            SP_ASSERT(src[n].size() == dst.step());
+            for (int i = 0; i < dst.step(); i++) {
+                *pd++ = static_cast<TYPE0>(src[n][i]);
+            }
+        }
+    }
+
+    template<typename TYPE0, typename TYPE1>
+    SP_CPUFUNC void cnvTensor(Mem1<Mem<TYPE0> > &dst, const Tensor4<TYPE1> &src) {
+        dst.resize(src.num());
+
+        const TYPE1 *ps = src.ptr();
+        for (int n = 0; n < src.num(); n++) {
+            dst[n].resize(src.dim, src.dsize);
+            for (int i = 0; i < src.step(); i++) {
+                dst[n][i] = static_cast<TYPE0>(*ps++);
+            }
+        }
+    }
+
+
     //--------------------------------------------------------------------------------
     // one hot
     //--------------------------------------------------------------------------------
@@ -90,12 +200,15 @@ namespace sp{
             b.resize(nodeNum, 1);
         }
 
-        void rand(const SP_REAL scale = 0.05){
+        void rand(const SP_REAL scale = 0.05, const int seed = 0){
+            simdRandg(w.ptr, w.size(), randKey(seed, 0));
+            simdRandg(b.ptr, b.size(), randKey(seed, 1));
+
             for (int i = 0; i < w.size(); i++){
-                w[i] = randg() * scale;
+                w[i] *= scale;
             }
             for (int i = 0; i < b.size(); i++){
-                b[i] = randg() * scale;
+                b[i] *= scale;
             }
         }
 
@@ -106,5 +219,115 @@ namespace sp{
 
     };
 
+
+    //--------------------------------------------------------------------------------
+    // im2col (convolution as matrix product)
+    //--------------------------------------------------------------------------------
+
+    enum ImgLayout {
+        // channel planes (c, y, x)
+        ImgLayout_NCHW = 0,
+
+        // interleaved channels (y, x, c)
+        ImgLayout_NHWC = 1
+    };
+
+    // convolution window geometry
+    struct CnvWin {
+        // input dsize (x, y, ch)
+        int dsize[3];
+
+        // output dsize (x, y)
+        int output[2];
+
+        int winSize;
+        int stride;
+        int margin;
+    };
+
+    // index = y * ystep + x * xstep + c * cstep
+    SP_CPUFUNC void cnvStep(int &xstep, int &ystep, int &cstep, const CnvWin &win, const ImgLayout layout) {
+        if (layout == ImgLayout_NCHW) {
+            xstep = 1;
+            ystep = win.dsize[0];
+            cstep = win.dsize[0] * win.dsize[1];
+        }
+        else {
+            xstep = win.dsize[2];
+            ystep = win.dsize[0] * win.dsize[2];
+            cstep = 1;
+        }
+    }
+
+    // col (K x P), K = (c * winSize + ky) * winSize + kx, P = oy * output[0] + ox (outside pixels are clamped)
+    // (col does not depend on the layout of src)
+    template<typename TYPE>
+    SP_CPUFUNC void im2col(TYPE *col, const TYPE *src, const CnvWin &win, const ImgLayout layout = ImgLayout_NCHW) {
+        const int hsize = win.winSize / 2;
+
+        int xstep, ystep, cstep;
+        cnvStep(xstep, ystep, cstep, win, layout);
+
+        for (int c = 0; c < win.dsize[2]; c++) {
+            for (int ky = 0; ky < win.winSize; ky++) {
+                for (int kx = 0; kx < win.winSize; kx++) {
+
+                    // valid ox range [obgn, oend), clamped outside
+                    const int x0 = win.margin + kx - hsize;
+                    const int oend = (x0 < win.dsize[0]) ? min(win.output[0], (win.dsize[0] - 1 - x0) / win.stride + 1) : 0;
+                    const int obgn = min(oend, (x0 >= 0) ? 0 : (-x0 + win.stride - 1) / win.stride);
+
+                    for (int oy = 0; oy < win.output[1]; oy++) {
+                        const int y = max(0, min(win.dsize[1] - 1, oy * win.stride + win.margin + ky - hsize));
+                        const TYPE *row = &src[y * ystep + c * cstep];
+
+                        int ox = 0;
+                        for (; ox < obgn; ox++) {
+                            *col++ = row[max(0, min(win.dsize[0] - 1, ox * win.stride + x0)) * xstep];
+                        }
+                        for (; ox < oend; ox++) {
+                            *col++ = row[(ox * win.stride + x0) * xstep];
+                        }
+                        for (; ox < win.output[0]; ox++) {
+                            *col++ = row[max(0, min(win.dsize[0] - 1, ox * win.stride + x0)) * xstep];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // dst += col (K x P) (outside pixels are skipped)
+    template<typename TYPE>
+    SP_CPUFUNC void col2im(TYPE *dst, const TYPE *col, const CnvWin &win, const ImgLayout layout = ImgLayout_NCHW) {
+        const int hsize = win.winSize / 2;
+
+        int xstep, ystep, cstep;
+        cnvStep(xstep, ystep, cstep, win, layout);
+
+        for (int c = 0; c < win.dsize[2]; c++) {
+            for (int ky = 0; ky < win.winSize; ky++) {
+                for (int kx = 0; kx < win.winSize; kx++) {
+
+                    // valid ox range
+                    const int x0 = win.margin + kx - hsize;
+                    const int obgn = (x0 >= 0) ? 0 : (-x0 + win.stride - 1) / win.stride;
+                    const int oend = (x0 < win.dsize[0]) ? min(win.output[0], (win.dsize[0] - 1 - x0) / win.stride + 1) : 0;
+
+                    for (int oy = 0; oy < win.output[1]; oy++) {
+                        const int y = oy * win.stride + win.margin + ky - hsize;
+                        if (y >= 0 && y < win.dsize[1]) {
+                            TYPE *row = &dst[y * ystep + c * cstep];
+                            for (int ox = obgn; ox < oend; ox++) {
+                                row[(ox * win.stride + x0) * xstep] += col[ox];
+                            }
+                        }
+                        col += win.output[0];
+                    }
+                }
+            }
+        }
+    }
+
 }
 #endif
@@ -34,10 +34,10 @@ namespace sp{
         //
 
         // src (mini batch)
-        const Mem1<Mem<SP_REAL> > *m_X, *m_A;
+        const Tensor4<float> *m_X, *m_A;
 
-        // dst (mini batch)
-        Mem1<Mem<SP_REAL> > m_Y, m_B;
+        // dst (mini batch, reused across iterations)
+        Tensor4<float> m_Y, m_B;
 
     public:
 
@@ -50,12 +50,16 @@ namespace sp{
         // node number
         int m_nodeNum;
 
+        // random seed (layer index in the model)
+        int m_seed;
+
         BaseLayer(){
             m_init = false;
             m_train = false;
             m_nodeNum = 0;
+            m_seed = 0;
         }
-        ~BaseLayer() {
+        virtual ~BaseLayer() {
         }
 
         // get layer name
@@ -73,22 +77,21 @@ namespace sp{
         //--------------------------------------------------------------------------------
 
         // execute foward(true) / backward(false)
-        const Mem1<Mem<SP_REAL> >* execute(const Mem1<Mem<SP_REAL> > *src, const bool direct){
+        const Tensor4<float>* execute(const Tensor4<float> *src, const bool direct){
 
             return (direct == true) ? _forward(src) : _backward(src);
         }
 
         // get result data
-        const Mem1<Mem<SP_REAL> >& getResult(const bool direct){
+        const Tensor4<float>& getResult(const bool direct){
 
             return (direct == true) ? m_Y : m_B;
         }
 
     private:
 
-        const Mem1<Mem<SP_REAL> >* _forward(const Mem1<Mem<SP_REAL> > *src){
+        const Tensor4<float>* _forward(const Tensor4<float> *src){
             m_X = src;
-            m_Y.resize(src->size());
 
             if (m_init == false){
                 m_init = true;
@@ -99,26 +102,23 @@ namespace sp{
             return &m_Y;
         }
 
-        const Mem1<Mem<SP_REAL> >* _backward(const Mem1<Mem<SP_REAL> > *src){
+        const Tensor4<float>* _backward(const Tensor4<float> *src){
             m_A = src;
-            m_B.resize(src->size());
+            m_B.resize(m_X->num(), m_X->dim, m_X->dsize);
 
             backward(m_B, *m_A, m_Y, *m_X);
-
-            // reshape
-            for (int n = 0; n < m_B.size(); n++){
-                m_B[n].resize((*m_X)[n].dim, (*m_X)[n].dsize);
-            }
             return &m_B;
         }
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor4<float> &X){
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        // Y : resized by each layer
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        // B : same size as X
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
         }
 
     };
@@ -148,6 +148,12 @@ namespace sp{
         // velocity for momentum
         NodeParam m_vel;
 
+        // float copy of m_prm (syncParam)
+        Mem1<float> m_wf, m_bf;
+
+        // gradient (backward, reused across iterations)
+        NodeParam m_grd;
+
     public:
 
         ParamLayer(){
@@ -177,19 +183,28 @@ namespace sp{
             }
         }
 
-        void update(const Mem1<NodeParam> &grds){
-            NodeParam grd = grds[0];
-            for (int n = 1; n < grds.size(); n++){
-                grd.w += grds[n].w;
-                grd.b += grds[n].b;
+    protected:
+
+        void syncParam(){
+            m_wf.resize(m_prm.w.size());
+            m_bf.resize(m_prm.b.size());
+            for (int i = 0; i < m_wf.size(); i++){
+                m_wf[i] = static_cast<float>(m_prm.w[i]);
+            }
+            for (int i = 0; i < m_bf.size(); i++){
+                m_bf[i] = static_cast<float>(m_prm.b[i]);
             }
-            update(grd);
         }
 
     private:
+        // in place (no temporary matrix per iteration)
         void sgd(const NodeParam &grd){
-            m_prm.w -= grd.w * m_lambda;
-            m_prm.b -= grd.b * m_lambda;
+            for (int i = 0; i < m_prm.w.size(); i++){
+                m_prm.w[i] -= grd.w[i] * m_lambda;
+            }
+            for (int i = 0; i < m_prm.b.size(); i++){
+                m_prm.b[i] -= grd.b[i] * m_lambda;
+            }
         }
 
         void momentum(const NodeParam &grd){
@@ -199,11 +214,14 @@ namespace sp{
             }
             const double momentum = 0.9;
 
-            m_vel.w = m_vel.w * momentum + grd.w * m_lambda;
-            m_vel.b = m_vel.b * momentum + grd.b * m_lambda;
-            m_prm.w -= m_vel.w;
-            m_prm.b -= m_vel.b;
-
+            for (int i = 0; i < m_vel.w.size(); i++){
+                m_vel.w[i] = m_vel.w[i] * momentum + grd.w[i] * m_lambda;
+                m_prm.w[i] -= m_vel.w[i];
+            }
+            for (int i = 0; i < m_vel.b.size(); i++){
+                m_vel.b[i] = m_vel.b[i] * momentum + grd.b[i] * m_lambda;
+                m_prm.b[i] -= m_vel.b[i];
+            }
         }
 
     };
@@ -215,6 +233,11 @@ namespace sp{
 
     class AffineLayer : public ParamLayer{
 
+    private:
+
+        // weight gradient (float)
+        Mem1<float> m_gw;
+
     public:
         AffineLayer(){
         }
@@ -231,49 +254,60 @@ namespace sp{
             ParamLayer::textex(file);
         }
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
-            const int dataNum = X[0].size();
+        virtual void init(const Tensor4<float> &X){
+            const int dataNum = X.step();
 
             // foward parameter
             m_prm.resize(m_nodeNum, dataNum);
-            m_prm.rand();
+            m_prm.rand(0.05, m_seed);
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        // Y (N x M) = X (N x D) * W^T + b
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            syncParam();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < Y.size(); n++){
-                const Mat mX = Mat(X[n].size(), 1, X[n].ptr);
+            const int N = X.num();
+            const int D = X.step();
+            const int M = m_nodeNum;
 
-                // Y = w * X + b
-                Y[n] = m_prm.w * mX + m_prm.b;
+            Y.resize(N, 1, &M);
+            simdGemm(Y.ptr(), M, X.ptr(), D, false, m_wf.ptr, D, true, N, M, D);
+
+            for (int n = 0; n < N; n++){
+                float *py = Y.ptr(n);
+                for (int m = 0; m < M; m++){
+                    py[m] += m_bf[m];
+                }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            const Mat wt = trnMat(m_prm.w);
+        // B (N x D) = A (N x M) * W, dW (M x D) = A^T * X
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
 
-            Mem1<NodeParam> m_grds(B.size());
+            const int N = X.num();
+            const int D = X.step();
+            const int M = m_nodeNum;
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < B.size(); n++){
-                const Mat mA(A[n].size(), 1, A[n].ptr);
-                const Mat mX(X[n].size(), 1, X[n].ptr);
+            simdGemm(B.ptr(), D, A.ptr(), M, false, m_wf.ptr, D, false, N, D, M);
 
-                m_grds[n].w = mA * trnMat(mX);
-                m_grds[n].b = mA;
+            m_gw.resize(M * D);
+            simdGemm(m_gw.ptr, D, A.ptr(), M, true, X.ptr(), D, false, M, D, N);
 
-                B[n] = wt * mA;
+            m_grd.resize(M, D);
+            m_grd.zero();
+            for (int i = 0; i < m_gw.size(); i++){
+                m_grd.w[i] = m_gw[i];
+            }
+            for (int n = 0; n < N; n++){
+                const float *pa = A.ptr(n);
+                for (int m = 0; m < M; m++){
+                    m_grd.b[m] += pa[m];
+                }
             }
 
             // update
-            update(m_grds);
+            update(m_grd);
         }
 
     };
@@ -292,28 +326,37 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            Y.resize(X.num(), X.dim, X.dsize);
 
-            for (int n = 0; n < Y.size(); n++){
-                const SP_REAL maxv = max(X[n]);
+            for (int n = 0; n < Y.num(); n++){
+                const float *px = X.ptr(n);
+                float *py = Y.ptr(n);
 
-                Mem1<SP_REAL> S(X[n].size());
-                for (int i = 0; i < S.size(); i++){
-                    S[i] = exp(X[n][i] - maxv);
+                float maxv = px[0];
+                for (int i = 1; i < X.step(); i++){
+                    maxv = max(maxv, px[i]);
+                }
+
+                double sum = 0.0;
+                for (int i = 0; i < X.step(); i++){
+                    py[i] = static_cast<float>(exp(px[i] - maxv));
+                    sum += py[i];
                 }
 
                 // Y = S / sum(S)
-                divElm(Y[n], S, sum(S));
+                for (int i = 0; i < X.step(); i++){
+                    py[i] = static_cast<float>(py[i] / sum);
+                }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
 
-            for (int n = 0; n < B.size(); n++){
-
-                // B = (Y - A) / batch
-                subMem(B[n], Y[n], A[n]);
-                divElm(B[n], B[n], B.size());
+            // B = (Y - A) / batch
+            const float scale = 1.0f / B.num();
+            for (int i = 0; i < B.size(); i++){
+                B[i] = (Y[i] - A[i]) * scale;
             }
         }
 
@@ -362,45 +405,38 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            for (int n = 0; n < Y.size(); n++){
-                Y[n].resize(X[n].dim, X[n].dsize);
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            Y.resize(X.num(), X.dim, X.dsize);
 
-                for (int i = 0; i < Y[n].size(); i++){
-                    Y[n][i] = calcFwrd(X[n][i]);
-                }
+            for (int i = 0; i < Y.size(); i++){
+                Y[i] = calcFwrd(X[i]);
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            for (int n = 0; n < B.size(); n++){
-                B[n].resize(A[n].dim, A[n].dsize);
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
 
-                for (int i = 0; i < B[n].size(); i++){
-                    B[n][i] = calcBwrd(A[n][i], Y[n][i], X[n][i]);
-                }
+            for (int i = 0; i < B.size(); i++){
+                B[i] = calcBwrd(A[i], Y[i], X[i]);
             }
         }
 
-        SP_REAL calcFwrd(const SP_REAL x){
+        float calcFwrd(const float x){
             switch (m_activation){
             case ReLU:
                 return (x > 0) ? x : 0;
             case Sigmoid:
             default:
-                return 1.0 / (1.0 + exp(-x));
+                return static_cast<float>(1.0 / (1.0 + exp(-x)));
             }
         }
 
-        SP_REAL calcBwrd(const SP_REAL a, const SP_REAL y, const SP_REAL x){
+        float calcBwrd(const float a, const float y, const float x){
             switch (m_activation){
             case ReLU:
                 return (x > 0) ? a : 0;
             case Sigmoid:
             default:
-                return a * y * y * exp(-x);
+                return static_cast<float>(a * y * y * exp(-x));
             }
         }
 
@@ -430,6 +466,12 @@ namespace sp{
         // kernel dsize
         int m_kernel[3];
 
+        // im2col buffer (per block)
+        Mem1<Mem1<float> > m_cols;
+
+        // weight gradient (per sample)
+        Mem1<float> m_gws;
+
     public:
         ConvolutionLayer(){
             m_nodeNum = 0;
@@ -461,144 +503,118 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor4<float> &X){
 
             // output dsize
-            m_output[0] = (X[0].dsize[0] - 2 * m_margin) / m_stride;
-            m_output[1] = (X[0].dsize[1] - 2 * m_margin) / m_stride;
+            m_output[0] = (X.dsize[0] - 2 * m_margin) / m_stride;
+            m_output[1] = (X.dsize[1] - 2 * m_margin) / m_stride;
             m_output[2] = m_nodeNum;
 
             // kernel dsize
             m_kernel[0] = m_winSize;
             m_kernel[1] = m_winSize;
-            m_kernel[2] = max(X[0].dsize[2], 1);
+            m_kernel[2] = max(X.dsize[2], 1);
 
             // foward parameter
             m_prm.resize(m_nodeNum, m_kernel[0] * m_kernel[1] * m_kernel[2]);
-            m_prm.rand();
+            m_prm.rand(0.05, m_seed);
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < X.size(); n++){
-                Y[n] = cnvFwrd(X[n]);
-            }
+        // samples per parallel block (one im2col buffer per block)
+        static int getBlock(const int num){
+            return max(1, (num + ThreadPool::instance()->size() - 1) / ThreadPool::instance()->size());
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
-
-            Mem1<NodeParam> grds(B.size());
-
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < B.size(); n++){
-                B[n] = cnvBwrd(A[n], X[n]);
-                grds[n] = grdBwrd(A[n], X[n]);
-            }
-
-            // update
-            update(grds);
+        CnvWin getWin(const Tensor4<float> &X) const {
+            CnvWin win;
+            win.dsize[0] = X.dsize[0];
+            win.dsize[1] = X.dsize[1];
+            win.dsize[2] = m_kernel[2];
+            win.output[0] = m_output[0];
+            win.output[1] = m_output[1];
+            win.winSize = m_winSize;
+            win.stride = m_stride;
+            win.margin = m_margin;
+            return win;
         }
 
-        Mem<SP_REAL>  cnvFwrd(const Mem<SP_REAL>  &X){
-            Mem<SP_REAL>  Y(3, m_output);
+        // Y (oc x P) = W (oc x K) * col (K x P) + b
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            syncParam();
 
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
+            Y.resize(X.num(), 3, m_output);
 
-                        const int u = ou * m_stride + m_margin;
-                        const int v = ov * m_stride + m_margin;
+            const CnvWin win = getWin(X);
+            const int K = m_prm.w.cols();
+            const int P = m_output[0] * m_output[1];
 
-                        const SP_REAL *pw = &m_prm.w(oc, 0);
-                        const int hsize = m_winSize / 2;
+            const int block = getBlock(X.num());
+            m_cols.resize((X.num() + block - 1) / block);
 
-                        SP_REAL sum = 0.0;
+            parallel_for(0, m_cols.size(), [&](const int b){
+                Mem1<float> &col = m_cols[b];
+                col.resize(K * P);
 
-                        // convolution forward
-                        for (int kc = 0; kc < m_kernel[2]; kc++){
-                            for (int ky = 0; ky < m_kernel[1]; ky++){
-                                for (int kx = 0; kx < m_kernel[0]; kx++){
-                                    sum += *(pw++) * acs3(X, u + kx - hsize, v + ky - hsize, kc);
-                                }
-                            }
+                for (int n = b * block; n < min((b + 1) * block, X.num()); n++){
+                    im2col(col.ptr, X.ptr(n), win);
+                    simdGemm(Y.ptr(n), P, m_wf.ptr, K, false, col.ptr, P, false, m_nodeNum, P, K);
+
+                    for (int oc = 0; oc < m_nodeNum; oc++){
+                        float *py = Y.ptr(n) + oc * P;
+                        for (int p = 0; p < P; p++){
+                            py[p] += m_bf[oc];
                         }
-                        acs3(Y, ou, ov, oc) = sum + m_prm.b(oc, 0);
                     }
                 }
-            }
-            return Y;
+            }, 1);
         }
 
-        Mem<SP_REAL>  cnvBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X){
-            Mem<SP_REAL>  B(X.dim, X.dsize);
+        // dcol (K x P) = W^T (K x oc) * A (oc x P), dW (oc x K) = A (oc x P) * col^T (P x K)
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
             B.zero();
 
-            Mat mB = trnMat(Mat(m_nodeNum, m_output[0] * m_output[1], A.ptr)) * m_prm.w;
+            const CnvWin win = getWin(X);
+            const int K = m_prm.w.cols();
+            const int P = m_output[0] * m_output[1];
+            const int G = m_nodeNum * K;
 
-            const Rect2 rect = getRect2(X.dsize);
-            for (int ov = 0; ov < m_output[1]; ov++){
-                for (int ou = 0; ou < m_output[0]; ou++){
+            m_gws.resize(X.num() * G);
 
-                    const int u = ou * m_stride + m_margin;
-                    const int v = ov * m_stride + m_margin;
+            const int block = getBlock(X.num());
+            m_cols.resize((X.num() + block - 1) / block);
 
-                    const SP_REAL *pb = &mB(ov * m_output[0] + ou, 0);
-                    const int hsize = m_winSize / 2;
+            parallel_for(0, m_cols.size(), [&](const int b){
+                Mem1<float> &col = m_cols[b];
+                col.resize(K * P);
 
-                    // convolution backward
-                    for (int kc = 0; kc < m_kernel[2]; kc++){
-                        for (int ky = 0; ky < m_kernel[1]; ky++){
-                            for (int kx = 0; kx < m_kernel[0]; kx++){
-                                const SP_REAL b = *(pb++);
-                                if (inRect(rect, u + kx - hsize, v + ky - hsize) == false) continue;
+                for (int n = b * block; n < min((b + 1) * block, X.num()); n++){
+                    simdGemm(col.ptr, P, m_wf.ptr, K, true, A.ptr(n), P, false, K, P, m_nodeNum);
+                    col2im(B.ptr(n), col.ptr, win);
 
-                                acs3(B, u + kx - hsize, v + ky - hsize, kc) += b;
-                            }
-                        }
-                    }
+                    im2col(col.ptr, X.ptr(n), win);
+                    simdGemm(&m_gws[n * G], K, A.ptr(n), P, false, col.ptr, P, true, m_nodeNum, K, P);
                 }
-            }
-            return B;
-        }
-
-        NodeParam grdBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X){
-            NodeParam grd;
-            grd.resize(m_nodeNum, m_kernel[0] * m_kernel[1] * m_kernel[2]);
-            grd.zero();
+            }, 1);
 
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
-
-                        const int u = ou * m_stride + m_margin;
-                        const int v = ov * m_stride + m_margin;
-
-                        const SP_REAL a = acs3(A, ou, ov, oc);
-                        const int hsize = m_winSize / 2;
-
-                        // w
-                        SP_REAL *pw = &grd.w(oc, 0);
-
-                        for (int kc = 0; kc < m_kernel[2]; kc++){
-                            for (int ky = 0; ky < m_kernel[1]; ky++){
-                                for (int kx = 0; kx < m_kernel[0]; kx++){
-                                    *(pw++) += a * acs3(X, u + kx - hsize, v + ky - hsize, kc);
-                                }
-                            }
-                        }
+            m_grd.resize(m_nodeNum, K);
+            m_grd.zero();
 
-                        // b
-                        grd.b(oc, 0) += a;
+            for (int n = 0; n < X.num(); n++){
+                const float *pg = &m_gws[n * G];
+                for (int i = 0; i < G; i++){
+                    m_grd.w[i] += pg[i];
+                }
+                for (int oc = 0; oc < m_nodeNum; oc++){
+                    const float *pa = A.ptr(n) + oc * P;
+                    for (int p = 0; p < P; p++){
+                        m_grd.b[oc] += pa[p];
                     }
                 }
             }
-            return grd;
+
+            // update
+            update(m_grd);
         }
 
     };
@@ -627,8 +643,8 @@ namespace sp{
         // kernel dsize
         int m_kernel[2];
 
-        // forward id map
-        Mem1<Mem<int> > m_fwrdMap;
+        // forward id map (index in the sample, -1: no data)
+        Mem1<int> m_fwrdMap;
 
     public:
         MaxPoolingLayer(){
@@ -659,12 +675,12 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor4<float> &X){
 
             // output dsize
-            m_output[0] = (X[0].dsize[0] - 2 * m_margin) / m_stride;
-            m_output[1] = (X[0].dsize[1] - 2 * m_margin) / m_stride;
-            m_output[2] = max(X[0].dsize[2], 1);
+            m_output[0] = (X.dsize[0] - 2 * m_margin) / m_stride;
+            m_output[1] = (X.dsize[1] - 2 * m_margin) / m_stride;
+            m_output[2] = max(X.dsize[2], 1);
 
             // kernel dsize
             m_kernel[0] = m_winSize;
@@ -672,34 +688,36 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            Y.resize(X.num(), 3, m_output);
             m_fwrdMap.resize(Y.size());
 
 #if SP_USE_OMP
 #pragma omp parallel for
 #endif
-            for (int n = 0; n < Y.size(); n++){
-                Y[n] = poolFwrd(X[n], m_fwrdMap[n]);
+            for (int n = 0; n < Y.num(); n++){
+                poolFwrd(Y.ptr(n), &m_fwrdMap[n * Y.step()], X.ptr(n), X.dsize);
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
+            B.zero();
 
-#if SP_USE_OMP
-#pragma omp parallel for
-#endif
-            for (int n = 0; n < B.size(); n++){
-                B[n] = poolBwrd(A[n], X[n], m_fwrdMap[n]);
-            }
+            for (int n = 0; n < B.num(); n++){
+                const int *map = &m_fwrdMap[n * A.step()];
+                const float *pa = A.ptr(n);
+                float *pb = B.ptr(n);
 
+                // max pooling backward
+                for (int i = 0; i < A.step(); i++){
+                    if (map[i] >= 0) pb[map[i]] += pa[i];
+                }
+            }
         }
 
-        Mem<SP_REAL>  poolFwrd(const Mem<SP_REAL>  &X, Mem<int> &fwrdMap){
-            fwrdMap.resize(3, m_output);
-
-            Mem3<SP_REAL> Y(m_output);
+        void poolFwrd(float *Y, int *fwrdMap, const float *X, const int *dsize){
 
-            const Rect2 rect = getRect2(X.dsize);
+            const int hsize = m_winSize / 2;
             for (int oc = 0; oc < m_output[2]; oc++){
                 for (int ov = 0; ov < m_output[1]; ov++){
                     for (int ou = 0; ou < m_output[0]; ou++){
@@ -707,48 +725,30 @@ namespace sp{
                         const int u = ou * m_stride + m_margin;
                         const int v = ov * m_stride + m_margin;
 
-                        const int hsize = m_winSize / 2;
-
-                        int &id = acs3(fwrdMap, ou, ov, oc);
-
-                        SP_REAL maxv = -SP_INFINITY;
+                        int id = -1;
+                        float maxv = -SP_INFINITY;
 
                         // max pooling forward
                         for (int ky = 0; ky < m_kernel[1]; ky++){
+                            const int y = v + ky - hsize;
+                            if (y < 0 || y >= dsize[1]) continue;
+
                             for (int kx = 0; kx < m_kernel[0]; kx++){
-                                if (inRect(rect, u + kx - hsize, v + ky - hsize) == false) continue;
+                                const int x = u + kx - hsize;
+                                if (x < 0 || x >= dsize[0]) continue;
 
-                                const SP_REAL val = acs3(X, u + kx - hsize, v + ky - hsize, oc);
-                                if (val > maxv){
-                                    maxv = val;
-                                    id = acsid3(X.dsize, u + kx - hsize, v + ky - hsize, oc);
+                                const int i = (oc * dsize[1] + y) * dsize[0] + x;
+                                if (X[i] > maxv){
+                                    maxv = X[i];
+                                    id = i;
                                 }
                             }
                         }
-                        acs3(Y, ou, ov, oc) = maxv;
-                    }
-                }
-            }
-            return Y;
-        }
-
-        Mem<SP_REAL>  poolBwrd(const Mem<SP_REAL>  &A, const Mem<SP_REAL>  &X, const Mem<int> &fwrdMap){
-            Mem<SP_REAL>  B(X.dim, X.dsize);
-            B.zero();
-
-            const Rect2 rect = getRect2(X.dsize);
-            for (int oc = 0; oc < m_output[2]; oc++){
-                for (int ov = 0; ov < m_output[1]; ov++){
-                    for (int ou = 0; ou < m_output[0]; ou++){
-
-                        const int id = acs3(fwrdMap, ou, ov, oc);
-
-                        // max pooling backward
-                        B[id] += acs3(A, ou, ov, oc);
+                        *Y++ = maxv;
+                        *fwrdMap++ = id;
                     }
                 }
             }
-            return B;
         }
 
     };
@@ -763,11 +763,18 @@ namespace sp{
     public:
         SP_REAL m_passRate;
 
-        Mem1<Mem<char> > m_mask;
+        Mem1<char> m_mask;
+
+        // uniform random buffer (training forward)
+        Mem1<SP_REAL> m_rnd;
+
+        // training forward count
+        int m_itr;
     public:
 
         DropOutLayer(const SP_REAL passRate = 0.5){
             m_passRate = passRate;
+            m_itr = 0;
         }
 
         virtual const char* getName(){
@@ -781,33 +788,36 @@ namespace sp{
 
     private:
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            Y.resize(X.num(), X.dim, X.dsize);
+
             if (m_train == true){
-                m_mask.resize(Y.size());
+                m_mask.resize(X.size());
 
-                for (int n = 0; n < Y.size(); n++){
-                    Y[n].resize(X[n].dim, X[n].dsize);
-                    m_mask[n].resize(X[n].dim, X[n].dsize);
+                RandStream rs = getRandStream(m_seed, m_itr++);
 
-                    for (int i = 0; i < Y[n].size(); i++){
-                        const char mask = (0.5 * (randu() + 1.0) < m_passRate) ? 1 : 0;
+                m_rnd.resize(X.size());
+                simdRandu(m_rnd.ptr, m_rnd.size(), rs);
 
-                        Y[n][i] = X[n][i] * mask;
-                        m_mask[n][i] = mask;
-                    }
+                for (int i = 0; i < Y.size(); i++){
+                    const char mask = (0.5 * (m_rnd[i] + 1.0) < m_passRate) ? 1 : 0;
+
+                    Y[i] = X[i] * mask;
+                    m_mask[i] = mask;
                 }
             }
             else{
-                for (int n = 0; n < Y.size(); n++){
-                    mulElm(Y[n], X[n], m_passRate);
+                const float passRate = static_cast<float>(m_passRate);
+                for (int i = 0; i < Y.size(); i++){
+                    Y[i] = X[i] * passRate;
                 }
             }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
 
-            for (int n = 0; n < B.size(); n++){
-                mulMem(B[n], A[n], m_mask[n]);
+            for (int i = 0; i < B.size(); i++){
+                B[i] = A[i] * m_mask[i];
             }
         }
 
@@ -822,7 +832,9 @@ namespace sp{
 
     private:
 
-        Mem1<Mem1<SP_REAL> > m_cX, m_nX;
+        // centered / normalized X (same layout as X)
+        Mem1<float> m_cX, m_nX;
+
         Mem1<SP_REAL> m_mean, m_var, m_std;
 
     public:
@@ -847,9 +859,9 @@ namespace sp{
 
     private:
 
-        virtual void init(const Mem1<Mem<SP_REAL> > &X){
+        virtual void init(const Tensor4<float> &X){
             if (m_nodeNum == 0){
-                m_nodeNum = X[0].size();
+                m_nodeNum = X.step();
             }
 
             m_prm.resize(m_nodeNum, 1);
@@ -867,28 +879,42 @@ namespace sp{
 
         }
 
-        virtual void forward(Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        // node r : X[n][r * S + s] (n < N, s < S)
 
-            m_cX.resize(m_nodeNum);
-            m_nX.resize(m_nodeNum);
+        virtual void forward(Tensor4<float> &Y, const Tensor4<float> &X){
+            Y.resize(X.num(), X.dim, X.dsize);
 
-            Mat M;
-            reshape(M, X);
+            const int N = X.num();
+            const int S = X.step() / m_nodeNum;
+            const int cnt = N * S;
 
-            for (int r = 0; r < M.rows(); r++){
-                Mem1<SP_REAL> bX(M.cols(), &M(r, 0));
+            m_cX.resize(X.size());
+            m_nX.resize(X.size());
 
-                Mem1<SP_REAL> cX, nX;
-                if (m_train == true){
-                    const SP_REAL meanv = mean(bX);
-                    cX = bX - meanv;
+            for (int r = 0; r < m_nodeNum; r++){
+                const float w = static_cast<float>(m_prm.w[r]);
+                const float b = static_cast<float>(m_prm.b[r]);
 
-                    const double var = sqmean(cX);
-                    const double std = sqrt(var + 10e-6);
-                    nX = cX / std;
+                double meanv, std;
+                if (m_train == true){
+                    double sum = 0.0;
+                    for (int n = 0; n < N; n++){
+                        const float *px = X.ptr(n) + r * S;
+                        for (int s = 0; s < S; s++){
+                            sum += px[s];
+                        }
+                    }
+                    meanv = sum / cnt;
 
-                    m_cX[r] = cX;
-                    m_nX[r] = nX;
+                    double sqsum = 0.0;
+                    for (int n = 0; n < N; n++){
+                        const float *px = X.ptr(n) + r * S;
+                        for (int s = 0; s < S; s++){
+                            sqsum += (px[s] - meanv) * (px[s] - meanv);
+                        }
+                    }
+                    const double var = sqsum / cnt;
+                    std = sqrt(var + 10e-6);
 
                     m_std[r] = std;
 
@@ -897,100 +923,78 @@ namespace sp{
                     m_var[r] = blend * m_var[r] + (1 - blend) * var;
                 }
                 else{
-                    cX = bX - m_mean[r];
-                    nX = cX / sqrt(m_var[r] + 10e-6);
+                    meanv = m_mean[r];
+                    std = sqrt(m_var[r] + 10e-6);
                 }
 
-                for (int c = 0; c < M.cols(); c++){
-                    M(r, c) = m_prm.w[r] * nX[c] + m_prm.b[r];
+                for (int n = 0; n < N; n++){
+                    const int base = n * X.step() + r * S;
+                    const float *px = X.ptr(n) + r * S;
+                    float *py = Y.ptr(n) + r * S;
+                    for (int s = 0; s < S; s++){
+                        const float cX = static_cast<float>(px[s] - meanv);
+                        const float nX = static_cast<float>(cX / std);
+                        m_cX[base + s] = cX;
+                        m_nX[base + s] = nX;
+                        py[s] = w * nX + b;
+                    }
                 }
             }
-
-            reshape(Y, M);
-
-            for (int n = 0; n < Y.size(); n++){
-                Y[n].resize(X[n].dim, X[n].dsize);
-            }
         }
 
-        virtual void backward(Mem1<Mem<SP_REAL> > &B, const Mem1<Mem<SP_REAL> > &A, const Mem1<Mem<SP_REAL> > &Y, const Mem1<Mem<SP_REAL> > &X){
+        virtual void backward(Tensor4<float> &B, const Tensor4<float> &A, const Tensor4<float> &Y, const Tensor4<float> &X){
 
-            Mat M;
-            reshape(M, A);
+            const int N = X.num();
+            const int S = X.step() / m_nodeNum;
+            const int cnt = N * S;
 
-            NodeParam m_grd;
             m_grd.resize(m_nodeNum, 1);
             m_grd.zero();
 
-            for (int r = 0; r < M.rows(); r++){
-                Mem1<SP_REAL> bA(M.cols(), &M(r, 0));
-
-                for (int c = 0; c < M.cols(); c++){
-                    m_grd.w[r] += m_nX[r][c] * bA[c];
-                    m_grd.b[r] += bA[c];
-                }
-
-                Mem1<SP_REAL> dnX(M.cols());
-                Mem1<SP_REAL> dcX(M.cols());
-                for (int c = 0; c < M.cols(); c++){
-                    dnX[c] = m_prm.w[r] * bA[c];
-                    dcX[c] = dnX[c] / m_std[r];
-                }
-
-                Mem1<SP_REAL> tmp(M.cols());
-                for (int c = 0; c < M.cols(); c++){
-                    tmp[c] = dnX[c] * m_cX[r][c] / (m_std[r] * m_std[r]);
+            for (int r = 0; r < m_nodeNum; r++){
+                const double w = m_prm.w[r];
+                const double std = m_std[r];
+
+                double gw = 0.0, gb = 0.0, tmp = 0.0;
+                for (int n = 0; n < N; n++){
+                    const int base = n * X.step() + r * S;
+                    const float *pa = A.ptr(n) + r * S;
+                    for (int s = 0; s < S; s++){
+                        gw += m_nX[base + s] * pa[s];
+                        gb += pa[s];
+                        tmp += w * pa[s] * m_cX[base + s] / (std * std);
+                    }
                 }
-                const SP_REAL dstd = -sum(tmp);
-                const SP_REAL dvar = 0.5 * dstd / m_std[r];
-
-                for (int c = 0; c < M.cols(); c++){
-                    dcX[c] += (2.0 / M.cols()) * m_cX[r][c] * dvar;
+                m_grd.w[r] = gw;
+                m_grd.b[r] = gb;
+
+                const double dstd = -tmp;
+                const double dvar = 0.5 * dstd / std;
+
+                // dcX = dnX / std + (2 / cnt) * cX * dvar
+                double dmean = 0.0;
+                for (int n = 0; n < N; n++){
+                    const int base = n * X.step() + r * S;
+                    const float *pa = A.ptr(n) + r * S;
+                    float *pb = B.ptr(n) + r * S;
+                    for (int s = 0; s < S; s++){
+                        const double dcX = w * pa[s] / std + (2.0 / cnt) * m_cX[base + s] * dvar;
+                        pb[s] = static_cast<float>(dcX);
+                        dmean += dcX;
+                    }
                 }
-                const SP_REAL dmean = sum(dcX);
 
-                for (int c = 0; c < M.cols(); c++){
-                    M(r, c) = dcX[c] - dmean / M.cols();
+                const float dm = static_cast<float>(dmean / cnt);
+                for (int n = 0; n < N; n++){
+                    float *pb = B.ptr(n) + r * S;
+                    for (int s = 0; s < S; s++){
+                        pb[s] -= dm;
+                    }
                 }
             }
 
             // update
             update(m_grd);
-
-            reshape(B, M);
-        }
-
-    private:
-
-        void reshape(Mat &M, const Mem1<Mem<SP_REAL> > &D){
-            const int batchNum = D.size();
-            const int dataNum = D[0].size();
-
-            M.resize(m_nodeNum, batchNum * dataNum / m_nodeNum);
-
-            SP_REAL *m = M.ptr;
-            for (int i = 0; i < dataNum; i++){
-                for (int n = 0; n < batchNum; n++){
-                    *m++ = D[n][i];
-                }
-            }
-        }
-
-        void reshape(Mem1<Mem<SP_REAL> > &R, const Mat &M){
-            const int batchNum = R.size();
-            const int dataNum = M.cols() * m_nodeNum / batchNum;
-            
-            for (int n = 0; n < batchNum; n++){
-                const int dsize[1] = { dataNum };
-                R[n].resize(1, dsize);
-            }
-
-            SP_REAL *m = M.ptr;
-            for (int i = 0; i < dataNum; i++){
-                for (int n = 0; n < batchNum; n++){
-                    R[n][i] = *m++;
-                }
-            }
         }
 
     };
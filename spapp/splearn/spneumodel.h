@@ -20,6 +20,12 @@ namespace sp{
     private:
         Mem1<BaseLayer*> m_order;
 
+        // input / truth buffer (reused across iterations)
+        Tensor4<float> m_src, m_truth;
+
+        // result as Mem (getResult)
+        Mem1<Mem<SP_REAL> > m_result;
+
     public:
 
         NetworkModel(){
@@ -37,35 +43,55 @@ namespace sp{
         }
 
         void addLayer(BaseLayer *layer){
+            layer->m_seed = m_order.size();
             m_order.push(layer);
         }
 
-        const Mem1<Mem<SP_REAL> >& getResult(){
+        const Tensor4<float>& getOutput(){
             return m_order[m_order.size() - 1]->getResult(true);
         }
 
+        const Mem1<Mem<SP_REAL> >& getResult(){
+            cnvTensor(m_result, getOutput());
+            return m_result;
+        }
+
 
         //--------------------------------------------------------------------------------
         // train
         //--------------------------------------------------------------------------------
 
-        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<Mem<SP_REAL> > &truth){
+        void train(const Tensor4<float> &src, const Tensor4<float> &truth){
 
             forward(src, true);
 
             backward(truth);
         }
 
-        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<int> &truth){
+        void train(const Tensor4<float> &src, const Mem1<int> &truth){
             forward(src, true);
-            const int labelNum = getResult()[0].size();
+            const int labelNum = getOutput().step();
 
-            Mem1<Mem<SP_REAL> > oh(truth.size());
-            for (int i = 0; i < oh.size(); i++){
-                oh[i] = oneHot<SP_REAL>(truth[i], labelNum);
+            m_truth.resize(truth.size(), 1, &labelNum);
+            m_truth.zero();
+            for (int n = 0; n < truth.size(); n++){
+                m_truth.ptr(n)[truth[n]] = 1.0f;
             }
 
-            backward(oh);
+            backward(m_truth);
+        }
+
+        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<Mem<SP_REAL> > &truth){
+            cnvTensor(m_src, src);
+            cnvTensor(m_truth, truth);
+
+            train(m_src, m_truth);
+        }
+
+        void train(const Mem1<Mem<SP_REAL> > &src, const Mem1<int> &truth){
+            cnvTensor(m_src, src);
+
+            train(m_src, truth);
         }
 
 
@@ -73,14 +99,19 @@ namespace sp{
         // forward
         //--------------------------------------------------------------------------------
 
-        void forward(const Mem1<Mem<SP_REAL> > &mem, bool train = false){
-            const Mem1<Mem<SP_REAL> > *prop = &mem;
+        void forward(const Tensor4<float> &src, bool train = false){
+            const Tensor4<float> *prop = &src;
             for (int i = 0; i < m_order.size(); i++){
                 m_order[i]->m_train = train;
                 prop = m_order[i]->execute(prop, true);
             }
         }
 
+        void forward(const Mem1<Mem<SP_REAL> > &mem, bool train = false){
+            cnvTensor(m_src, mem);
+            forward(m_src, train);
+        }
+
         void forward(const Mem<SP_REAL>  &mem, bool train = false){
             forward(Mem1<Mem<SP_REAL> >(1, &mem), train);
         }
@@ -91,21 +122,23 @@ namespace sp{
         // backward
         //--------------------------------------------------------------------------------
 
-        void backward(const Mem1<Mem<SP_REAL> > &mem){
+        void backward(const Tensor4<float> &truth){
 
-            const Mem1<Mem<SP_REAL> > *prop = &mem;
+            const Tensor4<float> *prop = &truth;
             for (int i = m_order.size() - 1; i >= 0; i--){
                 prop = m_order[i]->execute(prop, false);
             }
         }
 
+        void backward(const Mem1<Mem<SP_REAL> > &mem){
+            cnvTensor(m_truth, mem);
+            backward(m_truth);
+        }
+
         void backward(const Mem<SP_REAL>  &mem, bool train = false){
             backward(Mem1<Mem<SP_REAL> >(1, &mem));
         }
 
-
-    public:
-
         //--------------------------------------------------------------------------------
         // save / load
         //--------------------------------------------------------------------------------
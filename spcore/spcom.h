@@ -297,6 +297,19 @@ namespace sp{
     };
 
 
+    //--------------------------------------------------------------------------------
+    // random stream
+    //--------------------------------------------------------------------------------
+
+    struct RandStream {
+        // stream key
+        unsigned long long key;
+
+        // next counter
+        unsigned long long ctr;
+    };
+
+
     //--------------------------------------------------------------------------------
     // byte order
     //--------------------------------------------------------------------------------
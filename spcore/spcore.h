@@ -12,8 +12,10 @@
 #include "spcore/spgen/spbase.h"
 #include "spcore/spgen/sptype.h"
 #include "spcore/spgen/spmath.h"
+#include "spcore/spgen/spmatn.h"
 
 // cpu
+#include "spcore/spcpu/spalloc.h"
 #include "spcore/spcpu/spmem.h"
 #include "spcore/spcpu/spmop.h"
 #include "spcore/spcpu/spsolve.h"
@@ -24,6 +26,8 @@
 #include "spcore/spcpu/spstring.h"
 #include "spcore/spcpu/spsystem.h"
 #include "spcore/spcpu/spthread.h"
+#include "spcore/spcpu/spsimd.h"
+#include "spcore/spcpu/spfft.h"
 #include "spcore/spcpu/spdebug.h"
 
 
@@ -0,0 +1,469 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_ALLOC_H__
+#define __SP_ALLOC_H__
+
+#include "spcore/spcom.h"
+#include "spcore/spgen/spbase.h"
+
+#include <stdlib.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+
+//--------------------------------------------------------------------------------
+// memory allocator for Mem
+//--------------------------------------------------------------------------------
+//
+// every block is 64 byte aligned and has a 64 byte header which records its source,
+// so a block can be freed from any thread, inside or outside of a frame.
+//
+// - heap  : aligned malloc (replaceable by setMemAllocator)
+// - pool  : size-class free lists for long-lived buffers (setMemPool)
+// - arena : per-thread bump allocator used inside a MemFrame scope.
+//           the arena is rewound in bulk at the end of the outermost frame.
+//           a chunk that still has live blocks (data that escaped from the frame) is
+//           kept until the blocks are freed, so escaped data stays valid.
+//
+
+// memory alignment
+#define SP_MEMALIGN 64
+
+namespace sp {
+
+    // allocation counters
+    struct MemStat {
+        // Mem allocations / frees
+        long long alloc, free;
+
+        // heap calls (malloc / free)
+        long long halloc, hfree;
+
+        // allocations served by pool / arena
+        long long pool, arena;
+    };
+
+    namespace _alloc {
+
+        enum Kind {
+            KIND_HEAP = 0,
+            KIND_POOL = 1,
+            KIND_ARENA = 2
+        };
+
+        typedef void* (*AllocFunc)(size_t);
+        typedef void (*FreeFunc)(void*);
+
+        // block header (placed just before the block)
+        struct Header {
+            void *base;
+            size_t bytes;
+            void *owner;
+            Header *next;
+            FreeFunc hfree;
+            int kind;
+        };
+
+        struct Counter {
+            std::atomic<long long> alloc, free, halloc, hfree, pool, arena;
+        };
+
+        SP_CPUFUNC Counter& counter() {
+            static Counter *cnt = new Counter();
+            return *cnt;
+        }
+
+        SP_CPUFUNC AllocFunc& heapAllocFunc() {
+            static AllocFunc func = ::malloc;
+            return func;
+        }
+
+        SP_CPUFUNC FreeFunc& heapFreeFunc() {
+            static FreeFunc func = ::free;
+            return func;
+        }
+
+        SP_CPUFUNC size_t alignSize(const size_t bytes) {
+            return (bytes + SP_MEMALIGN - 1) & ~static_cast<size_t>(SP_MEMALIGN - 1);
+        }
+
+        SP_CPUFUNC Header* getHeader(void *ptr) {
+            return reinterpret_cast<Header*>(static_cast<char*>(ptr) - SP_MEMALIGN);
+        }
+
+        // aligned heap block (return: header)
+        SP_CPUFUNC Header* heapAlloc(const size_t bytes, const int kind, void *owner) {
+            const FreeFunc hfree = heapFreeFunc();
+
+            void *base = heapAllocFunc()(bytes + 2 * SP_MEMALIGN);
+            if (base == NULL) throw std::bad_alloc();
+
+            counter().halloc++;
+
+            // aligned block address - header size
+            const size_t addr = alignSize(reinterpret_cast<size_t>(base) + SP_MEMALIGN);
+            Header *header = reinterpret_cast<Header*>(addr - SP_MEMALIGN);
+
+            header->base = base;
+            header->bytes = bytes;
+            header->owner = owner;
+            header->next = NULL;
+            header->hfree = hfree;
+            header->kind = kind;
+            return header;
+        }
+
+        SP_CPUFUNC void heapFree(Header *header) {
+            counter().hfree++;
+            header->hfree(header->base);
+        }
+
+        SP_CPUFUNC void* getPtr(Header *header) {
+            return reinterpret_cast<char*>(header) + SP_MEMALIGN;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // size-class pool
+        //--------------------------------------------------------------------------------
+
+        class Pool {
+        public:
+            // 64 byte .. 128 MB (power of 2)
+            static const int CLASS_MIN = 6;
+            static const int CLASS_MAX = 27;
+
+        private:
+            std::mutex m_mtx;
+
+            Header *m_lists[CLASS_MAX + 1];
+
+            // cached bytes
+            size_t m_cache;
+            size_t m_maxCache;
+
+        public:
+            std::atomic<bool> enable;
+
+            Pool() {
+                for (int i = 0; i <= CLASS_MAX; i++) {
+                    m_lists[i] = NULL;
+                }
+                m_cache = 0;
+                m_maxCache = static_cast<size_t>(256) << 20;
+                enable = false;
+            }
+
+            static int getClass(const size_t bytes) {
+                int c = CLASS_MIN;
+                while ((static_cast<size_t>(1) << c) < bytes) c++;
+                return c;
+            }
+
+            void setMaxCache(const size_t maxCache) {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_maxCache = maxCache;
+                trim();
+            }
+
+            // return: NULL (out of size class)
+            Header* alloc(const size_t bytes) {
+                const int c = getClass(bytes);
+                if (c > CLASS_MAX) return NULL;
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    Header *header = m_lists[c];
+                    if (header != NULL) {
+                        m_lists[c] = header->next;
+                        m_cache -= header->bytes;
+                        counter().pool++;
+                        return header;
+                    }
+                }
+                return heapAlloc(static_cast<size_t>(1) << c, KIND_POOL, this);
+            }
+
+            void free(Header *header) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    if (m_cache + header->bytes <= m_maxCache) {
+                        const int c = getClass(header->bytes);
+                        header->next = m_lists[c];
+                        m_lists[c] = header;
+                        m_cache += header->bytes;
+                        return;
+                    }
+                }
+                heapFree(header);
+            }
+
+            // release cached blocks
+            void trim() {
+                for (int c = 0; c <= CLASS_MAX; c++) {
+                    while (m_lists[c] != NULL && (m_cache > m_maxCache || m_maxCache == 0)) {
+                        Header *header = m_lists[c];
+                        m_lists[c] = header->next;
+                        m_cache -= header->bytes;
+                        heapFree(header);
+                    }
+                }
+            }
+        };
+
+        SP_CPUFUNC Pool& pool() {
+            // not destroyed (blocks may be freed by static objects after exit)
+            static Pool *pool = new Pool();
+            return *pool;
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // frame arena
+        //--------------------------------------------------------------------------------
+
+        struct Chunk {
+            // live blocks + 1 (arena)
+            std::atomic<int> ref;
+
+            Header *header;
+            char *data;
+            size_t size;
+            size_t used;
+
+            Chunk *next;
+        };
+
+        SP_CPUFUNC void releaseChunk(Chunk *chunk) {
+            if (--chunk->ref == 0) {
+                heapFree(chunk->header);
+                delete chunk;
+            }
+        }
+
+        class Arena {
+        public:
+            // default chunk size
+            static const size_t CHUNK_SIZE = static_cast<size_t>(8) << 20;
+
+            // larger blocks are not allocated in the arena
+            static const size_t MAX_BLOCK = CHUNK_SIZE / 4;
+
+        private:
+            Chunk *m_chunks;
+            Chunk *m_crnt;
+
+        public:
+            // frame depth
+            int depth;
+
+            Arena() {
+                m_chunks = NULL;
+                m_crnt = NULL;
+                depth = 0;
+            }
+
+            ~Arena() {
+                while (m_chunks != NULL) {
+                    Chunk *chunk = m_chunks;
+                    m_chunks = chunk->next;
+                    releaseChunk(chunk);
+                }
+            }
+
+            // return: NULL (not allocated in the arena)
+            Header* alloc(const size_t bytes) {
+                if (bytes > MAX_BLOCK) return NULL;
+
+                const size_t need = SP_MEMALIGN + alignSize(bytes);
+
+                if (m_crnt == NULL || m_crnt->used + need > m_crnt->size) {
+                    m_crnt = NULL;
+                    for (Chunk *chunk = m_chunks; chunk != NULL; chunk = chunk->next) {
+                        if (chunk->ref == 1) chunk->used = 0;
+                        if (chunk->used + need <= chunk->size) {
+                            m_crnt = chunk;
+                            break;
+                        }
+                    }
+                    if (m_crnt == NULL) {
+                        Chunk *chunk = new Chunk();
+                        chunk->ref = 1;
+                        chunk->header = heapAlloc(CHUNK_SIZE, KIND_HEAP, NULL);
+                        chunk->data = static_cast<char*>(getPtr(chunk->header));
+                        chunk->size = CHUNK_SIZE;
+                        chunk->used = 0;
+                        chunk->next = m_chunks;
+                        m_chunks = chunk;
+                        m_crnt = chunk;
+                    }
+                }
+
+                Header *header = reinterpret_cast<Header*>(m_crnt->data + m_crnt->used);
+                m_crnt->used += need;
+                m_crnt->ref++;
+
+                header->base = NULL;
+                header->bytes = bytes;
+                header->owner = m_crnt;
+                header->next = NULL;
+                header->hfree = NULL;
+                header->kind = KIND_ARENA;
+
+                counter().arena++;
+                return header;
+            }
+
+            // rewind chunks without live blocks
+            void reset() {
+                for (Chunk *chunk = m_chunks; chunk != NULL; chunk = chunk->next) {
+                    if (chunk->ref == 1) chunk->used = 0;
+                }
+                m_crnt = NULL;
+            }
+        };
+
+        SP_CPUFUNC Arena& arena() {
+            static thread_local Arena arena;
+            return arena;
+        }
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // allocate / free
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC void* memAlloc(const size_t bytes) {
+        _alloc::counter().alloc++;
+
+        _alloc::Header *header = NULL;
+
+        _alloc::Arena &arena = _alloc::arena();
+        if (arena.depth > 0) {
+            header = arena.alloc(bytes);
+        }
+
+        _alloc::Pool &pool = _alloc::pool();
+        if (header == NULL && pool.enable == true) {
+            header = pool.alloc(bytes);
+        }
+
+        if (header == NULL) {
+            header = _alloc::heapAlloc(bytes, _alloc::KIND_HEAP, NULL);
+        }
+        return _alloc::getPtr(header);
+    }
+
+    SP_CPUFUNC void memFree(void *ptr) {
+        if (ptr == NULL) return;
+
+        _alloc::counter().free++;
+
+        _alloc::Header *header = _alloc::getHeader(ptr);
+        switch (header->kind) {
+        case _alloc::KIND_POOL:
+            static_cast<_alloc::Pool*>(header->owner)->free(header);
+            break;
+        case _alloc::KIND_ARENA:
+            _alloc::releaseChunk(static_cast<_alloc::Chunk*>(header->owner));
+            break;
+        default:
+            _alloc::heapFree(header);
+            break;
+        }
+    }
+
+    // construct / destruct array (same as new TYPE[num] / delete[])
+    template<typename TYPE>
+    SP_CPUFUNC TYPE* memNew(const int num) {
+        TYPE *ptr = static_cast<TYPE*>(memAlloc(num * sizeof(TYPE)));
+        for (int i = 0; i < num; i++) {
+            new (&ptr[i]) TYPE;
+        }
+        return ptr;
+    }
+
+    template<typename TYPE>
+    SP_CPUFUNC void memDelete(TYPE *ptr, const int num) {
+        if (ptr == NULL) return;
+        for (int i = 0; i < num; i++) {
+            ptr[i].~TYPE();
+        }
+        memFree(ptr);
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // setting
+    //--------------------------------------------------------------------------------
+
+    // heap function (used by heap blocks, pool blocks and arena chunks)
+    SP_CPUFUNC void setMemAllocator(void* (*alloc)(size_t), void (*free)(void*)) {
+        _alloc::heapAllocFunc() = (alloc != NULL) ? alloc : ::malloc;
+        _alloc::heapFreeFunc() = (free != NULL) ? free : ::free;
+    }
+
+    // size-class pool (maxCache: max cached bytes)
+    SP_CPUFUNC void setMemPool(const bool enable, const size_t maxCache = static_cast<size_t>(256) << 20) {
+        _alloc::Pool &pool = _alloc::pool();
+        pool.enable = enable;
+        pool.setMaxCache(enable ? maxCache : 0);
+    }
+
+    SP_CPUFUNC MemStat getMemStat() {
+        const _alloc::Counter &cnt = _alloc::counter();
+
+        MemStat stat;
+        stat.alloc = cnt.alloc;
+        stat.free = cnt.free;
+        stat.halloc = cnt.halloc;
+        stat.hfree = cnt.hfree;
+        stat.pool = cnt.pool;
+        stat.arena = cnt.arena;
+        return stat;
+    }
+
+    SP_CPUFUNC MemStat difMemStat(const MemStat &stat0, const MemStat &stat1) {
+        MemStat stat;
+        stat.alloc = stat1.alloc - stat0.alloc;
+        stat.free = stat1.free - stat0.free;
+        stat.halloc = stat1.halloc - stat0.halloc;
+        stat.hfree = stat1.hfree - stat0.hfree;
+        stat.pool = stat1.pool - stat0.pool;
+        stat.arena = stat1.arena - stat0.arena;
+        return stat;
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // frame scope (Mem allocations of this thread use the frame arena)
+    //--------------------------------------------------------------------------------
+
+    class MemFrame {
+        MemStat m_stat;
+
+    public:
+        MemFrame() {
+            m_stat = getMemStat();
+            _alloc::arena().depth++;
+        }
+
+        ~MemFrame() {
+            _alloc::Arena &arena = _alloc::arena();
+            if (--arena.depth == 0) {
+                arena.reset();
+            }
+        }
+
+        // allocation counters in this frame
+        MemStat stat() const {
+            return difMemStat(m_stat, getMemStat());
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,413 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_FFT_H__
+#define __SP_FFT_H__
+
+#include "spcore/spcom.h"
+#include "spcore/spgen/spbase.h"
+#include "spcore/spgen/spmath.h"
+#include "spcore/spcpu/spmem.h"
+#include "spcore/spcpu/spthread.h"
+
+#include <mutex>
+
+//--------------------------------------------------------------------------------
+// fast fourier transform
+//--------------------------------------------------------------------------------
+//
+// - complex : mixed-radix (4, 2, 3, 5, other primes) self-sorting FFT, any length
+// - real    : n / 2 + 1 half spectrum (even n : packed into a n / 2 complex FFT)
+// - 2d      : row FFT, blocked transpose, row FFT
+//
+// a plan (factors and twiddle table) is made once per length and cached.
+// forward : X[k] = sum x[j] e^(-2 pi i j k / n), inverse is normalized by 1 / n.
+//
+
+namespace sp {
+
+    namespace _fft {
+
+        class Plan {
+        public:
+            int n;
+
+            // radix of each stage
+            Mem1<int> radix;
+
+            // twiddle e^(-2 pi i k / n), k = 0 .. n - 1
+            Mem1<Cmp> tw;
+
+            Plan(const int n) {
+                this->n = n;
+
+                int m = n;
+                while (m % 4 == 0) { radix.push(4); m /= 4; }
+                while (m % 2 == 0) { radix.push(2); m /= 2; }
+                for (int p = 3; p * p <= m; p += 2) {
+                    while (m % p == 0) { radix.push(p); m /= p; }
+                }
+                if (m > 1) radix.push(m);
+
+                tw.resize(n);
+                for (int k = 0; k < n; k++) {
+                    const double a = -2.0 * SP_PI * k / n;
+                    tw[k] = getCmp(::cos(a), ::sin(a));
+                }
+            }
+        };
+
+        class PlanCache {
+            std::mutex m_mtx;
+            Mem1<Plan*> m_plans;
+
+        public:
+            ~PlanCache() {
+                for (int i = 0; i < m_plans.size(); i++) {
+                    delete m_plans[i];
+                }
+            }
+
+            const Plan& get(const int n) {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                for (int i = 0; i < m_plans.size(); i++) {
+                    if (m_plans[i]->n == n) return *m_plans[i];
+                }
+                m_plans.push(new Plan(n));
+                return *m_plans[m_plans.size() - 1];
+            }
+        };
+
+        SP_CPUFUNC const Plan& getPlan(const int n) {
+            static PlanCache cache;
+            return cache.get(n);
+        }
+
+        SP_CPUFUNC Cmp conj(const Cmp &a) {
+            return getCmp(a.re, -a.im);
+        }
+
+        // a * (-i) (forward) / a * (+i) (inverse)
+        template<bool INV>
+        SP_CPUFUNC Cmp rot(const Cmp &a) {
+            return (INV == false) ? getCmp(a.im, -a.re) : getCmp(-a.im, a.re);
+        }
+
+        template<bool INV>
+        SP_CPUFUNC Cmp twiddle(const Plan &plan, const int k) {
+            return (INV == false) ? plan.tw[k] : conj(plan.tw[k]);
+        }
+
+        // one stage (radix p, l1 : product of the former radix, ido : n / (l1 * p))
+        // cc(i, q, k) = cc[i + ido * (q + p * k)] -> ch(i, k, j) = ch[i + ido * (k + l1 * j)]
+        template<bool INV>
+        SP_CPUFUNC void pass(Cmp *ch, const Cmp *cc, const int p, const int l1, const int ido, const Plan &plan, Cmp *t) {
+            const int n = plan.n;
+            const int cs = ido;
+            const int os = ido * l1;
+
+            const double s3 = (INV == false) ? -::sqrt(0.75) : +::sqrt(0.75);
+            const double c51 = ::cos(2.0 * SP_PI / 5.0), c52 = ::cos(4.0 * SP_PI / 5.0);
+            const double s51 = ::sin(2.0 * SP_PI / 5.0), s52 = ::sin(4.0 * SP_PI / 5.0);
+
+            for (int k = 0; k < l1; k++) {
+                for (int i = 0; i < ido; i++) {
+                    const Cmp *c = cc + i + ido * p * k;
+                    Cmp *o = ch + i + ido * k;
+
+                    switch (p) {
+                    case 2:
+                    {
+                        t[0] = c[0] + c[cs];
+                        t[1] = c[0] - c[cs];
+                        break;
+                    }
+                    case 3:
+                    {
+                        const Cmp s = c[cs] + c[2 * cs];
+                        const Cmp d = c[cs] - c[2 * cs];
+                        const Cmp m = c[0] - s * 0.5;
+                        const Cmp r = getCmp(-d.im * s3, d.re * s3);
+                        t[0] = c[0] + s;
+                        t[1] = m + r;
+                        t[2] = m - r;
+                        break;
+                    }
+                    case 4:
+                    {
+                        const Cmp t0 = c[0] + c[2 * cs];
+                        const Cmp t1 = c[0] - c[2 * cs];
+                        const Cmp t2 = c[cs] + c[3 * cs];
+                        const Cmp t3 = rot<INV>(c[cs] - c[3 * cs]);
+                        t[0] = t0 + t2;
+                        t[1] = t1 + t3;
+                        t[2] = t0 - t2;
+                        t[3] = t1 - t3;
+                        break;
+                    }
+                    case 5:
+                    {
+                        const Cmp s14 = c[cs] + c[4 * cs];
+                        const Cmp d14 = c[cs] - c[4 * cs];
+                        const Cmp s23 = c[2 * cs] + c[3 * cs];
+                        const Cmp d23 = c[2 * cs] - c[3 * cs];
+
+                        const Cmp m1 = c[0] + s14 * c51 + s23 * c52;
+                        const Cmp m2 = c[0] + s14 * c52 + s23 * c51;
+                        const Cmp r1 = rot<INV>(d14 * s51 + d23 * s52);
+                        const Cmp r2 = rot<INV>(d14 * s52 - d23 * s51);
+
+                        t[0] = c[0] + s14 + s23;
+                        t[1] = m1 + r1;
+                        t[4] = m1 - r1;
+                        t[2] = m2 + r2;
+                        t[3] = m2 - r2;
+                        break;
+                    }
+                    default:
+                    {
+                        // generic radix (O(p^2))
+                        const int step = n / p;
+                        for (int j = 0; j < p; j++) {
+                            Cmp sum = c[0];
+                            for (int q = 1; q < p; q++) {
+                                sum += c[q * cs] * twiddle<INV>(plan, ((q * j) % p) * step);
+                            }
+                            t[j] = sum;
+                        }
+                        break;
+                    }
+                    }
+
+                    o[0] = t[0];
+                    for (int j = 1; j < p; j++) {
+                        o[j * os] = (i == 0) ? t[j] : t[j] * twiddle<INV>(plan, i * j * l1);
+                    }
+                }
+            }
+        }
+
+        // dst != src, buf : n (unnormalized)
+        template<bool INV>
+        SP_CPUFUNC void fft(Cmp *dst, const Cmp *src, Cmp *buf, const Plan &plan) {
+            const int n = plan.n;
+            const int snum = plan.radix.size();
+
+            if (snum == 0) {
+                for (int i = 0; i < n; i++) dst[i] = src[i];
+                return;
+            }
+
+            int maxp = 0;
+            for (int s = 0; s < snum; s++) maxp = max(maxp, plan.radix[s]);
+            Mem1<Cmp> t(maxp);
+
+            const Cmp *in = src;
+            Cmp *out = (snum % 2 == 1) ? dst : buf;
+
+            int l1 = 1;
+            for (int s = 0; s < snum; s++) {
+                const int p = plan.radix[s];
+                const int ido = n / (l1 * p);
+
+                pass<INV>(out, in, p, l1, ido, plan, t.ptr);
+
+                in = out;
+                out = (out == dst) ? buf : dst;
+                l1 *= p;
+            }
+        }
+
+        // real -> half spectrum (n / 2 + 1), buf : 3 * n
+        SP_CPUFUNC void rfft(Cmp *dst, const SP_REAL *src, const int n, Cmp *buf) {
+            Cmp *buf0 = buf;
+            Cmp *buf1 = buf + n;
+            Cmp *buf2 = buf + 2 * n;
+
+            if (n % 2 == 1) {
+                const Plan &plan = getPlan(n);
+                for (int i = 0; i < n; i++) buf0[i] = getCmp(src[i], 0.0);
+                fft<false>(buf1, buf0, buf2, plan);
+                for (int k = 0; k <= n / 2; k++) dst[k] = buf1[k];
+                return;
+            }
+
+            // z[j] = x[2j] + i x[2j + 1]
+            const int m = n / 2;
+            const Plan &plan = getPlan(m);
+            const Plan &full = getPlan(n);
+
+            for (int j = 0; j < m; j++) buf0[j] = getCmp(src[2 * j], src[2 * j + 1]);
+            fft<false>(buf1, buf0, buf2, plan);
+
+            for (int k = 0; k <= m; k++) {
+                const Cmp zk = buf1[k % m];
+                const Cmp zc = conj(buf1[(m - k) % m]);
+                const Cmp e = (zk + zc) * 0.5;
+                const Cmp o = rot<false>(zk - zc) * 0.5;
+                dst[k] = e + full.tw[k] * o;
+            }
+        }
+
+        // half spectrum (n / 2 + 1) -> real (normalized), buf : 3 * n
+        SP_CPUFUNC void irfft(SP_REAL *dst, const Cmp *src, const int n, Cmp *buf) {
+            Cmp *buf0 = buf;
+            Cmp *buf1 = buf + n;
+            Cmp *buf2 = buf + 2 * n;
+
+            if (n % 2 == 1) {
+                const Plan &plan = getPlan(n);
+                for (int k = 0; k < n; k++) buf0[k] = (k <= n / 2) ? src[k] : conj(src[n - k]);
+                fft<true>(buf1, buf0, buf2, plan);
+                for (int i = 0; i < n; i++) dst[i] = buf1[i].re / n;
+                return;
+            }
+
+            const int m = n / 2;
+            const Plan &plan = getPlan(m);
+            const Plan &full = getPlan(n);
+
+            for (int k = 0; k < m; k++) {
+                const Cmp xk = src[k];
+                const Cmp xc = conj(src[m - k]);
+                const Cmp e = (xk + xc) * 0.5;
+                const Cmp o = ((xk - xc) * 0.5) * conj(full.tw[k]);
+                buf0[k] = e + rot<true>(o);
+            }
+            fft<true>(buf1, buf0, buf2, plan);
+
+            for (int j = 0; j < m; j++) {
+                dst[2 * j + 0] = buf1[j].re / m;
+                dst[2 * j + 1] = buf1[j].im / m;
+            }
+        }
+
+        // dst (w x h) = src (h x w)^T
+        template<typename TYPE>
+        SP_CPUFUNC void trnBlock(TYPE *dst, const TYPE *src, const int w, const int h) {
+            const int B = 32;
+            for (int y0 = 0; y0 < h; y0 += B) {
+                for (int x0 = 0; x0 < w; x0 += B) {
+                    const int ye = min(y0 + B, h);
+                    const int xe = min(x0 + B, w);
+                    for (int y = y0; y < ye; y++) {
+                        for (int x = x0; x < xe; x++) {
+                            dst[x * h + y] = src[y * w + x];
+                        }
+                    }
+                }
+            }
+        }
+
+        // row transform of h rows (length n)
+        template<bool INV>
+        SP_CPUFUNC void fftRows(Cmp *dst, const Cmp *src, const int n, const int h) {
+            const Plan &plan = getPlan(n);
+            const int BLK = 8;
+
+            parallel_for(0, (h + BLK - 1) / BLK, [&](const int b) {
+                Mem1<Cmp> buf(n);
+                for (int y = b * BLK; y < min((b + 1) * BLK, h); y++) {
+                    fft<INV>(&dst[y * n], &src[y * n], buf.ptr, plan);
+                }
+            }, 1);
+        }
+    }
+
+    //--------------------------------------------------------------------------------
+    // 1d
+    //--------------------------------------------------------------------------------
+
+    SP_CPUFUNC void fft(Mem1<Cmp> &dst, const Mem1<Cmp> &src) {
+        const int n = src.size();
+        Mem1<Cmp> buf(n);
+        dst.resize(n);
+        _fft::fft<false>(dst.ptr, src.ptr, buf.ptr, _fft::getPlan(n));
+    }
+
+    SP_CPUFUNC void ifft(Mem1<Cmp> &dst, const Mem1<Cmp> &src) {
+        const int n = src.size();
+        Mem1<Cmp> buf(n);
+        dst.resize(n);
+        _fft::fft<true>(dst.ptr, src.ptr, buf.ptr, _fft::getPlan(n));
+        for (int i = 0; i < n; i++) {
+            dst[i] /= n;
+        }
+    }
+
+    // dst : n / 2 + 1
+    SP_CPUFUNC void rfft(Mem1<Cmp> &dst, const Mem1<SP_REAL> &src) {
+        const int n = src.size();
+        Mem1<Cmp> buf(3 * n);
+        dst.resize(n / 2 + 1);
+        _fft::rfft(dst.ptr, src.ptr, n, buf.ptr);
+    }
+
+    // src : n / 2 + 1
+    SP_CPUFUNC void irfft(Mem1<SP_REAL> &dst, const Mem1<Cmp> &src, const int n) {
+        SP_ASSERT(src.size() == n / 2 + 1);
+        Mem1<Cmp> buf(3 * n);
+        dst.resize(n);
+        _fft::irfft(dst.ptr, src.ptr, n, buf.ptr);
+    }
+
+    //--------------------------------------------------------------------------------
+    // 2d
+    //--------------------------------------------------------------------------------
+
+    // dst : (w / 2 + 1) x h
+    SP_CPUFUNC void rfft2(Mem2<Cmp> &dst, const Mem2<SP_REAL> &src) {
+        const int w = src.dsize[0];
+        const int h = src.dsize[1];
+        const int hw = w / 2 + 1;
+
+        Mem1<Cmp> rows(hw * h);
+        {
+            const int BLK = 8;
+            parallel_for(0, (h + BLK - 1) / BLK, [&](const int b) {
+                Mem1<Cmp> buf(3 * w);
+                for (int y = b * BLK; y < min((b + 1) * BLK, h); y++) {
+                    _fft::rfft(&rows[y * hw], &src[y * w], w, buf.ptr);
+                }
+            }, 1);
+        }
+
+        Mem1<Cmp> cols(hw * h), tmp(hw * h);
+        _fft::trnBlock(cols.ptr, rows.ptr, hw, h);
+        _fft::fftRows<false>(tmp.ptr, cols.ptr, h, hw);
+
+        dst.resize(hw, h);
+        _fft::trnBlock(dst.ptr, tmp.ptr, h, hw);
+    }
+
+    // src : (w / 2 + 1) x h
+    SP_CPUFUNC void irfft2(Mem2<SP_REAL> &dst, const Mem2<Cmp> &src, const int w) {
+        const int h = src.dsize[1];
+        const int hw = w / 2 + 1;
+        SP_ASSERT(src.dsize[0] == hw);
+
+        Mem1<Cmp> cols(hw * h), tmp(hw * h);
+        _fft::trnBlock(cols.ptr, src.ptr, hw, h);
+        _fft::fftRows<true>(tmp.ptr, cols.ptr, h, hw);
+
+        Mem1<Cmp> rows(hw * h);
+        _fft::trnBlock(rows.ptr, tmp.ptr, h, hw);
+
+        dst.resize(w, h);
+        {
+            const int BLK = 8;
+            parallel_for(0, (h + BLK - 1) / BLK, [&](const int b) {
+                Mem1<Cmp> buf(3 * w);
+                for (int y = b * BLK; y < min((b + 1) * BLK, h); y++) {
+                    _fft::irfft(&dst[y * w], &rows[y * hw], w, buf.ptr);
+                    for (int x = 0; x < w; x++) {
+                        dst[y * w + x] /= h;
+                    }
+                }
+            }, 1);
+        }
+    }
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "spcore/spcom.h"
 #include "spcore/spgen/spbase.h"
+#include "spcore/spcpu/spalloc.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -48,7 +49,7 @@ namespace sp{
         }
 
         void free(){
-            delete[]this->ptr;
+            memDelete(this->ptr, this->msize);
             reset();
         }
 
@@ -58,19 +59,20 @@ namespace sp{
         }
         
         void malloc(const int msize, const void *cpy) {
-            const TYPE *tmp = this->ptr;
+            TYPE *tmp = this->ptr;
+            const int tsize = this->msize;
 
             if (msize > this->msize) {
                 this->msize = msize;
-                this->ptr = new TYPE[msize];
+                this->ptr = memNew<TYPE>(msize);
             }
 
             if (cpy != NULL) {
                 copy(cpy, size());
             }
 
-            if (this->ptr != tmp && (cpy == tmp || cpy == NULL)) {
-                delete[]tmp;
+            if (this->ptr != tmp) {
+                memDelete(tmp, tsize);
             }
         }
 
@@ -707,6 +709,11 @@ namespace sp{
     //--------------------------------------------------------------------------------
     // mem pool 
     //--------------------------------------------------------------------------------
+    //
+    // elements are never moved (pointers are stable until free).
+    // the live table keeps the pointers of live elements, so operator[] is O(1).
+    // index order is the allocation order, and free moves the last element to the freed index.
+    //
 
     template<typename TYPE> class MemP {
 
@@ -716,20 +723,53 @@ namespace sp{
         // pool block size
         int m_block;
 
+        // slot header size / slot size (header: live index)
+        int m_head;
+        int m_step;
+
         // pool block ptr
-        Mem1<TYPE*> m_ptrs;
+        Mem1<Byte*> m_ptrs;
 
-        // reference to next 
-        Mem1<int*> m_refs;
-        
-        // next id
-        int m_next;
+        // used slot num in the last block
+        int m_used;
+
+        // live elements
+        Mem1<TYPE*> m_live;
+
+        // free slots
+        Mem1<TYPE*> m_frees;
+
+    public:
+
+        // iterator over live elements
+        template<typename ETYPE> class Iter {
+            TYPE *const *m_ptr;
+
+        public:
+            Iter(TYPE *const *ptr) : m_ptr(ptr) {
+            }
+
+            ETYPE& operator * () const {
+                return **m_ptr;
+            }
 
-        // crnt size
-        int m_size;
+            ETYPE* operator -> () const {
+                return *m_ptr;
+            }
+
+            Iter& operator ++ () {
+                m_ptr++;
+                return *this;
+            }
 
-        // max size
-        int m_maxs;
+            bool operator == (const Iter &iter) const {
+                return m_ptr == iter.m_ptr;
+            }
+
+            bool operator != (const Iter &iter) const {
+                return m_ptr != iter.m_ptr;
+            }
+        };
 
     public:
 
@@ -742,10 +782,14 @@ namespace sp{
         }
 
         MemP& operator = (const MemP &mem) {
+            if (this == &mem) return *this;
             init(mem.m_unit);
 
             for (int i = 0; i < mem.size(); i++) {
-                *malloc() = mem[i];
+                TYPE *dst = malloc();
+                for (int u = 0; u < m_unit; u++) {
+                    dst[u] = (&mem[i])[u];
+                }
             }
             return *this;
         }
@@ -759,22 +803,24 @@ namespace sp{
 
             m_unit = max(1, unit);
             m_block = 100;
+
+            const int align = static_cast<int>(alignof(TYPE));
+            m_head = ((static_cast<int>(sizeof(int)) + align - 1) / align) * align;
+            m_step = ((m_head + static_cast<int>(sizeof(TYPE)) * m_unit + m_head - 1) / m_head) * m_head;
         }
 
         void clear(){
+            for (int i = 0; i < m_live.size(); i++) {
+                destroy(m_live[i]);
+            }
             for (int i = 0; i < m_ptrs.size(); i++){
-                delete[]m_ptrs[i];
+                memFree(m_ptrs[i]);
             }
             m_ptrs.clear();
+            m_live.clear();
+            m_frees.clear();
 
-            for (int i = 0; i < m_refs.size(); i++){
-                delete[]m_refs[i];
-            }
-            m_refs.clear();
-
-            m_next = 0;
-            m_maxs = 0;
-            m_size = 0;
+            m_used = 0;
         }
 
         //--------------------------------------------------------------------------------
@@ -782,89 +828,87 @@ namespace sp{
         //--------------------------------------------------------------------------------
     
         int size() const {
-            return m_size;
+            return m_live.size();
         }
 
         TYPE& operator[](const int x) {
-            const int crnt = search(x);
-            const int m = crnt / m_block;
-            const int n = crnt % m_block;
-            return m_ptrs[m][n * m_unit];
+            return *m_live[x];
         }
 
         const TYPE& operator[](const int x) const {
-            const int crnt = search(x);
-            const int m = crnt / m_block;
-            const int n = crnt % m_block;
-            return m_ptrs[m][n * m_unit];
+            return *m_live[x];
         }
 
-        TYPE* malloc(){
+        Iter<TYPE> begin() {
+            return Iter<TYPE>(m_live.ptr);
+        }
 
-            if (m_size >= m_ptrs.size() * m_block){
-                m_ptrs.push(new TYPE[m_unit * m_block]);
-                m_refs.push(new int[m_block]);
-                m_next = m_size;
-            }
+        Iter<TYPE> end() {
+            return Iter<TYPE>(m_live.ptr + m_live.size());
+        }
 
-            const int m = m_next / m_block;
-            const int n = m_next % m_block;
+        Iter<const TYPE> begin() const {
+            return Iter<const TYPE>(m_live.ptr);
+        }
 
-            if (m_size >= m_maxs){
-                m_maxs++;
-                m_next++;
+        Iter<const TYPE> end() const {
+            return Iter<const TYPE>(m_live.ptr + m_live.size());
+        }
+
+        TYPE* malloc(){
+            TYPE *ret = NULL;
+
+            if (m_frees.size() > 0) {
+                ret = m_frees[m_frees.size() - 1];
+                m_frees.pop();
             }
-            else{
-                m_next = m_refs[m][n];
+            else {
+                if (m_ptrs.size() == 0 || m_used == m_block) {
+                    m_ptrs.push(static_cast<Byte*>(memAlloc(m_step * m_block)));
+                    m_used = 0;
+                }
+                ret = reinterpret_cast<TYPE*>(m_ptrs[m_ptrs.size() - 1] + m_used * m_step + m_head);
+                m_used++;
             }
-            
-            m_refs[m][n] = -1;
 
-            m_size++;
-
-            TYPE *ret = &m_ptrs[m][n * m_unit];
             for (int i = 0; i < m_unit; i++) {
-                ret[i] = TYPE();
+                new (&ret[i]) TYPE();
             }
+
+            index(ret) = m_live.size();
+            m_live.push(ret);
+
             return ret;
         }
 
+        // ptr: element allocated by this pool
         void free(TYPE *ptr){
-            if (m_size == 0) return;
+            if (ptr == NULL || m_live.size() == 0) return;
 
-            int crnt = -1;
-            for (int i = 0; i < m_ptrs.size(); i++){
-                const TYPE *p = m_ptrs[i];
-                if (ptr >= p && ptr < p + m_unit * m_block){
+            const int x = index(ptr);
+            if (x < 0 || x >= m_live.size() || m_live[x] != ptr) return;
 
-                    crnt = i * m_block + static_cast<int>(ptr - p) / m_unit;
-                    break;
-                }
-            }
-            if (crnt < 0) return;
+            // move the last element to x
+            TYPE *last = m_live[m_live.size() - 1];
+            m_live[x] = last;
+            index(last) = x;
+            m_live.pop();
 
-            const int m = crnt / m_block;
-            const int n = crnt % m_block;
-
-            m_size--;
-
-            m_refs[m][n] = m_next;
-            m_next = crnt;
+            index(ptr) = -1;
+            destroy(ptr);
+            m_frees.push(ptr);
         }
 
     private:
 
-        int search(const int x) const {
-            int id = 0;
+        int& index(TYPE *ptr) const {
+            return *reinterpret_cast<int*>(reinterpret_cast<Byte*>(ptr) - m_head);
+        }
 
-            int cnt = 0;
-            for (int i = 0; i < m_refs.size(); i++) {
-                for (int j = 0; j < m_block; j++, id++) {
-                    if (m_refs[i][j] < 0 && cnt++ == x) goto _exit;
-                }
+        void destroy(TYPE *ptr) {
+            for (int i = 0; i < m_unit; i++) {
+                ptr[i].~TYPE();
             }
-        _exit:;
-            return id;
         }
     };
 
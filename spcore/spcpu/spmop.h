@@ -533,10 +533,10 @@ namespace sp{
     //--------------------------------------------------------------------------------
 
     template<typename VEC>
-    SP_CPUFUNC Mem1<VEC> _matvec(const Mat &mat, const Mem1<VEC> &vecs) {
+    SP_CPUFUNC Mem1<VEC> _matvec(const SP_REAL *mat, const int rows, const int cols, const Mem1<VEC> &vecs) {
         Mem1<VEC> dst(vecs.size());
         for (int i = 0; i < dst.size(); i++) {
-            dst[i] = mat * vecs[i];
+            dst[i] = mulMat(mat, rows, cols, vecs[i]);
         }
         return dst;
     }
@@ -548,19 +548,19 @@ namespace sp{
     SP_CPUFUNC Line3 operator * (const Mat &mat, const Line3 line) { return mulMat(mat.ptr, mat.rows(), mat.cols(), line); }
     SP_CPUFUNC Mesh3 operator * (const Mat &mat, const Mesh3 mesh) { return mulMat(mat.ptr, mat.rows(), mat.cols(), mesh); }
 
-    SP_CPUFUNC Mem1<Vec2> operator * (const Mat &mat, const Mem1<Vec2> &vecs) { return _matvec(mat, vecs); }
-    SP_CPUFUNC Mem1<Vec3> operator * (const Mat &mat, const Mem1<Vec3> &vecs) { return _matvec(mat, vecs); }
-    SP_CPUFUNC Mem1<VecPD2> operator * (const Mat &mat, const Mem1<VecPD2> &vecs) { return _matvec(mat, vecs); }
-    SP_CPUFUNC Mem1<VecPD3> operator * (const Mat &mat, const Mem1<VecPD3> &vecs) { return _matvec(mat, vecs); }
-    SP_CPUFUNC Mem1<Line3> operator * (const Mat &mat, const Mem1<Line3> &lines) { return _matvec(mat, lines); }
-    SP_CPUFUNC Mem1<Mesh3> operator * (const Mat &mat, const Mem1<Mesh3> &meshes) { return _matvec(mat, meshes); }
+    SP_CPUFUNC Mem1<Vec2> operator * (const Mat &mat, const Mem1<Vec2> &vecs) { return _matvec(mat.ptr, mat.rows(), mat.cols(), vecs); }
+    SP_CPUFUNC Mem1<Vec3> operator * (const Mat &mat, const Mem1<Vec3> &vecs) { return _matvec(mat.ptr, mat.rows(), mat.cols(), vecs); }
+    SP_CPUFUNC Mem1<VecPD2> operator * (const Mat &mat, const Mem1<VecPD2> &vecs) { return _matvec(mat.ptr, mat.rows(), mat.cols(), vecs); }
+    SP_CPUFUNC Mem1<VecPD3> operator * (const Mat &mat, const Mem1<VecPD3> &vecs) { return _matvec(mat.ptr, mat.rows(), mat.cols(), vecs); }
+    SP_CPUFUNC Mem1<Line3> operator * (const Mat &mat, const Mem1<Line3> &lines) { return _matvec(mat.ptr, mat.rows(), mat.cols(), lines); }
+    SP_CPUFUNC Mem1<Mesh3> operator * (const Mat &mat, const Mem1<Mesh3> &meshes) { return _matvec(mat.ptr, mat.rows(), mat.cols(), meshes); }
 
-    SP_CPUFUNC Mem1<Vec2> operator * (const Pose &pose, const Mem1<Vec2> &vecs) { return getMat(pose) * vecs; }
-    SP_CPUFUNC Mem1<Vec3> operator * (const Pose &pose, const Mem1<Vec3> &vecs) { return getMat(pose) * vecs; }
-    SP_CPUFUNC Mem1<VecPD2> operator * (const Pose &pose, const Mem1<VecPD2> &vecs) { return getMat(pose) * vecs; }
-    SP_CPUFUNC Mem1<VecPD3> operator * (const Pose &pose, const Mem1<VecPD3> &vecs) { return getMat(pose) * vecs; }
-    SP_CPUFUNC Mem1<Line3> operator * (const Pose &pose, const Mem1<Line3> &lines) { return getMat(pose) * lines; }
-    SP_CPUFUNC Mem1<Mesh3> operator * (const Pose &pose, const Mem1<Mesh3> &meshes) { return getMat(pose) * meshes; }
+    SP_CPUFUNC Mem1<Vec2> operator * (const Pose &pose, const Mem1<Vec2> &vecs) { return _matvec(getMatN(pose).ptr, 3, 4, vecs); }
+    SP_CPUFUNC Mem1<Vec3> operator * (const Pose &pose, const Mem1<Vec3> &vecs) { return _matvec(getMatN(pose).ptr, 3, 4, vecs); }
+    SP_CPUFUNC Mem1<VecPD2> operator * (const Pose &pose, const Mem1<VecPD2> &vecs) { return _matvec(getMatN(pose).ptr, 3, 4, vecs); }
+    SP_CPUFUNC Mem1<VecPD3> operator * (const Pose &pose, const Mem1<VecPD3> &vecs) { return _matvec(getMatN(pose).ptr, 3, 4, vecs); }
+    SP_CPUFUNC Mem1<Line3> operator * (const Pose &pose, const Mem1<Line3> &lines) { return _matvec(getMatN(pose).ptr, 3, 4, lines); }
+    SP_CPUFUNC Mem1<Mesh3> operator * (const Pose &pose, const Mem1<Mesh3> &meshes) { return _matvec(getMatN(pose).ptr, 3, 4, meshes); }
 
 
     //--------------------------------------------------------------------------------
@@ -574,9 +574,9 @@ namespace sp{
             index[i] = i;
         }
 
-        srand(seed);
+        RandStream rs = getRandStream(seed);
         for (int i = 0; i < index.size(); i++) {
-            const int p = rand() % index.size();
+            const int p = rand(rs) % index.size();
             swap(index[i], index[p]);
         }
         return index;
@@ -0,0 +1,1080 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_SIMD_H__
+#define __SP_SIMD_H__
+
+#include "spcore/spcom.h"
+#include "spcore/spgen/spbase.h"
+#include "spcore/spcpu/spalloc.h"
+
+
+//--------------------------------------------------------------------------------
+// simd (x86 sse4.1 / avx2, selected at runtime)
+//--------------------------------------------------------------------------------
+
+#ifndef SP_USE_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SP_USE_SIMD 1
+#else
+#define SP_USE_SIMD 0
+#endif
+#endif
+
+#if SP_USE_SIMD
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SP_TARGET_SSE4
+#define SP_TARGET_AVX2
+#define SP_TARGET_FMA
+#else
+#define SP_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define SP_TARGET_AVX2 __attribute__((target("avx2")))
+#define SP_TARGET_FMA __attribute__((target("avx2,fma")))
+#endif
+
+#endif
+
+namespace sp {
+
+    enum SimdLevel {
+        SimdLevel_None = 0,
+        SimdLevel_SSE4 = 1,
+        SimdLevel_AVX2 = 2
+    };
+
+    SP_CPUFUNC SimdLevel _checkSimdLevel() {
+        SimdLevel level = SimdLevel_None;
+#if SP_USE_SIMD
+#if defined(_MSC_VER)
+        int info[4] = { 0 };
+        __cpuid(info, 0);
+        const int maxId = info[0];
+
+        __cpuid(info, 1);
+        const bool sse4 = (info[2] & (1 << 19)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool ymm = (osxsave == true) && ((_xgetbv(0) & 6) == 6);
+
+        bool avx2 = false;
+        if (maxId >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (sse4 == true) level = SimdLevel_SSE4;
+        if (sse4 == true && avx2 == true && ymm == true) level = SimdLevel_AVX2;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) level = SimdLevel_SSE4;
+        if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("avx2")) level = SimdLevel_AVX2;
+#endif
+#endif
+        return level;
+    }
+
+    SP_CPUFUNC bool _checkFma() {
+        bool fma = false;
+#if SP_USE_SIMD
+#if defined(_MSC_VER)
+        int info[4] = { 0 };
+        __cpuid(info, 1);
+        fma = (info[2] & (1 << 12)) != 0;
+#else
+        __builtin_cpu_init();
+        fma = __builtin_cpu_supports("fma") != 0;
+#endif
+#endif
+        return fma;
+    }
+
+    SP_CPUFUNC SimdLevel& _simdLevel() {
+        static SimdLevel level = _checkSimdLevel();
+        return level;
+    }
+
+    // get current simd level
+    SP_CPUFUNC SimdLevel getSimdLevel() {
+        return _simdLevel();
+    }
+
+    // set simd level (limited to the supported level)
+    SP_CPUFUNC SimdLevel setSimdLevel(const SimdLevel level) {
+        static const SimdLevel maxLevel = _checkSimdLevel();
+        _simdLevel() = (level < maxLevel) ? level : maxLevel;
+        return _simdLevel();
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // byte kernels
+    //--------------------------------------------------------------------------------
+
+    namespace _simd {
+
+        //--------------------------------------------------------------------------------
+        // scalar
+        //--------------------------------------------------------------------------------
+
+        SP_CPUFUNC void invert_c(Byte *dst, const Byte *src, const int num) {
+            for (int i = 0; i < num; i++) {
+                dst[i] = SP_BYTEMAX - src[i];
+            }
+        }
+
+        SP_CPUFUNC void thresh_c(Byte *dst, const Byte *src, const int num, const int thresh, const bool inv) {
+            if (inv == false) {
+                for (int i = 0; i < num; i++) {
+                    dst[i] = (src[i] >= thresh) ? 255 : 0;
+                }
+            }
+            else {
+                for (int i = 0; i < num; i++) {
+                    dst[i] = (src[i] < thresh) ? 255 : 0;
+                }
+            }
+        }
+
+        // region [dsize0 x dsize1] with row step
+        SP_CPUFUNC void minmax_c(Byte &minv, Byte &maxv, const Byte *src, const int step, const int dsize0, const int dsize1) {
+            for (int y = 0; y < dsize1; y++) {
+                const Byte *p = &src[y * step];
+                for (int x = 0; x < dsize0; x++) {
+                    minv = (p[x] < minv) ? p[x] : minv;
+                    maxv = (p[x] > maxv) ? p[x] : maxv;
+                }
+            }
+        }
+
+        SP_CPUFUNC void blend_c(Byte *dst, const Byte *src0, const double r0, const Byte *src1, const double r1, const int num) {
+            for (int i = 0; i < num; i++) {
+                dst[i] = static_cast<Byte>((src0[i] * r0 + src1[i] * r1) / (r0 + r1) + 0.5);
+            }
+        }
+
+        // same as cast<Byte>(Col3)
+        SP_CPUFUNC void cnvGry_c(Byte *dst, const Col3 *src, const int num) {
+            for (int i = 0; i < num; i++) {
+                _cast(dst[i], src[i]);
+            }
+        }
+
+        // u in [ubase, uend), source rows are clamped by the caller
+        SP_CPUFUNC void pyrdown_c(Byte *dst, const Byte *src0, const Byte *src1, const Byte *src2, const int sdsize0, const int ubase, const int uend) {
+            for (int u = ubase; u < uend; u++) {
+                const int su = 2 * u;
+
+                const int su0 = su + ((su == 0) ? 0 : -1);
+                const int su1 = su + 0;
+                const int su2 = su + ((su == sdsize0 - 1) ? 0 : +1);
+
+                const int s = (src0[su0] + 2 * src0[su1] + src0[su2]) + 2 * (src1[su0] + 2 * src1[su1] + src1[su2]) + (src2[su0] + 2 * src2[su1] + src2[su2]);
+                dst[u] = static_cast<Byte>((s + 8) >> 4);
+            }
+        }
+
+        // bilinear row (same operation order as acs2(src, double, double))
+        SP_CPUFUNC void rescale_c(Byte *dst, const Byte *src0, const Byte *src1, const double wy0, const double wy1, const int *x0, const int *x1, const double *wx0, const double *wx1, const int num) {
+            for (int u = 0; u < num; u++) {
+                const double v00 = src0[x0[u]] * wx0[u] * wy0;
+                const double v10 = src0[x1[u]] * wx1[u] * wy0;
+                const double v01 = src1[x0[u]] * wx0[u] * wy1;
+                const double v11 = src1[x1[u]] * wx1[u] * wy1;
+                _cast(dst[u], static_cast<double>(v00 + v10 + v01 + v11));
+            }
+        }
+
+#if SP_USE_SIMD
+
+        //--------------------------------------------------------------------------------
+        // sse4.1
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_SSE4 SP_CPUFUNC void invert_sse4(Byte *dst, const Byte *src, const int num) {
+            const __m128i one = _mm_set1_epi8(-1);
+
+            int i = 0;
+            for (; i + 16 <= num; i += 16) {
+                const __m128i a = _mm_loadu_si128((const __m128i*)&src[i]);
+                _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(a, one));
+            }
+            invert_c(&dst[i], &src[i], num - i);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void thresh_sse4(Byte *dst, const Byte *src, const int num, const int thresh, const bool inv) {
+            if (thresh <= 0 || thresh > SP_BYTEMAX) {
+                thresh_c(dst, src, num, thresh, inv);
+                return;
+            }
+            const __m128i t = _mm_set1_epi8(static_cast<char>(thresh));
+            const __m128i m = _mm_set1_epi8((inv == false) ? 0 : -1);
+
+            int i = 0;
+            for (; i + 16 <= num; i += 16) {
+                const __m128i a = _mm_loadu_si128((const __m128i*)&src[i]);
+                const __m128i b = _mm_cmpeq_epi8(_mm_max_epu8(a, t), a);
+                _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(b, m));
+            }
+            thresh_c(&dst[i], &src[i], num - i, thresh, inv);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void _minmax_sse4(Byte &minv, Byte &maxv, __m128i mn, __m128i mx) {
+            mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+            mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+            mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2));
+            mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1));
+            mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+            mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+            mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+            mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+            minv = min(minv, static_cast<Byte>(_mm_extract_epi8(mn, 0)));
+            maxv = max(maxv, static_cast<Byte>(_mm_extract_epi8(mx, 0)));
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void minmax_sse4(Byte &minv, Byte &maxv, const Byte *src, const int step, const int dsize0, const int dsize1) {
+            const int vnum = dsize0 / 16 * 16;
+            if (vnum > 0) {
+                __m128i mn = _mm_set1_epi8(static_cast<char>(minv));
+                __m128i mx = _mm_set1_epi8(static_cast<char>(maxv));
+                for (int y = 0; y < dsize1; y++) {
+                    const Byte *p = &src[y * step];
+                    for (int x = 0; x < vnum; x += 16) {
+                        const __m128i a = _mm_loadu_si128((const __m128i*)&p[x]);
+                        mn = _mm_min_epu8(mn, a);
+                        mx = _mm_max_epu8(mx, a);
+                    }
+                }
+                _minmax_sse4(minv, maxv, mn, mx);
+            }
+            minmax_c(minv, maxv, &src[vnum], step, dsize0 - vnum, dsize1);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void blend_sse4(Byte *dst, const Byte *src0, const double r0, const Byte *src1, const double r1, const int num) {
+            const __m128d vr0 = _mm_set1_pd(r0);
+            const __m128d vr1 = _mm_set1_pd(r1);
+            const __m128d vrs = _mm_set1_pd(r0 + r1);
+            const __m128d half = _mm_set1_pd(0.5);
+
+            int i = 0;
+            for (; i + 4 <= num; i += 4) {
+                int a, b;
+                memcpy(&a, &src0[i], 4);
+                memcpy(&b, &src1[i], 4);
+                const __m128i a32 = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(a));
+                const __m128i b32 = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(b));
+
+                __m128i d32[2];
+                for (int k = 0; k < 2; k++) {
+                    const __m128d ad = _mm_cvtepi32_pd((k == 0) ? a32 : _mm_srli_si128(a32, 8));
+                    const __m128d bd = _mm_cvtepi32_pd((k == 0) ? b32 : _mm_srli_si128(b32, 8));
+                    const __m128d s = _mm_add_pd(_mm_mul_pd(ad, vr0), _mm_mul_pd(bd, vr1));
+                    d32[k] = _mm_cvttpd_epi32(_mm_add_pd(_mm_div_pd(s, vrs), half));
+                }
+                const __m128i d = _mm_unpacklo_epi64(d32[0], d32[1]);
+                const int c = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(d, d), _mm_setzero_si128()));
+                memcpy(&dst[i], &c, 4);
+            }
+            blend_c(&dst[i], &src0[i], r0, &src1[i], r1, num - i);
+        }
+
+        // x = 299 r + 587 g + 114 b + 500, gray = x / 1000 = ((x >> 3) * 33555) >> 22
+        // the double formula may differ only if x % 1000 == 0, such pixels are recomputed by scalar
+        SP_TARGET_SSE4 SP_CPUFUNC __m128i _gry_sse4(int &fix, const __m128i r, const __m128i g, const __m128i b) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i wrg = _mm_set1_epi32((587 << 16) | 299);
+            const __m128i wb1 = _mm_set1_epi32((500 << 16) | 114);
+            const __m128i one = _mm_set1_epi16(1);
+
+            const __m128i r16[2] = { _mm_unpacklo_epi8(r, zero), _mm_unpackhi_epi8(r, zero) };
+            const __m128i g16[2] = { _mm_unpacklo_epi8(g, zero), _mm_unpackhi_epi8(g, zero) };
+            const __m128i b16[2] = { _mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero) };
+
+            __m128i q16[2], f16[2];
+            for (int k = 0; k < 2; k++) {
+                const __m128i x0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r16[k], g16[k]), wrg), _mm_madd_epi16(_mm_unpacklo_epi16(b16[k], one), wb1));
+                const __m128i x1 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r16[k], g16[k]), wrg), _mm_madd_epi16(_mm_unpackhi_epi16(b16[k], one), wb1));
+
+                const __m128i y = _mm_packs_epi32(_mm_srli_epi32(x0, 3), _mm_srli_epi32(x1, 3));
+                const __m128i l = _mm_packs_epi32(_mm_and_si128(x0, _mm_set1_epi32(7)), _mm_and_si128(x1, _mm_set1_epi32(7)));
+
+                q16[k] = _mm_srli_epi16(_mm_mulhi_epu16(y, _mm_set1_epi16(33555 - 65536)), 6);
+                f16[k] = _mm_and_si128(_mm_cmpeq_epi16(l, zero), _mm_cmpeq_epi16(y, _mm_mullo_epi16(q16[k], _mm_set1_epi16(125))));
+            }
+            fix = _mm_movemask_epi8(_mm_packs_epi16(f16[0], f16[1]));
+            return _mm_packus_epi16(q16[0], q16[1]);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void cnvGry_sse4(Byte *dst, const Col3 *src, const int num) {
+            const Byte *psrc = reinterpret_cast<const Byte*>(src);
+
+            // deinterleave rgb (16 pixels)
+            const __m128i s0r = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            const __m128i s1r = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+            const __m128i s2r = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+            const __m128i s0g = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            const __m128i s1g = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+            const __m128i s2g = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+            const __m128i s0b = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+            const __m128i s1b = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+            const __m128i s2b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+            int i = 0;
+            for (; i + 16 <= num; i += 16) {
+                const __m128i a0 = _mm_loadu_si128((const __m128i*)&psrc[i * 3 + 0]);
+                const __m128i a1 = _mm_loadu_si128((const __m128i*)&psrc[i * 3 + 16]);
+                const __m128i a2 = _mm_loadu_si128((const __m128i*)&psrc[i * 3 + 32]);
+
+                const __m128i r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, s0r), _mm_shuffle_epi8(a1, s1r)), _mm_shuffle_epi8(a2, s2r));
+                const __m128i g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, s0g), _mm_shuffle_epi8(a1, s1g)), _mm_shuffle_epi8(a2, s2g));
+                const __m128i b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, s0b), _mm_shuffle_epi8(a1, s1b)), _mm_shuffle_epi8(a2, s2b));
+
+                int fix = 0;
+                _mm_storeu_si128((__m128i*)&dst[i], _gry_sse4(fix, r, g, b));
+
+                for (int k = 0; fix != 0; k++, fix >>= 1) {
+                    if (fix & 1) _cast(dst[i + k], src[i + k]);
+                }
+            }
+            cnvGry_c(&dst[i], &src[i], num - i);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void pyrdown_sse4(Byte *dst, const Byte *src0, const Byte *src1, const Byte *src2, const int sdsize0, const int ubase, const int uend) {
+            const __m128i mask = _mm_set1_epi16(0x00FF);
+            const __m128i rnd = _mm_set1_epi16(8);
+
+            int u = ubase;
+            if (u == 0 && u < uend) {
+                pyrdown_c(dst, src0, src1, src2, sdsize0, 0, 1);
+                u++;
+            }
+
+            // needs source [2u - 1, 2u + 16)
+            for (; u + 8 <= uend && 2 * u + 16 <= sdsize0; u += 8) {
+                const Byte *s[3] = { src0, src1, src2 };
+                __m128i e[3], o[3], m[3];
+                for (int k = 0; k < 3; k++) {
+                    const __m128i a = _mm_loadu_si128((const __m128i*)&s[k][2 * u]);
+                    const __m128i b = _mm_loadu_si128((const __m128i*)&s[k][2 * u - 1]);
+                    e[k] = _mm_and_si128(a, mask);
+                    o[k] = _mm_srli_epi16(a, 8);
+                    m[k] = _mm_and_si128(b, mask);
+                }
+                const __m128i ce = _mm_add_epi16(_mm_add_epi16(e[0], e[2]), _mm_slli_epi16(e[1], 1));
+                const __m128i co = _mm_add_epi16(_mm_add_epi16(o[0], o[2]), _mm_slli_epi16(o[1], 1));
+                const __m128i cm = _mm_add_epi16(_mm_add_epi16(m[0], m[2]), _mm_slli_epi16(m[1], 1));
+
+                const __m128i sum = _mm_add_epi16(_mm_add_epi16(cm, co), _mm_slli_epi16(ce, 1));
+                const __m128i d = _mm_srli_epi16(_mm_add_epi16(sum, rnd), 4);
+                _mm_storel_epi64((__m128i*)&dst[u], _mm_packus_epi16(d, d));
+            }
+            pyrdown_c(dst, src0, src1, src2, sdsize0, u, uend);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void rescale_sse4(Byte *dst, const Byte *src0, const Byte *src1, const double wy0, const double wy1, const int *x0, const int *x1, const double *wx0, const double *wx1, const int num) {
+            const __m128d vy0 = _mm_set1_pd(wy0);
+            const __m128d vy1 = _mm_set1_pd(wy1);
+            const __m128d half = _mm_set1_pd(0.5);
+
+            int u = 0;
+            for (; u + 2 <= num; u += 2) {
+                const __m128d a00 = _mm_setr_pd(src0[x0[u]], src0[x0[u + 1]]);
+                const __m128d a10 = _mm_setr_pd(src0[x1[u]], src0[x1[u + 1]]);
+                const __m128d a01 = _mm_setr_pd(src1[x0[u]], src1[x0[u + 1]]);
+                const __m128d a11 = _mm_setr_pd(src1[x1[u]], src1[x1[u + 1]]);
+                const __m128d w0 = _mm_loadu_pd(&wx0[u]);
+                const __m128d w1 = _mm_loadu_pd(&wx1[u]);
+
+                const __m128d v00 = _mm_mul_pd(_mm_mul_pd(a00, w0), vy0);
+                const __m128d v10 = _mm_mul_pd(_mm_mul_pd(a10, w1), vy0);
+                const __m128d v01 = _mm_mul_pd(_mm_mul_pd(a01, w0), vy1);
+                const __m128d v11 = _mm_mul_pd(_mm_mul_pd(a11, w1), vy1);
+                const __m128d v = _mm_add_pd(_mm_add_pd(_mm_add_pd(v00, v10), v01), v11);
+
+                const __m128i d = _mm_cvttpd_epi32(_mm_add_pd(_mm_min_pd(v, _mm_set1_pd(SP_BYTEMAX)), half));
+                dst[u + 0] = static_cast<Byte>(_mm_cvtsi128_si32(d));
+                dst[u + 1] = static_cast<Byte>(_mm_extract_epi32(d, 1));
+            }
+            rescale_c(&dst[u], src0, src1, wy0, wy1, &x0[u], &x1[u], &wx0[u], &wx1[u], num - u);
+        }
+
+
+        //--------------------------------------------------------------------------------
+        // avx2
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_AVX2 SP_CPUFUNC void invert_avx2(Byte *dst, const Byte *src, const int num) {
+            const __m256i one = _mm256_set1_epi8(-1);
+
+            int i = 0;
+            for (; i + 32 <= num; i += 32) {
+                const __m256i a = _mm256_loadu_si256((const __m256i*)&src[i]);
+                _mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(a, one));
+            }
+            for (; i + 16 <= num; i += 16) {
+                const __m128i a = _mm_loadu_si128((const __m128i*)&src[i]);
+                _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(a, _mm256_castsi256_si128(one)));
+            }
+            invert_c(&dst[i], &src[i], num - i);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void thresh_avx2(Byte *dst, const Byte *src, const int num, const int thresh, const bool inv) {
+            if (thresh <= 0 || thresh > SP_BYTEMAX) {
+                thresh_c(dst, src, num, thresh, inv);
+                return;
+            }
+            const __m256i t = _mm256_set1_epi8(static_cast<char>(thresh));
+            const __m256i m = _mm256_set1_epi8((inv == false) ? 0 : -1);
+
+            int i = 0;
+            for (; i + 32 <= num; i += 32) {
+                const __m256i a = _mm256_loadu_si256((const __m256i*)&src[i]);
+                const __m256i b = _mm256_cmpeq_epi8(_mm256_max_epu8(a, t), a);
+                _mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(b, m));
+            }
+            for (; i + 16 <= num; i += 16) {
+                const __m128i a = _mm_loadu_si128((const __m128i*)&src[i]);
+                const __m128i b = _mm_cmpeq_epi8(_mm_max_epu8(a, _mm256_castsi256_si128(t)), a);
+                _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(b, _mm256_castsi256_si128(m)));
+            }
+            thresh_c(&dst[i], &src[i], num - i, thresh, inv);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void minmax_avx2(Byte &minv, Byte &maxv, const Byte *src, const int step, const int dsize0, const int dsize1) {
+            const int vnum = dsize0 / 16 * 16;
+            if (vnum > 0) {
+                __m256i mn = _mm256_set1_epi8(static_cast<char>(minv));
+                __m256i mx = _mm256_set1_epi8(static_cast<char>(maxv));
+                for (int y = 0; y < dsize1; y++) {
+                    const Byte *p = &src[y * step];
+                    int x = 0;
+                    for (; x + 32 <= vnum; x += 32) {
+                        const __m256i a = _mm256_loadu_si256((const __m256i*)&p[x]);
+                        mn = _mm256_min_epu8(mn, a);
+                        mx = _mm256_max_epu8(mx, a);
+                    }
+                    if (x < vnum) {
+                        const __m256i a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&p[x]));
+                        mn = _mm256_min_epu8(mn, _mm256_permute2x128_si256(a, a, 0x00));
+                        mx = _mm256_max_epu8(mx, _mm256_permute2x128_si256(a, a, 0x00));
+                    }
+                }
+                __m128i mn1 = _mm_min_epu8(_mm256_castsi256_si128(mn), _mm256_extracti128_si256(mn, 1));
+                __m128i mx1 = _mm_max_epu8(_mm256_castsi256_si128(mx), _mm256_extracti128_si256(mx, 1));
+                mn1 = _mm_min_epu8(mn1, _mm_srli_si128(mn1, 8));
+                mn1 = _mm_min_epu8(mn1, _mm_srli_si128(mn1, 4));
+                mn1 = _mm_min_epu8(mn1, _mm_srli_si128(mn1, 2));
+                mn1 = _mm_min_epu8(mn1, _mm_srli_si128(mn1, 1));
+                mx1 = _mm_max_epu8(mx1, _mm_srli_si128(mx1, 8));
+                mx1 = _mm_max_epu8(mx1, _mm_srli_si128(mx1, 4));
+                mx1 = _mm_max_epu8(mx1, _mm_srli_si128(mx1, 2));
+                mx1 = _mm_max_epu8(mx1, _mm_srli_si128(mx1, 1));
+                minv = min(minv, static_cast<Byte>(_mm_extract_epi8(mn1, 0)));
+                maxv = max(maxv, static_cast<Byte>(_mm_extract_epi8(mx1, 0)));
+            }
+            minmax_c(minv, maxv, &src[vnum], step, dsize0 - vnum, dsize1);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void blend_avx2(Byte *dst, const Byte *src0, const double r0, const Byte *src1, const double r1, const int num) {
+            const __m256d vr0 = _mm256_set1_pd(r0);
+            const __m256d vr1 = _mm256_set1_pd(r1);
+            const __m256d vrs = _mm256_set1_pd(r0 + r1);
+            const __m256d half = _mm256_set1_pd(0.5);
+
+            int i = 0;
+            for (; i + 8 <= num; i += 8) {
+                const __m256i a32 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&src0[i]));
+                const __m256i b32 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&src1[i]));
+
+                __m128i d32[2];
+                for (int k = 0; k < 2; k++) {
+                    const __m256d ad = _mm256_cvtepi32_pd((k == 0) ? _mm256_castsi256_si128(a32) : _mm256_extracti128_si256(a32, 1));
+                    const __m256d bd = _mm256_cvtepi32_pd((k == 0) ? _mm256_castsi256_si128(b32) : _mm256_extracti128_si256(b32, 1));
+                    const __m256d s = _mm256_add_pd(_mm256_mul_pd(ad, vr0), _mm256_mul_pd(bd, vr1));
+                    d32[k] = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_div_pd(s, vrs), half));
+                }
+                const __m128i d16 = _mm_packs_epi32(d32[0], d32[1]);
+                _mm_storel_epi64((__m128i*)&dst[i], _mm_packus_epi16(d16, d16));
+            }
+            blend_c(&dst[i], &src0[i], r0, &src1[i], r1, num - i);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void cnvGry_avx2(Byte *dst, const Col3 *src, const int num) {
+            const Byte *psrc = reinterpret_cast<const Byte*>(src);
+
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i wrg = _mm256_set1_epi32((587 << 16) | 299);
+            const __m256i wb1 = _mm256_set1_epi32((500 << 16) | 114);
+            const __m256i one = _mm256_set1_epi16(1);
+
+            // deinterleave rgb (16 pixels per 128bit lane)
+            const __m256i s0r = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            const __m256i s1r = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1));
+            const __m256i s2r = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13));
+            const __m256i s0g = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            const __m256i s1g = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1));
+            const __m256i s2g = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14));
+            const __m256i s0b = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+            const __m256i s1b = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1));
+            const __m256i s2b = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15));
+
+            int i = 0;
+            for (; i + 32 <= num; i += 32) {
+                const Byte *p = &psrc[i * 3];
+                const __m256i a0 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&p[0])), _mm_loadu_si128((const __m128i*)&p[48]), 1);
+                const __m256i a1 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&p[16])), _mm_loadu_si128((const __m128i*)&p[64]), 1);
+                const __m256i a2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&p[32])), _mm_loadu_si128((const __m128i*)&p[80]), 1);
+
+                const __m256i r = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, s0r), _mm256_shuffle_epi8(a1, s1r)), _mm256_shuffle_epi8(a2, s2r));
+                const __m256i g = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, s0g), _mm256_shuffle_epi8(a1, s1g)), _mm256_shuffle_epi8(a2, s2g));
+                const __m256i b = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, s0b), _mm256_shuffle_epi8(a1, s1b)), _mm256_shuffle_epi8(a2, s2b));
+
+                // same as _gry_sse4 (per 128bit lane)
+                const __m256i r16[2] = { _mm256_unpacklo_epi8(r, zero), _mm256_unpackhi_epi8(r, zero) };
+                const __m256i g16[2] = { _mm256_unpacklo_epi8(g, zero), _mm256_unpackhi_epi8(g, zero) };
+                const __m256i b16[2] = { _mm256_unpacklo_epi8(b, zero), _mm256_unpackhi_epi8(b, zero) };
+
+                __m256i q16[2], f16[2];
+                for (int k = 0; k < 2; k++) {
+                    const __m256i x0 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(r16[k], g16[k]), wrg), _mm256_madd_epi16(_mm256_unpacklo_epi16(b16[k], one), wb1));
+                    const __m256i x1 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(r16[k], g16[k]), wrg), _mm256_madd_epi16(_mm256_unpackhi_epi16(b16[k], one), wb1));
+
+                    const __m256i y = _mm256_packs_epi32(_mm256_srli_epi32(x0, 3), _mm256_srli_epi32(x1, 3));
+                    const __m256i l = _mm256_packs_epi32(_mm256_and_si256(x0, _mm256_set1_epi32(7)), _mm256_and_si256(x1, _mm256_set1_epi32(7)));
+
+                    q16[k] = _mm256_srli_epi16(_mm256_mulhi_epu16(y, _mm256_set1_epi16(33555 - 65536)), 6);
+                    f16[k] = _mm256_and_si256(_mm256_cmpeq_epi16(l, zero), _mm256_cmpeq_epi16(y, _mm256_mullo_epi16(q16[k], _mm256_set1_epi16(125))));
+                }
+                unsigned int fix = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_packs_epi16(f16[0], f16[1])));
+                _mm256_storeu_si256((__m256i*)&dst[i], _mm256_packus_epi16(q16[0], q16[1]));
+
+                for (int k = 0; fix != 0; k++, fix >>= 1) {
+                    if (fix & 1) _cast(dst[i + k], src[i + k]);
+                }
+            }
+            cnvGry_c(&dst[i], &src[i], num - i);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void pyrdown_avx2(Byte *dst, const Byte *src0, const Byte *src1, const Byte *src2, const int sdsize0, const int ubase, const int uend) {
+            const __m256i mask = _mm256_set1_epi16(0x00FF);
+            const __m256i rnd = _mm256_set1_epi16(8);
+
+            int u = ubase;
+            if (u == 0 && u < uend) {
+                pyrdown_c(dst, src0, src1, src2, sdsize0, 0, 1);
+                u++;
+            }
+
+            // needs source [2u - 1, 2u + 32)
+            for (; u + 16 <= uend && 2 * u + 32 <= sdsize0; u += 16) {
+                const Byte *s[3] = { src0, src1, src2 };
+                __m256i e[3], o[3], m[3];
+                for (int k = 0; k < 3; k++) {
+                    const __m256i a = _mm256_loadu_si256((const __m256i*)&s[k][2 * u]);
+                    const __m256i b = _mm256_loadu_si256((const __m256i*)&s[k][2 * u - 1]);
+                    e[k] = _mm256_and_si256(a, mask);
+                    o[k] = _mm256_srli_epi16(a, 8);
+                    m[k] = _mm256_and_si256(b, mask);
+                }
+                const __m256i ce = _mm256_add_epi16(_mm256_add_epi16(e[0], e[2]), _mm256_slli_epi16(e[1], 1));
+                const __m256i co = _mm256_add_epi16(_mm256_add_epi16(o[0], o[2]), _mm256_slli_epi16(o[1], 1));
+                const __m256i cm = _mm256_add_epi16(_mm256_add_epi16(m[0], m[2]), _mm256_slli_epi16(m[1], 1));
+
+                const __m256i sum = _mm256_add_epi16(_mm256_add_epi16(cm, co), _mm256_slli_epi16(ce, 1));
+                const __m256i d = _mm256_srli_epi16(_mm256_add_epi16(sum, rnd), 4);
+                const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(d, d), 0x08);
+                _mm_storeu_si128((__m128i*)&dst[u], _mm256_castsi256_si128(p));
+            }
+            pyrdown_c(dst, src0, src1, src2, sdsize0, u, uend);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void rescale_avx2(Byte *dst, const Byte *src0, const Byte *src1, const double wy0, const double wy1, const int *x0, const int *x1, const double *wx0, const double *wx1, const int num) {
+            const __m256d vy0 = _mm256_set1_pd(wy0);
+            const __m256d vy1 = _mm256_set1_pd(wy1);
+            const __m256d half = _mm256_set1_pd(0.5);
+            const __m256d maxv = _mm256_set1_pd(SP_BYTEMAX);
+
+            int u = 0;
+            for (; u + 4 <= num; u += 4) {
+                const __m256d a00 = _mm256_setr_pd(src0[x0[u]], src0[x0[u + 1]], src0[x0[u + 2]], src0[x0[u + 3]]);
+                const __m256d a10 = _mm256_setr_pd(src0[x1[u]], src0[x1[u + 1]], src0[x1[u + 2]], src0[x1[u + 3]]);
+                const __m256d a01 = _mm256_setr_pd(src1[x0[u]], src1[x0[u + 1]], src1[x0[u + 2]], src1[x0[u + 3]]);
+                const __m256d a11 = _mm256_setr_pd(src1[x1[u]], src1[x1[u + 1]], src1[x1[u + 2]], src1[x1[u + 3]]);
+
+                const __m256d w0 = _mm256_loadu_pd(&wx0[u]);
+                const __m256d w1 = _mm256_loadu_pd(&wx1[u]);
+
+                const __m256d v00 = _mm256_mul_pd(_mm256_mul_pd(a00, w0), vy0);
+                const __m256d v10 = _mm256_mul_pd(_mm256_mul_pd(a10, w1), vy0);
+                const __m256d v01 = _mm256_mul_pd(_mm256_mul_pd(a01, w0), vy1);
+                const __m256d v11 = _mm256_mul_pd(_mm256_mul_pd(a11, w1), vy1);
+                const __m256d v = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(v00, v10), v01), v11);
+
+                const __m128i d = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_min_pd(v, maxv), half));
+                const __m128i d16 = _mm_packs_epi32(d, d);
+                const int c = _mm_cvtsi128_si32(_mm_packus_epi16(d16, d16));
+                memcpy(&dst[u], &c, 4);
+            }
+            rescale_c(&dst[u], src0, src1, wy0, wy1, &x0[u], &x1[u], &wx0[u], &wx1[u], num - u);
+        }
+#endif
+
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // random kernels (same values as randu(key, ctr) / randg(key, ctr))
+    //--------------------------------------------------------------------------------
+
+    namespace _simd {
+
+        //--------------------------------------------------------------------------------
+        // c
+        //--------------------------------------------------------------------------------
+
+        SP_CPUFUNC void randu_c(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            for (int i = 0; i < num; i++) {
+                dst[i] = randu(key, ctr + i);
+            }
+        }
+
+        // box-muller pairs (same as randg(key, 2n), randg(key, 2n + 1))
+        SP_CPUFUNC void _gauss_c(SP_REAL *dst, const double *a, const double *b, const int pnum) {
+            for (int i = 0; i < pnum; i++) {
+                const double r = sqrt(-2.0 * log(a[i]));
+                dst[i * 2 + 0] = static_cast<SP_REAL>(r * sin(2.0 * SP_PI * b[i]));
+                dst[i * 2 + 1] = static_cast<SP_REAL>(r * cos(2.0 * SP_PI * b[i]));
+            }
+        }
+
+        SP_CPUFUNC void randg_c(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            int i = 0;
+            if ((ctr & 1) && num > 0) {
+                dst[i++] = randg(key, ctr);
+            }
+            for (; i + 2 <= num; i += 2) {
+                const unsigned long long x = _rbits(key, (ctr + i) >> 1);
+                const double a = (static_cast<double>(x >> 32) + 0.5) * (1.0 / 4294967296.0);
+                const double b = (static_cast<double>(x & 0xFFFFFFFFULL) + 0.5) * (1.0 / 4294967296.0);
+                _gauss_c(&dst[i], &a, &b, 1);
+            }
+            for (; i < num; i++) {
+                dst[i] = randg(key, ctr + i);
+            }
+        }
+
+#if SP_USE_SIMD
+
+        // counter step of _rbits
+        const unsigned long long _RGAMMA = 0x9E3779B97F4A7C15ULL;
+
+        SP_CPUFUNC void _store(double *dst, const double *src, const int num) {
+            memcpy(dst, src, num * sizeof(double));
+        }
+        SP_CPUFUNC void _store(float *dst, const double *src, const int num) {
+            for (int i = 0; i < num; i++) dst[i] = static_cast<float>(src[i]);
+        }
+
+        //--------------------------------------------------------------------------------
+        // sse4.1
+        //--------------------------------------------------------------------------------
+
+        // the 2 lane emulation of 64bit multiply is slower than the scalar code
+        SP_TARGET_SSE4 SP_CPUFUNC void randu_sse4(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            randu_c(dst, num, key, ctr);
+        }
+
+        SP_TARGET_SSE4 SP_CPUFUNC void randg_sse4(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            randg_c(dst, num, key, ctr);
+        }
+
+        //--------------------------------------------------------------------------------
+        // avx2 (4 lanes)
+        //--------------------------------------------------------------------------------
+
+        // a * c (mod 2^64)
+        SP_TARGET_AVX2 SP_CPUFUNC __m256i _mul64_avx2(const __m256i a, const unsigned long long c) {
+            const __m256i cl = _mm256_set1_epi64x(static_cast<long long>(c & 0xFFFFFFFFULL));
+            const __m256i ch = _mm256_set1_epi64x(static_cast<long long>(c >> 32));
+            const __m256i lo = _mm256_mul_epu32(a, cl);
+            const __m256i hi = _mm256_add_epi64(_mm256_mul_epu32(a, ch), _mm256_mul_epu32(_mm256_srli_epi64(a, 32), cl));
+            return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC __m256i _rmix_avx2(__m256i z) {
+            z = _mul64_avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), 0xBF58476D1CE4E5B9ULL);
+            z = _mul64_avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), 0x94D049BB133111EBULL);
+            return _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+        }
+
+        // x (< 2^52) -> double
+        SP_TARGET_AVX2 SP_CPUFUNC __m256d _cnvd_avx2(const __m256i x) {
+            const __m256i e = _mm256_set1_epi64x(0x4330000000000000LL);
+            return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(x, e)), _mm256_set1_pd(4503599627370496.0));
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC __m256i _rinit_avx2(const unsigned long long key, const unsigned long long ctr) {
+            const unsigned long long z0 = key + (ctr + 1) * _RGAMMA;
+            return _mm256_set_epi64x(static_cast<long long>(z0 + 3 * _RGAMMA), static_cast<long long>(z0 + 2 * _RGAMMA), static_cast<long long>(z0 + _RGAMMA), static_cast<long long>(z0));
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void randu_avx2(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            __m256i z = _rinit_avx2(key, ctr);
+            const __m256i step = _mm256_set1_epi64x(static_cast<long long>(4 * _RGAMMA));
+
+            const __m256d half = _mm256_set1_pd(0.5);
+            const __m256d scale = _mm256_set1_pd(1.0 / 2251799813685248.0);
+            const __m256d one = _mm256_set1_pd(1.0);
+
+            int i = 0;
+            for (; i + 4 <= num; i += 4) {
+                const __m256d k = _cnvd_avx2(_mm256_srli_epi64(_rmix_avx2(z), 12));
+                double u[4];
+                _mm256_storeu_pd(u, _mm256_sub_pd(_mm256_mul_pd(_mm256_add_pd(k, half), scale), one));
+                _store(&dst[i], u, 4);
+                z = _mm256_add_epi64(z, step);
+            }
+            randu_c(&dst[i], num - i, key, ctr + i);
+        }
+
+        SP_TARGET_AVX2 SP_CPUFUNC void randg_avx2(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr) {
+            int i = 0;
+            if ((ctr & 1) && num > 0) {
+                dst[i++] = randg(key, ctr);
+            }
+
+            // 4 pairs per loop
+            __m256i z = _rinit_avx2(key, (ctr + i) >> 1);
+            const __m256i step = _mm256_set1_epi64x(static_cast<long long>(4 * _RGAMMA));
+            const __m256i mask = _mm256_set1_epi64x(0xFFFFFFFFLL);
+
+            const __m256d half = _mm256_set1_pd(0.5);
+            const __m256d scale = _mm256_set1_pd(1.0 / 4294967296.0);
+
+            for (; i + 8 <= num; i += 8) {
+                const __m256i x = _rmix_avx2(z);
+                double a[4], b[4];
+                _mm256_storeu_pd(a, _mm256_mul_pd(_mm256_add_pd(_cnvd_avx2(_mm256_srli_epi64(x, 32)), half), scale));
+                _mm256_storeu_pd(b, _mm256_mul_pd(_mm256_add_pd(_cnvd_avx2(_mm256_and_si256(x, mask)), half), scale));
+                _gauss_c(&dst[i], a, b, 4);
+                z = _mm256_add_epi64(z, step);
+            }
+            randg_c(&dst[i], num - i, key, ctr + i);
+        }
+#endif
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // gemm kernels
+    //--------------------------------------------------------------------------------
+    //
+    // op(A), op(B) are packed into (MC x KC) / (KC x NC) panels of MR rows / NR columns,
+    // and the MR x NR tile of C is accumulated in registers.
+    //
+
+    namespace _simd {
+
+        template<typename TYPE> struct GemmSize {
+            // register tile
+            static const int MR = 6;
+            static const int NR = 64 / sizeof(TYPE);
+
+            // cache block
+            static const int KC = 256;
+            static const int MC = 96;
+            static const int NC = 2048;
+        };
+
+        // op(A)(i, k) -> dst[(i / MR) * MR * kc + k * MR + i % MR] (zero padding)
+        template<typename TYPE>
+        SP_CPUFUNC void _packA(TYPE *dst, const TYPE *A, const int lda, const bool trans, const int i0, const int k0, const int mc, const int kc) {
+            const int MR = GemmSize<TYPE>::MR;
+            for (int i = 0; i < mc; i += MR) {
+                const int mr = (mc - i < MR) ? mc - i : MR;
+                for (int k = 0; k < kc; k++) {
+                    for (int r = 0; r < MR; r++) {
+                        const int ai = i0 + i + r;
+                        const int ak = k0 + k;
+                        *dst++ = (r < mr) ? ((trans == false) ? A[ai * lda + ak] : A[ak * lda + ai]) : static_cast<TYPE>(0);
+                    }
+                }
+            }
+        }
+
+        // op(B)(k, j) -> dst[(j / NR) * NR * kc + k * NR + j % NR] (zero padding)
+        template<typename TYPE>
+        SP_CPUFUNC void _packB(TYPE *dst, const TYPE *B, const int ldb, const bool trans, const int k0, const int j0, const int kc, const int nc) {
+            const int NR = GemmSize<TYPE>::NR;
+            for (int j = 0; j < nc; j += NR) {
+                const int nr = (nc - j < NR) ? nc - j : NR;
+                for (int k = 0; k < kc; k++) {
+                    const int bk = k0 + k;
+                    if (trans == false) {
+                        const TYPE *src = &B[bk * ldb + j0 + j];
+                        for (int c = 0; c < NR; c++) {
+                            *dst++ = (c < nr) ? src[c] : static_cast<TYPE>(0);
+                        }
+                    }
+                    else {
+                        for (int c = 0; c < NR; c++) {
+                            *dst++ = (c < nr) ? B[(j0 + j + c) * ldb + bk] : static_cast<TYPE>(0);
+                        }
+                    }
+                }
+            }
+        }
+
+        // C[mr x nr] += tile
+        template<typename TYPE>
+        SP_CPUFUNC void _addTile(TYPE *C, const int ldc, const TYPE *tile, const int mr, const int nr) {
+            const int NR = GemmSize<TYPE>::NR;
+            for (int r = 0; r < mr; r++) {
+                for (int c = 0; c < nr; c++) {
+                    C[r * ldc + c] += tile[r * NR + c];
+                }
+            }
+        }
+
+        //--------------------------------------------------------------------------------
+        // scalar
+        //--------------------------------------------------------------------------------
+
+        template<typename TYPE>
+        SP_CPUFUNC void gemmKernel_c(TYPE *C, const int ldc, const TYPE *pa, const TYPE *pb, const int kc, const int mr, const int nr) {
+            const int MR = GemmSize<TYPE>::MR;
+            const int NR = GemmSize<TYPE>::NR;
+
+            TYPE tile[GemmSize<TYPE>::MR * GemmSize<TYPE>::NR] = { 0 };
+            for (int k = 0; k < kc; k++) {
+                for (int r = 0; r < MR; r++) {
+                    const TYPE a = pa[r];
+                    for (int c = 0; c < NR; c++) {
+                        tile[r * NR + c] += a * pb[c];
+                    }
+                }
+                pa += MR;
+                pb += NR;
+            }
+            _addTile(C, ldc, tile, mr, nr);
+        }
+
+#if SP_USE_SIMD
+
+        //--------------------------------------------------------------------------------
+        // avx2 + fma
+        //--------------------------------------------------------------------------------
+
+        SP_TARGET_FMA SP_CPUFUNC void gemmKernel_fma(double *C, const int ldc, const double *pa, const double *pb, const int kc, const int mr, const int nr) {
+            __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+            __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+            __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+            __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+            __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+            __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+            for (int k = 0; k < kc; k++) {
+                const __m256d b0 = _mm256_loadu_pd(pb + 0);
+                const __m256d b1 = _mm256_loadu_pd(pb + 4);
+                __m256d a;
+                a = _mm256_broadcast_sd(pa + 0); c00 = _mm256_fmadd_pd(a, b0, c00); c01 = _mm256_fmadd_pd(a, b1, c01);
+                a = _mm256_broadcast_sd(pa + 1); c10 = _mm256_fmadd_pd(a, b0, c10); c11 = _mm256_fmadd_pd(a, b1, c11);
+                a = _mm256_broadcast_sd(pa + 2); c20 = _mm256_fmadd_pd(a, b0, c20); c21 = _mm256_fmadd_pd(a, b1, c21);
+                a = _mm256_broadcast_sd(pa + 3); c30 = _mm256_fmadd_pd(a, b0, c30); c31 = _mm256_fmadd_pd(a, b1, c31);
+                a = _mm256_broadcast_sd(pa + 4); c40 = _mm256_fmadd_pd(a, b0, c40); c41 = _mm256_fmadd_pd(a, b1, c41);
+                a = _mm256_broadcast_sd(pa + 5); c50 = _mm256_fmadd_pd(a, b0, c50); c51 = _mm256_fmadd_pd(a, b1, c51);
+                pa += 6;
+                pb += 8;
+            }
+
+            double tile[6 * 8];
+            _mm256_storeu_pd(tile + 0, c00); _mm256_storeu_pd(tile + 4, c01);
+            _mm256_storeu_pd(tile + 8, c10); _mm256_storeu_pd(tile + 12, c11);
+            _mm256_storeu_pd(tile + 16, c20); _mm256_storeu_pd(tile + 20, c21);
+            _mm256_storeu_pd(tile + 24, c30); _mm256_storeu_pd(tile + 28, c31);
+            _mm256_storeu_pd(tile + 32, c40); _mm256_storeu_pd(tile + 36, c41);
+            _mm256_storeu_pd(tile + 40, c50); _mm256_storeu_pd(tile + 44, c51);
+            _addTile(C, ldc, tile, mr, nr);
+        }
+
+        SP_TARGET_FMA SP_CPUFUNC void gemmKernel_fma(float *C, const int ldc, const float *pa, const float *pb, const int kc, const int mr, const int nr) {
+            __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+            __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+            __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+            __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+            __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+            __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+            for (int k = 0; k < kc; k++) {
+                const __m256 b0 = _mm256_loadu_ps(pb + 0);
+                const __m256 b1 = _mm256_loadu_ps(pb + 8);
+                __m256 a;
+                a = _mm256_broadcast_ss(pa + 0); c00 = _mm256_fmadd_ps(a, b0, c00); c01 = _mm256_fmadd_ps(a, b1, c01);
+                a = _mm256_broadcast_ss(pa + 1); c10 = _mm256_fmadd_ps(a, b0, c10); c11 = _mm256_fmadd_ps(a, b1, c11);
+                a = _mm256_broadcast_ss(pa + 2); c20 = _mm256_fmadd_ps(a, b0, c20); c21 = _mm256_fmadd_ps(a, b1, c21);
+                a = _mm256_broadcast_ss(pa + 3); c30 = _mm256_fmadd_ps(a, b0, c30); c31 = _mm256_fmadd_ps(a, b1, c31);
+                a = _mm256_broadcast_ss(pa + 4); c40 = _mm256_fmadd_ps(a, b0, c40); c41 = _mm256_fmadd_ps(a, b1, c41);
+                a = _mm256_broadcast_ss(pa + 5); c50 = _mm256_fmadd_ps(a, b0, c50); c51 = _mm256_fmadd_ps(a, b1, c51);
+                pa += 6;
+                pb += 16;
+            }
+
+            float tile[6 * 16];
+            _mm256_storeu_ps(tile + 0, c00); _mm256_storeu_ps(tile + 8, c01);
+            _mm256_storeu_ps(tile + 16, c10); _mm256_storeu_ps(tile + 24, c11);
+            _mm256_storeu_ps(tile + 32, c20); _mm256_storeu_ps(tile + 40, c21);
+            _mm256_storeu_ps(tile + 48, c30); _mm256_storeu_ps(tile + 56, c31);
+            _mm256_storeu_ps(tile + 64, c40); _mm256_storeu_ps(tile + 72, c41);
+            _mm256_storeu_ps(tile + 80, c50); _mm256_storeu_ps(tile + 88, c51);
+            _addTile(C, ldc, tile, mr, nr);
+        }
+
+#endif
+
+        // C (M x N) = op(A) (M x K) * op(B) (K x N) + (add ? C : 0)
+        template<typename TYPE>
+        SP_CPUFUNC void gemm(TYPE *C, const int ldc, const TYPE *A, const int lda, const bool transA, const TYPE *B, const int ldb, const bool transB, const int M, const int N, const int K, const bool add, const bool fma) {
+            const int MR = GemmSize<TYPE>::MR;
+            const int NR = GemmSize<TYPE>::NR;
+            const int KC = GemmSize<TYPE>::KC;
+            const int MC = GemmSize<TYPE>::MC;
+            const int NC = GemmSize<TYPE>::NC;
+
+            if (add == false) {
+                for (int i = 0; i < M; i++) {
+                    for (int j = 0; j < N; j++) {
+                        C[i * ldc + j] = static_cast<TYPE>(0);
+                    }
+                }
+            }
+            if (M <= 0 || N <= 0 || K <= 0) return;
+
+            const int mcmax = (M < MC) ? M : MC;
+            const int ncmax = (N < NC) ? N : NC;
+            const int kcmax = (K < KC) ? K : KC;
+
+            TYPE *pa = static_cast<TYPE*>(memAlloc(((mcmax + MR - 1) / MR) * MR * kcmax * sizeof(TYPE)));
+            TYPE *pb = static_cast<TYPE*>(memAlloc(((ncmax + NR - 1) / NR) * NR * kcmax * sizeof(TYPE)));
+
+            for (int j0 = 0; j0 < N; j0 += NC) {
+                const int nc = (N - j0 < NC) ? N - j0 : NC;
+
+                for (int k0 = 0; k0 < K; k0 += KC) {
+                    const int kc = (K - k0 < KC) ? K - k0 : KC;
+                    _packB(pb, B, ldb, transB, k0, j0, kc, nc);
+
+                    for (int i0 = 0; i0 < M; i0 += MC) {
+                        const int mc = (M - i0 < MC) ? M - i0 : MC;
+                        _packA(pa, A, lda, transA, i0, k0, mc, kc);
+
+                        for (int j = 0; j < nc; j += NR) {
+                            const int nr = (nc - j < NR) ? nc - j : NR;
+                            for (int i = 0; i < mc; i += MR) {
+                                const int mr = (mc - i < MR) ? mc - i : MR;
+
+                                TYPE *pc = &C[(i0 + i) * ldc + j0 + j];
+#if SP_USE_SIMD
+                                if (fma == true) {
+                                    gemmKernel_fma(pc, ldc, &pa[i * kc], &pb[j * kc], kc, mr, nr);
+                                    continue;
+                                }
+#endif
+                                gemmKernel_c(pc, ldc, &pa[i * kc], &pb[j * kc], kc, mr, nr);
+                            }
+                        }
+                    }
+                }
+            }
+
+            memFree(pa);
+            memFree(pb);
+        }
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // dispatch
+    //--------------------------------------------------------------------------------
+
+#if SP_USE_SIMD
+#define SP_SIMD_DISPATCH(FUNC, ...) \
+    switch (getSimdLevel()) { \
+    case SimdLevel_AVX2: _simd::FUNC##_avx2(__VA_ARGS__); break; \
+    case SimdLevel_SSE4: _simd::FUNC##_sse4(__VA_ARGS__); break; \
+    default: _simd::FUNC##_c(__VA_ARGS__); break; \
+    }
+#else
+#define SP_SIMD_DISPATCH(FUNC, ...) _simd::FUNC##_c(__VA_ARGS__);
+#endif
+
+    // dst = 255 - src
+    SP_CPUFUNC void simdInvert(Byte *dst, const Byte *src, const int num) {
+        SP_SIMD_DISPATCH(invert, dst, src, num);
+    }
+
+    // dst = (src >= thresh) ? 255 : 0 (inv: src < thresh)
+    SP_CPUFUNC void simdThresh(Byte *dst, const Byte *src, const int num, const int thresh, const bool inv = false) {
+        SP_SIMD_DISPATCH(thresh, dst, src, num, thresh, inv);
+    }
+
+    // update min / max value in region [dsize0 x dsize1]
+    SP_CPUFUNC void simdMinMax(Byte &minv, Byte &maxv, const Byte *src, const int step, const int dsize0, const int dsize1) {
+        SP_SIMD_DISPATCH(minmax, minv, maxv, src, step, dsize0, dsize1);
+    }
+
+    // dst = (src0 * r0 + src1 * r1) / (r0 + r1) (same as blendCol)
+    SP_CPUFUNC void simdBlend(Byte *dst, const Byte *src0, const double r0, const Byte *src1, const double r1, const int num) {
+        SP_SIMD_DISPATCH(blend, dst, src0, r0, src1, r1, num);
+    }
+
+    // rgb -> gray (same as cast<Byte>(Col3))
+    SP_CPUFUNC void simdCnvGry(Byte *dst, const Col3 *src, const int num) {
+        SP_SIMD_DISPATCH(cnvGry, dst, src, num);
+    }
+
+    // one row of pyrdown (5x5 binomial -> 3x3, stride 2)
+    SP_CPUFUNC void simdPyrdown(Byte *dst, const Byte *src0, const Byte *src1, const Byte *src2, const int sdsize0, const int ddsize0) {
+        SP_SIMD_DISPATCH(pyrdown, dst, src0, src1, src2, sdsize0, 0, ddsize0);
+    }
+
+    // one row of bilinear rescale with precomputed column table
+    SP_CPUFUNC void simdRescale(Byte *dst, const Byte *src0, const Byte *src1, const double wy0, const double wy1, const int *x0, const int *x1, const double *wx0, const double *wx1, const int num) {
+        SP_SIMD_DISPATCH(rescale, dst, src0, src1, wy0, wy1, x0, x1, wx0, wx1, num);
+    }
+
+    // dst[i] = randu(key, ctr + i)
+    SP_CPUFUNC void simdRandu(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr = 0) {
+        SP_SIMD_DISPATCH(randu, dst, num, key, ctr);
+    }
+
+    // dst[i] = randg(key, ctr + i)
+    SP_CPUFUNC void simdRandg(SP_REAL *dst, const int num, const unsigned long long key, const unsigned long long ctr = 0) {
+        SP_SIMD_DISPATCH(randg, dst, num, key, ctr);
+    }
+
+    // draw num samples from the stream
+    SP_CPUFUNC void simdRandu(SP_REAL *dst, const int num, RandStream &rs) {
+        simdRandu(dst, num, rs.key, rs.ctr);
+        rs.ctr += num;
+    }
+
+    SP_CPUFUNC void simdRandg(SP_REAL *dst, const int num, RandStream &rs) {
+        simdRandg(dst, num, rs.key, rs.ctr);
+        rs.ctr += num;
+    }
+
+    // C (M x N) = op(A) (M x K) * op(B) (K x N) + (add ? C : 0)
+    // op(X) = trans ? X^T : X, lda / ldb / ldc : row step of the stored matrix
+    // (the fma kernel rounds once per multiply-add, results differ from the scalar kernel in the last bits)
+    template<typename TYPE>
+    SP_CPUFUNC void simdGemm(TYPE *C, const int ldc, const TYPE *A, const int lda, const bool transA, const TYPE *B, const int ldb, const bool transB, const int M, const int N, const int K, const bool add = false) {
+        static const bool fma = _checkFma();
+        _simd::gemm(C, ldc, A, lda, transA, B, ldb, transB, M, N, K, add, fma == true && getSimdLevel() == SimdLevel_AVX2);
+    }
+
+#undef SP_SIMD_DISPATCH
+
+}
+
+#endif
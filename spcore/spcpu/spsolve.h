@@ -137,6 +137,41 @@ namespace sp{
             return (result.size() > 0) ? true : false;
         }
 
+        // solve equation (A * X = B, X: N x 1, normal equation on stack)
+        template<int N>
+        SP_CPUFUNC bool solveAX_B(MatN<N, 1> &result, const Mat &A, const Mat &B, const Mat W = Mat()) {
+            SP_ASSERT(A.cols() == N);
+
+            MatN<N, N> AtA = zeroMatN<N, N>();
+            MatN<N, 1> AtB = zeroMatN<N, 1>();
+
+            const int nsize = A.rows();
+
+            for (int i = 0; i < nsize; i++) {
+                const SP_REAL *pa = &A(i, 0);
+                const SP_REAL w = (W.ptr != NULL) ? W[i] : 1.0;
+                if (w == 0.0) continue;
+
+                const SP_REAL b = B(i, 0) * w;
+                for (int r = 0; r < N; r++) {
+                    const SP_REAL a = pa[r] * w;
+                    for (int c = r; c < N; c++) {
+                        AtA(r, c) += a * pa[c];
+                    }
+                    AtB[r] += pa[r] * b;
+                }
+            }
+
+            // fill
+            for (int r = 0; r < N; r++) {
+                for (int c = r + 1; c < N; c++) {
+                    AtA(c, r) = AtA(r, c);
+                }
+            }
+
+            return solveMat(result, AtA, AtB);
+        }
+
         // solve equation (A * X = 0)
         SP_CPUFUNC bool solveAX_Z(Mat &result, const Mat &A, const Mat W = Mat()) {
 
@@ -10,22 +10,326 @@
 // thread
 //--------------------------------------------------------------------------------
 
+#include "spcore/spcom.h"
+#include "spcore/spgen/spbase.h"
+
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
 #include <functional>
 
 namespace sp {
 
+    //--------------------------------------------------------------------------------
+    // thread pool (persistent workers, per-worker deque, work stealing)
+    //--------------------------------------------------------------------------------
+
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+    private:
+
+        struct Worker {
+            std::mutex mtx;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker> > m_workers;
+        std::vector<std::thread> m_threads;
+
+        // sleep control
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+
+        // queued task count
+        std::atomic<int> m_queued;
+
+        // round robin id for external push
+        std::atomic<unsigned int> m_next;
+
+        std::atomic<bool> m_stop;
+
+        struct Owner {
+            const ThreadPool *pool;
+            int id;
+        };
+
+        static Owner& _owner() {
+            static thread_local Owner owner = { NULL, -1 };
+            return owner;
+        }
+
+        // worker id of the calling thread (-1: external thread)
+        static int _wid(const ThreadPool *pool) {
+            const Owner &owner = _owner();
+            return (owner.pool == pool) ? owner.id : -1;
+        }
+
+    public:
+
+        ThreadPool(const int num = 0) {
+            m_queued = 0;
+            m_next = 0;
+            m_stop = false;
+
+            int n = (num > 0) ? num : static_cast<int>(std::thread::hardware_concurrency());
+            n = (n > 0) ? n : 1;
+
+            for (int i = 0; i < n; i++) {
+                m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+            }
+            for (int i = 0; i < n; i++) {
+                m_threads.push_back(std::thread([this, i] { loop(i); }));
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                m_threads[i].join();
+            }
+        }
+
+        static ThreadPool *instance() {
+            static ThreadPool pool;
+            return &pool;
+        }
+
+        int size() const {
+            return static_cast<int>(m_workers.size());
+        }
+
+        //--------------------------------------------------------------------------------
+        // task
+        //--------------------------------------------------------------------------------
+
+        void push(const Task &task) {
+            const int wid = _wid(this);
+
+            // own deque (lifo) for worker threads, round robin for others
+            const int id = (wid >= 0) ? wid : static_cast<int>(m_next++ % m_workers.size());
+            {
+                Worker &w = *m_workers[id];
+                std::lock_guard<std::mutex> lock(w.mtx);
+                w.tasks.push_back(task);
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                m_queued++;
+            }
+            m_cv.notify_one();
+        }
+
+        // run one queued task on the calling thread
+        bool help() {
+            Task task;
+            if (pop(task, _wid(this)) == false) return false;
+
+            task();
+            return true;
+        }
+
+    private:
+
+        bool pop(Task &task, const int wid) {
+            const int n = static_cast<int>(m_workers.size());
+
+            // own deque from back
+            if (wid >= 0) {
+                Worker &w = *m_workers[wid];
+                std::lock_guard<std::mutex> lock(w.mtx);
+                if (w.tasks.size() > 0) {
+                    task = std::move(w.tasks.back());
+                    w.tasks.pop_back();
+                    m_queued--;
+                    return true;
+                }
+            }
+
+            // steal from front
+            const int base = (wid >= 0) ? wid + 1 : static_cast<int>(m_next % n);
+            for (int i = 0; i < n; i++) {
+                Worker &w = *m_workers[(base + i) % n];
+                std::lock_guard<std::mutex> lock(w.mtx);
+                if (w.tasks.size() > 0) {
+                    task = std::move(w.tasks.front());
+                    w.tasks.pop_front();
+                    m_queued--;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void loop(const int wid) {
+            _owner().pool = this;
+            _owner().id = wid;
+
+            while (true) {
+                Task task;
+                if (pop(task, wid) == true) {
+                    task();
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(m_mtx);
+                m_cv.wait(lock, [this] { return m_stop == true || m_queued > 0; });
+                if (m_stop == true) break;
+            }
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // task group
+    //--------------------------------------------------------------------------------
+
+    class TaskGroup {
+    private:
+        ThreadPool *m_pool;
+        std::shared_ptr<std::atomic<int> > m_cnt;
+
+    public:
+        TaskGroup(ThreadPool *pool = NULL) {
+            m_pool = (pool != NULL) ? pool : ThreadPool::instance();
+            m_cnt = std::make_shared<std::atomic<int> >(0);
+        }
+
+        ~TaskGroup() {
+            wait();
+        }
+
+        void run(const std::function<void()> &func) {
+            std::shared_ptr<std::atomic<int> > cnt = m_cnt;
+            (*cnt)++;
+
+            m_pool->push([cnt, func] {
+                func();
+                (*cnt)--;
+            });
+        }
+
+        // wait for all tasks (the calling thread helps to run queued tasks)
+        void wait() {
+            while (*m_cnt > 0) {
+                if (m_pool->help() == false) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // parallel for / reduce
+    //--------------------------------------------------------------------------------
+
+    // func(i) for i in [begin, end)
+    template<typename FUNC>
+    SP_CPUFUNC void parallel_for(const int begin, const int end, const FUNC &func, const int grain = 0, ThreadPool *pool = NULL) {
+        if (end <= begin) return;
+
+        ThreadPool *p = (pool != NULL) ? pool : ThreadPool::instance();
+
+        const int num = end - begin;
+        const int step = (grain > 0) ? grain : max(1, num / (p->size() * 4));
+
+        if (num <= step) {
+            for (int i = begin; i < end; i++) {
+                func(i);
+            }
+            return;
+        }
+
+        TaskGroup group(p);
+        for (int b = begin + step; b < end; b += step) {
+            const int e = min(b + step, end);
+            group.run([&func, b, e] {
+                for (int i = b; i < e; i++) {
+                    func(i);
+                }
+            });
+        }
+
+        // first chunk on the calling thread
+        for (int i = begin; i < begin + step; i++) {
+            func(i);
+        }
+        group.wait();
+    }
+
+    // join(func(b0, e0, init), func(b1, e1, init), ...) in index order
+    template<typename TYPE, typename FUNC, typename JOIN>
+    SP_CPUFUNC TYPE parallel_reduce(const int begin, const int end, const TYPE &init, const FUNC &func, const JOIN &join, const int grain = 0, ThreadPool *pool = NULL) {
+        if (end <= begin) return init;
+
+        ThreadPool *p = (pool != NULL) ? pool : ThreadPool::instance();
+
+        const int num = end - begin;
+        const int step = (grain > 0) ? grain : max(1, num / (p->size() * 4));
+        const int cnum = (num + step - 1) / step;
+
+        std::vector<TYPE> parts(cnum, init);
+        parallel_for(0, cnum, [&](const int c) {
+            const int b = begin + c * step;
+            const int e = min(b + step, end);
+            parts[c] = func(b, e, init);
+        }, 1, p);
+
+        TYPE ret = parts[0];
+        for (int c = 1; c < cnum; c++) {
+            ret = join(ret, parts[c]);
+        }
+        return ret;
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // serial thread (one persistent worker, tasks run in order)
+    //--------------------------------------------------------------------------------
+
     class Thread {
     private:
-        bool m_used;
         bool m_init;
         std::mutex m_mtx;
 
+        // queued and running task count
+        std::atomic<int> m_cnt;
+
+        std::thread m_th;
+        std::mutex m_qmtx;
+        std::condition_variable m_cv;
+        std::deque<std::function<void()> > m_tasks;
+        bool m_stop;
+
     public:
         Thread() {
             init();
-            m_used = false;
+            m_cnt = 0;
+            m_stop = false;
+        }
+
+        // queued tasks are run before the worker stops
+        ~Thread() {
+            {
+                std::lock_guard<std::mutex> lock(m_qmtx);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+
+            if (m_th.joinable()) {
+                m_th.join();
+            }
         }
 
         void init() {
@@ -39,7 +343,7 @@ namespace sp {
         }
 
         bool used() {
-            return (m_init == false) | (m_used == true);
+            return (m_init == false) | (m_cnt > 0);
         }
 
         void lock() {
@@ -52,48 +356,48 @@ namespace sp {
 
         template<class Class, void (Class::*Func)()>
         bool run(Class *ptr, const bool wait = true) {
-            if (m_init == false) return false;
-            if (wait == false && m_used == true) return false;
-
-            std::thread th([this, ptr, wait] {
-                lock();
-                m_used = true;
-                (ptr->*Func)();
-                m_used = false;
-                unlock();
-            });
-            th.detach();
-            return true;
+            return run(std::function<void()>([ptr] { (ptr->*Func)(); }), wait);
         }
 
         bool run(std::function<void()> func, const bool wait = true) {
             if (m_init == false) return false;
-            if (wait == false && m_used == true) return false;
+            if (wait == false && m_cnt > 0) return false;
 
-            std::thread th([this, func, wait] {
-                lock();
-                m_used = true;
-                func();
-                m_used = false;
-                unlock();
-            });
-            th.detach();
+            {
+                std::lock_guard<std::mutex> lock(m_qmtx);
+                if (m_th.joinable() == false) {
+                    m_th = std::thread([this] { loop(); });
+                }
+                m_cnt++;
+                m_tasks.push_back(func);
+            }
+            m_cv.notify_one();
             return true;
         }
 
         bool run(void (*func)(), const bool wait = true) {
-            if (m_init == false) return false;
-            if (wait == false && m_used == true) return false;
+            return run(std::function<void()>(func), wait);
+        }
+
+    private:
+
+        void loop() {
+            while (true) {
+                std::function<void()> func;
+                {
+                    std::unique_lock<std::mutex> lock(m_qmtx);
+                    m_cv.wait(lock, [this] { return m_stop == true || m_tasks.size() > 0; });
+                    if (m_tasks.size() == 0) break;
+
+                    func = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                }
 
-            std::thread th([this, func, wait] {
                 lock();
-                m_used = true;
                 func();
-                m_used = false;
+                m_cnt--;
                 unlock();
-            });
-            th.detach();
-            return true;
+            }
         }
     };
 }
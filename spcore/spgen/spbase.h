@@ -116,7 +116,8 @@ namespace sp{
     // random
     //--------------------------------------------------------------------------------
     
-    static unsigned int _randseed = 0;
+    // state of rand() / randu() / randg() (per thread)
+    static thread_local unsigned int _randseed = 0;
     SP_GENFUNC unsigned int _snext(const unsigned int seed) {
         unsigned int s = seed + 1;
         s ^= (s << 13);
@@ -176,6 +177,73 @@ namespace sp{
     }
 
 
+    //--------------------------------------------------------------------------------
+    // counter-based random
+    //--------------------------------------------------------------------------------
+
+    // the value is a pure function of (key, ctr) (SplitMix64 keyed by stream),
+    // so the samples can be drawn in any order and from any thread
+
+    SP_GENFUNC unsigned long long _rmix(unsigned long long z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    SP_GENFUNC unsigned long long _rbits(const unsigned long long key, const unsigned long long ctr) {
+        return _rmix(key + (ctr + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    // stream key (seed, stream id)
+    SP_GENFUNC unsigned long long randKey(const int seed, const int stream = 0) {
+        const unsigned long long s = (static_cast<unsigned long long>(static_cast<unsigned int>(seed)) << 32) | static_cast<unsigned int>(stream);
+        return _rmix(s + 0x9E3779B97F4A7C15ULL);
+    }
+
+    // get random [0, 2^31)
+    SP_GENFUNC int rand(const unsigned long long key, const unsigned long long ctr) {
+        return static_cast<int>(_rbits(key, ctr) >> 33);
+    }
+
+    // get random uniform (-1.0, 1.0)
+    SP_GENFUNC SP_REAL randu(const unsigned long long key, const unsigned long long ctr) {
+        const double k = static_cast<double>(_rbits(key, ctr) >> 12);
+        const double u = (k + 0.5) * (1.0 / 2251799813685248.0) - 1.0;
+        return static_cast<SP_REAL>(u);
+    }
+
+    // get random gauss (ctr 2n and 2n+1 are the sin / cos pair of box-muller)
+    SP_GENFUNC SP_REAL randg(const unsigned long long key, const unsigned long long ctr) {
+        const unsigned long long x = _rbits(key, ctr >> 1);
+
+        const double a = (static_cast<double>(x >> 32) + 0.5) * (1.0 / 4294967296.0);
+        const double b = (static_cast<double>(x & 0xFFFFFFFFULL) + 0.5) * (1.0 / 4294967296.0);
+        const double r = sqrt(-2.0 * log(a));
+        const double g = (ctr & 1) ? r * cos(2.0 * SP_PI * b) : r * sin(2.0 * SP_PI * b);
+        return static_cast<SP_REAL>(g);
+    }
+
+    // get random stream (one stream per thread / task)
+    SP_GENFUNC RandStream getRandStream(const int seed, const int stream = 0) {
+        RandStream rs;
+        rs.key = randKey(seed, stream);
+        rs.ctr = 0;
+        return rs;
+    }
+
+    SP_GENFUNC int rand(RandStream &rs) {
+        return rand(rs.key, rs.ctr++);
+    }
+
+    SP_GENFUNC SP_REAL randu(RandStream &rs) {
+        return randu(rs.key, rs.ctr++);
+    }
+
+    SP_GENFUNC SP_REAL randg(RandStream &rs) {
+        return randg(rs.key, rs.ctr++);
+    }
+
+
     //--------------------------------------------------------------------------------
     // byte order
     //--------------------------------------------------------------------------------
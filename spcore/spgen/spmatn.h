@@ -0,0 +1,273 @@
+﻿//--------------------------------------------------------------------------------
+// Copyright (c) 2017-2020, sanko-shoko. All rights reserved.
+//--------------------------------------------------------------------------------
+
+#ifndef __SP_MATN_H__
+#define __SP_MATN_H__
+
+#include "spcore/spcom.h"
+#include "spcore/spgen/spbase.h"
+#include "spcore/spgen/spmath.h"
+#include "spcore/spgen/sptype.h"
+
+namespace sp {
+
+    //--------------------------------------------------------------------------------
+    // fixed size matrix (R x C, row major, no heap memory)
+    //--------------------------------------------------------------------------------
+
+    template<int R, int C>
+    struct MatN {
+        SP_REAL ptr[R * C];
+
+        static constexpr int rows() { return R; }
+        static constexpr int cols() { return C; }
+        static constexpr int size() { return R * C; }
+
+        SP_REAL& operator [] (const int i) {
+            return ptr[i];
+        }
+
+        const SP_REAL& operator [] (const int i) const {
+            return ptr[i];
+        }
+
+        SP_REAL& operator () (const int r, const int c) {
+            return ptr[r * C + c];
+        }
+
+        const SP_REAL& operator () (const int r, const int c) const {
+            return ptr[r * C + c];
+        }
+    };
+
+
+    //--------------------------------------------------------------------------------
+    // get matrix
+    //--------------------------------------------------------------------------------
+
+    template<int R, int C>
+    SP_GENFUNC MatN<R, C> zeroMatN() {
+        MatN<R, C> dst;
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] = 0.0;
+        }
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC MatN<R, C> eyeMatN() {
+        MatN<R, C> dst;
+        for (int r = 0; r < R; r++) {
+            for (int c = 0; c < C; c++) {
+                dst.ptr[r * C + c] = (r == c) ? 1.0 : 0.0;
+            }
+        }
+        return dst;
+    }
+
+    SP_GENFUNC MatN<3, 3> getMatN(const Rot &rot) {
+        MatN<3, 3> dst;
+        getMat(dst.ptr, 3, 3, rot);
+        return dst;
+    }
+
+    SP_GENFUNC MatN<3, 4> getMatN(const Pose &pose) {
+        MatN<3, 4> dst;
+        getMat(dst.ptr, 3, 4, pose);
+        return dst;
+    }
+
+    SP_GENFUNC MatN<3, 3> getMatN(const CamParam &cam) {
+        MatN<3, 3> dst;
+        getMat(dst.ptr, 3, 3, cam);
+        return dst;
+    }
+
+    SP_GENFUNC MatN<3, 3> skewMatN(const Vec3 &vec) {
+        MatN<3, 3> dst;
+        dst(0, 0) = 0.0; dst(0, 1) = -vec.z; dst(0, 2) = +vec.y;
+        dst(1, 0) = +vec.z; dst(1, 1) = 0.0; dst(1, 2) = -vec.x;
+        dst(2, 0) = -vec.y; dst(2, 1) = +vec.x; dst(2, 2) = 0.0;
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC MatN<C, R> trnMat(const MatN<R, C> &mat) {
+        MatN<C, R> dst;
+        for (int r = 0; r < R; r++) {
+            for (int c = 0; c < C; c++) {
+                dst.ptr[c * R + r] = mat.ptr[r * C + c];
+            }
+        }
+        return dst;
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // operator (loop counts are constant and unrolled by the compiler)
+    //--------------------------------------------------------------------------------
+
+    template<int R, int K, int C>
+    SP_GENFUNC MatN<R, C> operator * (const MatN<R, K> &mat0, const MatN<K, C> &mat1) {
+        MatN<R, C> dst;
+        for (int r = 0; r < R; r++) {
+            for (int c = 0; c < C; c++) {
+                SP_REAL sum = 0.0;
+                for (int k = 0; k < K; k++) {
+                    sum += mat0.ptr[r * K + k] * mat1.ptr[k * C + c];
+                }
+                dst.ptr[r * C + c] = sum;
+            }
+        }
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC MatN<R, C> operator + (const MatN<R, C> &mat0, const MatN<R, C> &mat1) {
+        MatN<R, C> dst;
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] = mat0.ptr[i] + mat1.ptr[i];
+        }
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC MatN<R, C> operator - (const MatN<R, C> &mat0, const MatN<R, C> &mat1) {
+        MatN<R, C> dst;
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] = mat0.ptr[i] - mat1.ptr[i];
+        }
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC MatN<R, C> operator * (const MatN<R, C> &mat, const double val) {
+        MatN<R, C> dst;
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] = static_cast<SP_REAL>(mat.ptr[i] * val);
+        }
+        return dst;
+    }
+
+    template<int R, int C>
+    SP_GENFUNC void operator += (MatN<R, C> &dst, const MatN<R, C> &mat) {
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] += mat.ptr[i];
+        }
+    }
+
+    template<int R, int C>
+    SP_GENFUNC void operator -= (MatN<R, C> &dst, const MatN<R, C> &mat) {
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] -= mat.ptr[i];
+        }
+    }
+
+    template<int R, int C>
+    SP_GENFUNC void operator *= (MatN<R, C> &dst, const double val) {
+        for (int i = 0; i < R * C; i++) {
+            dst.ptr[i] = static_cast<SP_REAL>(dst.ptr[i] * val);
+        }
+    }
+
+    template<int R, int C>
+    SP_GENFUNC Vec2 operator * (const MatN<R, C> &mat, const Vec2 &vec) {
+        return mulMat(mat.ptr, R, C, vec);
+    }
+
+    template<int R, int C>
+    SP_GENFUNC Vec3 operator * (const MatN<R, C> &mat, const Vec3 &vec) {
+        return mulMat(mat.ptr, R, C, vec);
+    }
+
+
+    //--------------------------------------------------------------------------------
+    // decomposition / inverse
+    //--------------------------------------------------------------------------------
+
+    // mat = L * D * L^T (L: unit lower triangular, symmetric mat)
+    template<int N>
+    SP_GENFUNC bool ldltMat(MatN<N, N> &L, MatN<N, 1> &D, const MatN<N, N> &mat) {
+        for (int c = 0; c < N; c++) {
+            double d = mat.ptr[c * N + c];
+            for (int k = 0; k < c; k++) {
+                d -= L.ptr[c * N + k] * L.ptr[c * N + k] * D.ptr[k];
+            }
+            if (fabs(d) < SP_SMALL) return false;
+            D.ptr[c] = static_cast<SP_REAL>(d);
+
+            L.ptr[c * N + c] = 1.0;
+            for (int r = c + 1; r < N; r++) {
+                double s = mat.ptr[r * N + c];
+                for (int k = 0; k < c; k++) {
+                    s -= L.ptr[r * N + k] * L.ptr[c * N + k] * D.ptr[k];
+                }
+                L.ptr[r * N + c] = static_cast<SP_REAL>(s / d);
+                L.ptr[c * N + r] = 0.0;
+            }
+        }
+        return true;
+    }
+
+    // mat = L * L^T (symmetric positive definite mat)
+    template<int N>
+    SP_GENFUNC bool cholMat(MatN<N, N> &L, const MatN<N, N> &mat) {
+        MatN<N, 1> D;
+        if (ldltMat(L, D, mat) == false) return false;
+
+        for (int c = 0; c < N; c++) {
+            if (D.ptr[c] <= 0.0) return false;
+            const SP_REAL s = sqrt(D.ptr[c]);
+            for (int r = c; r < N; r++) {
+                L.ptr[r * N + c] *= s;
+            }
+        }
+        return true;
+    }
+
+    // solve mat * x = b (symmetric mat, ldlt)
+    template<int N>
+    SP_GENFUNC bool solveMat(MatN<N, 1> &x, const MatN<N, N> &mat, const MatN<N, 1> &b) {
+        MatN<N, N> L;
+        MatN<N, 1> D;
+        if (ldltMat(L, D, mat) == false) return false;
+
+        for (int r = 0; r < N; r++) {
+            SP_REAL s = b.ptr[r];
+            for (int k = 0; k < r; k++) {
+                s -= L.ptr[r * N + k] * x.ptr[k];
+            }
+            x.ptr[r] = s;
+        }
+        for (int r = 0; r < N; r++) {
+            x.ptr[r] /= D.ptr[r];
+        }
+        for (int r = N - 1; r >= 0; r--) {
+            SP_REAL s = x.ptr[r];
+            for (int k = r + 1; k < N; k++) {
+                s -= L.ptr[k * N + r] * x.ptr[k];
+            }
+            x.ptr[r] = s;
+        }
+        return true;
+    }
+
+    // general inverse (gauss-jordan)
+    template<int N>
+    SP_GENFUNC bool invMat(MatN<N, N> &dst, const MatN<N, N> &mat) {
+        SP_REAL buf[N * N];
+        return invMat(dst.ptr, mat.ptr, N, N, buf);
+    }
+
+    SP_GENFUNC bool invMat(MatN<2, 2> &dst, const MatN<2, 2> &mat) {
+        return invMat22(dst.ptr, mat.ptr);
+    }
+
+    SP_GENFUNC bool invMat(MatN<3, 3> &dst, const MatN<3, 3> &mat) {
+        return invMat33(dst.ptr, mat.ptr);
+    }
+
+}
+
+#endif
@@ -162,6 +162,12 @@ namespace sp {
         const unsigned int s1 = _snext(s0);
         return getVec2(randu(s0) * x, randu(s1) * y);
     }
+    // random uniform
+    SP_CPUFUNC Vec2 randuVec2(const double x, const double y, RandStream &rs) {
+        const SP_REAL u0 = randu(rs);
+        const SP_REAL u1 = randu(rs);
+        return getVec2(u0 * x, u1 * y);
+    }
 
     // random uniform
     SP_CPUFUNC Vec3 randuVec3(const double x, const double y, const double z) {
@@ -174,6 +180,13 @@ namespace sp {
         const unsigned int s2 = _snext(s1);
         return getVec3(randu(s0) * x, randu(s1) * y, randu(s2) * z);
     }
+    // random uniform
+    SP_CPUFUNC Vec3 randuVec3(const double x, const double y, const double z, RandStream &rs) {
+        const SP_REAL u0 = randu(rs);
+        const SP_REAL u1 = randu(rs);
+        const SP_REAL u2 = randu(rs);
+        return getVec3(u0 * x, u1 * y, u2 * z);
+    }
 
     // random gauss
     SP_CPUFUNC Vec2 randgVec2(const double x, const double y) {
@@ -185,6 +198,12 @@ namespace sp {
         const unsigned int s1 = _snext(s0);
         return getVec2(randg(s0) * x, randg(s1) * y);
     }
+    // random gauss
+    SP_CPUFUNC Vec2 randgVec2(const double x, const double y, RandStream &rs) {
+        const SP_REAL g0 = randg(rs);
+        const SP_REAL g1 = randg(rs);
+        return getVec2(g0 * x, g1 * y);
+    }
 
     // random gauss
     SP_CPUFUNC Vec3 randgVec3(const double x, const double y, const double z) {
@@ -197,6 +216,13 @@ namespace sp {
         const unsigned int s2 = _snext(s1);
         return getVec3(randg(s0) * x, randg(s1) * y, randg(s2) * z);
     }
+    // random gauss
+    SP_CPUFUNC Vec3 randgVec3(const double x, const double y, const double z, RandStream &rs) {
+        const SP_REAL g0 = randg(rs);
+        const SP_REAL g1 = randg(rs);
+        const SP_REAL g2 = randg(rs);
+        return getVec3(g0 * x, g1 * y, g2 * z);
+    }
 
     //--------------------------------------------------------------------------------
     // matrix * vector
@@ -1,6 +1,18 @@
 ﻿#include "simplesp.h"
 using namespace sp;
 #include <locale.h>
+
+// constructor / destructor counter (MemP test)
+struct CntObj {
+    static int ctor, dtor;
+    int val;
+    CntObj() { ctor++; val = 0; }
+    CntObj(const CntObj &obj) { ctor++; val = obj.val; }
+    ~CntObj() { dtor++; }
+};
+int CntObj::ctor = 0;
+int CntObj::dtor = 0;
+
 int main() {
 
     // strget
@@ -53,5 +65,757 @@ int main() {
         printf("extset %s\n", extset(path, "txt"));
 
     }
+
+    // fixed size matrix
+    {
+        MatN<6, 6> A;
+        MatN<6, 1> B;
+        for (int r = 0; r < 6; r++) {
+            for (int c = 0; c < 6; c++) {
+                A(r, c) = (r == c) ? 10.0 : 1.0 / (r + c + 1);
+            }
+            B[r] = r + 1.0;
+        }
+
+        const Mat mA(6, 6, A.ptr);
+        const Mat mB(6, 1, B.ptr);
+
+        const MatN<6, 6> AA = A * A;
+        const Mat mAA = mA * mA;
+
+        MatN<6, 6> iA;
+        invMat(iA, A);
+        const Mat miA = invMat(mA);
+
+        MatN<6, 1> X;
+        solveMat(X, A, B);
+        const Mat mX = miA * mB;
+
+        SP_REAL maxd = 0.0;
+        for (int i = 0; i < 36; i++) {
+            maxd = max(maxd, ::fabs(AA[i] - mAA[i]));
+            maxd = max(maxd, ::fabs(iA[i] - miA[i]));
+        }
+        for (int i = 0; i < 6; i++) {
+            maxd = max(maxd, ::fabs(X[i] - mX[i]));
+        }
+        printf("matn max diff %e\n", maxd);
+    }
+    // fft (mixed radix, compared with direct dft)
+    {
+        const int sizes[] = { 1, 2, 12, 30, 49, 97 };
+
+        SP_REAL maxd = 0.0;
+        for (int s = 0; s < 6; s++) {
+            const int n = sizes[s];
+
+            Mem1<SP_REAL> x(n);
+            for (int i = 0; i < n; i++) {
+                x[i] = ::sin(i * 2.1 + n);
+            }
+
+            Mem1<Cmp> X;
+            rfft(X, x);
+
+            for (int k = 0; k <= n / 2; k++) {
+                Cmp sum = getCmp(0.0, 0.0);
+                for (int j = 0; j < n; j++) {
+                    const SP_REAL a = -2.0 * SP_PI * j * k / n;
+                    sum += getCmp(x[j] * ::cos(a), x[j] * ::sin(a));
+                }
+                maxd = max(maxd, norm(sum - X[k]));
+            }
+
+            Mem1<SP_REAL> y;
+            irfft(y, X, n);
+            for (int i = 0; i < n; i++) {
+                maxd = max(maxd, ::fabs(y[i] - x[i]));
+            }
+        }
+        printf("fft max diff %e\n", maxd);
+    }
+    // separable filter (Byte fixed point, compared with filterX -> filterY, up to 1 LSB)
+    {
+        const int dsize[2] = { 45, 70 };
+
+        Mem2<Byte> src(dsize);
+        for (int i = 0; i < src.size(); i++) {
+            src[i] = static_cast<Byte>((i * 37 + (i / 7) * 11) % 256);
+        }
+
+        int maxd = 0;
+        for (int half = 1; half <= 7; half += 3) {
+            const double sigma = 0.3 * (half - 1) + 0.8;
+
+            Mem1<SP_REAL> kernel(2 * half + 1);
+            for (int k = -half; k <= half; k++) {
+                kernel(k + half) = ::exp(-(k * k) / (2.0 * sigma * sigma));
+            }
+
+            Mem2<Byte> dst0, dst1, tmp;
+            filterX<Byte, Byte>(tmp, src, kernel);
+            filterY<Byte, Byte>(dst0, tmp, kernel);
+            sepFilter<Byte, Byte>(dst1, src, kernel, kernel);
+
+            for (int i = 0; i < src.size(); i++) {
+                maxd = max(maxd, ::abs(static_cast<int>(dst0[i]) - static_cast<int>(dst1[i])));
+            }
+        }
+        printf("sepFilter Byte max diff %d (%s)\n", maxd, (maxd <= 1) ? "ok" : "ng");
+    }
+    // box filter (running sums, compared with direct window sums, rows split into several strips)
+    {
+        const int dsize[2] = { 23, 200 };
+
+        Mem2<SP_REAL> src(dsize);
+        Mem2<Col3> srcb(dsize);
+        for (int i = 0; i < src.size(); i++) {
+            src[i] = ::sin(i * 0.7);
+            srcb[i] = getCol3((i * 37) % 256, (i * 101) % 256, (i * i) % 256);
+        }
+
+        SP_REAL maxd = 0.0;
+        int maxdb = 0;
+        for (int winSize = 1; winSize <= 41; winSize += 8) {
+            Mem2<SP_REAL> dst;
+            boxFilter(dst, src, winSize);
+
+            Mem2<Col3> dstb;
+            boxFilter<Col3, Byte>(dstb, srcb, winSize);
+
+            const int half = winSize / 2;
+            for (int v = 0; v < dsize[1]; v++) {
+                for (int u = 0; u < dsize[0]; u++) {
+                    SP_REAL sum = 0.0;
+                    int sumb[3] = { 0, 0, 0 };
+                    int cnt = 0;
+                    for (int y = max(0, v - half); y <= min(dsize[1] - 1, v + half); y++) {
+                        for (int x = max(0, u - half); x <= min(dsize[0] - 1, u + half); x++) {
+                            sum += src(x, y);
+                            sumb[0] += srcb(x, y).r;
+                            sumb[1] += srcb(x, y).g;
+                            sumb[2] += srcb(x, y).b;
+                            cnt++;
+                        }
+                    }
+                    maxd = max(maxd, ::fabs(sum / cnt - dst(u, v)));
+
+                    // rounded mean
+                    const Col3 &b = dstb(u, v);
+                    maxdb = max(maxdb, ::abs((sumb[0] + cnt / 2) / cnt - b.r));
+                    maxdb = max(maxdb, ::abs((sumb[1] + cnt / 2) / cnt - b.g));
+                    maxdb = max(maxdb, ::abs((sumb[2] + cnt / 2) / cnt - b.b));
+                }
+            }
+        }
+        printf("box filter max diff %e\n", maxd);
+        printf("box filter Byte max diff %d (%s)\n", maxdb, (maxdb == 0) ? "ok" : "ng");
+    }
+    // descriptor index (compared with brute-force findMatch)
+    {
+        const int num = 400;
+        const int dim = 128;
+
+        Mem1<Ftr> ftrs[2];
+        unsigned int seed = 1;
+        for (int s = 0; s < 2; s++) {
+            ftrs[s].resize(num);
+            for (int i = 0; i < num; i++) {
+                Dsc &dsc = ftrs[s][i].dsc;
+                dsc.dim = dim;
+                dsc.type = Dsc::DSC_SIFT;
+                dsc.val.resize(dim * sizeof(float));
+                dsc.bin.resize(dim / 8);
+
+                // half of the descriptors are shared (with noise)
+                float *val = reinterpret_cast<float*>(dsc.val.ptr);
+                double sq = 0.0;
+                for (int d = 0; d < dim; d++) {
+                    seed = seed * 1103515245 + 12345;
+                    const float noise = static_cast<float>((seed >> 16) % 1000) / 1000.0f;
+                    val[d] = (i < num / 2) ? static_cast<float>(1.0 + ::sin(i * 1.3 + d * (i % 7 + 1) * 0.7)) + 0.2f * noise : noise;
+                    sq += val[d] * val[d];
+                }
+                for (int d = 0; d < dim; d++) {
+                    val[d] = static_cast<float>(val[d] / ::sqrt(sq));
+                }
+                cnvBit(dsc.bin.ptr, dim / 8, val, dim, static_cast<float>(1.0 / ::sqrt(dim)));
+
+                ftrs[s][i].cst = (i % 5 == 0) ? -1.0 : 1.0;
+            }
+        }
+
+        const Mem1<int> matches = findMatch(ftrs[0], ftrs[1]);
+
+        // exhaustive leaf checks
+        DscIndex index[2];
+        for (int s = 0; s < 2; s++) {
+            index[s].setKdParam(4, num);
+            index[s].build(ftrs[s]);
+        }
+        const Mem1<int> kdmatches = findMatch(index[0], index[1]);
+
+        int cnt = 0;
+        int diff = 0;
+        for (int i = 0; i < num; i++) {
+            cnt += (matches[i] >= 0) ? 1 : 0;
+            diff += (kdmatches[i] != matches[i]) ? 1 : 0;
+        }
+        printf("dsc index match %d, diff %d (%s)\n", cnt, diff, (cnt > 0 && diff == 0) ? "ok" : "ng");
+    }
+    // ransac (SPRT with many outliers, PROSAC with match quality)
+    {
+        const unsigned long long key = randKey(14, 0);
+        unsigned long long ctr = 0;
+
+        const int num = 500;
+        const double rate = 0.3;
+
+        // quality : inliers are higher on average
+        Mem1<SP_REAL> quals(num);
+        Mem1<bool> inls(num);
+        for (int i = 0; i < num; i++) {
+            inls[i] = (i % 10) < rate * 10;
+            quals[i] = (inls[i] ? 0.5 : 0.0) + 0.8 * (randu(key, ctr++) + 1.0) / 2.0;
+        }
+
+        // line y = 0.5 x + 3.0 (engine)
+        {
+            Mem1<Vec2> pnts(num);
+            for (int i = 0; i < num; i++) {
+                const double x = 100.0 * randu(key, ctr++);
+                pnts[i] = inls[i] ? getVec2(x, 0.5 * x + 3.0 + 0.1 * randu(key, ctr++)) : getVec2(x, 100.0 * randu(key, ctr++));
+            }
+
+            for (int q = 0; q < 2; q++) {
+                Vec2 line = getVec2(0.0, 0.0);
+                const SP_REAL maxe = ransac(line, num, 2, [&](Mem1<Vec2> &tests, const int *index) -> bool {
+                    const Vec2 &a = pnts[index[0]];
+                    const Vec2 &b = pnts[index[1]];
+                    if (::fabs(b.x - a.x) < SP_SMALL) return false;
+
+                    tests.resize(1);
+                    tests[0].x = (b.y - a.y) / (b.x - a.x);
+                    tests[0].y = a.y - tests[0].x * a.x;
+                    return true;
+                }, [&](const Vec2 &test, const int i) -> SP_REAL {
+                    return ::fabs(pnts[i].y - (test.x * pnts[i].x + test.y));
+                }, 0.5, (q == 0) ? NULL : &quals);
+
+                const bool ok = ::fabs(line.x - 0.5) < 0.01 && ::fabs(line.y - 3.0) < 0.5 && maxe > 0.25;
+                printf("ransac line (%s) rate %.2f (%s)\n", (q == 0) ? "sprt" : "prosac", maxe, ok ? "ok" : "ng");
+            }
+        }
+
+        // pose (2D-3D) and homography (trailing quals)
+        {
+            const CamParam cam = getCamParam(640, 480);
+            const Pose pose = getPose(getRotAngleX(0.2) * getRotAngleY(-0.1), getVec3(10.0, -20.0, 500.0));
+
+            Mem1<Vec3> objs(num);
+            Mem1<Vec2> pixs(num);
+            Mem1<Vec2> objs2(num);
+            for (int i = 0; i < num; i++) {
+                const SP_REAL ox = randu(key, ctr++);
+                const SP_REAL oy = randu(key, ctr++);
+                objs[i] = getVec3(100.0 * ox, 100.0 * oy, 0.0);
+                objs2[i] = getVec2(objs[i].x, objs[i].y);
+
+                if (inls[i] == true) {
+                    pixs[i] = mulCam(cam, prjVec(pose * objs[i]));
+                }
+                else {
+                    const SP_REAL px = randu(key, ctr++);
+                    const SP_REAL py = randu(key, ctr++);
+                    pixs[i] = getVec2(320.0 + 320.0 * px, 240.0 + 240.0 * py);
+                }
+            }
+
+            for (int q = 0; q < 2; q++) {
+                const Mem<SP_REAL> *pq = (q == 0) ? NULL : &quals;
+
+                Pose est = zeroPose();
+                const bool ret0 = calcPoseRANSAC(est, cam, pixs, objs, 4.0, pq);
+
+                Mat H;
+                const bool ret1 = calcHMatRANSAC(H, pixs, objs2, 5.0, pq);
+
+                SP_REAL maxd0 = 0.0;
+                SP_REAL maxd1 = 0.0;
+                for (int i = 0; i < num; i++) {
+                    if (inls[i] == false) continue;
+                    maxd0 = max(maxd0, normVec(mulCam(cam, prjVec(est * objs[i])) - pixs[i]));
+                    maxd1 = max(maxd1, errHMat(H, pixs[i], objs2[i]));
+                }
+                const bool ok = ret0 && ret1 && maxd0 < 1.0 && maxd1 < 1.0;
+                printf("ransac pose / hmat (%s) err %.2e %.2e (%s)\n", (q == 0) ? "sprt" : "prosac", maxd0, maxd1, ok ? "ok" : "ng");
+            }
+        }
+    }
+    // labeling (compared with bfs, 4 / 8 nears, rows split into two or more strips)
+    {
+        const unsigned long long key = randKey(22, 0);
+        unsigned long long ctr = 0;
+
+        const int dsize[2] = { 61, 150 };
+
+        Mem2<Byte> bin(dsize);
+        for (int i = 0; i < bin.size(); i++) {
+            bin[i] = (randu(key, ctr++) > 0.1) ? 1 : 0;
+        }
+
+        for (int n = 0; n < 2; n++) {
+            const bool near8 = (n == 1);
+
+            Mem2<int> map;
+            Mem1<LabelInfo> infos;
+            const int labelNum = labeling(map, infos, bin, near8);
+
+            // bfs labels (raster order of the first pixel)
+            Mem2<int> ref(dsize);
+            setElm(ref, -1);
+            Mem1<int> que(bin.size());
+            Mem1<LabelInfo> refs;
+
+            for (int i = 0; i < bin.size(); i++) {
+                if (bin[i] == 0 || ref[i] >= 0) continue;
+
+                const int id = refs.size();
+                int rn = 0;
+                int wn = 0;
+                que[wn++] = i;
+                ref[i] = id;
+
+                int x0 = dsize[0], y0 = dsize[1], x1 = -1, y1 = -1;
+                double sx = 0.0, sy = 0.0;
+                while (rn < wn) {
+                    const int u = que[rn] % dsize[0];
+                    const int v = que[rn] / dsize[0];
+                    rn++;
+
+                    x0 = min(x0, u); y0 = min(y0, v); x1 = max(x1, u); y1 = max(y1, v);
+                    sx += u;
+                    sy += v;
+
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            if (near8 == false && dx != 0 && dy != 0) continue;
+                            const int x = u + dx;
+                            const int y = v + dy;
+                            if (x < 0 || y < 0 || x >= dsize[0] || y >= dsize[1]) continue;
+                            if (bin(x, y) == 0 || ref(x, y) >= 0) continue;
+                            ref(x, y) = id;
+                            que[wn++] = y * dsize[0] + x;
+                        }
+                    }
+                }
+
+                LabelInfo info;
+                info.area = wn;
+                info.rect = getRect2(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+                info.center = getVec2(sx / wn, sy / wn);
+                refs.push(info);
+            }
+
+            // one-to-one correspondence of the labels
+            int diff = (labelNum == refs.size() && infos.size() == labelNum) ? 0 : 1;
+            if (diff == 0) {
+                Mem1<int> l2r(labelNum);
+                setElm(l2r, -1);
+                for (int i = 0; i < bin.size(); i++) {
+                    if (ref[i] < 0 || map[i] < 0) {
+                        diff += (ref[i] != map[i]) ? 1 : 0;
+                        continue;
+                    }
+                    if (l2r[map[i]] < 0) l2r[map[i]] = ref[i];
+                    diff += (l2r[map[i]] != ref[i]) ? 1 : 0;
+                }
+                for (int l = 0; l < labelNum && diff == 0; l++) {
+                    const LabelInfo &a = infos[l];
+                    const LabelInfo &b = refs[l2r[l]];
+                    diff += (a.area != b.area || cmp(a.rect, b.rect) == false || normVec(a.center - b.center) > 1e-6) ? 1 : 0;
+                }
+            }
+            printf("labeling (%s) num %d, diff %d (%s)\n", near8 ? "8 nears" : "4 nears", labelNum, diff, (labelNum > 1 && diff == 0) ? "ok" : "ng");
+        }
+    }
+    // vertex welding (compared with greedy brute force, large coordinates), weldMesh and savePLY
+    {
+        const unsigned long long key = randKey(23, 0);
+        unsigned long long ctr = 0;
+
+        const int num = 2000;
+        const double tol = 0.05;
+
+        // clustered points, a part of them far from the origin (cell index beyond int)
+        Mem1<Vec3> src(num);
+        for (int i = 0; i < num; i++) {
+            const SP_REAL base = (i % 4 == 0) ? 1.0e12 : 0.0;
+            const int c = i % 300;
+            src[i] = getVec3(base + 0.3 * (c % 7), 0.3 * ((c / 7) % 7), -0.3 * (c / 49));
+            const SP_REAL nx = randu(key, ctr++);
+            const SP_REAL ny = randu(key, ctr++);
+            const SP_REAL nz = randu(key, ctr++);
+            src[i] += getVec3(nx, ny, nz) * 0.01;
+        }
+        for (int i = 0; i < num; i += 9) {
+            src[i] = src[i / 2];
+        }
+        // near-equal copies (rounding noise)
+        for (int i = 1; i < num; i += 11) {
+            src[i] = src[i / 3] + getVec3(1.0e-9, -1.0e-9, 0.0);
+        }
+
+        // 0 : exact, 1 : tol, 2 : indexing (operator ==)
+        for (int t = 0; t < 3; t++) {
+            const double ttol = (t == 1) ? tol : 0.0;
+
+            Mem1<Vec3> dst;
+            Mem1<int> idxs;
+            if (t < 2) {
+                weldVertex(dst, idxs, src, ttol);
+            }
+            else {
+                indexing(dst, idxs, src);
+            }
+
+            int diff = 0;
+            Mem1<Vec3> ref;
+            for (int i = 0; i < num; i++) {
+                int r = 0;
+                for (; r < ref.size(); r++) {
+                    bool same = false;
+                    if (t == 0) same = (::memcmp(&ref[r], &src[i], sizeof(Vec3)) == 0);
+                    if (t == 1) same = (sqVec(ref[r] - src[i]) <= ttol * ttol);
+                    if (t == 2) same = (ref[r] == src[i]);
+                    if (same == true) break;
+                }
+                if (r == ref.size()) ref.push(src[i]);
+
+                diff += (idxs[i] != r) ? 1 : 0;
+            }
+            diff += (dst.size() != ref.size()) ? 1 : 0;
+
+            const char *names[] = { "exact", "tol", "indexing" };
+            printf("weldVertex (%s) num %d -> %d, diff %d (%s)\n", names[t], num, dst.size(), diff, (dst.size() < num && diff == 0) ? "ok" : "ng");
+        }
+
+        // 0.1 + 0.2 != 0.3 in bytes, but equal by operator ==
+        {
+            Mem1<Vec3> pnts;
+            pnts.push(getVec3(0.1 + 0.2, 0.0, 0.0));
+            pnts.push(getVec3(0.3, 0.0, 0.0));
+            pnts.push(getVec3(1.0, 0.0, 0.0));
+
+            Mem1<Vec3> dst0, dst1;
+            Mem1<int> idxs0, idxs1;
+            indexing(dst0, idxs0, pnts);
+            weldVertex(dst1, idxs1, pnts, 0.0);
+
+            const bool ok = dst0.size() == 2 && idxs0[1] == 0 && dst1.size() == 3;
+            printf("indexing near-equal %d, exact %d (%s)\n", dst0.size(), dst1.size(), ok ? "ok" : "ng");
+        }
+
+        // grid of 2 * 8 * 8 triangles (9 * 9 shared vertices)
+        Mem1<Mesh3> meshes;
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                const Vec3 a = getVec3(x + 0.0, y + 0.0, 0.0);
+                const Vec3 b = getVec3(x + 1.0, y + 0.0, 0.0);
+                const Vec3 c = getVec3(x + 1.0, y + 1.0, 0.0);
+                const Vec3 d = getVec3(x + 0.0, y + 1.0, 0.0);
+                meshes.push(getMesh3(a, b, c));
+                meshes.push(getMesh3(a, c, d));
+            }
+        }
+
+        Mem1<Vec3> vtxs;
+        Mem1<int> idxs;
+        weldMesh(vtxs, idxs, meshes);
+
+        int mdiff = (vtxs.size() == 81 && idxs.size() == meshes.size() * 3) ? 0 : 1;
+        for (int i = 0; i < idxs.size() && mdiff == 0; i++) {
+            mdiff += (vtxs[idxs[i]] == meshes[i / 3].pos[i % 3]) ? 0 : 1;
+        }
+        printf("weldMesh vtxs %d, diff %d (%s)\n", vtxs.size(), mdiff, (mdiff == 0) ? "ok" : "ng");
+
+        const char *path = "test_weld.ply";
+        Mem1<Mesh3> loads;
+        const bool ret = savePLY(path, vtxs, idxs) && loadPLY(path, loads);
+        ::remove(path);
+
+        int pdiff = (ret == true && loads.size() == meshes.size()) ? 0 : 1;
+        for (int i = 0; i < loads.size() && pdiff == 0; i++) {
+            for (int j = 0; j < 3; j++) {
+                pdiff += (normVec(loads[i].pos[j] - meshes[i].pos[j]) < 1e-6) ? 0 : 1;
+            }
+        }
+        printf("savePLY (vtxs, idxs) meshes %d, diff %d (%s)\n", loads.size(), pdiff, (pdiff == 0) ? "ok" : "ng");
+    }
+    // im2col / col2im (NHWC conv compared with NCHW on transposed data)
+    {
+        CnvWin win;
+        win.dsize[0] = 9;
+        win.dsize[1] = 7;
+        win.dsize[2] = 3;
+        win.winSize = 3;
+        win.stride = 2;
+        win.margin = 1;
+        win.output[0] = 5;
+        win.output[1] = 4;
+
+        const int W = win.dsize[0];
+        const int H = win.dsize[1];
+        const int C = win.dsize[2];
+        const int K = C * win.winSize * win.winSize;
+        const int P = win.output[0] * win.output[1];
+        const int OC = 4;
+
+        Mem1<float> nchw(W * H * C), nhwc(W * H * C);
+        for (int c = 0; c < C; c++) {
+            for (int y = 0; y < H; y++) {
+                for (int x = 0; x < W; x++) {
+                    const float v = static_cast<float>(::sin(0.3 * x + 0.7 * y + 1.1 * c));
+                    nchw[(c * H + y) * W + x] = v;
+                    nhwc[(y * W + x) * C + c] = v;
+                }
+            }
+        }
+        Mem1<float> wgt(OC * K), dcol(K * P);
+        for (int i = 0; i < wgt.size(); i++) {
+            wgt[i] = static_cast<float>(::cos(0.37 * i));
+        }
+        for (int i = 0; i < dcol.size(); i++) {
+            dcol[i] = static_cast<float>(::sin(0.11 * i));
+        }
+
+        // forward : Y (OC x P) = W (OC x K) * col (K x P)
+        Mem1<float> col0(K * P), col1(K * P), y0(OC * P), y1(OC * P);
+        im2col(col0.ptr, nchw.ptr, win, ImgLayout_NCHW);
+        im2col(col1.ptr, nhwc.ptr, win, ImgLayout_NHWC);
+        simdGemm(y0.ptr, P, wgt.ptr, K, false, col0.ptr, P, false, OC, P, K);
+        simdGemm(y1.ptr, P, wgt.ptr, K, false, col1.ptr, P, false, OC, P, K);
+
+        int diff = 0;
+        for (int i = 0; i < y0.size(); i++) {
+            diff += (y0[i] != y1[i]) ? 1 : 0;
+        }
+
+        // backward : dst += col
+        Mem1<float> b0(W * H * C), b1(W * H * C);
+        b0.zero();
+        b1.zero();
+        col2im(b0.ptr, dcol.ptr, win, ImgLayout_NCHW);
+        col2im(b1.ptr, dcol.ptr, win, ImgLayout_NHWC);
+        for (int c = 0; c < C; c++) {
+            for (int y = 0; y < H; y++) {
+                for (int x = 0; x < W; x++) {
+                    diff += (b0[(c * H + y) * W + x] != b1[(y * W + x) * C + c]) ? 1 : 0;
+                }
+            }
+        }
+        printf("im2col / col2im NHWC vs NCHW diff %d (%s)\n", diff, (diff == 0) ? "ok" : "ng");
+    }
+    // memory allocator (alignment, free on another thread, escaped arena block, pool reuse)
+    {
+        int ng = 0;
+
+        // alignment (heap, pool, arena)
+        for (int m = 0; m < 3; m++) {
+            setMemPool(m == 1);
+            MemFrame *frame = (m == 2) ? new MemFrame() : NULL;
+            for (int size = 1; size < 5000; size = size * 3 + 1) {
+                void *ptr = memAlloc(size);
+                ng += (reinterpret_cast<size_t>(ptr) % 64 != 0) ? 1 : 0;
+                memFree(ptr);
+            }
+            delete frame;
+        }
+        setMemPool(false);
+        printf("mem alignment (%s)\n", (ng == 0) ? "ok" : "ng");
+
+        // free on another thread (heap / pool block from this thread, arena block from a worker frame)
+        {
+            int cnt = 0;
+            for (int m = 0; m < 2; m++) {
+                setMemPool(m == 1);
+                int *ptr = static_cast<int*>(memAlloc(100 * sizeof(int)));
+                ptr[99] = 99;
+                std::thread th([&]() { cnt += (ptr[99] == 99) ? 1 : 0; memFree(ptr); });
+                th.join();
+            }
+            setMemPool(false);
+
+            // the worker's arena is destroyed at its exit
+            Mem1<int> esc;
+            std::thread th([&]() {
+                MemFrame frame;
+                Mem1<int> tmp(1000);
+                for (int i = 0; i < tmp.size(); i++) tmp[i] = i;
+                esc = std::move(tmp);
+            });
+            th.join();
+
+            int fail = 0;
+            for (int i = 0; i < esc.size(); i++) fail += (esc[i] != i) ? 1 : 0;
+            const MemStat s0 = getMemStat();
+            esc = Mem1<int>();
+            const bool ok = cnt == 2 && esc.size() == 0 && fail == 0 && difMemStat(s0, getMemStat()).free == 1;
+            printf("mem free on another thread (%s)\n", ok ? "ok" : "ng");
+        }
+
+        // escaped arena block stays valid after the outermost frame, then is freed
+        {
+            Mem1<int> esc;
+            long long arena = 0;
+            {
+                MemFrame frame;
+                Mem1<int> tmp(1000);
+                for (int i = 0; i < tmp.size(); i++) tmp[i] = i;
+                esc = std::move(tmp);
+                arena = frame.stat().arena;
+            }
+
+            // the next frame reuses the arena (the escaped block must not be overwritten)
+            {
+                MemFrame frame;
+                for (int k = 0; k < 4; k++) {
+                    Mem1<int> tmp(1000);
+                    for (int i = 0; i < tmp.size(); i++) tmp[i] = -1;
+                }
+            }
+
+            int fail = 0;
+            for (int i = 0; i < esc.size(); i++) fail += (esc[i] != i) ? 1 : 0;
+
+            const MemStat s0 = getMemStat();
+            esc = Mem1<int>();
+            const bool ok = arena > 0 && fail == 0 && difMemStat(s0, getMemStat()).free == 1;
+            printf("mem escaped arena block (%s)\n", ok ? "ok" : "ng");
+        }
+
+        // pool reuse (same size class), zero heap calls in a repeated frame
+        {
+            setMemPool(true);
+
+            void *ptr0 = memAlloc(1000);
+            memFree(ptr0);
+            const MemStat s0 = getMemStat();
+            void *ptr1 = memAlloc(900);
+            const MemStat d = difMemStat(s0, getMemStat());
+            memFree(ptr1);
+            printf("mem pool reuse (%s)\n", (ptr0 == ptr1 && d.pool == 1 && d.halloc == 0) ? "ok" : "ng");
+
+            long long halloc = -1;
+            for (int it = 0; it < 3; it++) {
+                MemFrame frame;
+
+                // arena (small) and pool (larger than the arena block limit)
+                Mem1<float> a(1000);
+                Mem2<double> b(300, 300);
+                Mem1<Byte> c(4 << 20);
+                a.zero();
+                b.zero();
+                c.zero();
+
+                halloc = frame.stat().halloc;
+            }
+            printf("mem repeated frame heap calls %lld (%s)\n", halloc, (halloc == 0) ? "ok" : "ng");
+
+            setMemPool(false);
+        }
+    }
+    // memory pool MemP (swap-remove free, pointer stability, double free, ctor / dtor, copy)
+    {
+        MemP<int> pool;
+        Mem1<int*> ptrs;
+        for (int i = 0; i < 10; i++) {
+            int *p = pool.malloc();
+            *p = i;
+            ptrs.push(p);
+        }
+
+        // swap-remove : the last element moves to the freed index
+        pool.free(ptrs[3]);
+        pool.free(ptrs[3]);
+
+        bool ok0 = (pool.size() == 9 && pool[3] == 9);
+        int cnt = 0;
+        int sum = 0;
+        for (const int &v : pool) {
+            ok0 &= (&v == &pool[cnt++]);
+            sum += v;
+        }
+        ok0 &= (cnt == pool.size() && sum == 45 - 3);
+        printf("MemP swap-remove (%s)\n", ok0 ? "ok" : "ng");
+
+        // pointer stability and reuse of the freed element
+        pool.free(ptrs[5]);
+        int *p0 = pool.malloc();
+        int *p1 = pool.malloc();
+        bool ok1 = (p0 == ptrs[5] && p1 == ptrs[3] && pool.size() == 10);
+        for (int i = 0; i < 10; i++) {
+            if (i == 3 || i == 5) continue;
+            ok1 &= (*ptrs[i] == i);
+        }
+        printf("MemP pointer stability (%s)\n", ok1 ? "ok" : "ng");
+
+        // double free is a no-op (the element is not handed out twice)
+        pool.free(p0);
+        pool.free(p0);
+        int *p2 = pool.malloc();
+        int *p3 = pool.malloc();
+        const bool ok2 = (p2 == p0 && p3 != p0 && pool.size() == 11);
+        printf("MemP double free (%s)\n", ok2 ? "ok" : "ng");
+
+        // constructors and destructors run once per element (unit 3)
+        {
+            CntObj::ctor = 0;
+            CntObj::dtor = 0;
+            {
+                MemP<CntObj> objs;
+                objs.init(3);
+
+                Mem1<CntObj*> list;
+                for (int i = 0; i < 250; i++) {
+                    list.push(objs.malloc());
+                }
+                for (int i = 0; i < 250; i += 5) {
+                    objs.free(list[i]);
+                    objs.free(list[i]);
+                }
+                for (int i = 0; i < 20; i++) {
+                    objs.malloc();
+                }
+            }
+            const bool ok3 = (CntObj::ctor == (250 + 20) * 3 && CntObj::dtor == CntObj::ctor);
+            printf("MemP ctor %d, dtor %d (%s)\n", CntObj::ctor, CntObj::dtor, ok3 ? "ok" : "ng");
+        }
+
+        // operator = copies all unit elements
+        {
+            MemP<int> src;
+            src.init(4);
+            for (int i = 0; i < 150; i++) {
+                int *p = src.malloc();
+                for (int u = 0; u < 4; u++) {
+                    p[u] = i * 4 + u;
+                }
+            }
+            src.free(&src[7]);
+
+            MemP<int> dst;
+            dst = src;
+
+            bool ok4 = (dst.size() == src.size());
+            for (int i = 0; i < dst.size() && ok4; i++) {
+                for (int u = 0; u < 4; u++) {
+                    ok4 &= ((&dst[i])[u] == (&src[i])[u]);
+                }
+                ok4 &= (&dst[i] != &src[i]);
+            }
+            printf("MemP copy (%s)\n", ok4 ? "ok" : "ng");
+        }
+    }
     return 0;
 }
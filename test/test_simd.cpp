@@ -0,0 +1,374 @@
+﻿#include "simplesp.h"
+using namespace sp;
+
+//--------------------------------------------------------------------------------
+// reference (scalar code before simd)
+//--------------------------------------------------------------------------------
+
+void refRescaleFast(Mem<Byte> &dst, const Mem<Byte> &src, const double dscale0, const double dscale1) {
+    const int dsize[2] = { sp::round(src.dsize[0] * dscale0), sp::round(src.dsize[1] * dscale1) };
+    dst.resize(2, dsize);
+
+    Byte *pDst = dst.ptr;
+    for (int v = 0; v < dst.dsize[1]; v++) {
+        for (int u = 0; u < dst.dsize[0]; u++) {
+            const double su = u / dscale0;
+            const double sv = v / dscale1;
+            *pDst++ = cast<Byte>(acs2<Byte>(src, su, sv));
+        }
+    }
+}
+
+void refBinalize(Mem2<Byte> &dst, const Mem2<Byte> &src, const int thresh, const bool inv) {
+    dst.resize(src.dsize);
+    for (int i = 0; i < dst.size(); i++) {
+        dst[i] = (inv == false) ? ((src[i] >= thresh) ? 255 : 0) : ((src[i] < thresh) ? 255 : 0);
+    }
+}
+
+void refBinalizeBlock(Mem2<Byte> &dst, const Mem2<Byte> &src, const int blockSize, const bool inv) {
+    dst.resize(src.dsize);
+    for (int v = 0; v < dst.dsize[1]; v += blockSize) {
+        for (int u = 0; u < dst.dsize[0]; u += blockSize) {
+            const int sizeX = min(u + blockSize, src.dsize[0]);
+            const int sizeY = min(v + blockSize, src.dsize[1]);
+
+            Byte maxv = 0;
+            Byte minv = SP_BYTEMAX;
+
+            const int margin = blockSize / 2;
+            for (int y = v - margin; y < sizeY + margin; y++) {
+                for (int x = u - margin; x < sizeX + margin; x++) {
+                    const Byte val = src(x, y);
+                    maxv = max(maxv, val);
+                    minv = min(minv, val);
+                }
+            }
+            const int thresh = (maxv + minv) / 2;
+            for (int y = v; y < sizeY; y++) {
+                for (int x = u; x < sizeX; x++) {
+                    dst(x, y) = (inv == false) ? ((src(x, y) >= thresh) ? 255 : 0) : ((src(x, y) < thresh) ? 255 : 0);
+                }
+            }
+        }
+    }
+}
+
+template <typename TYPE>
+void refBlend(Mem<TYPE> &dst, const Mem<TYPE> &src0, const double r0, const Mem<TYPE> &src1, const double r1) {
+    dst.resize(2, src0.dsize);
+    for (int i = 0; i < dst.size(); i++) {
+        dst[i] = blendCol(src0[i], r0, src1[i], r1);
+    }
+}
+
+template <typename TYPE>
+void refInvert(Mem<TYPE> &dst, const Mem<TYPE> &src) {
+    dst.resize(2, src.dsize);
+    const int num = dst.size() * sizeof(TYPE);
+    for (int i = 0; i < num; i++) {
+        reinterpret_cast<Byte*>(dst.ptr)[i] = SP_BYTEMAX - reinterpret_cast<const Byte*>(src.ptr)[i];
+    }
+}
+
+void refCnvImg(Mem<Byte> &dst, const Mem<Col3> &src) {
+    dst.resize(2, src.dsize);
+    for (int i = 0; i < dst.size(); i++) {
+        dst[i] = cast<Byte>(src[i]);
+    }
+}
+
+template <typename TYPE>
+void refGemm(TYPE *C, const TYPE *A, const bool transA, const TYPE *B, const bool transB, const int M, const int N, const int K) {
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < K; k++) {
+                const TYPE a = (transA == false) ? A[i * K + k] : A[k * M + i];
+                const TYPE b = (transB == false) ? B[k * N + j] : B[j * K + k];
+                sum += static_cast<double>(a) * b;
+            }
+            C[i * N + j] = static_cast<TYPE>(sum);
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------
+// test
+//--------------------------------------------------------------------------------
+
+int errNum = 0;
+
+template <typename TYPE>
+void check(const char *name, const SimdLevel level, const Mem<TYPE> &img0, const Mem<TYPE> &img1) {
+    bool ok = (img0.dim == img1.dim) && cmp(img0.dsize, img1.dsize, img0.dim);
+    if (ok == true) {
+        ok = (memcmp(img0.ptr, img1.ptr, img0.size() * sizeof(TYPE)) == 0);
+    }
+    if (ok == false) {
+        printf("[NG] %s (level %d, %d x %d)\n", name, level, img1.dsize[0], img1.dsize[1]);
+        errNum++;
+    }
+}
+
+template <typename TYPE>
+void randImg(Mem2<TYPE> &img, const int dsize0, const int dsize1) {
+    img.resize(dsize0, dsize1);
+    Byte *ptr = reinterpret_cast<Byte*>(img.ptr);
+    for (int i = 0; i < img.size() * static_cast<int>(sizeof(TYPE)); i++) {
+        ptr[i] = static_cast<Byte>(sp::rand() % 256);
+    }
+}
+
+int main() {
+
+    const SimdLevel maxLevel = getSimdLevel();
+    printf("simd level %d\n", maxLevel);
+
+    const int sizes[][2] = { { 1, 1 }, { 2, 3 }, { 7, 5 }, { 31, 17 }, { 33, 64 }, { 100, 1 }, { 640, 481 }, { 1023, 37 } };
+    const int snum = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (int level = SimdLevel_None; level <= maxLevel; level++) {
+        setSimdLevel(static_cast<SimdLevel>(level));
+
+        for (int s = 0; s < snum; s++) {
+            Mem2<Byte> gry, gry1, ref, dst;
+            Mem2<Col3> col, col1, cref, cdst;
+            randImg(gry, sizes[s][0], sizes[s][1]);
+            randImg(gry1, sizes[s][0], sizes[s][1]);
+            randImg(col, sizes[s][0], sizes[s][1]);
+            randImg(col1, sizes[s][0], sizes[s][1]);
+
+            const SimdLevel lv = getSimdLevel();
+
+            // rescale
+            {
+                const double scales[] = { 0.5, 0.37, 1.0, 1.7, 2.0 };
+                for (int i = 0; i < 5; i++) {
+                    refRescaleFast(ref, gry, scales[i], scales[4 - i]);
+                    rescaleFast(dst, gry, scales[i], scales[4 - i]);
+                    check("rescaleFast", lv, ref, dst);
+                }
+            }
+
+            // pyrdown
+            {
+                pyrdown<Byte>(ref, gry);
+                pyrdown(dst, gry);
+                check("pyrdown", lv, ref, dst);
+            }
+
+            // binalize
+            {
+                const int threshs[] = { -1, 0, 1, 128, 255, 256 };
+                for (int i = 0; i < 6; i++) {
+                    for (int inv = 0; inv < 2; inv++) {
+                        refBinalize(ref, gry, threshs[i], inv != 0);
+                        binalize(dst, gry, threshs[i], inv != 0);
+                        check("binalize", lv, ref, dst);
+                    }
+                }
+                for (int b = 1; b < 40; b += 7) {
+                    for (int inv = 0; inv < 2; inv++) {
+                        refBinalizeBlock(ref, gry, b, inv != 0);
+                        binalizeBlock(dst, gry, b, inv != 0);
+                        check("binalizeBlock", lv, ref, dst);
+                    }
+                }
+            }
+
+            // blend
+            {
+                const double rs[][2] = { { 0.3, 0.7 }, { 1.0, 2.0 }, { 0.0, 1.0 }, { 1.0, 0.0 }, { 0.0, 0.0 }, { 0.123, 0.456 } };
+                for (int i = 0; i < 6; i++) {
+                    refBlend(ref, gry, rs[i][0], gry1, rs[i][1]);
+                    blend(dst, gry, rs[i][0], gry1, rs[i][1]);
+                    check("blend", lv, ref, dst);
+
+                    refBlend(cref, col, rs[i][0], col1, rs[i][1]);
+                    blend(cdst, col, rs[i][0], col1, rs[i][1]);
+                    check("blend", lv, cref, cdst);
+                }
+            }
+
+            // invert
+            {
+                refInvert(ref, gry);
+                invert(dst, gry);
+                check("invert", lv, ref, dst);
+
+                refInvert(cref, col);
+                invert<Col3, Byte>(cdst, col);
+                check("invert", lv, cref, cdst);
+            }
+
+            // convert
+            {
+                refCnvImg(ref, col);
+                cnvImg(dst, col);
+                check("cnvImg", lv, ref, dst);
+            }
+        }
+
+        // convert (all colors)
+        {
+            Mem2<Col3> col(4096, 4096);
+            for (int i = 0; i < col.size(); i++) {
+                col[i] = getCol3((i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF);
+            }
+            Mem2<Byte> ref, dst;
+            refCnvImg(ref, col);
+            cnvImg(dst, col);
+            check("cnvImg (all colors)", getSimdLevel(), ref, dst);
+        }
+
+        // random (same as scalar counter-based random)
+        {
+            const unsigned long long key = randKey(1, 2);
+            for (int s = 0; s < snum; s++) {
+                const int num = sizes[s][0] * sizes[s][1];
+                for (int ctr = 0; ctr < 3; ctr++) {
+                    Mem1<SP_REAL> ref(num), dst(num);
+
+                    for (int i = 0; i < num; i++) ref[i] = randu(key, ctr + i);
+                    simdRandu(dst.ptr, num, key, ctr);
+                    check("simdRandu", getSimdLevel(), ref, dst);
+
+                    for (int i = 0; i < num; i++) ref[i] = randg(key, ctr + i);
+                    simdRandg(dst.ptr, num, key, ctr);
+                    check("simdRandg", getSimdLevel(), ref, dst);
+                }
+            }
+        }
+    }
+
+    // gemm (fma rounds differently from the scalar kernel, compared with a tolerance)
+    for (int level = SimdLevel_None; level <= maxLevel; level++) {
+        setSimdLevel(static_cast<SimdLevel>(level));
+
+        const int gsizes[][3] = { { 1, 1, 1 }, { 7, 13, 5 }, { 10, 256, 147 }, { 147, 256, 10 }, { 97, 2050, 260 } };
+        for (int s = 0; s < 5; s++) {
+            const int M = gsizes[s][0];
+            const int N = gsizes[s][1];
+            const int K = gsizes[s][2];
+
+            for (int t = 0; t < 4; t++) {
+                const bool transA = (t & 1) != 0;
+                const bool transB = (t & 2) != 0;
+
+                Mem1<double> A(M * K), B(K * N), ref(M * N), dst(M * N);
+                simdRandu(A.ptr, A.size(), randKey(s, 0));
+                simdRandu(B.ptr, B.size(), randKey(s, 1));
+
+                refGemm(ref.ptr, A.ptr, transA, B.ptr, transB, M, N, K);
+                simdGemm(dst.ptr, N, A.ptr, transA ? M : K, transA, B.ptr, transB ? K : N, transB, M, N, K);
+
+                double maxe = 0.0;
+                for (int i = 0; i < M * N; i++) {
+                    maxe = max(maxe, ::fabs(ref[i] - dst[i]));
+                }
+                if (maxe > 1e-10 * K) {
+                    printf("[NG] simdGemm (level %d, %d x %d x %d, err %e)\n", getSimdLevel(), M, N, K, maxe);
+                    errNum++;
+                }
+
+                // float
+                Mem1<float> fA(M * K), fB(K * N), fref(M * N), fdst(M * N);
+                for (int i = 0; i < fA.size(); i++) fA[i] = static_cast<float>(A[i]);
+                for (int i = 0; i < fB.size(); i++) fB[i] = static_cast<float>(B[i]);
+
+                refGemm(fref.ptr, fA.ptr, transA, fB.ptr, transB, M, N, K);
+                simdGemm(fdst.ptr, N, fA.ptr, transA ? M : K, transA, fB.ptr, transB ? K : N, transB, M, N, K);
+
+                double fmaxe = 0.0;
+                for (int i = 0; i < M * N; i++) {
+                    fmaxe = max(fmaxe, ::fabs(static_cast<double>(fref[i]) - fdst[i]));
+                }
+                if (fmaxe > 1e-6 * K) {
+                    printf("[NG] simdGemm float (level %d, %d x %d x %d, err %e)\n", getSimdLevel(), M, N, K, fmaxe);
+                    errNum++;
+                }
+            }
+        }
+    }
+
+    // descriptor set kernels (same as scalar)
+    for (int level = SimdLevel_None; level <= maxLevel; level++) {
+        setSimdLevel(static_cast<SimdLevel>(level));
+
+        const _dscset::Kernel ker = _dscset::getKernel();
+        const int BLOCK = _dscset::BLOCK;
+
+        const int dims[] = { 4, 8, 64, 128, 132 };
+        for (int s = 0; s < 5; s++) {
+            const int dim = dims[s];
+
+            // quantized range [-127, 127] including both ends
+            Mem1<signed char> qry(dim), blk(dim * BLOCK);
+            for (int i = 0; i < qry.size(); i++) qry[i] = static_cast<signed char>((i % 9 == 0) ? -127 : sp::rand() % 255 - 127);
+            for (int i = 0; i < blk.size(); i++) blk[i] = static_cast<signed char>((i % 11 == 0) ? 127 : (i % 13 == 0) ? -127 : sp::rand() % 255 - 127);
+
+            Mem1<int> ref(BLOCK), dst(BLOCK);
+            _dscset::dotBlock_c(ref.ptr, qry.ptr, blk.ptr, dim);
+            ker.dotBlock(dst.ptr, qry.ptr, blk.ptr, dim);
+            check("dotBlock", getSimdLevel(), ref, dst);
+        }
+
+        const int bsizes[] = { 8, 16, 32 };
+        for (int s = 0; s < 3; s++) {
+            const int bsize = bsizes[s];
+
+            Mem1<Byte> qry(bsize), blk(bsize * BLOCK);
+            for (int i = 0; i < qry.size(); i++) qry[i] = static_cast<Byte>(sp::rand() % 256);
+            for (int i = 0; i < blk.size(); i++) blk[i] = static_cast<Byte>((i < bsize) ? qry[i] : (i < 2 * bsize) ? ~qry[i % bsize] : sp::rand() % 256);
+
+            Mem1<int> ref(BLOCK), dst(BLOCK);
+            _dscset::bitBlock_c(ref.ptr, qry.ptr, blk.ptr, bsize);
+            ker.bitBlock(dst.ptr, qry.ptr, blk.ptr, bsize);
+            check("bitBlock", getSimdLevel(), ref, dst);
+        }
+
+        // match (same as level none)
+        {
+            const int num = 100;
+            const int dim = 128;
+
+            Mem1<Ftr> ftrs[2];
+            for (int f = 0; f < 2; f++) {
+                ftrs[f].resize(num);
+                for (int i = 0; i < num; i++) {
+                    Dsc &dsc = ftrs[f][i].dsc;
+                    dsc.dim = dim;
+                    dsc.val.resize(dim * sizeof(float));
+                    dsc.bin.resize(dim / 8);
+
+                    float *val = reinterpret_cast<float*>(dsc.val.ptr);
+                    double sq = 0.0;
+                    for (int d = 0; d < dim; d++) {
+                        val[d] = static_cast<float>(1.0 + ::sin(i * 1.3 + d * (i % 7 + 1) * 0.7) + ((f == 0) ? 0.0 : 0.01 * (sp::rand() % 10)));
+                        sq += val[d] * val[d];
+                    }
+                    for (int d = 0; d < dim; d++) {
+                        val[d] = static_cast<float>(val[d] / ::sqrt(sq));
+                    }
+                    cnvBit(dsc.bin.ptr, dim / 8, val, dim, static_cast<float>(1.0 / ::sqrt(dim)));
+
+                    ftrs[f][i].cst = (i % 3 == 0) ? -1.0 : 1.0;
+                }
+            }
+            const DscSet set0(ftrs[0]), set1(ftrs[1]);
+
+            const SimdLevel lv = getSimdLevel();
+            setSimdLevel(SimdLevel_None);
+            const Mem1<int> ref = findMatch(set0, set1);
+
+            setSimdLevel(lv);
+            const Mem1<int> dst = findMatch(set0, set1);
+            check("findMatch (DscSet)", lv, ref, dst);
+        }
+    }
+
+    printf("%s (%d errors)\n", (errNum == 0) ? "OK" : "NG", errNum);
+    return (errNum == 0) ? 0 : 1;
+}